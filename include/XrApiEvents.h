@@ -0,0 +1,247 @@
+
+#ifndef XR_XrApiEvents_h
+#define XR_XrApiEvents_h
+
+#include "string.h" // for memset(), memcpy()
+#include "XrApiConfig.h"
+#include "XrApiTypes.h"
+#include "XrApi.h"
+
+/*
+Batched event pump on top of xrapiPollEvent().
+
+Each frame the pump drains every pending event into a fixed arena in one pass, coalesces
+redundant focus and visibility transitions, and then dispatches the remaining events through
+a handler table indexed by xrEventType.
+
+Events are polled directly into the arena. Every slot is advanced by the size of the actual
+event structure for its type, so the arena holds many small events even though each poll
+needs XRAPI_MAX_EVENT_SIZE bytes of headroom. Draining stops early when the arena can no
+longer provide that headroom. The pump then polls one more event to find out whether the
+queue is really empty; if it is not, that event is held over and read first next frame, and
+the remaining events stay queued in the runtime.
+
+Focus and visibility are state changes. When a batch contains several transitions of the
+same kind only the final state matters, and it is dropped altogether if it matches the state
+the application already knows about.
+*/
+
+/// Number of event types known to this header. Events with larger types are dispatched to the
+/// pump's UnknownHandler.
+#define XRAPI_EVENT_TYPE_COUNT (XRAPI_EVENT_FOCUS_LOST + 1)
+/// Maximum number of events drained per frame.
+#define XRAPI_EVENT_PUMP_MAX_EVENTS 64
+/// Size of the event arena in bytes.
+#define XRAPI_EVENT_PUMP_ARENA_SIZE (2 * XRAPI_MAX_EVENT_SIZE)
+
+typedef void (*xrEventHandler)(void* userData, const xrEventHeader* event);
+
+/// Event counts of the last xrEventPump_Pump() call.
+typedef struct xrEventPumpStats_ {
+    // Number of events read from the runtime.
+    uint32_t Polled;
+    // Number of events handed to a handler.
+    uint32_t Dispatched;
+    // Number of focus and visibility events removed as redundant.
+    uint32_t Coalesced;
+    // Number of events without a handler.
+    uint32_t Unhandled;
+    // True if the arena or event index filled up while more events were pending.
+    bool Truncated;
+    // Number of polled events per type.
+    uint32_t PerType[XRAPI_EVENT_TYPE_COUNT];
+} xrEventPumpStats;
+
+typedef enum xrEventPumpState_ {
+    xrEventPumpState_Unknown = -1,
+    xrEventPumpState_Off = 0,
+    xrEventPumpState_On = 1,
+} xrEventPumpState;
+
+typedef struct xrEventPump_ {
+    void* UserData;
+    xrEventHandler Handlers[XRAPI_EVENT_TYPE_COUNT];
+    xrEventHandler UnknownHandler;
+
+    // Last focus and visibility state dispatched to the application.
+    xrEventPumpState Focus;
+    xrEventPumpState Visibility;
+
+    int EventCount;
+    unsigned short Offsets[XRAPI_EVENT_PUMP_MAX_EVENTS];
+    bool Coalesced[XRAPI_EVENT_PUMP_MAX_EVENTS];
+    // Aligned so the event structures can be read in place.
+    union {
+        xrEventHeader Header;
+        double Align;
+        unsigned char Bytes[XRAPI_EVENT_PUMP_ARENA_SIZE];
+    } Arena;
+    // Event polled past a full arena, read first by the next drain.
+    bool HasHeldEvent;
+    union {
+        xrEventHeader Header;
+        xrEventDataBuffer Buffer;
+    } HeldEvent;
+
+    xrEventPumpStats Stats;
+    // Totals since xrEventPump_Init().
+    uint64_t TotalPolled;
+    uint64_t TotalDispatched;
+    uint64_t TotalCoalesced;
+} xrEventPump;
+
+static inline void xrEventPump_Init(xrEventPump* pump, void* userData) {
+    memset(pump, 0, sizeof(xrEventPump));
+    pump->UserData = userData;
+    pump->Focus = xrEventPumpState_Unknown;
+    pump->Visibility = xrEventPumpState_Unknown;
+}
+
+static inline void
+xrEventPump_SetHandler(xrEventPump* pump, const xrEventType type, xrEventHandler handler) {
+    if ((int)type >= 0 && (int)type < XRAPI_EVENT_TYPE_COUNT) {
+        pump->Handlers[type] = handler;
+    }
+}
+
+/// Size of the structure for an event type, rounded up to keep arena slots aligned.
+static inline size_t xrEventPump_EventSize(const xrEventType type) {
+    static const size_t sizes[XRAPI_EVENT_TYPE_COUNT] = {
+        sizeof(xrEventHeader), // XRAPI_EVENT_NONE
+        sizeof(xrEventDataLost),
+        sizeof(xrEventVisibilityGained),
+        sizeof(xrEventVisibilityLost),
+        sizeof(xrEventFocusGained),
+        sizeof(xrEventFocusLost),
+    };
+    const size_t size = ((int)type >= 0 && (int)type < XRAPI_EVENT_TYPE_COUNT)
+        ? (size_t)sizes[type]
+        : (size_t)XRAPI_MAX_EVENT_SIZE;
+    return (size + 7) & ~(size_t)7;
+}
+
+static inline const xrEventHeader* xrEventPump_GetEvent(const xrEventPump* pump, const int index) {
+    return (const xrEventHeader*)&pump->Arena.Bytes[pump->Offsets[index]];
+}
+
+/// Reads all pending events into the arena. Returns the number of events read.
+static inline int xrEventPump_Drain(xrEventPump* pump) {
+    memset(&pump->Stats, 0, sizeof(pump->Stats));
+    pump->EventCount = 0;
+
+    size_t offset = 0;
+    for (;;) {
+        if (pump->EventCount >= XRAPI_EVENT_PUMP_MAX_EVENTS ||
+            offset + XRAPI_MAX_EVENT_SIZE > XRAPI_EVENT_PUMP_ARENA_SIZE) {
+            // Only report truncation if the queue is not empty yet.
+            if (!pump->HasHeldEvent) {
+                xrEventHeader* held = &pump->HeldEvent.Header;
+                held->EventType = XRAPI_EVENT_NONE;
+                pump->HasHeldEvent =
+                    xrapiPollEvent(held) == xrSuccess && held->EventType != XRAPI_EVENT_NONE;
+            }
+            pump->Stats.Truncated = pump->HasHeldEvent;
+            break;
+        }
+        xrEventHeader* event = (xrEventHeader*)&pump->Arena.Bytes[offset];
+        if (pump->HasHeldEvent) {
+            // Unknown types are sized as XRAPI_MAX_EVENT_SIZE rounded up, past the held event.
+            const size_t size = xrEventPump_EventSize(pump->HeldEvent.Header.EventType);
+            memcpy(
+                event,
+                &pump->HeldEvent,
+                (size < sizeof(pump->HeldEvent)) ? size : sizeof(pump->HeldEvent));
+            pump->HasHeldEvent = false;
+        } else {
+            event->EventType = XRAPI_EVENT_NONE;
+            if (xrapiPollEvent(event) != xrSuccess || event->EventType == XRAPI_EVENT_NONE) {
+                break;
+            }
+        }
+        const int index = pump->EventCount++;
+        pump->Offsets[index] = (unsigned short)offset;
+        pump->Coalesced[index] = false;
+        if ((int)event->EventType >= 0 && (int)event->EventType < XRAPI_EVENT_TYPE_COUNT) {
+            pump->Stats.PerType[event->EventType]++;
+        }
+        offset += xrEventPump_EventSize(event->EventType);
+    }
+    pump->Stats.Polled = (uint32_t)pump->EventCount;
+    pump->TotalPolled += pump->Stats.Polled;
+    return pump->EventCount;
+}
+
+/// Keeps only the last transition of a gained/lost pair, and drops it if it matches 'state'.
+static inline void xrEventPump_CoalescePair(
+    xrEventPump* pump,
+    const xrEventType gained,
+    const xrEventType lost,
+    xrEventPumpState* state) {
+    int last = -1;
+    for (int i = 0; i < pump->EventCount; i++) {
+        const xrEventType type = xrEventPump_GetEvent(pump, i)->EventType;
+        if (type == gained || type == lost) {
+            if (last >= 0) {
+                pump->Coalesced[last] = true;
+                pump->Stats.Coalesced++;
+            }
+            last = i;
+        }
+    }
+    if (last >= 0) {
+        const xrEventPumpState newState = (xrEventPump_GetEvent(pump, last)->EventType == gained)
+            ? xrEventPumpState_On
+            : xrEventPumpState_Off;
+        if (newState == *state) {
+            pump->Coalesced[last] = true;
+            pump->Stats.Coalesced++;
+        }
+        *state = newState;
+    }
+}
+
+/// Coalesces and dispatches the events read by the last xrEventPump_Drain().
+static inline void xrEventPump_Dispatch(xrEventPump* pump) {
+    xrEventPump_CoalescePair(
+        pump, XRAPI_EVENT_FOCUS_GAINED, XRAPI_EVENT_FOCUS_LOST, &pump->Focus);
+    xrEventPump_CoalescePair(
+        pump, XRAPI_EVENT_VISIBILITY_GAINED, XRAPI_EVENT_VISIBILITY_LOST, &pump->Visibility);
+
+    for (int i = 0; i < pump->EventCount; i++) {
+        if (pump->Coalesced[i]) {
+            continue;
+        }
+        const xrEventHeader* event = xrEventPump_GetEvent(pump, i);
+        const int type = (int)event->EventType;
+        const xrEventHandler handler = (type >= 0 && type < XRAPI_EVENT_TYPE_COUNT)
+            ? pump->Handlers[type]
+            : pump->UnknownHandler;
+        if (handler == NULL) {
+            pump->Stats.Unhandled++;
+            continue;
+        }
+        handler(pump->UserData, event);
+        pump->Stats.Dispatched++;
+    }
+    pump->TotalDispatched += pump->Stats.Dispatched;
+    pump->TotalCoalesced += pump->Stats.Coalesced;
+    pump->EventCount = 0;
+}
+
+/// Drains and dispatches all pending events. Call once per frame.
+static inline void xrEventPump_Pump(xrEventPump* pump) {
+    xrEventPump_Drain(pump);
+    xrEventPump_Dispatch(pump);
+}
+
+/// Returns true once a focus gained event was seen and no focus lost event since.
+static inline bool xrEventPump_HasFocus(const xrEventPump* pump) {
+    return pump->Focus == xrEventPumpState_On;
+}
+
+/// Returns true once a visibility gained event was seen and no visibility lost event since.
+static inline bool xrEventPump_IsVisible(const xrEventPump* pump) {
+    return pump->Visibility == xrEventPumpState_On;
+}
+
+#endif // XR_XrApiEvents_h
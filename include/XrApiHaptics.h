@@ -0,0 +1,374 @@
+
+#ifndef XR_XrApiHaptics_h
+#define XR_XrApiHaptics_h
+
+#include "math.h" // for ceil(), floorf()
+#include "string.h" // for memset()
+#include "XrApiConfig.h"
+#include "XrApiTypes.h"
+#include "XrApiInput.h"
+
+/*
+Buffered haptics mixer.
+
+xrapiSetHapticVibrationBuffer() may only be called once per frame per device. This mixer lets
+an application trigger any number of overlapping effects (clicks, rumbles and PCM clips) and
+turns them into exactly one xrHapticBuffer per frame.
+
+Every device has a timeline of samples with sample n playing at
+
+    Origin + n * SampleDuration
+
+Effects are placed on that timeline when they are triggered. Each frame the mixer submits
+the samples that start at the frame's predicted display time and cover the frame plus a
+safety margin. Consecutive buffers therefore overlap. The runtime replaces the overlapping
+tail with the newer buffer, so an effect triggered during a frame is heard from the next
+displayed frame on.
+
+Mixed samples are kept in a mirrored ring (every sample is written at index i and at
+i + XRAPI_HAPTICS_RING_SAMPLES). Any window of up to XRAPI_HAPTICS_RING_SAMPLES samples is
+then contiguous in memory and can be handed to the runtime without copying. Samples that
+were already mixed are only mixed again when a newly triggered effect overlaps them.
+
+The mixer does not allocate. Clip sample data is owned by the caller and must stay valid
+until the clip has finished playing or the mixer is stopped.
+*/
+
+/// Maximum number of effects playing at the same time on one device.
+#define XRAPI_HAPTICS_MAX_VOICES 8
+/// Size of the per-device sample ring. Must be a power of two.
+#define XRAPI_HAPTICS_RING_SAMPLES 256
+
+typedef enum xrHapticEffectType_ {
+    xrHapticEffect_None = 0,
+    xrHapticEffect_Click = 1, // full intensity at the start, linear decay to zero
+    xrHapticEffect_Rumble = 2, // constant intensity with linear attack and release
+    xrHapticEffect_Clip = 3, // caller provided 8-bit samples at the device sample rate
+} xrHapticEffectType;
+
+typedef struct xrHapticVoice_ {
+    xrHapticEffectType Type;
+    // Absolute sample index of the first sample of the effect.
+    int64_t StartSample;
+    uint32_t LengthSamples;
+    uint32_t AttackSamples;
+    uint32_t ReleaseSamples;
+    float Amplitude;
+    const uint8_t* ClipSamples;
+} xrHapticVoice;
+
+/// Counters for tuning the frame margin and for telemetry.
+typedef struct xrHapticMixerStats_ {
+    // Number of xrHapticMixer_BuildFrame() calls.
+    uint32_t Frames;
+    // Number of buffers produced for submission.
+    uint32_t Buffers;
+    // Total number of samples in produced buffers.
+    uint32_t Samples;
+    // Number of frames that started after the end of the previous buffer, and the number of
+    // samples that were not covered by any buffer while an effect was playing.
+    uint32_t Gaps;
+    uint32_t GapSamples;
+    // Number of frames where the requested window exceeded the device's HapticSamplesMax,
+    // and the number of samples that were cut off.
+    uint32_t Overruns;
+    uint32_t OverrunSamples;
+    // Number of effects that replaced a playing effect because all voices were in use.
+    uint32_t VoiceSteals;
+} xrHapticMixerStats;
+
+typedef struct xrHapticMixer_ {
+    // Duration of one haptic sample in seconds, from HapticSampleDurationMS.
+    double SampleDuration;
+    // Maximum number of samples per buffer, from HapticSamplesMax.
+    uint32_t MaxSamples;
+    // Number of frame periods each buffer covers beyond the current frame.
+    float MarginFrames;
+
+    bool HasOrigin;
+    // Time of sample 0 on the device timeline.
+    double Origin;
+    // First sample of the last produced buffer; earlier samples are already playing.
+    int64_t CommittedSample;
+    // One past the last sample of the last produced buffer.
+    int64_t CoveredEndSample;
+    // Samples in [MixedBeginSample, MixedEndSample) hold up-to-date mixes in the ring.
+    int64_t MixedBeginSample;
+    int64_t MixedEndSample;
+    // True while the runtime is playing a buffer that was not marked as terminated.
+    bool Playing;
+
+    xrHapticVoice Voices[XRAPI_HAPTICS_MAX_VOICES];
+    uint8_t Ring[XRAPI_HAPTICS_RING_SAMPLES * 2];
+
+    xrHapticMixerStats Stats;
+} xrHapticMixer;
+
+/// Initializes the mixer for a device with buffered haptics support
+/// (xrControllerCaps_HasBufferedHapticVibration).
+static inline void xrHapticMixer_Init(
+    xrHapticMixer* mixer,
+    const xrInputTrackedRemoteCapabilities* caps) {
+    memset(mixer, 0, sizeof(xrHapticMixer));
+    mixer->SampleDuration =
+        (caps->HapticSampleDurationMS > 0 ? caps->HapticSampleDurationMS : 1) * 0.001;
+    mixer->MaxSamples = caps->HapticSamplesMax;
+    if (mixer->MaxSamples == 0 || mixer->MaxSamples > XRAPI_HAPTICS_RING_SAMPLES) {
+        mixer->MaxSamples = XRAPI_HAPTICS_RING_SAMPLES;
+    }
+    mixer->MarginFrames = 1.0f;
+}
+
+/// Absolute index of the first sample that starts at or after 'timeInSeconds'.
+static inline int64_t xrHapticMixer_SampleIndex(
+    const xrHapticMixer* mixer,
+    const double timeInSeconds) {
+    // The small bias keeps times that land exactly on a sample from rounding up.
+    return (int64_t)ceil((timeInSeconds - mixer->Origin) / mixer->SampleDuration - 1e-6);
+}
+
+static inline uint32_t xrHapticMixer_SampleCount(
+    const xrHapticMixer* mixer,
+    const float durationInSeconds) {
+    const double count = ceil(durationInSeconds / mixer->SampleDuration - 1e-6);
+    return (count > 1.0) ? (uint32_t)count : 1;
+}
+
+static inline xrHapticVoice* xrHapticMixer_AllocVoice(xrHapticMixer* mixer) {
+    xrHapticVoice* oldest = &mixer->Voices[0];
+    for (int i = 0; i < XRAPI_HAPTICS_MAX_VOICES; i++) {
+        xrHapticVoice* voice = &mixer->Voices[i];
+        if (voice->Type == xrHapticEffect_None) {
+            return voice;
+        }
+        if (voice->StartSample < oldest->StartSample) {
+            oldest = voice;
+        }
+    }
+    mixer->Stats.VoiceSteals++;
+    return oldest;
+}
+
+static inline void xrHapticMixer_AddVoice(
+    xrHapticMixer* mixer,
+    const double startTime,
+    const xrHapticVoice* voice) {
+    if (!mixer->HasOrigin) {
+        mixer->Origin = startTime;
+        mixer->HasOrigin = true;
+    }
+    int64_t start = xrHapticMixer_SampleIndex(mixer, startTime);
+    if (start < mixer->CommittedSample) {
+        start = mixer->CommittedSample;
+    }
+    xrHapticVoice* dst = xrHapticMixer_AllocVoice(mixer);
+    *dst = *voice;
+    dst->StartSample = start;
+    // Samples from the start of the new effect on have to be mixed again.
+    if (mixer->MixedEndSample > start) {
+        mixer->MixedEndSample = (mixer->MixedBeginSample > start) ? mixer->MixedBeginSample : start;
+    }
+}
+
+/// Plays a click starting at 'startTime', usually the predicted display time of the frame
+/// that shows the event causing the click.
+static inline void xrHapticMixer_PlayClick(
+    xrHapticMixer* mixer,
+    const double startTime,
+    const float amplitude,
+    const float durationInSeconds) {
+    xrHapticVoice voice;
+    memset(&voice, 0, sizeof(voice));
+    voice.Type = xrHapticEffect_Click;
+    voice.LengthSamples = xrHapticMixer_SampleCount(mixer, durationInSeconds);
+    voice.Amplitude = amplitude;
+    xrHapticMixer_AddVoice(mixer, startTime, &voice);
+}
+
+/// Plays a constant rumble with linear attack and release ramps.
+static inline void xrHapticMixer_PlayRumble(
+    xrHapticMixer* mixer,
+    const double startTime,
+    const float amplitude,
+    const float durationInSeconds,
+    const float attackInSeconds,
+    const float releaseInSeconds) {
+    xrHapticVoice voice;
+    memset(&voice, 0, sizeof(voice));
+    voice.Type = xrHapticEffect_Rumble;
+    voice.LengthSamples = xrHapticMixer_SampleCount(mixer, durationInSeconds);
+    voice.AttackSamples =
+        (attackInSeconds > 0.0f) ? xrHapticMixer_SampleCount(mixer, attackInSeconds) : 0;
+    voice.ReleaseSamples =
+        (releaseInSeconds > 0.0f) ? xrHapticMixer_SampleCount(mixer, releaseInSeconds) : 0;
+    voice.Amplitude = amplitude;
+    xrHapticMixer_AddVoice(mixer, startTime, &voice);
+}
+
+/// Plays 8-bit intensity samples recorded at the device's haptic sample rate, scaled by 'gain'.
+static inline void xrHapticMixer_PlayClip(
+    xrHapticMixer* mixer,
+    const double startTime,
+    const uint8_t* samples,
+    const uint32_t numSamples,
+    const float gain) {
+    if (samples == NULL || numSamples == 0) {
+        return;
+    }
+    xrHapticVoice voice;
+    memset(&voice, 0, sizeof(voice));
+    voice.Type = xrHapticEffect_Clip;
+    voice.LengthSamples = numSamples;
+    voice.Amplitude = gain * (1.0f / 255.0f);
+    voice.ClipSamples = samples;
+    xrHapticMixer_AddVoice(mixer, startTime, &voice);
+}
+
+/// Stops all effects. The next built buffer is a terminating buffer if anything was playing.
+static inline void xrHapticMixer_Stop(xrHapticMixer* mixer) {
+    for (int i = 0; i < XRAPI_HAPTICS_MAX_VOICES; i++) {
+        mixer->Voices[i].Type = xrHapticEffect_None;
+    }
+    mixer->MixedEndSample = mixer->MixedBeginSample;
+}
+
+static inline float xrHapticVoice_Sample(const xrHapticVoice* voice, const uint32_t offset) {
+    switch (voice->Type) {
+        case xrHapticEffect_Click:
+            return voice->Amplitude * (1.0f - (float)offset / (float)voice->LengthSamples);
+        case xrHapticEffect_Rumble: {
+            float envelope = 1.0f;
+            if (offset < voice->AttackSamples) {
+                envelope = (float)(offset + 1) / (float)(voice->AttackSamples + 1);
+            }
+            const uint32_t remaining = voice->LengthSamples - offset;
+            if (remaining <= voice->ReleaseSamples) {
+                const float release = (float)remaining / (float)(voice->ReleaseSamples + 1);
+                envelope = (release < envelope) ? release : envelope;
+            }
+            return voice->Amplitude * envelope;
+        }
+        case xrHapticEffect_Clip:
+            return voice->Amplitude * voice->ClipSamples[offset];
+        default:
+            return 0.0f;
+    }
+}
+
+/// Mixes samples [begin, end) into the ring.
+static inline void
+xrHapticMixer_Mix(xrHapticMixer* mixer, const int64_t begin, const int64_t end) {
+    const int64_t mask = XRAPI_HAPTICS_RING_SAMPLES - 1;
+    for (int64_t i = begin; i < end; i++) {
+        float sum = 0.0f;
+        for (int v = 0; v < XRAPI_HAPTICS_MAX_VOICES; v++) {
+            const xrHapticVoice* voice = &mixer->Voices[v];
+            if (voice->Type != xrHapticEffect_None && i >= voice->StartSample &&
+                i < voice->StartSample + voice->LengthSamples) {
+                sum += xrHapticVoice_Sample(voice, (uint32_t)(i - voice->StartSample));
+            }
+        }
+        sum = (sum > 0.0f) ? ((sum < 1.0f) ? sum : 1.0f) : 0.0f;
+        const uint8_t value = (uint8_t)floorf(sum * 255.0f + 0.5f);
+        mixer->Ring[i & mask] = value;
+        mixer->Ring[(i & mask) + XRAPI_HAPTICS_RING_SAMPLES] = value;
+    }
+}
+
+/// Builds the buffer for the frame that will be displayed at 'displayTime'.
+/// 'framePeriod' is the display refresh period in seconds (times the swap interval).
+/// Returns false if there is nothing to submit this frame, in which case the device should
+/// not be given a buffer. Otherwise 'buffer' points into the mixer's ring and stays valid
+/// until the next call on this mixer.
+static inline bool xrHapticMixer_BuildFrame(
+    xrHapticMixer* mixer,
+    const double displayTime,
+    const double framePeriod,
+    xrHapticBuffer* buffer) {
+    mixer->Stats.Frames++;
+
+    // Retire effects that finished before this frame.
+    bool active = false;
+    const int64_t first = mixer->HasOrigin ? xrHapticMixer_SampleIndex(mixer, displayTime) : 0;
+    for (int i = 0; i < XRAPI_HAPTICS_MAX_VOICES; i++) {
+        xrHapticVoice* voice = &mixer->Voices[i];
+        if (voice->Type != xrHapticEffect_None) {
+            if (voice->StartSample + voice->LengthSamples <= first) {
+                voice->Type = xrHapticEffect_None;
+            } else {
+                active = true;
+            }
+        }
+    }
+
+    if (!active && !mixer->Playing) {
+        return false;
+    }
+
+    if (mixer->Playing && first > mixer->CoveredEndSample) {
+        mixer->Stats.Gaps++;
+        mixer->Stats.GapSamples += (uint32_t)(first - mixer->CoveredEndSample);
+    }
+
+    int64_t count = xrHapticMixer_SampleIndex(
+                        mixer, displayTime + framePeriod * (1.0 + mixer->MarginFrames)) -
+        first;
+    if (count < 1) {
+        count = 1;
+    }
+    if (count > (int64_t)mixer->MaxSamples) {
+        mixer->Stats.Overruns++;
+        mixer->Stats.OverrunSamples += (uint32_t)(count - mixer->MaxSamples);
+        count = mixer->MaxSamples;
+    }
+    const int64_t end = first + count;
+
+    // Reuse what is still valid in the ring and only mix the rest.
+    if (first < mixer->MixedBeginSample || first >= mixer->MixedEndSample) {
+        mixer->MixedEndSample = first;
+    }
+    if (mixer->MixedEndSample < end) {
+        xrHapticMixer_Mix(mixer, mixer->MixedEndSample, end);
+        mixer->MixedEndSample = end;
+    }
+    mixer->MixedBeginSample = first;
+
+    // Terminate once no effect reaches past this buffer.
+    bool more = false;
+    for (int i = 0; i < XRAPI_HAPTICS_MAX_VOICES; i++) {
+        const xrHapticVoice* voice = &mixer->Voices[i];
+        if (voice->Type != xrHapticEffect_None &&
+            voice->StartSample + voice->LengthSamples > end) {
+            more = true;
+        }
+    }
+
+    buffer->BufferTime = mixer->Origin + (double)first * mixer->SampleDuration;
+    buffer->NumSamples = (uint32_t)count;
+    buffer->Terminated = !more;
+    buffer->HapticBuffer = &mixer->Ring[first & (XRAPI_HAPTICS_RING_SAMPLES - 1)];
+
+    mixer->CommittedSample = first;
+    mixer->CoveredEndSample = end;
+    mixer->Playing = more;
+    mixer->Stats.Buffers++;
+    mixer->Stats.Samples += (uint32_t)count;
+    return true;
+}
+
+/// Builds this frame's buffer and hands it to the runtime. Call once per frame per device,
+/// and do not call xrapiSetHapticVibrationSimple() for the same device in that frame.
+static inline xrResult xrHapticMixer_Submit(
+    xrHapticMixer* mixer,
+    xrMobile* xr,
+    const xrDeviceID deviceID,
+    const double displayTime,
+    const double framePeriod) {
+    xrHapticBuffer buffer;
+    if (!xrHapticMixer_BuildFrame(mixer, displayTime, framePeriod, &buffer)) {
+        return xrSuccess;
+    }
+    return xrapiSetHapticVibrationBuffer(xr, deviceID, &buffer);
+}
+
+#endif // XR_XrApiHaptics_h
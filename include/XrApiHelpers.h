@@ -7,6 +7,7 @@
 #include "XrApiConfig.h"
 #include "XrApiVersion.h"
 #include "XrApiTypes.h"
+#include "XrApiMath.h"
 
 #define XRAPI_PI 3.14159265358979323846f
 #define XRAPI_ZNEAR 0.1f
@@ -209,23 +210,75 @@ xrMatrix4f_CreateTranslation(const float x, const float y, const float z) {
     return out;
 }
 
+/// Returns the 4x4 homogeneous rotation matrix Z * Y * X for the given sines and cosines of
+/// the rotations about the three axes. The product is expanded in the order
+/// xrMatrix4f_Multiply() evaluates it, so the result is identical.
+static inline xrMatrix4f xrMatrix4f_CreateRotationFromSinCos(
+    const float sinX,
+    const float cosX,
+    const float sinY,
+    const float cosY,
+    const float sinZ,
+    const float cosZ) {
+    xrMatrix4f out;
+    out.M[0][0] = cosZ * cosY;
+    out.M[0][1] = cosZ * (sinY * sinX) - sinZ * cosX;
+    out.M[0][2] = cosZ * (sinY * cosX) + sinZ * sinX;
+    out.M[0][3] = 0.0f;
+    out.M[1][0] = sinZ * cosY;
+    out.M[1][1] = sinZ * (sinY * sinX) + cosZ * cosX;
+    out.M[1][2] = sinZ * (sinY * cosX) - cosZ * sinX;
+    out.M[1][3] = 0.0f;
+    out.M[2][0] = -sinY;
+    out.M[2][1] = cosY * sinX;
+    out.M[2][2] = cosY * cosX;
+    out.M[2][3] = 0.0f;
+    out.M[3][0] = 0.0f;
+    out.M[3][1] = 0.0f;
+    out.M[3][2] = 0.0f;
+    out.M[3][3] = 1.0f;
+    return out;
+}
+
 /// Returns a 4x4 homogeneous rotation matrix.
 static inline xrMatrix4f
 xrMatrix4f_CreateRotation(const float radiansX, const float radiansY, const float radiansZ) {
-    const float sinX = sinf(radiansX);
-    const float cosX = cosf(radiansX);
-    const xrMatrix4f rotationX = {
-        {{1, 0, 0, 0}, {0, cosX, -sinX, 0}, {0, sinX, cosX, 0}, {0, 0, 0, 1}}};
-    const float sinY = sinf(radiansY);
-    const float cosY = cosf(radiansY);
-    const xrMatrix4f rotationY = {
-        {{cosY, 0, sinY, 0}, {0, 1, 0, 0}, {-sinY, 0, cosY, 0}, {0, 0, 0, 1}}};
-    const float sinZ = sinf(radiansZ);
-    const float cosZ = cosf(radiansZ);
-    const xrMatrix4f rotationZ = {
-        {{cosZ, -sinZ, 0, 0}, {sinZ, cosZ, 0, 0}, {0, 0, 1, 0}, {0, 0, 0, 1}}};
-    const xrMatrix4f rotationXY = xrMatrix4f_Multiply(&rotationY, &rotationX);
-    return xrMatrix4f_Multiply(&rotationZ, &rotationXY);
+    return xrMatrix4f_CreateRotationFromSinCos(
+        sinf(radiansX),
+        cosf(radiansX),
+        sinf(radiansY),
+        cosf(radiansY),
+        sinf(radiansZ),
+        cosf(radiansZ));
+}
+
+/// Same as xrMatrix4f_CreateRotation( radians[i].x, radians[i].y, radians[i].z ) for 'count'
+/// rotations, with the sines and cosines computed four at a time by xrSinCos_Array().
+static inline void xrMatrix4f_CreateRotations(
+    xrMatrix4f* out,
+    const xrVector3f* radians,
+    const int count,
+    const xrSinCosAccuracy accuracy) {
+    // Large enough to amortize the setup, small enough for the stack.
+    enum { BATCH = 32 };
+    float angles[3 * BATCH];
+    float sines[3 * BATCH];
+    float cosines[3 * BATCH];
+    for (int first = 0; first < count; first += BATCH) {
+        const int batch = (count - first < BATCH) ? count - first : BATCH;
+        for (int i = 0; i < batch; i++) {
+            angles[i * 3 + 0] = radians[first + i].x;
+            angles[i * 3 + 1] = radians[first + i].y;
+            angles[i * 3 + 2] = radians[first + i].z;
+        }
+        xrSinCos_Array(sines, cosines, angles, batch * 3, accuracy);
+        for (int i = 0; i < batch; i++) {
+            const float* s = &sines[i * 3];
+            const float* c = &cosines[i * 3];
+            out[first + i] =
+                xrMatrix4f_CreateRotationFromSinCos(s[0], c[0], s[1], c[1], s[2], c[2]);
+        }
+    }
 }
 
 /// Returns a projection matrix based on the specified dimensions.
@@ -421,6 +474,15 @@ static inline xrMatrix4f xrMatrix4f_TanAngleMatrixFromProjection(const xrMatrix4
     return tanAngleMatrix;
 }
 
+/// TexCoordsFromTanAngles of the default layers, precomputed so building a default layer does
+/// not evaluate tanf() and two matrices. Equal to xrMatrix4f_TanAngleMatrixFromProjection() of
+/// xrMatrix4f_CreateProjectionFov( 90.0f, 90.0f, 0.0f, 0.0f, 0.1f, 0.0f ).
+static XRAPI_CONSTEXPR const xrMatrix4f xrDefaultTexCoordsFromTanAngles = {
+    {{0.5f, 0.0f, -0.5f, 0.0f},
+     {0.0f, 0.5f, -0.5f, 0.0f},
+     {0.0f, 0.0f, -1.0f, 0.0f},
+     {-1.0f, -0.2f, -1.0f, 1.0f}}};
+
 /// If a simple quad defined as a -1 to 1 XY unit square is transformed to
 /// the camera view with the given modelView matrix, it can alternately be
 /// drawn as a time warp overlay image to take advantage of the full window
@@ -522,14 +584,9 @@ static inline xrVector3f xrVector3f_RotateAboutPivot(
     const xrQuatf* rotation,
     const xrVector3f* pivot,
     const xrVector3f* point) {
-    const xrMatrix4f t0 = xrMatrix4f_CreateTranslation(pivot->x, pivot->y, pivot->z);
-    const xrMatrix4f r = xrMatrix4f_CreateFromQuaternion(rotation);
-    const xrMatrix4f t1 = xrMatrix4f_CreateTranslation(-pivot->x, -pivot->y, -pivot->z);
-    const xrMatrix4f c0 = xrMatrix4f_Multiply(&t0, &r);
-    const xrMatrix4f c1 = xrMatrix4f_Multiply(&c0, &t1);
-    const xrVector4f v = {point->x, point->y, point->z, 1.0f};
-    const xrVector4f v2 = xrVector4f_MultiplyMatrix4f(&c1, &v);
-    const xrVector3f v3 = {v2.x, v2.y, v2.z};
+    const xrVector3f local = {point->x - pivot->x, point->y - pivot->y, point->z - pivot->z};
+    const xrVector3f rotated = xrQuatf_Rotate(rotation, &local);
+    const xrVector3f v3 = {rotated.x + pivot->x, rotated.y + pivot->y, rotated.z + pivot->z};
     return v3;
 }
 
@@ -609,11 +666,6 @@ static inline xrFrameParms xrapiDefaultFrameParms(
     const xrFrameInit init,
     const double currentTime,
     xrTextureSwapChain* textureSwapChain) {
-    const xrMatrix4f projectionMatrix =
-        xrMatrix4f_CreateProjectionFov(90.0f, 90.0f, 0.0f, 0.0f, 0.1f, 0.0f);
-    const xrMatrix4f texCoordsFromTanAngles =
-        xrMatrix4f_TanAngleMatrixFromProjection(&projectionMatrix);
-
     xrFrameParms parms;
     memset(&parms, 0, sizeof(parms));
 
@@ -621,7 +673,8 @@ static inline xrFrameParms xrapiDefaultFrameParms(
     for (int layer = 0; layer < XRAPI_FRAME_LAYER_TYPE_MAX; layer++) {
         parms.Layers[layer].ColorScale = 1.0f;
         for (int eye = 0; eye < XRAPI_FRAME_LAYER_EYE_MAX; eye++) {
-            parms.Layers[layer].Textures[eye].TexCoordsFromTanAngles = texCoordsFromTanAngles;
+            parms.Layers[layer].Textures[eye].TexCoordsFromTanAngles =
+                xrDefaultTexCoordsFromTanAngles;
             parms.Layers[layer].Textures[eye].TextureRect.width = 1.0f;
             parms.Layers[layer].Textures[eye].TextureRect.height = 1.0f;
             parms.Layers[layer].Textures[eye].HeadPose.Pose.Orientation.w = 1.0f;
@@ -699,16 +752,18 @@ static inline xrFrameParms xrapiDefaultFrameParms(
 
 //-----------------------------------------------------------------
 // Layer Types - default initialization.
+//
+// The defaults are built from constants only. Compiled as C++14 or later, the layers
+// without a default swap chain are constexpr, so a default can be kept as a template
+// and copied:
+//
+//     static constexpr xrLayerProjection2 defaultLayer = xrapiDefaultLayerProjection2();
+//
 //-----------------------------------------------------------------
 
-static inline xrLayerProjection2 xrapiDefaultLayerProjection2() {
+static inline XRAPI_CONSTEXPR xrLayerProjection2 xrapiDefaultLayerProjection2() {
     xrLayerProjection2 layer = {};
 
-    const xrMatrix4f projectionMatrix =
-        xrMatrix4f_CreateProjectionFov(90.0f, 90.0f, 0.0f, 0.0f, 0.1f, 0.0f);
-    const xrMatrix4f texCoordsFromTanAngles =
-        xrMatrix4f_TanAngleMatrixFromProjection(&projectionMatrix);
-
     layer.Header.Type = XRAPI_LAYER_TYPE_PROJECTION2;
     layer.Header.Flags = 0;
     layer.Header.ColorScale.x = 1.0f;
@@ -722,7 +777,7 @@ static inline xrLayerProjection2 xrapiDefaultLayerProjection2() {
     layer.HeadPose.Pose.Orientation.w = 1.0f;
 
     for (int i = 0; i < XRAPI_FRAME_LAYER_EYE_MAX; i++) {
-        layer.Textures[i].TexCoordsFromTanAngles = texCoordsFromTanAngles;
+        layer.Textures[i].TexCoordsFromTanAngles = xrDefaultTexCoordsFromTanAngles;
         layer.Textures[i].TextureRect.x = 0.0f;
         layer.Textures[i].TextureRect.y = 0.0f;
         layer.Textures[i].TextureRect.width = 1.0f;
@@ -780,14 +835,9 @@ static inline xrLayerProjection2 xrapiDefaultLayerSolidColorProjection2(
     return layer;
 }
 
-static inline xrLayerCylinder2 xrapiDefaultLayerCylinder2() {
+static inline XRAPI_CONSTEXPR xrLayerCylinder2 xrapiDefaultLayerCylinder2() {
     xrLayerCylinder2 layer = {};
 
-    const xrMatrix4f projectionMatrix =
-        xrMatrix4f_CreateProjectionFov(90.0f, 90.0f, 0.0f, 0.0f, 0.1f, 0.0f);
-    const xrMatrix4f texCoordsFromTanAngles =
-        xrMatrix4f_TanAngleMatrixFromProjection(&projectionMatrix);
-
     layer.Header.Type = XRAPI_LAYER_TYPE_CYLINDER2;
     layer.Header.Flags = 0;
     layer.Header.ColorScale.x = 1.0f;
@@ -801,7 +851,7 @@ static inline xrLayerCylinder2 xrapiDefaultLayerCylinder2() {
     layer.HeadPose.Pose.Orientation.w = 1.0f;
 
     for (int i = 0; i < XRAPI_FRAME_LAYER_EYE_MAX; i++) {
-        layer.Textures[i].TexCoordsFromTanAngles = texCoordsFromTanAngles;
+        layer.Textures[i].TexCoordsFromTanAngles = xrDefaultTexCoordsFromTanAngles;
         layer.Textures[i].TextureRect.x = 0.0f;
         layer.Textures[i].TextureRect.y = 0.0f;
         layer.Textures[i].TextureRect.width = 1.0f;
@@ -815,7 +865,7 @@ static inline xrLayerCylinder2 xrapiDefaultLayerCylinder2() {
     return layer;
 }
 
-static inline xrLayerCube2 xrapiDefaultLayerCube2() {
+static inline XRAPI_CONSTEXPR xrLayerCube2 xrapiDefaultLayerCube2() {
     xrLayerCube2 layer = {};
 
     layer.Header.Type = XRAPI_LAYER_TYPE_CUBE2;
@@ -829,7 +879,10 @@ static inline xrLayerCube2 xrapiDefaultLayerCube2() {
     layer.Header.Reserved = NULL;
 
     layer.HeadPose.Pose.Orientation.w = 1.0f;
-    layer.TexCoordsFromTanAngles = xrMatrix4f_CreateIdentity();
+    layer.TexCoordsFromTanAngles.M[0][0] = 1.0f;
+    layer.TexCoordsFromTanAngles.M[1][1] = 1.0f;
+    layer.TexCoordsFromTanAngles.M[2][2] = 1.0f;
+    layer.TexCoordsFromTanAngles.M[3][3] = 1.0f;
 
     layer.Offset.x = 0.0f;
     layer.Offset.y = 0.0f;
@@ -838,7 +891,7 @@ static inline xrLayerCube2 xrapiDefaultLayerCube2() {
     return layer;
 }
 
-static inline xrLayerEquirect2 xrapiDefaultLayerEquirect2() {
+static inline XRAPI_CONSTEXPR xrLayerEquirect2 xrapiDefaultLayerEquirect2() {
     xrLayerEquirect2 layer = {};
 
     layer.Header.Type = XRAPI_LAYER_TYPE_EQUIRECT2;
@@ -852,7 +905,10 @@ static inline xrLayerEquirect2 xrapiDefaultLayerEquirect2() {
     layer.Header.Reserved = NULL;
 
     layer.HeadPose.Pose.Orientation.w = 1.0f;
-    layer.TexCoordsFromTanAngles = xrMatrix4f_CreateIdentity();
+    layer.TexCoordsFromTanAngles.M[0][0] = 1.0f;
+    layer.TexCoordsFromTanAngles.M[1][1] = 1.0f;
+    layer.TexCoordsFromTanAngles.M[2][2] = 1.0f;
+    layer.TexCoordsFromTanAngles.M[3][3] = 1.0f;
 
     for (int i = 0; i < XRAPI_FRAME_LAYER_EYE_MAX; i++) {
         layer.Textures[i].TextureRect.x = 0.0f;
@@ -890,14 +946,9 @@ static inline xrLayerLoadingIcon2 xrapiDefaultLayerLoadingIcon2() {
     return layer;
 }
 
-static inline xrLayerFishEye2 xrapiDefaultLayerFishEye2() {
+static inline XRAPI_CONSTEXPR xrLayerFishEye2 xrapiDefaultLayerFishEye2() {
     xrLayerFishEye2 layer = {};
 
-    const xrMatrix4f projectionMatrix =
-        xrMatrix4f_CreateProjectionFov(90.0f, 90.0f, 0.0f, 0.0f, 0.1f, 0.0f);
-    const xrMatrix4f texCoordsFromTanAngles =
-        xrMatrix4f_TanAngleMatrixFromProjection(&projectionMatrix);
-
     layer.Header.Type = XRAPI_LAYER_TYPE_FISHEYE2;
     layer.Header.Flags = 0;
     layer.Header.ColorScale.x = 1.0f;
@@ -911,7 +962,7 @@ static inline xrLayerFishEye2 xrapiDefaultLayerFishEye2() {
     layer.HeadPose.Pose.Orientation.w = 1.0f;
 
     for (int i = 0; i < XRAPI_FRAME_LAYER_EYE_MAX; i++) {
-        layer.Textures[i].LensFromTanAngles = texCoordsFromTanAngles;
+        layer.Textures[i].LensFromTanAngles = xrDefaultTexCoordsFromTanAngles;
         layer.Textures[i].TextureRect.x = 0.0f;
         layer.Textures[i].TextureRect.y = 0.0f;
         layer.Textures[i].TextureRect.width = 1.0f;
@@ -925,6 +976,15 @@ static inline xrLayerFishEye2 xrapiDefaultLayerFishEye2() {
     return layer;
 }
 
+#if defined(__cplusplus) && __cplusplus >= 201402L
+// Keep the defaults constant expressions.
+XRAPI_STATIC_ASSERT(xrapiDefaultLayerProjection2().Header.Type == XRAPI_LAYER_TYPE_PROJECTION2);
+XRAPI_STATIC_ASSERT(xrapiDefaultLayerCylinder2().Header.Type == XRAPI_LAYER_TYPE_CYLINDER2);
+XRAPI_STATIC_ASSERT(xrapiDefaultLayerCube2().Header.Type == XRAPI_LAYER_TYPE_CUBE2);
+XRAPI_STATIC_ASSERT(xrapiDefaultLayerEquirect2().Header.Type == XRAPI_LAYER_TYPE_EQUIRECT2);
+XRAPI_STATIC_ASSERT(xrapiDefaultLayerFishEye2().Header.Type == XRAPI_LAYER_TYPE_FISHEYE2);
+#endif
+
 //-----------------------------------------------------------------
 // Eye view matrix helper functions.
 //-----------------------------------------------------------------
@@ -946,15 +1006,18 @@ static inline float xrapiGetEyeHeight(
 }
 
 static inline xrMatrix4f xrapiGetTransformFromPose(const xrPosef* pose) {
-    const xrMatrix4f rotation = xrMatrix4f_CreateFromQuaternion(&pose->Orientation);
-    const xrMatrix4f translation =
-        xrMatrix4f_CreateTranslation(pose->Position.x, pose->Position.y, pose->Position.z);
-    return xrMatrix4f_Multiply(&translation, &rotation);
+    // Translation * Rotation without the 4x4 multiply.
+    xrMatrix4f transform = xrMatrix4f_CreateFromQuaternion(&pose->Orientation);
+    transform.M[0][3] = pose->Position.x;
+    transform.M[1][3] = pose->Position.y;
+    transform.M[2][3] = pose->Position.z;
+    return transform;
 }
 
 static inline xrMatrix4f xrapiGetViewMatrixFromPose(const xrPosef* pose) {
-    const xrMatrix4f transform = xrapiGetTransformFromPose(pose);
-    return xrMatrix4f_Inverse(&transform);
+    // The inverse of a rigid pose is a rigid pose; no general 4x4 inverse needed.
+    const xrPosef inverse = xrPosef_Inverse(pose);
+    return xrapiGetTransformFromPose(&inverse);
 }
 
 #endif // XR_XrApiHelpers_h
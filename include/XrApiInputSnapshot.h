@@ -0,0 +1,306 @@
+
+#ifndef XR_XrApiInputSnapshot_h
+#define XR_XrApiInputSnapshot_h
+
+#include "string.h" // for memset(), memcpy()
+#include "XrApiConfig.h"
+#include "XrApiTypes.h"
+#include "XrApiInput.h"
+
+/*
+Reads the input state of all devices into one snapshot per frame.
+
+Reading input directly takes an xrapiEnumerateInputDevices() loop, a capabilities query, and
+a state and tracking query for every device, every frame. Capabilities do not change while a
+device stays connected, so the cache only enumerates devices and queries their capabilities
+when it rescans. A rescan happens on the first update, after xrInputCache_Invalidate(), when
+a state query fails because a device went away, and every RescanInterval updates to find
+newly connected devices. All other updates only issue the state and tracking queries.
+
+The state of every device is read straight into the contiguous xrInputSnapshot, together with
+the tracking state of tracked remotes and hands and the button transitions since the
+previous update:
+
+    xrInputCache_Update( &cache, xr, 0.0, &snapshot );
+    for ( int i = 0; i < snapshot.DeviceCount; i++ ) {
+        if ( snapshot.Devices[i].Pressed & xrButton_A ) {
+            ...
+
+Button transitions are tracked per device ID, so they survive rescans. A device that stops
+reporting releases all of its buttons. A newly found device starts without transitions, so
+buttons that are already held when it connects are not reported as pressed.
+*/
+
+/// Maximum number of input devices in a snapshot.
+#define XRAPI_INPUT_SNAPSHOT_MAX_DEVICES 8
+/// Default number of updates between rescans for newly connected devices.
+#define XRAPI_INPUT_CACHE_RESCAN_INTERVAL 36
+
+/// Capabilities of any input device type, selected by Header.Type.
+typedef union xrInputCapabilities_Union_ {
+    xrInputCapabilityHeader Header;
+    xrInputTrackedRemoteCapabilities TrackedRemote;
+    xrInputHeadsetCapabilities Headset;
+    xrInputGamepadCapabilities Gamepad;
+    xrInputHandCapabilities Hand;
+} xrInputCapabilities_Union;
+
+/// Input state of any input device type, selected by Header.ControllerType.
+typedef union xrInputState_Union_ {
+    xrInputStateHeader Header;
+    xrInputStateTrackedRemote TrackedRemote;
+    xrInputStateHeadset Headset;
+    xrInputStateGamepad Gamepad;
+    xrInputStateHand Hand;
+} xrInputState_Union;
+
+typedef enum xrInputSnapshotFlags_ {
+    XRAPI_INPUT_SNAPSHOT_STATE_VALID = 1 << 0, //< State and the button masks are valid.
+    XRAPI_INPUT_SNAPSHOT_TRACKING_VALID = 1 << 1, //< Tracking holds the device pose.
+    XRAPI_INPUT_SNAPSHOT_NEW_DEVICE = 1 << 2, //< First update since the device was found.
+} xrInputSnapshotFlags;
+
+/// Input of a single device in a snapshot.
+typedef struct xrInputDeviceSnapshot_ {
+    xrDeviceID DeviceID;
+    xrControllerType Type;
+    // Copied from the cached capabilities. For hands these are the xrHandCapabilities and
+    // xrHandStateCapabilities masks.
+    uint32_t ControllerCapabilities;
+    uint32_t ButtonCapabilities;
+    // Mask of xrInputSnapshotFlags.
+    uint32_t Flags;
+    // Buttons held down, described by xrButton. For hands this holds the
+    // xrInputStateHandStatus flags, so pinches have transitions like buttons.
+    uint32_t Buttons;
+    // Buttons that went down and up since the previous update.
+    uint32_t Pressed;
+    uint32_t Released;
+    xrTracking Tracking;
+    xrInputState_Union State;
+} xrInputDeviceSnapshot;
+
+/// Input of all devices for one frame.
+typedef struct xrInputSnapshot_ {
+    int DeviceCount;
+    xrInputDeviceSnapshot Devices[XRAPI_INPUT_SNAPSHOT_MAX_DEVICES];
+} xrInputSnapshot;
+
+/// Runtime calls of the last xrInputCache_Update() call.
+typedef struct xrInputCacheStats_ {
+    uint32_t EnumerateCalls;
+    uint32_t CapabilityCalls;
+    uint32_t StateCalls;
+    uint32_t TrackingCalls;
+    // True if the devices were enumerated.
+    bool Rescanned;
+    // True if devices were added or removed.
+    bool DevicesChanged;
+} xrInputCacheStats;
+
+typedef struct xrInputCachedDevice_ {
+    xrInputCapabilities_Union Capabilities;
+    // True if xrapiGetInputTrackingState() is queried for the device.
+    bool Tracked;
+    // True once Buttons holds the buttons of a previous update.
+    bool HasButtons;
+    uint32_t Buttons;
+} xrInputCachedDevice;
+
+typedef struct xrInputCache_ {
+    int RescanInterval;
+    int UpdatesSinceScan;
+    bool ScanRequested;
+    int DeviceCount;
+    xrInputCachedDevice Devices[XRAPI_INPUT_SNAPSHOT_MAX_DEVICES];
+
+    xrInputCacheStats Stats;
+    // Totals since xrInputCache_Init().
+    uint64_t TotalUpdates;
+    uint64_t TotalCalls;
+    uint64_t TotalRescans;
+} xrInputCache;
+
+static inline void xrInputCache_Init(xrInputCache* cache) {
+    memset(cache, 0, sizeof(xrInputCache));
+    cache->RescanInterval = XRAPI_INPUT_CACHE_RESCAN_INTERVAL;
+    cache->ScanRequested = true;
+}
+
+/// Forces a rescan on the next update, for instance after re-entering VR mode.
+static inline void xrInputCache_Invalidate(xrInputCache* cache) {
+    cache->ScanRequested = true;
+}
+
+/// Returns the cached capabilities of a device, or NULL if the device is not known.
+static inline const xrInputCapabilities_Union* xrInputCache_GetCapabilities(
+    const xrInputCache* cache,
+    const xrDeviceID deviceID) {
+    for (int i = 0; i < cache->DeviceCount; i++) {
+        if (cache->Devices[i].Capabilities.Header.DeviceID == deviceID) {
+            return &cache->Devices[i].Capabilities;
+        }
+    }
+    return NULL;
+}
+
+/// Returns the index of the cached device matching 'header', or -1.
+static inline int xrInputCache_FindDevice(
+    const xrInputCache* cache,
+    const xrInputCapabilityHeader* header) {
+    for (int i = 0; i < cache->DeviceCount; i++) {
+        const xrInputCapabilityHeader* cached = &cache->Devices[i].Capabilities.Header;
+        if (cached->DeviceID == header->DeviceID && cached->Type == header->Type) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/// Enumerates the devices. Capabilities are only queried for devices that were not cached.
+static inline void xrInputCache_Scan(xrInputCache* cache, xrMobile* xr) {
+    xrInputCachedDevice devices[XRAPI_INPUT_SNAPSHOT_MAX_DEVICES];
+    int deviceCount = 0;
+    int keptCount = 0;
+
+    for (uint32_t index = 0; deviceCount < XRAPI_INPUT_SNAPSHOT_MAX_DEVICES; index++) {
+        xrInputCapabilityHeader header;
+        memset(&header, 0, sizeof(header));
+        cache->Stats.EnumerateCalls++;
+        if (xrapiEnumerateInputDevices(xr, index, &header) < 0) {
+            break;
+        }
+
+        xrInputCachedDevice* device = &devices[deviceCount];
+        const int cached = xrInputCache_FindDevice(cache, &header);
+        if (cached >= 0) {
+            *device = cache->Devices[cached];
+            deviceCount++;
+            keptCount++;
+            continue;
+        }
+
+        if (header.Type != xrControllerType_TrackedRemote &&
+            header.Type != xrControllerType_Headset &&
+            header.Type != xrControllerType_Gamepad && header.Type != xrControllerType_Hand) {
+            // There is no state structure for other device types.
+            continue;
+        }
+        memset(device, 0, sizeof(xrInputCachedDevice));
+        device->Capabilities.Header = header;
+        cache->Stats.CapabilityCalls++;
+        if (xrapiGetInputDeviceCapabilities(xr, &device->Capabilities.Header) < 0) {
+            // Most likely disconnected between the two calls.
+            continue;
+        }
+        device->Tracked = header.Type == xrControllerType_Hand ||
+            (header.Type == xrControllerType_TrackedRemote &&
+             (device->Capabilities.TrackedRemote.ControllerCapabilities &
+              xrControllerCaps_HasOrientationTracking) != 0);
+        deviceCount++;
+    }
+
+    cache->Stats.Rescanned = true;
+    cache->Stats.DevicesChanged = keptCount != cache->DeviceCount || deviceCount != keptCount;
+    memcpy(cache->Devices, devices, deviceCount * sizeof(xrInputCachedDevice));
+    cache->DeviceCount = deviceCount;
+    cache->UpdatesSinceScan = 0;
+    cache->ScanRequested = false;
+    cache->TotalRescans++;
+}
+
+/// Returns the buttons of a state read for a device of the given type.
+static inline uint32_t xrInputCache_GetButtons(const xrInputState_Union* state) {
+    switch (state->Header.ControllerType) {
+        case xrControllerType_TrackedRemote:
+            return state->TrackedRemote.Buttons;
+        case xrControllerType_Headset:
+            return state->Headset.Buttons;
+        case xrControllerType_Gamepad:
+            return state->Gamepad.Buttons;
+        case xrControllerType_Hand:
+            return state->Hand.InputStateStatus;
+        default:
+            return 0;
+    }
+}
+
+/// Reads the input state of all devices into 'snapshot'. The tracking state of tracked
+/// remotes and hands is read for 'absTimeInSeconds'; pass 0.0 for the most recent sample.
+/// Call once per frame. Returns the number of devices in the snapshot.
+static inline int xrInputCache_Update(
+    xrInputCache* cache,
+    xrMobile* xr,
+    const double absTimeInSeconds,
+    xrInputSnapshot* snapshot) {
+    memset(&cache->Stats, 0, sizeof(cache->Stats));
+
+    if (cache->ScanRequested || ++cache->UpdatesSinceScan >= cache->RescanInterval) {
+        xrInputCache_Scan(cache, xr);
+    }
+
+    snapshot->DeviceCount = cache->DeviceCount;
+    for (int i = 0; i < cache->DeviceCount; i++) {
+        xrInputCachedDevice* cached = &cache->Devices[i];
+        const xrInputCapabilities_Union* caps = &cached->Capabilities;
+        xrInputDeviceSnapshot* device = &snapshot->Devices[i];
+
+        device->DeviceID = caps->Header.DeviceID;
+        device->Type = caps->Header.Type;
+        // The capability structures of all types start with the same two masks.
+        device->ControllerCapabilities = caps->TrackedRemote.ControllerCapabilities;
+        device->ButtonCapabilities = caps->TrackedRemote.ButtonCapabilities;
+        device->Flags = cached->HasButtons ? 0 : XRAPI_INPUT_SNAPSHOT_NEW_DEVICE;
+
+        uint32_t buttons = 0;
+        device->State.Header.ControllerType = caps->Header.Type;
+        device->State.Header.TimeInSeconds = 0.0;
+        cache->Stats.StateCalls++;
+        if (xrapiGetCurrentInputState(xr, caps->Header.DeviceID, &device->State.Header) >= 0) {
+            device->Flags |= XRAPI_INPUT_SNAPSHOT_STATE_VALID;
+            buttons = xrInputCache_GetButtons(&device->State);
+        } else {
+            // The device went away, find out which devices are left on the next update.
+            cache->ScanRequested = true;
+        }
+
+        const uint32_t previous = cached->HasButtons ? cached->Buttons : buttons;
+        device->Buttons = buttons;
+        device->Pressed = buttons & ~previous;
+        device->Released = previous & ~buttons;
+        cached->Buttons = buttons;
+        cached->HasButtons = true;
+
+        memset(&device->Tracking, 0, sizeof(device->Tracking));
+        if (cached->Tracked) {
+            cache->Stats.TrackingCalls++;
+            if (xrapiGetInputTrackingState(
+                    xr, caps->Header.DeviceID, absTimeInSeconds, &device->Tracking) >= 0) {
+                device->Flags |= XRAPI_INPUT_SNAPSHOT_TRACKING_VALID;
+            }
+        }
+    }
+
+    cache->TotalUpdates++;
+    cache->TotalCalls += cache->Stats.EnumerateCalls + cache->Stats.CapabilityCalls +
+        cache->Stats.StateCalls + cache->Stats.TrackingCalls;
+    return snapshot->DeviceCount;
+}
+
+/// Returns the first device of 'type' with all of 'capabilities' set in its controller
+/// capabilities, or NULL. For instance xrControllerCaps_LeftHand finds the left controller.
+static inline const xrInputDeviceSnapshot* xrInputSnapshot_FindDevice(
+    const xrInputSnapshot* snapshot,
+    const xrControllerType type,
+    const uint32_t capabilities) {
+    for (int i = 0; i < snapshot->DeviceCount; i++) {
+        const xrInputDeviceSnapshot* device = &snapshot->Devices[i];
+        if (device->Type == type &&
+            (device->ControllerCapabilities & capabilities) == capabilities) {
+            return device;
+        }
+    }
+    return NULL;
+}
+
+#endif // XR_XrApiInputSnapshot_h
@@ -0,0 +1,171 @@
+
+#ifndef XR_XrApiInstancePacking_h
+#define XR_XrApiInstancePacking_h
+
+#include "math.h" // for lrintf()
+#include "string.h" // for memcpy()
+#include "XrApiConfig.h"
+#include "XrApiTypes.h"
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+/*
+Compact per-instance transform for instanced rendering of rigid objects.
+
+A rigid transform is uploaded as a unit quaternion in four signed normalized 16-bit integers
+and a position in four half floats, 16 bytes per instance instead of the 64 bytes of a
+4x4 matrix. The vertex shader reads the orientation as a normalized GL_SHORT attribute and
+the position as a GL_HALF_FLOAT attribute, and rotates with
+
+    p + 2.0 * cross( q.xyz, cross( q.xyz, p ) + q.w * p )
+
+Orientations are rounded to the nearest 1/32767, which is well below a pixel for objects of
+a few meters. Half float positions have 11 significant bits, so they suit objects within a
+few tens of meters of the origin that do not move by small amounts every frame.
+
+The packers round to nearest even. The 64-bit ARM path uses NEON and is bit-exact with the
+scalar path for all inputs except NaN payloads. The unpackers decode the way OpenGL ES 3.0
+converts the attributes, so they can be used to check the packed data on the CPU.
+*/
+
+/// Transform of one instance as laid out in the instance attribute buffer.
+typedef struct xrPackedInstance_ {
+    // Unit quaternion x, y, z, w as signed normalized 16-bit integers.
+    int16_t Orientation[4];
+    // Position x, y, z as half floats, and 1.0 in w.
+    uint16_t Position[4];
+} xrPackedInstance;
+
+/// Converts to a half float, rounding to nearest even. Values too large for a half float
+/// become infinity.
+static inline uint16_t xrPackedInstance_FloatToHalf(const float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    const uint32_t sign = (bits >> 16) & 0x8000;
+    bits &= 0x7FFFFFFF;
+
+    uint32_t half;
+    if (bits >= (143u << 23)) {
+        // Overflow, infinity or NaN.
+        half = (bits > 0x7F800000) ? 0x7E00 : 0x7C00;
+    } else if (bits < (113u << 23)) {
+        // Denormal or zero. Adding 0.5 shifts the mantissa into place and lets the float
+        // addition do the rounding.
+        const uint32_t magicBits = 126u << 23;
+        float magic;
+        float absValue;
+        memcpy(&magic, &magicBits, sizeof(magic));
+        memcpy(&absValue, &bits, sizeof(absValue));
+        absValue += magic;
+        memcpy(&bits, &absValue, sizeof(bits));
+        half = bits - magicBits;
+    } else {
+        // Normal. Rebias the exponent and round the mantissa to nearest even.
+        const uint32_t mantissaOdd = (bits >> 13) & 1;
+        bits += ((uint32_t)(15 - 127) << 23) + 0xFFF + mantissaOdd;
+        half = bits >> 13;
+    }
+    return (uint16_t)(half | sign);
+}
+
+static inline float xrPackedInstance_HalfToFloat(const uint16_t half) {
+    const uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+    const uint32_t exponent = (half >> 10) & 0x1F;
+    const uint32_t mantissa = half & 0x3FF;
+
+    float value;
+    if (exponent == 0) {
+        value = (float)mantissa * (1.0f / 16777216.0f);
+        value = sign ? -value : value;
+    } else {
+        const uint32_t bits = sign |
+            ((exponent == 0x1F) ? (0x7F800000 | (mantissa << 13))
+                                : (((exponent + 127 - 15) << 23) | (mantissa << 13)));
+        memcpy(&value, &bits, sizeof(value));
+    }
+    return value;
+}
+
+/// Converts to a signed normalized 16-bit integer, rounding the single precision product with
+/// 32767 to nearest even.
+static inline int16_t xrPackedInstance_FloatToSnorm16(const float value) {
+    const float clamped = (value > 1.0f) ? 1.0f : ((value < -1.0f) ? -1.0f : value);
+    return (int16_t)lrintf(clamped * 32767.0f);
+}
+
+/// Decodes like a normalized GL_SHORT vertex attribute.
+static inline float xrPackedInstance_Snorm16ToFloat(const int16_t value) {
+    const float f = (float)value / 32767.0f;
+    return (f < -1.0f) ? -1.0f : f;
+}
+
+/// Packs 'count' unit quaternions into four signed normalized 16-bit integers each.
+static inline void
+xrPackedInstance_PackOrientations(int16_t* dst, const xrQuatf* src, const int count) {
+    int i = 0;
+#if defined(__aarch64__)
+    const float32x4_t one = vdupq_n_f32(1.0f);
+    const float32x4_t minusOne = vdupq_n_f32(-1.0f);
+    for (; i < count; i++) {
+        float32x4_t q = vld1q_f32(&src[i].x);
+        q = vminq_f32(vmaxq_f32(q, minusOne), one);
+        const int32x4_t rounded = vcvtnq_s32_f32(vmulq_n_f32(q, 32767.0f));
+        vst1_s16(dst + i * 4, vmovn_s32(rounded));
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i * 4 + 0] = xrPackedInstance_FloatToSnorm16(src[i].x);
+        dst[i * 4 + 1] = xrPackedInstance_FloatToSnorm16(src[i].y);
+        dst[i * 4 + 2] = xrPackedInstance_FloatToSnorm16(src[i].z);
+        dst[i * 4 + 3] = xrPackedInstance_FloatToSnorm16(src[i].w);
+    }
+}
+
+/// Packs 'count' positions into four half floats each, with 1.0 in w.
+static inline void
+xrPackedInstance_PackPositions(uint16_t* dst, const xrVector3f* src, const int count) {
+    int i = 0;
+#if defined(__aarch64__)
+    for (; i + 4 <= count; i += 4) {
+        // Transpose three xyz triples in and four xyzw quads out.
+        const float32x4x3_t xyz = vld3q_f32(&src[i].x);
+        float32x4x4_t xyzw;
+        xyzw.val[0] = xyz.val[0];
+        xyzw.val[1] = xyz.val[1];
+        xyzw.val[2] = xyz.val[2];
+        xyzw.val[3] = vdupq_n_f32(1.0f);
+        uint16x4x4_t halves;
+        for (int c = 0; c < 4; c++) {
+            halves.val[c] = vreinterpret_u16_f16(vcvt_f16_f32(xyzw.val[c]));
+        }
+        vst4_u16(dst + i * 4, halves);
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i * 4 + 0] = xrPackedInstance_FloatToHalf(src[i].x);
+        dst[i * 4 + 1] = xrPackedInstance_FloatToHalf(src[i].y);
+        dst[i * 4 + 2] = xrPackedInstance_FloatToHalf(src[i].z);
+        dst[i * 4 + 3] = 0x3C00; // 1.0
+    }
+}
+
+static inline xrQuatf xrPackedInstance_UnpackOrientation(const xrPackedInstance* instance) {
+    xrQuatf q;
+    q.x = xrPackedInstance_Snorm16ToFloat(instance->Orientation[0]);
+    q.y = xrPackedInstance_Snorm16ToFloat(instance->Orientation[1]);
+    q.z = xrPackedInstance_Snorm16ToFloat(instance->Orientation[2]);
+    q.w = xrPackedInstance_Snorm16ToFloat(instance->Orientation[3]);
+    return q;
+}
+
+static inline xrVector3f xrPackedInstance_UnpackPosition(const xrPackedInstance* instance) {
+    xrVector3f p;
+    p.x = xrPackedInstance_HalfToFloat(instance->Position[0]);
+    p.y = xrPackedInstance_HalfToFloat(instance->Position[1]);
+    p.z = xrPackedInstance_HalfToFloat(instance->Position[2]);
+    return p;
+}
+
+#endif // XR_XrApiInstancePacking_h
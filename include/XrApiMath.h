@@ -0,0 +1,750 @@
+
+#ifndef XR_XrApiMath_h
+#define XR_XrApiMath_h
+
+#include "math.h" // for sqrtf(), acosf(), sinf(), cosf(), atan2f()
+#include "string.h" // for memcpy()
+#include "XrApiConfig.h"
+#include "XrApiTypes.h"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/*
+Quaternion and rigid pose math.
+
+Rotating, composing and inverting poses directly on xrQuatf and xrPosef avoids building a
+4x4 matrix for every step. A pose maps a point from its local space into its parent space
+by rotating and then translating it, which matches xrapiGetTransformFromPose(), so
+
+    xrPosef_Transform( pose, p ) == Translation * Rotation * p
+    xrPosef_Multiply( a, b )     == Transform( a ) * Transform( b )
+
+Quaternions are Hamilton quaternions with w last, the same convention as
+xrMatrix4f_CreateFromQuaternion(). Orientations are expected to be unit length; only
+xrQuatf_Normalize() and xrQuatf_Inverse() accept other lengths.
+
+The batch functions process arrays of poses stored as one array per component (structure
+of arrays), so that four poses fit one NEON register per component and no shuffling is
+needed. The arrays are owned by the caller. The output may be the same arrays as an input,
+but not partially overlapping arrays. Targets without NEON fall back to the scalar
+functions.
+*/
+
+//-----------------------------------------------------------------
+// Sine and cosine.
+//-----------------------------------------------------------------
+
+typedef enum xrSinCosAccuracy_ {
+    // Within 2 ulp of the correctly rounded result, like sinf() and cosf().
+    XRAPI_SINCOS_ACCURACY_FULL = 0,
+    // Absolute error below 1.5e-5, and within 208 ulp, with two fewer multiply-adds. This is
+    // less than the quantization of a 16-bit normalized rotation.
+    XRAPI_SINCOS_ACCURACY_FAST = 1,
+} xrSinCosAccuracy;
+
+/// Arguments up to this magnitude are reduced with a four part pi / 2 without loss of
+/// accuracy. Larger arguments, infinities and NaNs are passed to sinf() and cosf().
+#define XRAPI_SINCOS_MAX_ARGUMENT 8192.0f
+
+/*
+The argument is reduced to r = x - k * pi / 2 with |r| <= pi / 4 and k the nearest integer,
+sin( r ) and cos( r ) are evaluated with minimax polynomials in r^2, and the quadrant k mod 4
+selects and negates them. The reduction subtracts pi / 2 in four parts, the first three with
+few enough bits that k times them is exact for |k| < 2^13. The last part keeps the results
+near the zeros of sine and cosine accurate up to XRAPI_SINCOS_MAX_ARGUMENT.
+
+The FULL polynomials are the ones from the Cephes sinf() and cosf(). Everything is branch
+free, so on targets without NEON the portable loop vectorizes as well, 4 or 8 wide with
+SSE or AVX.
+*/
+
+// The scalar versions select with integer masks rather than float compares, because
+// compilers do not if-convert a float compare that may raise an exception, and the loops
+// would not vectorize.
+static inline float xrSinCos_Reduce(const float radians, int* quadrant) {
+    const float limit = XRAPI_SINCOS_MAX_ARGUMENT;
+    uint32_t bits;
+    uint32_t limitBits;
+    memcpy(&bits, &radians, sizeof(bits));
+    memcpy(&limitBits, &limit, sizeof(limitBits));
+    // Also false for NaN.
+    const uint32_t inRange = ((bits & 0x7FFFFFFF) <= limitBits) ? 0xFFFFFFFF : 0;
+    bits &= inRange;
+    // Round half away from zero: add 0.5 with the sign of x and truncate.
+    const uint32_t halfBits = (bits & 0x80000000) | 0x3F000000;
+    float x;
+    float half;
+    memcpy(&x, &bits, sizeof(x));
+    memcpy(&half, &halfBits, sizeof(half));
+    const int k = (int)(x * 0.636619772367581343f + half);
+    const float kf = (float)k;
+    *quadrant = k;
+    const float r = (x - kf * 1.5703125f) - kf * 4.837512969970703125e-4f;
+    return (r - kf * 7.549533620476723e-8f) - kf * 2.5633440682570896e-12f;
+}
+
+static inline void xrSinCos_Quadrant(
+    const float s,
+    const float c,
+    const int quadrant,
+    float* sine,
+    float* cosine) {
+    uint32_t sBits;
+    uint32_t cBits;
+    memcpy(&sBits, &s, sizeof(sBits));
+    memcpy(&cBits, &c, sizeof(cBits));
+    const uint32_t swap = (quadrant & 1) ? 0xFFFFFFFF : 0;
+    // Bit 1 of the quadrant moved to the sign bit.
+    const uint32_t sinSign = ((uint32_t)quadrant << 30) & 0x80000000;
+    const uint32_t cosSign = ((uint32_t)(quadrant + 1) << 30) & 0x80000000;
+    const uint32_t sinBits = ((cBits & swap) | (sBits & ~swap)) ^ sinSign;
+    const uint32_t cosBits = ((sBits & swap) | (cBits & ~swap)) ^ cosSign;
+    memcpy(sine, &sinBits, sizeof(*sine));
+    memcpy(cosine, &cosBits, sizeof(*cosine));
+}
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+static inline float32x4_t xrSinCosx4_Reduce(const float32x4_t radians, int32x4_t* quadrant) {
+    const float32x4_t limit = vdupq_n_f32(XRAPI_SINCOS_MAX_ARGUMENT);
+    // Also false for NaN.
+    const uint32x4_t inRange = vcleq_f32(vabsq_f32(radians), limit);
+    const float32x4_t x = vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(radians), inRange));
+    // Round half away from zero: add 0.5 with the sign of x and truncate.
+    const uint32x4_t signBit = vandq_u32(vreinterpretq_u32_f32(x), vdupq_n_u32(0x80000000));
+    const float32x4_t half =
+        vreinterpretq_f32_u32(vorrq_u32(signBit, vreinterpretq_u32_f32(vdupq_n_f32(0.5f))));
+    const int32x4_t k = vcvtq_s32_f32(vmlaq_n_f32(half, x, 0.636619772367581343f));
+    const float32x4_t kf = vcvtq_f32_s32(k);
+    float32x4_t r = vmlsq_n_f32(x, kf, 1.5703125f);
+    r = vmlsq_n_f32(r, kf, 4.837512969970703125e-4f);
+    r = vmlsq_n_f32(r, kf, 7.549533620476723e-8f);
+    r = vmlsq_n_f32(r, kf, 2.5633440682570896e-12f);
+    *quadrant = k;
+    return r;
+}
+
+static inline void xrSinCosx4_Quadrant(
+    const float32x4_t s,
+    const float32x4_t c,
+    const int32x4_t quadrant,
+    float32x4_t* sine,
+    float32x4_t* cosine) {
+    const uint32x4_t swap = vtstq_s32(quadrant, vdupq_n_s32(1));
+    // Bit 1 of the quadrant moved to the sign bit.
+    const uint32x4_t sinSign = vshlq_n_u32(vreinterpretq_u32_s32(quadrant), 30);
+    const uint32x4_t cosSign =
+        vshlq_n_u32(vreinterpretq_u32_s32(vaddq_s32(quadrant, vdupq_n_s32(1))), 30);
+    const uint32x4_t signMask = vdupq_n_u32(0x80000000);
+    const uint32x4_t sinBits = vreinterpretq_u32_f32(vbslq_f32(swap, c, s));
+    const uint32x4_t cosBits = vreinterpretq_u32_f32(vbslq_f32(swap, s, c));
+    *sine = vreinterpretq_f32_u32(veorq_u32(sinBits, vandq_u32(sinSign, signMask)));
+    *cosine = vreinterpretq_f32_u32(veorq_u32(cosBits, vandq_u32(cosSign, signMask)));
+}
+#endif
+
+/// Computes the sine and cosine of 'count' angles in radians. The outputs must not overlap
+/// the input.
+static inline void xrSinCos_Array(
+    float* sines,
+    float* cosines,
+    const float* radians,
+    const int count,
+    const xrSinCosAccuracy accuracy) {
+    int i = 0;
+    if (accuracy == XRAPI_SINCOS_ACCURACY_FAST) {
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+        for (; i + 4 <= count; i += 4) {
+            int32x4_t k;
+            const float32x4_t r = xrSinCosx4_Reduce(vld1q_f32(radians + i), &k);
+            const float32x4_t u = vmulq_f32(r, r);
+            const float32x4_t ps = vmlaq_n_f32(vdupq_n_f32(-1.6662833807e-1f), u, 8.1529923418e-3f);
+            const float32x4_t pc = vmlaq_n_f32(vdupq_n_f32(-4.9977630708e-1f), u, 4.0488935844e-2f);
+            const float32x4_t s = vmlaq_f32(r, vmulq_f32(r, u), ps);
+            const float32x4_t c = vmlaq_f32(vdupq_n_f32(1.0f), u, pc);
+            float32x4_t sine;
+            float32x4_t cosine;
+            xrSinCosx4_Quadrant(s, c, k, &sine, &cosine);
+            vst1q_f32(sines + i, sine);
+            vst1q_f32(cosines + i, cosine);
+        }
+#endif
+        for (; i < count; i++) {
+            int k;
+            const float r = xrSinCos_Reduce(radians[i], &k);
+            const float u = r * r;
+            const float s = r + r * u * (-1.6662833807e-1f + u * 8.1529923418e-3f);
+            const float c = 1.0f + u * (-4.9977630708e-1f + u * 4.0488935844e-2f);
+            xrSinCos_Quadrant(s, c, k, &sines[i], &cosines[i]);
+        }
+    } else {
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+        for (; i + 4 <= count; i += 4) {
+            int32x4_t k;
+            const float32x4_t r = xrSinCosx4_Reduce(vld1q_f32(radians + i), &k);
+            const float32x4_t u = vmulq_f32(r, r);
+            float32x4_t ps = vmlaq_n_f32(vdupq_n_f32(8.3321608736e-3f), u, -1.9515295891e-4f);
+            ps = vmlaq_f32(vdupq_n_f32(-1.6666654611e-1f), u, ps);
+            float32x4_t pc = vmlaq_n_f32(vdupq_n_f32(-1.38873163e-3f), u, 2.44331571e-5f);
+            pc = vmlaq_f32(vdupq_n_f32(4.16666457e-2f), u, pc);
+            const float32x4_t s = vmlaq_f32(r, vmulq_f32(r, u), ps);
+            const float32x4_t c =
+                vmlaq_f32(vmlsq_n_f32(vdupq_n_f32(1.0f), u, 0.5f), vmulq_f32(u, u), pc);
+            float32x4_t sine;
+            float32x4_t cosine;
+            xrSinCosx4_Quadrant(s, c, k, &sine, &cosine);
+            vst1q_f32(sines + i, sine);
+            vst1q_f32(cosines + i, cosine);
+        }
+#endif
+        for (; i < count; i++) {
+            int k;
+            const float r = xrSinCos_Reduce(radians[i], &k);
+            const float u = r * r;
+            const float s = r +
+                r * u * (-1.6666654611e-1f + u * (8.3321608736e-3f + u * -1.9515295891e-4f));
+            const float c = (1.0f - 0.5f * u) +
+                u * u * (4.16666457e-2f + u * (-1.38873163e-3f + u * 2.44331571e-5f));
+            xrSinCos_Quadrant(s, c, k, &sines[i], &cosines[i]);
+        }
+    }
+    // Kept out of the loops above so that they stay branch free.
+    for (i = 0; i < count; i++) {
+        if (!(radians[i] >= -XRAPI_SINCOS_MAX_ARGUMENT &&
+              radians[i] <= XRAPI_SINCOS_MAX_ARGUMENT)) {
+            sines[i] = sinf(radians[i]);
+            cosines[i] = cosf(radians[i]);
+        }
+    }
+}
+
+//-----------------------------------------------------------------
+// Quaternions.
+//-----------------------------------------------------------------
+
+static inline xrQuatf xrQuatf_CreateIdentity() {
+    const xrQuatf q = {0.0f, 0.0f, 0.0f, 1.0f};
+    return q;
+}
+
+/// Returns the rotation of 'radians' about the unit length 'axis', counter clockwise when
+/// looking down the axis.
+static inline xrQuatf xrQuatf_CreateFromAxisAngle(const xrVector3f* axis, const float radians) {
+    const float s = sinf(radians * 0.5f);
+    const xrQuatf q = {axis->x * s, axis->y * s, axis->z * s, cosf(radians * 0.5f)};
+    return q;
+}
+
+static inline float xrQuatf_Dot(const xrQuatf* a, const xrQuatf* b) {
+    return a->x * b->x + a->y * b->y + a->z * b->z + a->w * b->w;
+}
+
+/// Returns the rotation that applies 'b' first and then 'a'.
+static inline xrQuatf xrQuatf_Multiply(const xrQuatf* a, const xrQuatf* b) {
+    xrQuatf out;
+    out.x = a->w * b->x + a->x * b->w + a->y * b->z - a->z * b->y;
+    out.y = a->w * b->y - a->x * b->z + a->y * b->w + a->z * b->x;
+    out.z = a->w * b->z + a->x * b->y - a->y * b->x + a->z * b->w;
+    out.w = a->w * b->w - a->x * b->x - a->y * b->y - a->z * b->z;
+    return out;
+}
+
+/// The inverse of a unit quaternion.
+static inline xrQuatf xrQuatf_Conjugate(const xrQuatf* q) {
+    const xrQuatf out = {-q->x, -q->y, -q->z, q->w};
+    return out;
+}
+
+/// The inverse of a quaternion of any length other than zero.
+static inline xrQuatf xrQuatf_Inverse(const xrQuatf* q) {
+    const float scale = 1.0f / xrQuatf_Dot(q, q);
+    const xrQuatf out = {-q->x * scale, -q->y * scale, -q->z * scale, q->w * scale};
+    return out;
+}
+
+/// Returns 'q' scaled to unit length, or the identity if 'q' is too close to zero.
+static inline xrQuatf xrQuatf_Normalize(const xrQuatf* q) {
+    const float lengthSq = xrQuatf_Dot(q, q);
+    if (lengthSq < 1e-12f) {
+        return xrQuatf_CreateIdentity();
+    }
+    const float scale = 1.0f / sqrtf(lengthSq);
+    const xrQuatf out = {q->x * scale, q->y * scale, q->z * scale, q->w * scale};
+    return out;
+}
+
+/// Normalized linear interpolation along the shortest arc. The rotation does not advance at
+/// a constant rate, but for angles of a few degrees the result is within rounding of slerp.
+static inline xrQuatf xrQuatf_Nlerp(const xrQuatf* a, const xrQuatf* b, const float t) {
+    const float tb = (xrQuatf_Dot(a, b) < 0.0f) ? -t : t;
+    const float ta = 1.0f - t;
+    const xrQuatf out = {
+        ta * a->x + tb * b->x, ta * a->y + tb * b->y, ta * a->z + tb * b->z, ta * a->w + tb * b->w};
+    return xrQuatf_Normalize(&out);
+}
+
+/// Spherical linear interpolation along the shortest arc.
+static inline xrQuatf xrQuatf_Slerp(const xrQuatf* a, const xrQuatf* b, const float t) {
+    const float dot = xrQuatf_Dot(a, b);
+    const float cosAngle = (dot < 0.0f) ? -dot : dot;
+    if (cosAngle > 0.9995f) {
+        // sin( angle ) is too small to divide by.
+        return xrQuatf_Nlerp(a, b, t);
+    }
+    const float angle = acosf(cosAngle);
+    const float scale = 1.0f / sinf(angle);
+    const float ta = sinf((1.0f - t) * angle) * scale;
+    const float tb = sinf(t * angle) * scale * ((dot < 0.0f) ? -1.0f : 1.0f);
+    const xrQuatf out = {
+        ta * a->x + tb * b->x, ta * a->y + tb * b->y, ta * a->z + tb * b->z, ta * a->w + tb * b->w};
+    return out;
+}
+
+/// Rotates 'v' by the unit quaternion 'q'.
+static inline xrVector3f xrQuatf_Rotate(const xrQuatf* q, const xrVector3f* v) {
+    // v + w * t + cross( q.xyz, t ) with t = 2 * cross( q.xyz, v )
+    const float tx = 2.0f * (q->y * v->z - q->z * v->y);
+    const float ty = 2.0f * (q->z * v->x - q->x * v->z);
+    const float tz = 2.0f * (q->x * v->y - q->y * v->x);
+    xrVector3f out;
+    out.x = v->x + q->w * tx + (q->y * tz - q->z * ty);
+    out.y = v->y + q->w * ty + (q->z * tx - q->x * tz);
+    out.z = v->z + q->w * tz + (q->x * ty - q->y * tx);
+    return out;
+}
+
+/// Rotation vector (axis * angle) of the rotation taking 'from' to 'to', expressed in the
+/// space 'from' and 'to' are expressed in.
+static inline xrVector3f xrQuatf_DeltaRotation(const xrQuatf* from, const xrQuatf* to) {
+    const xrQuatf fromInverse = xrQuatf_Conjugate(from);
+    xrQuatf delta = xrQuatf_Multiply(to, &fromInverse);
+    if (delta.w < 0.0f) {
+        delta.x = -delta.x;
+        delta.y = -delta.y;
+        delta.z = -delta.z;
+        delta.w = -delta.w;
+    }
+    const float sinHalf = sqrtf(delta.x * delta.x + delta.y * delta.y + delta.z * delta.z);
+    xrVector3f out = {0.0f, 0.0f, 0.0f};
+    if (sinHalf > 1e-7f) {
+        const float scale = 2.0f * atan2f(sinHalf, delta.w) / sinHalf;
+        out.x = delta.x * scale;
+        out.y = delta.y * scale;
+        out.z = delta.z * scale;
+    } else {
+        // First order for tiny angles.
+        out.x = 2.0f * delta.x;
+        out.y = 2.0f * delta.y;
+        out.z = 2.0f * delta.z;
+    }
+    return out;
+}
+
+/// Applies the rotation vector 'rotation' on the left of 'q'.
+static inline xrQuatf xrQuatf_Integrate(const xrQuatf* q, const xrVector3f* rotation) {
+    const float angle = sqrtf(
+        rotation->x * rotation->x + rotation->y * rotation->y + rotation->z * rotation->z);
+    if (angle < 1e-7f) {
+        return *q;
+    }
+    const float s = sinf(angle * 0.5f) / angle;
+    const xrQuatf delta = {rotation->x * s, rotation->y * s, rotation->z * s, cosf(angle * 0.5f)};
+    const xrQuatf out = xrQuatf_Multiply(&delta, q);
+    return xrQuatf_Normalize(&out);
+}
+
+//-----------------------------------------------------------------
+// Poses.
+//-----------------------------------------------------------------
+
+static inline xrPosef xrPosef_CreateIdentity() {
+    xrPosef pose;
+    pose.Orientation = xrQuatf_CreateIdentity();
+    pose.Position.x = 0.0f;
+    pose.Position.y = 0.0f;
+    pose.Position.z = 0.0f;
+    return pose;
+}
+
+/// Maps the point 'p' from the local space of 'pose' to its parent space.
+static inline xrVector3f xrPosef_Transform(const xrPosef* pose, const xrVector3f* p) {
+    xrVector3f out = xrQuatf_Rotate(&pose->Orientation, p);
+    out.x += pose->Position.x;
+    out.y += pose->Position.y;
+    out.z += pose->Position.z;
+    return out;
+}
+
+/// Returns the pose that applies 'b' first and then 'a', for instance the world pose of a
+/// child from the world pose 'a' of its parent and its pose 'b' relative to the parent.
+static inline xrPosef xrPosef_Multiply(const xrPosef* a, const xrPosef* b) {
+    xrPosef out;
+    out.Orientation = xrQuatf_Multiply(&a->Orientation, &b->Orientation);
+    out.Position = xrPosef_Transform(a, &b->Position);
+    return out;
+}
+
+static inline xrPosef xrPosef_Inverse(const xrPosef* pose) {
+    xrPosef out;
+    out.Orientation = xrQuatf_Conjugate(&pose->Orientation);
+    const xrVector3f p = xrQuatf_Rotate(&out.Orientation, &pose->Position);
+    out.Position.x = -p.x;
+    out.Position.y = -p.y;
+    out.Position.z = -p.z;
+    return out;
+}
+
+//-----------------------------------------------------------------
+// Batches stored as one array per component.
+//-----------------------------------------------------------------
+
+typedef struct xrVector3fSoA_ {
+    float* x;
+    float* y;
+    float* z;
+} xrVector3fSoA;
+
+typedef struct xrQuatfSoA_ {
+    float* x;
+    float* y;
+    float* z;
+    float* w;
+} xrQuatfSoA;
+
+typedef struct xrPosefSoA_ {
+    xrQuatfSoA Orientation;
+    xrVector3fSoA Position;
+} xrPosefSoA;
+
+static inline xrQuatf xrQuatfSoA_Get(const xrQuatfSoA* soa, const int i) {
+    const xrQuatf q = {soa->x[i], soa->y[i], soa->z[i], soa->w[i]};
+    return q;
+}
+
+static inline void xrQuatfSoA_Set(const xrQuatfSoA* soa, const int i, const xrQuatf* q) {
+    soa->x[i] = q->x;
+    soa->y[i] = q->y;
+    soa->z[i] = q->z;
+    soa->w[i] = q->w;
+}
+
+static inline xrVector3f xrVector3fSoA_Get(const xrVector3fSoA* soa, const int i) {
+    const xrVector3f v = {soa->x[i], soa->y[i], soa->z[i]};
+    return v;
+}
+
+static inline void xrVector3fSoA_Set(const xrVector3fSoA* soa, const int i, const xrVector3f* v) {
+    soa->x[i] = v->x;
+    soa->y[i] = v->y;
+    soa->z[i] = v->z;
+}
+
+static inline xrPosef xrPosefSoA_Get(const xrPosefSoA* soa, const int i) {
+    xrPosef pose;
+    pose.Orientation = xrQuatfSoA_Get(&soa->Orientation, i);
+    pose.Position = xrVector3fSoA_Get(&soa->Position, i);
+    return pose;
+}
+
+static inline void xrPosefSoA_Set(const xrPosefSoA* soa, const int i, const xrPosef* pose) {
+    xrQuatfSoA_Set(&soa->Orientation, i, &pose->Orientation);
+    xrVector3fSoA_Set(&soa->Position, i, &pose->Position);
+}
+
+/// Copies 'count' poses into the component arrays.
+static inline void xrPosefSoA_Load(const xrPosefSoA* dst, const xrPosef* src, const int count) {
+    for (int i = 0; i < count; i++) {
+        xrPosefSoA_Set(dst, i, &src[i]);
+    }
+}
+
+/// Copies 'count' poses out of the component arrays.
+static inline void xrPosefSoA_Store(xrPosef* dst, const xrPosefSoA* src, const int count) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = xrPosefSoA_Get(src, i);
+    }
+}
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+// Four quaternions or vectors, one register per component.
+typedef struct xrQuatfx4_ {
+    float32x4_t x, y, z, w;
+} xrQuatfx4;
+
+typedef struct xrVector3fx4_ {
+    float32x4_t x, y, z;
+} xrVector3fx4;
+
+static inline xrQuatfx4 xrQuatfx4_Load(const xrQuatfSoA* soa, const int i) {
+    xrQuatfx4 q;
+    q.x = vld1q_f32(soa->x + i);
+    q.y = vld1q_f32(soa->y + i);
+    q.z = vld1q_f32(soa->z + i);
+    q.w = vld1q_f32(soa->w + i);
+    return q;
+}
+
+static inline void xrQuatfx4_Store(const xrQuatfSoA* soa, const int i, const xrQuatfx4 q) {
+    vst1q_f32(soa->x + i, q.x);
+    vst1q_f32(soa->y + i, q.y);
+    vst1q_f32(soa->z + i, q.z);
+    vst1q_f32(soa->w + i, q.w);
+}
+
+static inline xrVector3fx4 xrVector3fx4_Load(const xrVector3fSoA* soa, const int i) {
+    xrVector3fx4 v;
+    v.x = vld1q_f32(soa->x + i);
+    v.y = vld1q_f32(soa->y + i);
+    v.z = vld1q_f32(soa->z + i);
+    return v;
+}
+
+static inline void xrVector3fx4_Store(const xrVector3fSoA* soa, const int i, const xrVector3fx4 v) {
+    vst1q_f32(soa->x + i, v.x);
+    vst1q_f32(soa->y + i, v.y);
+    vst1q_f32(soa->z + i, v.z);
+}
+
+static inline xrQuatfx4 xrQuatfx4_Multiply(const xrQuatfx4 a, const xrQuatfx4 b) {
+    xrQuatfx4 out;
+    out.x = vmlsq_f32(vmlaq_f32(vmlaq_f32(vmulq_f32(a.w, b.x), a.x, b.w), a.y, b.z), a.z, b.y);
+    out.y = vmlaq_f32(vmlaq_f32(vmlsq_f32(vmulq_f32(a.w, b.y), a.x, b.z), a.y, b.w), a.z, b.x);
+    out.z = vmlaq_f32(vmlsq_f32(vmlaq_f32(vmulq_f32(a.w, b.z), a.x, b.y), a.y, b.x), a.z, b.w);
+    out.w = vmlsq_f32(vmlsq_f32(vmlsq_f32(vmulq_f32(a.w, b.w), a.x, b.x), a.y, b.y), a.z, b.z);
+    return out;
+}
+
+static inline xrVector3fx4 xrQuatfx4_Rotate(const xrQuatfx4 q, const xrVector3fx4 v) {
+    const float32x4_t tx = vmulq_n_f32(vmlsq_f32(vmulq_f32(q.y, v.z), q.z, v.y), 2.0f);
+    const float32x4_t ty = vmulq_n_f32(vmlsq_f32(vmulq_f32(q.z, v.x), q.x, v.z), 2.0f);
+    const float32x4_t tz = vmulq_n_f32(vmlsq_f32(vmulq_f32(q.x, v.y), q.y, v.x), 2.0f);
+    xrVector3fx4 out;
+    out.x = vaddq_f32(vmlaq_f32(v.x, q.w, tx), vmlsq_f32(vmulq_f32(q.y, tz), q.z, ty));
+    out.y = vaddq_f32(vmlaq_f32(v.y, q.w, ty), vmlsq_f32(vmulq_f32(q.z, tx), q.x, tz));
+    out.z = vaddq_f32(vmlaq_f32(v.z, q.w, tz), vmlsq_f32(vmulq_f32(q.x, ty), q.y, tx));
+    return out;
+}
+#endif
+
+/// out[i] = a[i] * b[i] for 'count' poses.
+static inline void xrPosefSoA_Multiply(
+    const xrPosefSoA* out,
+    const xrPosefSoA* a,
+    const xrPosefSoA* b,
+    const int count) {
+    int i = 0;
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    for (; i + 4 <= count; i += 4) {
+        const xrQuatfx4 aq = xrQuatfx4_Load(&a->Orientation, i);
+        const xrQuatfx4 bq = xrQuatfx4_Load(&b->Orientation, i);
+        const xrVector3fx4 ap = xrVector3fx4_Load(&a->Position, i);
+        const xrVector3fx4 bp = xrVector3fx4_Load(&b->Position, i);
+        xrVector3fx4 p = xrQuatfx4_Rotate(aq, bp);
+        p.x = vaddq_f32(p.x, ap.x);
+        p.y = vaddq_f32(p.y, ap.y);
+        p.z = vaddq_f32(p.z, ap.z);
+        xrQuatfx4_Store(&out->Orientation, i, xrQuatfx4_Multiply(aq, bq));
+        xrVector3fx4_Store(&out->Position, i, p);
+    }
+#endif
+    for (; i < count; i++) {
+        const xrPosef pa = xrPosefSoA_Get(a, i);
+        const xrPosef pb = xrPosefSoA_Get(b, i);
+        const xrPosef pose = xrPosef_Multiply(&pa, &pb);
+        xrPosefSoA_Set(out, i, &pose);
+    }
+}
+
+/// out[i] = inverse( in[i] ) for 'count' poses.
+static inline void
+xrPosefSoA_Inverse(const xrPosefSoA* out, const xrPosefSoA* in, const int count) {
+    int i = 0;
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    for (; i + 4 <= count; i += 4) {
+        xrQuatfx4 q = xrQuatfx4_Load(&in->Orientation, i);
+        q.x = vnegq_f32(q.x);
+        q.y = vnegq_f32(q.y);
+        q.z = vnegq_f32(q.z);
+        xrVector3fx4 p = xrQuatfx4_Rotate(q, xrVector3fx4_Load(&in->Position, i));
+        p.x = vnegq_f32(p.x);
+        p.y = vnegq_f32(p.y);
+        p.z = vnegq_f32(p.z);
+        xrQuatfx4_Store(&out->Orientation, i, q);
+        xrVector3fx4_Store(&out->Position, i, p);
+    }
+#endif
+    for (; i < count; i++) {
+        const xrPosef pose = xrPosefSoA_Get(in, i);
+        const xrPosef inverse = xrPosef_Inverse(&pose);
+        xrPosefSoA_Set(out, i, &inverse);
+    }
+}
+
+/// Maps 'count' points from the local space of 'pose' to its parent space. The rotation is
+/// expanded to a 3x3 matrix once, which takes fewer operations per point than the
+/// quaternion.
+static inline void xrPosef_TransformPoints(
+    const xrVector3fSoA* out,
+    const xrPosef* pose,
+    const xrVector3fSoA* in,
+    const int count) {
+    const xrQuatf* q = &pose->Orientation;
+    const float ww = q->w * q->w;
+    const float xx = q->x * q->x;
+    const float yy = q->y * q->y;
+    const float zz = q->z * q->z;
+    const float m[3][4] = {
+        {ww + xx - yy - zz,
+         2 * (q->x * q->y - q->w * q->z),
+         2 * (q->x * q->z + q->w * q->y),
+         pose->Position.x},
+        {2 * (q->x * q->y + q->w * q->z),
+         ww - xx + yy - zz,
+         2 * (q->y * q->z - q->w * q->x),
+         pose->Position.y},
+        {2 * (q->x * q->z - q->w * q->y),
+         2 * (q->y * q->z + q->w * q->x),
+         ww - xx - yy + zz,
+         pose->Position.z}};
+    int i = 0;
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    for (; i + 4 <= count; i += 4) {
+        const xrVector3fx4 p = xrVector3fx4_Load(in, i);
+        xrVector3fx4 r;
+        r.x = vmlaq_n_f32(vdupq_n_f32(m[0][3]), p.x, m[0][0]);
+        r.y = vmlaq_n_f32(vdupq_n_f32(m[1][3]), p.x, m[1][0]);
+        r.z = vmlaq_n_f32(vdupq_n_f32(m[2][3]), p.x, m[2][0]);
+        r.x = vmlaq_n_f32(vmlaq_n_f32(r.x, p.y, m[0][1]), p.z, m[0][2]);
+        r.y = vmlaq_n_f32(vmlaq_n_f32(r.y, p.y, m[1][1]), p.z, m[1][2]);
+        r.z = vmlaq_n_f32(vmlaq_n_f32(r.z, p.y, m[2][1]), p.z, m[2][2]);
+        xrVector3fx4_Store(out, i, r);
+    }
+#endif
+    for (; i < count; i++) {
+        const float x = in->x[i];
+        const float y = in->y[i];
+        const float z = in->z[i];
+        out->x[i] = m[0][3] + x * m[0][0] + y * m[0][1] + z * m[0][2];
+        out->y[i] = m[1][3] + x * m[1][0] + y * m[1][1] + z * m[1][2];
+        out->z[i] = m[2][3] + x * m[2][0] + y * m[2][1] + z * m[2][2];
+    }
+}
+
+/// out[i] = xrQuatf_Nlerp( a[i], b[i], t ) for 'count' quaternions.
+static inline void xrQuatfSoA_Nlerp(
+    const xrQuatfSoA* out,
+    const xrQuatfSoA* a,
+    const xrQuatfSoA* b,
+    const float t,
+    const int count) {
+    int i = 0;
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    const float32x4_t ta = vdupq_n_f32(1.0f - t);
+    const float32x4_t tb = vdupq_n_f32(t);
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    for (; i + 4 <= count; i += 4) {
+        const xrQuatfx4 qa = xrQuatfx4_Load(a, i);
+        const xrQuatfx4 qb = xrQuatfx4_Load(b, i);
+        float32x4_t dot = vmulq_f32(qa.x, qb.x);
+        dot = vmlaq_f32(dot, qa.y, qb.y);
+        dot = vmlaq_f32(dot, qa.z, qb.z);
+        dot = vmlaq_f32(dot, qa.w, qb.w);
+        const float32x4_t sb = vbslq_f32(vcltq_f32(dot, zero), vnegq_f32(tb), tb);
+        xrQuatfx4 q;
+        q.x = vmlaq_f32(vmulq_f32(ta, qa.x), sb, qb.x);
+        q.y = vmlaq_f32(vmulq_f32(ta, qa.y), sb, qb.y);
+        q.z = vmlaq_f32(vmulq_f32(ta, qa.z), sb, qb.z);
+        q.w = vmlaq_f32(vmulq_f32(ta, qa.w), sb, qb.w);
+        // Along the shortest arc the length is at least sqrt( 1/2 ), so there is no zero to
+        // guard against. Reciprocal square root estimate refined by two Newton-Raphson steps.
+        float32x4_t lengthSq = vmulq_f32(q.x, q.x);
+        lengthSq = vmlaq_f32(lengthSq, q.y, q.y);
+        lengthSq = vmlaq_f32(lengthSq, q.z, q.z);
+        lengthSq = vmlaq_f32(lengthSq, q.w, q.w);
+        float32x4_t scale = vrsqrteq_f32(lengthSq);
+        scale = vmulq_f32(vrsqrtsq_f32(vmulq_f32(lengthSq, scale), scale), scale);
+        scale = vmulq_f32(vrsqrtsq_f32(vmulq_f32(lengthSq, scale), scale), scale);
+        q.x = vmulq_f32(q.x, scale);
+        q.y = vmulq_f32(q.y, scale);
+        q.z = vmulq_f32(q.z, scale);
+        q.w = vmulq_f32(q.w, scale);
+        xrQuatfx4_Store(out, i, q);
+    }
+#endif
+    for (; i < count; i++) {
+        const xrQuatf qa = xrQuatfSoA_Get(a, i);
+        const xrQuatf qb = xrQuatfSoA_Get(b, i);
+        const xrQuatf q = xrQuatf_Nlerp(&qa, &qb, t);
+        xrQuatfSoA_Set(out, i, &q);
+    }
+}
+
+/// out[i] = xrQuatf_Slerp( a[i], b[i], t ) for 'count' quaternions.
+///
+/// Instead of acos and sin the NEON path evaluates the series for the slerp weights from
+/// Eberly, "A Fast and Accurate Algorithm for Computing SLERP" (2011), which only needs
+/// multiply-adds. With eight terms the result is within 3e-5 of the exact one for inputs
+/// up to 180 degrees apart, and much closer for the small angles between animation samples.
+static inline void xrQuatfSoA_Slerp(
+    const xrQuatfSoA* out,
+    const xrQuatfSoA* a,
+    const xrQuatfSoA* b,
+    const float t,
+    const int count) {
+    int i = 0;
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    // The weight of an input with interpolation parameter s is
+    //     s * ( 1 + c[0] * ( 1 + c[1] * ( ... ( 1 + c[7] ) ) ) )
+    // with c[k] = ( s^2 / ( k ( 2k + 1 ) ) - k / ( 2k + 1 ) ) * ( dot - 1 ), counting k
+    // from 1. The last term is scaled to make up for the truncated series.
+    static const float correction = 1.85298109240830f;
+    const float sa = 1.0f - t;
+    const float sb = t;
+    // Only ( dot - 1 ) varies per quaternion, so the rest of each term is computed once.
+    float ca[8];
+    float cb[8];
+    for (int k = 1; k <= 8; k++) {
+        const float scale = (k == 8) ? correction : 1.0f;
+        const float u = scale / (float)(k * (2 * k + 1));
+        const float v = scale * (float)k / (float)(2 * k + 1);
+        ca[k - 1] = u * sa * sa - v;
+        cb[k - 1] = u * sb * sb - v;
+    }
+    const float32x4_t one = vdupq_n_f32(1.0f);
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    for (; i + 4 <= count; i += 4) {
+        const xrQuatfx4 qa = xrQuatfx4_Load(a, i);
+        const xrQuatfx4 qb = xrQuatfx4_Load(b, i);
+        float32x4_t dot = vmulq_f32(qa.x, qb.x);
+        dot = vmlaq_f32(dot, qa.y, qb.y);
+        dot = vmlaq_f32(dot, qa.z, qb.z);
+        dot = vmlaq_f32(dot, qa.w, qb.w);
+        const uint32x4_t negative = vcltq_f32(dot, zero);
+        const float32x4_t dotMinusOne = vsubq_f32(vabsq_f32(dot), one);
+        float32x4_t wa = one;
+        float32x4_t wb = one;
+        for (int k = 7; k >= 0; k--) {
+            wa = vmlaq_f32(one, vmulq_n_f32(dotMinusOne, ca[k]), wa);
+            wb = vmlaq_f32(one, vmulq_n_f32(dotMinusOne, cb[k]), wb);
+        }
+        wa = vmulq_n_f32(wa, sa);
+        wb = vmulq_n_f32(wb, sb);
+        wb = vbslq_f32(negative, vnegq_f32(wb), wb);
+        xrQuatfx4 q;
+        q.x = vmlaq_f32(vmulq_f32(wa, qa.x), wb, qb.x);
+        q.y = vmlaq_f32(vmulq_f32(wa, qa.y), wb, qb.y);
+        q.z = vmlaq_f32(vmulq_f32(wa, qa.z), wb, qb.z);
+        q.w = vmlaq_f32(vmulq_f32(wa, qa.w), wb, qb.w);
+        xrQuatfx4_Store(out, i, q);
+    }
+#endif
+    for (; i < count; i++) {
+        const xrQuatf qa = xrQuatfSoA_Get(a, i);
+        const xrQuatf qb = xrQuatfSoA_Get(b, i);
+        const xrQuatf q = xrQuatf_Slerp(&qa, &qb, t);
+        xrQuatfSoA_Set(out, i, &q);
+    }
+}
+
+#endif // XR_XrApiMath_h
@@ -0,0 +1,714 @@
+
+#ifndef XR_XrApiPoseFilter_h
+#define XR_XrApiPoseFilter_h
+
+#include "math.h" // for sqrtf()
+#include "string.h" // for memcpy(), memcmp(), memset()
+#include "XrApiConfig.h"
+#include "XrApiTypes.h"
+#include "XrApiInput.h"
+#include "XrApiHelpers.h"
+#include "XrApiMath.h"
+#include "XrApiControllerClient.h"
+
+/*
+Pose filters for noisy, low-rate tracking input.
+
+Hand tracking produces samples at a much lower rate than the display refresh, and every
+xrapiGetHandPose() call extrapolates the latest sample to the requested time. Filtering those
+extrapolated poses directly treats the same measurement as many measurements and amplifies
+the jitter. The filters here only take a new measurement when xrHandPose::SampleTimeStamp
+advances, use the capture-to-capture interval as the filter time step, and predict the
+filtered state forward to the frame's predicted display time.
+
+All state lives in fixed-size structures; nothing here allocates or calls into the runtime.
+*/
+
+//-----------------------------------------------------------------
+// One-Euro filter.
+//-----------------------------------------------------------------
+
+/// Tuning of a One-Euro filter (Casiez, Roussel, Vogel: "1 Euro Filter: A Simple Speed-based
+/// Low-pass Filter for Noisy Input in Interactive Systems", CHI 2012).
+/// The cutoff frequency rises linearly with the filtered speed, so the filter removes jitter
+/// when the input is still and adds little lag when it moves quickly.
+typedef struct xrOneEuroParms_ {
+    // Cutoff frequency in Hz used when the input is at rest. Lower means smoother.
+    float MinCutoff;
+    // Increase of the cutoff frequency per unit of speed (m/s or rad/s). Higher means less lag.
+    float Beta;
+    // Cutoff frequency in Hz of the low-pass filter applied to the speed estimate.
+    float DerivativeCutoff;
+} xrOneEuroParms;
+
+/// Smoothing factor of a first order low-pass filter with the given cutoff for time step dt.
+static inline float xrOneEuro_Alpha(const float cutoffHz, const float dt) {
+    const float tau = 1.0f / (2.0f * XRAPI_PI * cutoffHz);
+    return 1.0f / (1.0f + tau / dt);
+}
+
+/// One-Euro filter state for a position.
+typedef struct xrOneEuroVector3f_ {
+    xrVector3f Value;
+    xrVector3f Velocity; // filtered, in units per second
+} xrOneEuroVector3f;
+
+static inline void xrOneEuroVector3f_Reset(xrOneEuroVector3f* filter, const xrVector3f* value) {
+    filter->Value = *value;
+    filter->Velocity.x = 0.0f;
+    filter->Velocity.y = 0.0f;
+    filter->Velocity.z = 0.0f;
+}
+
+/// Feeds a new measurement taken dt seconds after the previous one.
+/// 'weight' in [0, 1] scales how much of the measurement is accepted; 0 holds the state.
+static inline void xrOneEuroVector3f_Update(
+    xrOneEuroVector3f* filter,
+    const xrOneEuroParms* parms,
+    const xrVector3f* value,
+    const float dt,
+    const float weight) {
+    const float alphaD = xrOneEuro_Alpha(parms->DerivativeCutoff, dt) * weight;
+    const float invDt = 1.0f / dt;
+    filter->Velocity.x += alphaD * ((value->x - filter->Value.x) * invDt - filter->Velocity.x);
+    filter->Velocity.y += alphaD * ((value->y - filter->Value.y) * invDt - filter->Velocity.y);
+    filter->Velocity.z += alphaD * ((value->z - filter->Value.z) * invDt - filter->Velocity.z);
+
+    const float speed = sqrtf(
+        filter->Velocity.x * filter->Velocity.x + filter->Velocity.y * filter->Velocity.y +
+        filter->Velocity.z * filter->Velocity.z);
+    const float alpha = xrOneEuro_Alpha(parms->MinCutoff + parms->Beta * speed, dt) * weight;
+    filter->Value.x += alpha * (value->x - filter->Value.x);
+    filter->Value.y += alpha * (value->y - filter->Value.y);
+    filter->Value.z += alpha * (value->z - filter->Value.z);
+}
+
+/// Returns the filtered position extrapolated 'seconds' ahead with the filtered velocity.
+static inline xrVector3f xrOneEuroVector3f_Predict(
+    const xrOneEuroVector3f* filter,
+    const float seconds) {
+    xrVector3f out = {
+        filter->Value.x + filter->Velocity.x * seconds,
+        filter->Value.y + filter->Velocity.y * seconds,
+        filter->Value.z + filter->Velocity.z * seconds};
+    return out;
+}
+
+/// One-Euro filter state for an orientation.
+typedef struct xrOneEuroQuatf_ {
+    xrQuatf Value;
+    xrVector3f AngularVelocity; // filtered, radians per second
+} xrOneEuroQuatf;
+
+static inline void xrOneEuroQuatf_Reset(xrOneEuroQuatf* filter, const xrQuatf* value) {
+    filter->Value = xrQuatf_Normalize(value);
+    filter->AngularVelocity.x = 0.0f;
+    filter->AngularVelocity.y = 0.0f;
+    filter->AngularVelocity.z = 0.0f;
+}
+
+/// Feeds a new measurement taken dt seconds after the previous one.
+/// 'weight' in [0, 1] scales how much of the measurement is accepted; 0 holds the state.
+static inline void xrOneEuroQuatf_Update(
+    xrOneEuroQuatf* filter,
+    const xrOneEuroParms* parms,
+    const xrQuatf* value,
+    const float dt,
+    const float weight) {
+    const xrVector3f delta = xrQuatf_DeltaRotation(&filter->Value, value);
+    const float alphaD = xrOneEuro_Alpha(parms->DerivativeCutoff, dt) * weight;
+    const float invDt = 1.0f / dt;
+    filter->AngularVelocity.x += alphaD * (delta.x * invDt - filter->AngularVelocity.x);
+    filter->AngularVelocity.y += alphaD * (delta.y * invDt - filter->AngularVelocity.y);
+    filter->AngularVelocity.z += alphaD * (delta.z * invDt - filter->AngularVelocity.z);
+
+    const float speed = sqrtf(
+        filter->AngularVelocity.x * filter->AngularVelocity.x +
+        filter->AngularVelocity.y * filter->AngularVelocity.y +
+        filter->AngularVelocity.z * filter->AngularVelocity.z);
+    const float alpha = xrOneEuro_Alpha(parms->MinCutoff + parms->Beta * speed, dt) * weight;
+    filter->Value = xrQuatf_Nlerp(&filter->Value, value, alpha);
+}
+
+/// Returns the filtered orientation extrapolated 'seconds' ahead with the filtered velocity.
+static inline xrQuatf xrOneEuroQuatf_Predict(const xrOneEuroQuatf* filter, const float seconds) {
+    const xrVector3f rotation = {
+        filter->AngularVelocity.x * seconds,
+        filter->AngularVelocity.y * seconds,
+        filter->AngularVelocity.z * seconds};
+    return xrQuatf_Integrate(&filter->Value, &rotation);
+}
+
+//-----------------------------------------------------------------
+// Constant velocity Kalman filter.
+//-----------------------------------------------------------------
+
+/// Tuning of a constant velocity Kalman filter. The state of each axis is a value and its
+/// rate of change, driven by white noise acceleration.
+/// The ratio of the two noise levels sets the trade-off: a larger AccelerationNoise follows
+/// changes of speed sooner, a larger MeasurementNoise smooths more.
+typedef struct xrKalmanParms_ {
+    // Standard deviation of a measurement, in meters or radians.
+    float MeasurementNoise;
+    // Spectral density of the acceleration, in m/s^2 or rad/s^2 per square root of Hz.
+    float AccelerationNoise;
+} xrKalmanParms;
+
+/// Covariance of the value and rate of one axis. All axes of a position or orientation use
+/// the same parameters and time steps, so they share a single covariance.
+typedef struct xrKalmanCovariance_ {
+    float ValueValue;
+    float ValueRate;
+    float RateRate;
+} xrKalmanCovariance;
+
+/// Covariance after a reset: the value is as certain as a measurement, the rate unknown.
+static inline xrKalmanCovariance xrKalmanCovariance_Create(const xrKalmanParms* parms) {
+    xrKalmanCovariance covariance;
+    covariance.ValueValue = parms->MeasurementNoise * parms->MeasurementNoise;
+    covariance.ValueRate = 0.0f;
+    covariance.RateRate = 1.0f;
+    return covariance;
+}
+
+/// Advances the covariance by dt seconds and folds in one measurement. Returns the gains
+/// that correct the value and the rate by the innovation (measurement minus prediction).
+static inline void xrKalmanCovariance_Update(
+    xrKalmanCovariance* covariance,
+    const xrKalmanParms* parms,
+    const float dt,
+    float* valueGain,
+    float* rateGain) {
+    // P = F * P * F' + Q with F = [1 dt; 0 1] and the white noise acceleration Q.
+    const float q = parms->AccelerationNoise * parms->AccelerationNoise;
+    const float dt2 = dt * dt;
+    const float p00 = covariance->ValueValue + dt * (2.0f * covariance->ValueRate) +
+        dt2 * covariance->RateRate + q * dt2 * dt * (1.0f / 3.0f);
+    const float p01 = covariance->ValueRate + dt * covariance->RateRate + q * dt2 * 0.5f;
+    const float p11 = covariance->RateRate + q * dt;
+    // Measurement of the value only.
+    const float r = parms->MeasurementNoise * parms->MeasurementNoise;
+    const float invS = 1.0f / (p00 + r);
+    *valueGain = p00 * invS;
+    *rateGain = p01 * invS;
+    covariance->ValueValue = (1.0f - *valueGain) * p00;
+    covariance->ValueRate = (1.0f - *valueGain) * p01;
+    covariance->RateRate = p11 - *rateGain * p01;
+}
+
+//-----------------------------------------------------------------
+// Hand pose filter.
+//-----------------------------------------------------------------
+
+typedef struct xrHandFilterParms_ {
+    // Filter tuning for the hand root pose position and orientation.
+    xrOneEuroParms RootPosition;
+    xrOneEuroParms RootOrientation;
+    // Filter tuning for the local bone rotations.
+    xrOneEuroParms Bones;
+    // Fraction of a measurement accepted at zero confidence. Confidence linearly blends from
+    // this value up to 1 at full confidence. 0 holds the last confident pose.
+    float MinConfidenceWeight;
+    // Upper bound on how far ahead of the last sample the pose is predicted, in seconds.
+    float MaxPredictionTime;
+    // Gaps between samples longer than this (in seconds) reset the filter instead of
+    // smoothing across the discontinuity.
+    float MaxSampleGap;
+    // Predict the bone rotations in addition to the root pose. Bone velocity estimates are
+    // noisier than the root's, so this is off by default.
+    bool PredictBones;
+} xrHandFilterParms;
+
+static inline xrHandFilterParms xrapiDefaultHandFilterParms() {
+    xrHandFilterParms parms;
+    parms.RootPosition.MinCutoff = 1.0f;
+    parms.RootPosition.Beta = 20.0f;
+    parms.RootPosition.DerivativeCutoff = 1.0f;
+    parms.RootOrientation.MinCutoff = 1.0f;
+    parms.RootOrientation.Beta = 0.5f;
+    parms.RootOrientation.DerivativeCutoff = 1.0f;
+    parms.Bones.MinCutoff = 1.5f;
+    parms.Bones.Beta = 0.3f;
+    parms.Bones.DerivativeCutoff = 1.0f;
+    parms.MinConfidenceWeight = 0.1f;
+    parms.MaxPredictionTime = 0.1f;
+    parms.MaxSampleGap = 0.25f;
+    parms.PredictBones = false;
+    return parms;
+}
+
+/// Per-hand filter state. Keep one of these for each hand and feed it every pose queried
+/// from xrapiGetHandPose().
+typedef struct xrHandFilter_ {
+    xrHandFilterParms Parms;
+    bool Initialized;
+    // Capture time of the last sample fed to the filters.
+    double SampleTimeStamp;
+    // Time at which the filtered state is valid (the requested time of the last sample).
+    double StateTimeStamp;
+    xrOneEuroVector3f RootPosition;
+    xrOneEuroQuatf RootOrientation;
+    xrOneEuroQuatf Bones[xrHandBone_Max];
+} xrHandFilter;
+
+static inline void xrHandFilter_Init(xrHandFilter* filter, const xrHandFilterParms* parms) {
+    memset(filter, 0, sizeof(xrHandFilter));
+    filter->Parms = *parms;
+    filter->Initialized = false;
+}
+
+/// Finger each bone belongs to, or -1 for bones only covered by the hand confidence.
+static inline int xrHandFilter_FingerForBone(const int bone) {
+    static const signed char fingers[xrHandBone_Max] = {
+        -1, // xrHandBone_WristRoot
+        -1, // xrHandBone_ForearmStub
+        xrHandFinger_Thumb, xrHandFinger_Thumb, xrHandFinger_Thumb, xrHandFinger_Thumb,
+        xrHandFinger_Index, xrHandFinger_Index, xrHandFinger_Index,
+        xrHandFinger_Middle, xrHandFinger_Middle, xrHandFinger_Middle,
+        xrHandFinger_Ring, xrHandFinger_Ring, xrHandFinger_Ring,
+        xrHandFinger_Pinky, xrHandFinger_Pinky, xrHandFinger_Pinky, xrHandFinger_Pinky,
+        xrHandFinger_Thumb, // xrHandBone_ThumbTip
+        xrHandFinger_Index, // xrHandBone_IndexTip
+        xrHandFinger_Middle, // xrHandBone_MiddleTip
+        xrHandFinger_Ring, // xrHandBone_RingTip
+        xrHandFinger_Pinky, // xrHandBone_PinkyTip
+    };
+    return fingers[bone];
+}
+
+/// xrConfidence values are the bit patterns of floats in [0, 1].
+static inline float xrHandFilter_ConfidenceToFloat(const xrConfidence confidence) {
+    const uint32_t bits = (uint32_t)confidence;
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return (value > 0.0f) ? ((value < 1.0f) ? value : 1.0f) : 0.0f;
+}
+
+static inline float xrHandFilter_WeightFromConfidence(
+    const xrHandFilterParms* parms,
+    const float confidence) {
+    return parms->MinConfidenceWeight + (1.0f - parms->MinConfidenceWeight) * confidence;
+}
+
+/// Filters a hand pose returned by xrapiGetHandPose() and predicts it to 'displayTime',
+/// normally the predicted display time of the frame being rendered.
+///
+/// A new measurement is only taken when the pose's SampleTimeStamp advances. Calling this
+/// every frame with the same underlying sample only re-predicts the filtered state, so the
+/// hand keeps moving smoothly between the slower tracking updates.
+///
+/// 'out' receives a copy of 'in' with the filtered RootPose and BoneRotations, and its
+/// RequestedTimeStamp set to 'displayTime'. 'in' and 'out' may point to the same pose.
+static inline void xrHandFilter_Update(
+    xrHandFilter* filter,
+    const xrHandPose* in,
+    const double displayTime,
+    xrHandPose* out) {
+    if (out != in) {
+        *out = *in;
+    }
+
+    if (in->Status != xrHandTrackingStatus_Tracked) {
+        filter->Initialized = false;
+        return;
+    }
+
+    const xrHandFilterParms* parms = &filter->Parms;
+    const double sampleDelta = in->SampleTimeStamp - filter->SampleTimeStamp;
+
+    if (!filter->Initialized || sampleDelta > parms->MaxSampleGap || sampleDelta < 0.0) {
+        xrOneEuroVector3f_Reset(&filter->RootPosition, &in->RootPose.Position);
+        xrOneEuroQuatf_Reset(&filter->RootOrientation, &in->RootPose.Orientation);
+        for (int i = 0; i < xrHandBone_Max; i++) {
+            xrOneEuroQuatf_Reset(&filter->Bones[i], &in->BoneRotations[i]);
+        }
+        filter->SampleTimeStamp = in->SampleTimeStamp;
+        filter->StateTimeStamp = in->RequestedTimeStamp;
+        filter->Initialized = true;
+    } else if (sampleDelta > 0.0) {
+        // Clamp so a duplicated capture time never produces an infinite velocity.
+        const float dt = (sampleDelta > 1e-3) ? (float)sampleDelta : 1e-3f;
+        const float handWeight = xrHandFilter_WeightFromConfidence(
+            parms, xrHandFilter_ConfidenceToFloat(in->HandConfidence));
+
+        xrOneEuroVector3f_Update(
+            &filter->RootPosition, &parms->RootPosition, &in->RootPose.Position, dt, handWeight);
+        xrOneEuroQuatf_Update(
+            &filter->RootOrientation,
+            &parms->RootOrientation,
+            &in->RootPose.Orientation,
+            dt,
+            handWeight);
+
+        float fingerWeights[xrHandFinger_Max];
+        for (int i = 0; i < xrHandFinger_Max; i++) {
+            fingerWeights[i] = handWeight *
+                xrHandFilter_WeightFromConfidence(
+                                   parms, xrHandFilter_ConfidenceToFloat(in->FingerConfidences[i]));
+        }
+        for (int i = 0; i < xrHandBone_Max; i++) {
+            const int finger = xrHandFilter_FingerForBone(i);
+            const float weight = (finger >= 0) ? fingerWeights[finger] : handWeight;
+            xrOneEuroQuatf_Update(&filter->Bones[i], &parms->Bones, &in->BoneRotations[i], dt, weight);
+        }
+
+        filter->SampleTimeStamp = in->SampleTimeStamp;
+        filter->StateTimeStamp = in->RequestedTimeStamp;
+    }
+
+    double ahead = displayTime - filter->StateTimeStamp;
+    ahead = (ahead > 0.0) ? ahead : 0.0;
+    ahead = (ahead < parms->MaxPredictionTime) ? ahead : parms->MaxPredictionTime;
+    const float seconds = (float)ahead;
+
+    out->RootPose.Position = xrOneEuroVector3f_Predict(&filter->RootPosition, seconds);
+    out->RootPose.Orientation = xrOneEuroQuatf_Predict(&filter->RootOrientation, seconds);
+    for (int i = 0; i < xrHandBone_Max; i++) {
+        out->BoneRotations[i] = parms->PredictBones
+            ? xrOneEuroQuatf_Predict(&filter->Bones[i], seconds)
+            : filter->Bones[i].Value;
+    }
+    out->RequestedTimeStamp = displayTime;
+}
+
+//-----------------------------------------------------------------
+// Tracked device filter.
+//-----------------------------------------------------------------
+
+/*
+Filters the poses of all tracked devices, the controllers and the head, in one call.
+
+The state of every device lives in one arena with an array per component, indexed by
+device slot. The Kalman position filter runs as straight loops over those arrays across all
+devices. The orientation filters need the quaternion functions, and the One-Euro filters
+the speed of each device, so those go device by device through the functions above.
+
+Feed the poses returned by xrapiGetInputTrackingState() with an absolute time of 0.0, so
+that each is the latest measurement rather than a prediction, or the flat controller data
+converted by xrDeviceFilter_TrackingFromControllerData(). A device takes a new measurement
+when its pose time advances, and its filtered state is then predicted to the display time.
+*/
+
+#define XRAPI_DEVICE_FILTER_MAX_DEVICES 8
+
+typedef enum xrDeviceFilterType_ {
+    XRAPI_DEVICE_FILTER_ONE_EURO = 0,
+    XRAPI_DEVICE_FILTER_KALMAN = 1,
+} xrDeviceFilterType;
+
+typedef struct xrDeviceFilterParms_ {
+    xrDeviceFilterType Type;
+    // Tuning for XRAPI_DEVICE_FILTER_ONE_EURO.
+    xrOneEuroParms OneEuroPosition;
+    xrOneEuroParms OneEuroOrientation;
+    // Tuning for XRAPI_DEVICE_FILTER_KALMAN.
+    xrKalmanParms KalmanPosition;
+    xrKalmanParms KalmanOrientation;
+    // Upper bound on how far ahead of the last measurement the pose is predicted, in seconds.
+    float MaxPredictionTime;
+    // Gaps between measurements longer than this (in seconds) reset the filter.
+    float MaxSampleGap;
+} xrDeviceFilterParms;
+
+static inline xrDeviceFilterParms xrapiDefaultDeviceFilterParms(const xrDeviceFilterType type) {
+    xrDeviceFilterParms parms;
+    parms.Type = type;
+    parms.OneEuroPosition.MinCutoff = 1.0f;
+    parms.OneEuroPosition.Beta = 40.0f;
+    parms.OneEuroPosition.DerivativeCutoff = 1.0f;
+    parms.OneEuroOrientation.MinCutoff = 2.0f;
+    parms.OneEuroOrientation.Beta = 0.5f;
+    parms.OneEuroOrientation.DerivativeCutoff = 1.0f;
+    parms.KalmanPosition.MeasurementNoise = 0.001f;
+    parms.KalmanPosition.AccelerationNoise = 0.3f;
+    parms.KalmanOrientation.MeasurementNoise = 0.003f;
+    parms.KalmanOrientation.AccelerationNoise = 0.3f;
+    parms.MaxPredictionTime = 0.05f;
+    parms.MaxSampleGap = 0.25f;
+    return parms;
+}
+
+typedef struct xrDeviceFilterArena_ {
+    xrDeviceFilterParms Parms;
+    int DeviceCount;
+    bool Initialized[XRAPI_DEVICE_FILTER_MAX_DEVICES];
+    // Time of the last measurement, at which the filtered state is valid.
+    double StateTime[XRAPI_DEVICE_FILTER_MAX_DEVICES];
+    // Filtered state, one array per component.
+    float Position[3][XRAPI_DEVICE_FILTER_MAX_DEVICES];
+    float Velocity[3][XRAPI_DEVICE_FILTER_MAX_DEVICES];
+    float Orientation[4][XRAPI_DEVICE_FILTER_MAX_DEVICES];
+    float AngularVelocity[3][XRAPI_DEVICE_FILTER_MAX_DEVICES];
+    // Kalman covariances.
+    xrKalmanCovariance PositionCovariance[XRAPI_DEVICE_FILTER_MAX_DEVICES];
+    xrKalmanCovariance OrientationCovariance[XRAPI_DEVICE_FILTER_MAX_DEVICES];
+    // Scratch for one update: the measured positions, the time step, and 1 for devices with
+    // a new measurement, else 0.
+    float Measured[3][XRAPI_DEVICE_FILTER_MAX_DEVICES];
+    float Step[XRAPI_DEVICE_FILTER_MAX_DEVICES];
+    float Take[XRAPI_DEVICE_FILTER_MAX_DEVICES];
+} xrDeviceFilterArena;
+
+static inline void xrDeviceFilterArena_Init(
+    xrDeviceFilterArena* arena,
+    const xrDeviceFilterParms* parms,
+    const int deviceCount) {
+    memset(arena, 0, sizeof(xrDeviceFilterArena));
+    arena->Parms = *parms;
+    arena->DeviceCount = (deviceCount < XRAPI_DEVICE_FILTER_MAX_DEVICES)
+        ? deviceCount
+        : XRAPI_DEVICE_FILTER_MAX_DEVICES;
+}
+
+static inline xrQuatf xrDeviceFilterArena_GetOrientation(
+    const xrDeviceFilterArena* arena,
+    const int device) {
+    const xrQuatf q = {
+        arena->Orientation[0][device],
+        arena->Orientation[1][device],
+        arena->Orientation[2][device],
+        arena->Orientation[3][device]};
+    return q;
+}
+
+static inline void xrDeviceFilterArena_SetOrientation(
+    xrDeviceFilterArena* arena,
+    const int device,
+    const xrQuatf* q) {
+    arena->Orientation[0][device] = q->x;
+    arena->Orientation[1][device] = q->y;
+    arena->Orientation[2][device] = q->z;
+    arena->Orientation[3][device] = q->w;
+}
+
+static inline xrVector3f xrDeviceFilterArena_GetAngularVelocity(
+    const xrDeviceFilterArena* arena,
+    const int device) {
+    const xrVector3f v = {
+        arena->AngularVelocity[0][device],
+        arena->AngularVelocity[1][device],
+        arena->AngularVelocity[2][device]};
+    return v;
+}
+
+static inline void xrDeviceFilterArena_SetAngularVelocity(
+    xrDeviceFilterArena* arena,
+    const int device,
+    const xrVector3f* v) {
+    arena->AngularVelocity[0][device] = v->x;
+    arena->AngularVelocity[1][device] = v->y;
+    arena->AngularVelocity[2][device] = v->z;
+}
+
+static inline void xrDeviceFilterArena_ResetDevice(
+    xrDeviceFilterArena* arena,
+    const int device,
+    const xrRigidBodyPosef* pose) {
+    const float* position = &pose->Pose.Position.x;
+    for (int axis = 0; axis < 3; axis++) {
+        arena->Position[axis][device] = position[axis];
+        arena->Velocity[axis][device] = 0.0f;
+        arena->AngularVelocity[axis][device] = 0.0f;
+    }
+    const xrQuatf orientation = xrQuatf_Normalize(&pose->Pose.Orientation);
+    xrDeviceFilterArena_SetOrientation(arena, device, &orientation);
+    arena->PositionCovariance[device] = xrKalmanCovariance_Create(&arena->Parms.KalmanPosition);
+    arena->OrientationCovariance[device] =
+        xrKalmanCovariance_Create(&arena->Parms.KalmanOrientation);
+    arena->StateTime[device] = pose->TimeInSeconds;
+    arena->Initialized[device] = true;
+}
+
+/// Filters the poses of arena->DeviceCount devices, 'in[i]' being the pose of device slot i,
+/// and predicts them to 'displayTime'.
+///
+/// 'out' receives copies of 'in' with the filtered pose and velocities, TimeInSeconds set to
+/// 'displayTime' and PredictionInSeconds to how far the filtered state was predicted.
+/// Devices without a valid orientation are passed through and their filter is reset.
+/// 'in' and 'out' may point to the same array.
+static inline void xrDeviceFilterArena_Update(
+    xrDeviceFilterArena* arena,
+    const xrTracking* in,
+    const double displayTime,
+    xrTracking* out) {
+    const xrDeviceFilterParms* parms = &arena->Parms;
+    const int count = arena->DeviceCount;
+
+    // Decide per device whether there is a new measurement.
+    for (int i = 0; i < count; i++) {
+        arena->Measured[0][i] = in[i].HeadPose.Pose.Position.x;
+        arena->Measured[1][i] = in[i].HeadPose.Pose.Position.y;
+        arena->Measured[2][i] = in[i].HeadPose.Pose.Position.z;
+        arena->Step[i] = 1.0f;
+        arena->Take[i] = 0.0f;
+        if (!(in[i].Status & XRAPI_TRACKING_STATUS_ORIENTATION_VALID)) {
+            arena->Initialized[i] = false;
+            continue;
+        }
+        const double delta = in[i].HeadPose.TimeInSeconds - arena->StateTime[i];
+        if (!arena->Initialized[i] || delta > parms->MaxSampleGap || delta < 0.0) {
+            xrDeviceFilterArena_ResetDevice(arena, i, &in[i].HeadPose);
+        } else if (delta > 0.0) {
+            // Clamp so a duplicated time stamp never produces an infinite velocity.
+            arena->Step[i] = (delta > 1e-3) ? (float)delta : 1e-3f;
+            arena->Take[i] = 1.0f;
+            arena->StateTime[i] = in[i].HeadPose.TimeInSeconds;
+        }
+    }
+
+    if (parms->Type == XRAPI_DEVICE_FILTER_KALMAN) {
+        // The gains only depend on the time steps, so each device's covariance is updated
+        // once and then applied to all three axes. Devices without a new measurement get
+        // zero gain and a zero time step, which leaves their state unchanged.
+        float positionGain[2][XRAPI_DEVICE_FILTER_MAX_DEVICES];
+        for (int i = 0; i < count; i++) {
+            if (arena->Take[i] != 0.0f) {
+                xrKalmanCovariance_Update(
+                    &arena->PositionCovariance[i],
+                    &parms->KalmanPosition,
+                    arena->Step[i],
+                    &positionGain[0][i],
+                    &positionGain[1][i]);
+            } else {
+                positionGain[0][i] = 0.0f;
+                positionGain[1][i] = 0.0f;
+            }
+        }
+        for (int axis = 0; axis < 3; axis++) {
+            const float* measured = arena->Measured[axis];
+            float* position = arena->Position[axis];
+            float* velocity = arena->Velocity[axis];
+            for (int i = 0; i < count; i++) {
+                const float dt = arena->Step[i] * arena->Take[i];
+                const float predicted = position[i] + velocity[i] * dt;
+                const float innovation = (measured[i] - predicted) * arena->Take[i];
+                position[i] = predicted + positionGain[0][i] * innovation;
+                velocity[i] += positionGain[1][i] * innovation;
+            }
+        }
+        for (int i = 0; i < count; i++) {
+            if (arena->Take[i] == 0.0f) {
+                continue;
+            }
+            float valueGain;
+            float rateGain;
+            xrKalmanCovariance_Update(
+                &arena->OrientationCovariance[i],
+                &parms->KalmanOrientation,
+                arena->Step[i],
+                &valueGain,
+                &rateGain);
+            const xrQuatf orientation = xrDeviceFilterArena_GetOrientation(arena, i);
+            xrVector3f angularVelocity = xrDeviceFilterArena_GetAngularVelocity(arena, i);
+            const xrVector3f step = {
+                angularVelocity.x * arena->Step[i],
+                angularVelocity.y * arena->Step[i],
+                angularVelocity.z * arena->Step[i]};
+            const xrQuatf predicted = xrQuatf_Integrate(&orientation, &step);
+            const xrVector3f innovation =
+                xrQuatf_DeltaRotation(&predicted, &in[i].HeadPose.Pose.Orientation);
+            const xrVector3f correction = {
+                innovation.x * valueGain, innovation.y * valueGain, innovation.z * valueGain};
+            const xrQuatf corrected = xrQuatf_Integrate(&predicted, &correction);
+            angularVelocity.x += innovation.x * rateGain;
+            angularVelocity.y += innovation.y * rateGain;
+            angularVelocity.z += innovation.z * rateGain;
+            xrDeviceFilterArena_SetOrientation(arena, i, &corrected);
+            xrDeviceFilterArena_SetAngularVelocity(arena, i, &angularVelocity);
+        }
+    } else {
+        for (int i = 0; i < count; i++) {
+            if (arena->Take[i] == 0.0f) {
+                continue;
+            }
+            xrOneEuroVector3f position;
+            position.Value.x = arena->Position[0][i];
+            position.Value.y = arena->Position[1][i];
+            position.Value.z = arena->Position[2][i];
+            position.Velocity.x = arena->Velocity[0][i];
+            position.Velocity.y = arena->Velocity[1][i];
+            position.Velocity.z = arena->Velocity[2][i];
+            xrOneEuroVector3f_Update(
+                &position,
+                &parms->OneEuroPosition,
+                &in[i].HeadPose.Pose.Position,
+                arena->Step[i],
+                1.0f);
+            arena->Position[0][i] = position.Value.x;
+            arena->Position[1][i] = position.Value.y;
+            arena->Position[2][i] = position.Value.z;
+            arena->Velocity[0][i] = position.Velocity.x;
+            arena->Velocity[1][i] = position.Velocity.y;
+            arena->Velocity[2][i] = position.Velocity.z;
+
+            xrOneEuroQuatf orientation;
+            orientation.Value = xrDeviceFilterArena_GetOrientation(arena, i);
+            orientation.AngularVelocity = xrDeviceFilterArena_GetAngularVelocity(arena, i);
+            xrOneEuroQuatf_Update(
+                &orientation,
+                &parms->OneEuroOrientation,
+                &in[i].HeadPose.Pose.Orientation,
+                arena->Step[i],
+                1.0f);
+            xrDeviceFilterArena_SetOrientation(arena, i, &orientation.Value);
+            xrDeviceFilterArena_SetAngularVelocity(arena, i, &orientation.AngularVelocity);
+        }
+    }
+
+    // Predict every device to the display time.
+    for (int i = 0; i < count; i++) {
+        if (out != in) {
+            out[i] = in[i];
+        }
+        if (!arena->Initialized[i]) {
+            continue;
+        }
+        double ahead = displayTime - arena->StateTime[i];
+        ahead = (ahead > 0.0) ? ahead : 0.0;
+        ahead = (ahead < parms->MaxPredictionTime) ? ahead : parms->MaxPredictionTime;
+        const float seconds = (float)ahead;
+
+        xrRigidBodyPosef* pose = &out[i].HeadPose;
+        float* position = &pose->Pose.Position.x;
+        float* velocity = &pose->LinearVelocity.x;
+        for (int axis = 0; axis < 3; axis++) {
+            position[axis] = arena->Position[axis][i] + arena->Velocity[axis][i] * seconds;
+            velocity[axis] = arena->Velocity[axis][i];
+        }
+        const xrQuatf orientation = xrDeviceFilterArena_GetOrientation(arena, i);
+        const xrVector3f angularVelocity = xrDeviceFilterArena_GetAngularVelocity(arena, i);
+        const xrVector3f rotation = {
+            angularVelocity.x * seconds, angularVelocity.y * seconds, angularVelocity.z * seconds};
+        pose->Pose.Orientation = xrQuatf_Integrate(&orientation, &rotation);
+        pose->AngularVelocity = angularVelocity;
+        pose->TimeInSeconds = displayTime;
+        pose->PredictionInSeconds = seconds;
+    }
+}
+
+/// Converts one group of the flat data returned by xrapiController_getData() to the
+/// tracking state xrDeviceFilterArena_Update() takes. The data carries no time stamp, so
+/// 'timeInSeconds' should be the time it was read, and the pose is only taken as a new
+/// measurement when it differs from the last one of the device.
+static inline void xrDeviceFilter_TrackingFromControllerData(
+    const float* data,
+    const int group,
+    const double timeInSeconds,
+    const xrTracking* previous,
+    xrTracking* out) {
+    const float* values = data + group * XRAPI_CONTROLLER_GROUP_DATA_SIZE;
+    memset(out, 0, sizeof(xrTracking));
+    if (values[XRAPI_CONTROLLER_INDEX_CONNECT_STATUS] != 0.0f) {
+        out->Status = XRAPI_TRACKING_STATUS_ORIENTATION_TRACKED |
+            XRAPI_TRACKING_STATUS_ORIENTATION_VALID | XRAPI_TRACKING_STATUS_POSITION_TRACKED |
+            XRAPI_TRACKING_STATUS_POSITION_VALID;
+    }
+    // The rotation lanes hold x, y, z, w.
+    memcpy(&out->HeadPose.Pose.Orientation.x, values + XRAPI_CONTROLLER_INDEX_ROTATION, 16);
+    memcpy(&out->HeadPose.Pose.Position.x, values + XRAPI_CONTROLLER_INDEX_POSITION, 12);
+    const bool unchanged = previous != NULL &&
+        memcmp(&previous->HeadPose.Pose, &out->HeadPose.Pose, sizeof(xrPosef)) == 0;
+    out->HeadPose.TimeInSeconds = unchanged ? previous->HeadPose.TimeInSeconds : timeInSeconds;
+}
+
+#endif // XR_XrApiPoseFilter_h
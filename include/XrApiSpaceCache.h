@@ -0,0 +1,181 @@
+
+#ifndef XR_XrApiSpaceCache_h
+#define XR_XrApiSpaceCache_h
+
+#include "string.h" // for memset()
+#include "XrApiConfig.h"
+#include "XrApiTypes.h"
+#include "XrApi.h"
+#include "XrApiHelpers.h"
+
+/*
+Caches the poses of all tracking spaces and the transforms between them.
+
+The tracking spaces only move relative to each other when the system or the user recenters,
+which the runtime counts in XRAPI_SYS_STATUS_RECENTER_COUNT and
+XRAPI_SYS_STATUS_USER_RECENTER_COUNT. xrSpaceCache_Update() reads both counters once per frame
+and only locates the spaces again when one of them changed. Every refresh precomputes the
+transform between each pair of spaces, so converting between spaces afterwards is a table
+lookup without runtime calls:
+
+    xrSpaceCache_Update( &cache, xr, java );
+    const xrMatrix4f* stageToLocal =
+        xrSpaceCache_GetTransform( &cache, XRAPI_TRACKING_SPACE_STAGE, XRAPI_TRACKING_SPACE_LOCAL );
+
+The poses are relative to the current tracking space, so change it through
+xrSpaceCache_SetTrackingSpace(). The STAGE space follows the Guardian setup rather than the
+recenter counters; call xrSpaceCache_Invalidate() when the boundary may have changed, for
+instance when the application regains focus, and after re-entering VR mode.
+*/
+
+/// Number of tracking spaces in the cache.
+#define XRAPI_SPACE_CACHE_SPACE_COUNT 5
+
+/// Returns the cache index of a tracking space, or -1 for unknown spaces.
+static inline int xrSpaceCache_SpaceIndex(const xrTrackingSpace space) {
+    switch (space) {
+        case XRAPI_TRACKING_SPACE_LOCAL:
+            return 0;
+        case XRAPI_TRACKING_SPACE_LOCAL_FLOOR:
+            return 1;
+        case XRAPI_TRACKING_SPACE_LOCAL_TILTED:
+            return 2;
+        case XRAPI_TRACKING_SPACE_STAGE:
+            return 3;
+        case XRAPI_TRACKING_SPACE_LOCAL_FIXED_YAW:
+            return 4;
+        default:
+            return -1;
+    }
+}
+
+typedef struct xrSpaceCache_ {
+    // Recenter counts the cached poses were located with.
+    int RecenterCount;
+    int UserRecenterCount;
+    // True if the next update locates the spaces regardless of the recenter counts.
+    bool Invalid;
+    xrTrackingSpace CurrentSpace;
+
+    // Pose of each space relative to the current space, indexed by xrSpaceCache_SpaceIndex().
+    xrPosef Poses[XRAPI_SPACE_CACHE_SPACE_COUNT];
+    // Pose and transform of space 'from' relative to space 'to', as [to][from]. A transform
+    // maps coordinates in 'from' to coordinates in 'to'; [from][to] is its inverse.
+    xrPosef RelativePoses[XRAPI_SPACE_CACHE_SPACE_COUNT][XRAPI_SPACE_CACHE_SPACE_COUNT];
+    xrMatrix4f Transforms[XRAPI_SPACE_CACHE_SPACE_COUNT][XRAPI_SPACE_CACHE_SPACE_COUNT];
+
+    // Number of times the spaces were located since xrSpaceCache_Init().
+    uint64_t Refreshes;
+} xrSpaceCache;
+
+static inline void xrSpaceCache_Init(xrSpaceCache* cache) {
+    memset(cache, 0, sizeof(xrSpaceCache));
+    cache->Invalid = true;
+    cache->CurrentSpace = XRAPI_TRACKING_SPACE_LOCAL;
+    for (int i = 0; i < XRAPI_SPACE_CACHE_SPACE_COUNT; i++) {
+        cache->Poses[i] = xrPosef_CreateIdentity();
+        for (int j = 0; j < XRAPI_SPACE_CACHE_SPACE_COUNT; j++) {
+            cache->RelativePoses[i][j] = xrPosef_CreateIdentity();
+            cache->Transforms[i][j] = xrMatrix4f_CreateIdentity();
+        }
+    }
+}
+
+/// Makes the next update locate the spaces again.
+static inline void xrSpaceCache_Invalidate(xrSpaceCache* cache) {
+    cache->Invalid = true;
+}
+
+/// Locates all spaces and recomputes the transforms between them.
+static inline void xrSpaceCache_Refresh(xrSpaceCache* cache, xrMobile* xr) {
+    static const xrTrackingSpace spaces[XRAPI_SPACE_CACHE_SPACE_COUNT] = {
+        XRAPI_TRACKING_SPACE_LOCAL,
+        XRAPI_TRACKING_SPACE_LOCAL_FLOOR,
+        XRAPI_TRACKING_SPACE_LOCAL_TILTED,
+        XRAPI_TRACKING_SPACE_STAGE,
+        XRAPI_TRACKING_SPACE_LOCAL_FIXED_YAW,
+    };
+
+    cache->CurrentSpace = xrapiGetTrackingSpace(xr);
+    xrPosef inverses[XRAPI_SPACE_CACHE_SPACE_COUNT];
+    for (int i = 0; i < XRAPI_SPACE_CACHE_SPACE_COUNT; i++) {
+        cache->Poses[i] = xrapiLocateTrackingSpace(xr, spaces[i]);
+        inverses[i] = xrPosef_Inverse(&cache->Poses[i]);
+    }
+    for (int to = 0; to < XRAPI_SPACE_CACHE_SPACE_COUNT; to++) {
+        for (int from = 0; from < XRAPI_SPACE_CACHE_SPACE_COUNT; from++) {
+            xrPosef* pose = &cache->RelativePoses[to][from];
+            *pose = (to == from) ? xrPosef_CreateIdentity()
+                                 : xrPosef_Multiply(&inverses[to], &cache->Poses[from]);
+            cache->Transforms[to][from] = xrapiGetTransformFromPose(pose);
+        }
+    }
+    cache->Invalid = false;
+    cache->Refreshes++;
+}
+
+/// Reads the recenter counts and refreshes the cache if either changed. Call once per frame.
+/// Returns true if the cache was refreshed.
+static inline bool xrSpaceCache_Update(xrSpaceCache* cache, xrMobile* xr, const xrJava* java) {
+    const int recenterCount = xrapiGetSystemStatusInt(java, XRAPI_SYS_STATUS_RECENTER_COUNT);
+    const int userRecenterCount =
+        xrapiGetSystemStatusInt(java, XRAPI_SYS_STATUS_USER_RECENTER_COUNT);
+    if (!cache->Invalid && recenterCount == cache->RecenterCount &&
+        userRecenterCount == cache->UserRecenterCount) {
+        return false;
+    }
+    cache->RecenterCount = recenterCount;
+    cache->UserRecenterCount = userRecenterCount;
+    xrSpaceCache_Refresh(cache, xr);
+    return true;
+}
+
+/// Sets the tracking space and refreshes the cache, because all poses are relative to it.
+static inline xrResult
+xrSpaceCache_SetTrackingSpace(xrSpaceCache* cache, xrMobile* xr, const xrTrackingSpace space) {
+    const xrResult result = xrapiSetTrackingSpace(xr, space);
+    if (result == xrSuccess) {
+        xrSpaceCache_Refresh(cache, xr);
+    }
+    return result;
+}
+
+/// Returns the cache index of 'space'. Unknown spaces map to the current tracking space, or
+/// to LOCAL if that is unknown as well.
+static inline int xrSpaceCache_LookupIndex(const xrSpaceCache* cache, const xrTrackingSpace space) {
+    const int index = xrSpaceCache_SpaceIndex(space);
+    if (index >= 0) {
+        return index;
+    }
+    const int current = xrSpaceCache_SpaceIndex(cache->CurrentSpace);
+    return (current >= 0) ? current : 0;
+}
+
+/// Returns the pose of 'space' relative to the current tracking space, like
+/// xrapiLocateTrackingSpace(). Unknown spaces are treated as the current tracking space.
+static inline xrPosef xrSpaceCache_GetPose(const xrSpaceCache* cache, const xrTrackingSpace space) {
+    return cache->Poses[xrSpaceCache_LookupIndex(cache, space)];
+}
+
+/// Returns the transform from coordinates in space 'from' to coordinates in space 'to'.
+/// Unknown spaces are treated as the current tracking space.
+static inline const xrMatrix4f* xrSpaceCache_GetTransform(
+    const xrSpaceCache* cache,
+    const xrTrackingSpace from,
+    const xrTrackingSpace to) {
+    return &cache->Transforms[xrSpaceCache_LookupIndex(cache, to)]
+                             [xrSpaceCache_LookupIndex(cache, from)];
+}
+
+/// Converts a pose from space 'from' to space 'to'.
+static inline xrPosef xrSpaceCache_ConvertPose(
+    const xrSpaceCache* cache,
+    const xrTrackingSpace from,
+    const xrTrackingSpace to,
+    const xrPosef* pose) {
+    const xrPosef* relative = &cache->RelativePoses[xrSpaceCache_LookupIndex(cache, to)]
+                                                   [xrSpaceCache_LookupIndex(cache, from)];
+    return xrPosef_Multiply(relative, pose);
+}
+
+#endif // XR_XrApiSpaceCache_h
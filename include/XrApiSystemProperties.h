@@ -0,0 +1,217 @@
+
+#ifndef XR_XrApiSystemProperties_h
+#define XR_XrApiSystemProperties_h
+
+#include "string.h" // for memset(), memcpy(), strncpy()
+#include "XrApiConfig.h"
+#include "XrApiTypes.h"
+#include "XrApiExtension.h"
+#include "XrApi.h"
+
+/*
+Snapshot of the system properties.
+
+Every xrapiGetSystemProperty*() call may go through JNI or to the runtime service, even though
+the properties are constants for a device. xrSystemProperties_Refresh() reads all known
+xrSystemProperty values and the extended properties of XrApiExtension.h once, and the typed
+accessors afterwards read the snapshot without calling into the runtime:
+
+    xrSystemProperties properties;
+    xrSystemProperties_Refresh( &properties, &java );    // right after xrapiInitialize()
+    const int width =
+        xrSystemProperties_GetInt( &properties, XRAPI_SYS_PROP_SUGGESTED_EYE_TEXTURE_WIDTH );
+
+Scalar properties are read both as int and as float, so either accessor returns the value the
+runtime would. Properties that are not part of the snapshot read as 0, 0.0f, an empty string
+or an empty array; query those directly. Some properties, like the display refresh rate and
+the suggested eye texture size, can change with the VR mode, so refresh the snapshot after
+entering VR mode.
+
+The snapshot is plain data and can be read from any thread, as long as it is not refreshed
+at the same time.
+*/
+
+/// Number of property IDs in the snapshot, including unused IDs inside the covered ranges.
+#define XRAPI_SYSTEM_PROPERTY_SLOT_COUNT 37
+/// Capacity of the string and array properties.
+#define XRAPI_SYSTEM_PROPERTY_MAX_STRING 256
+#define XRAPI_SYSTEM_PROPERTY_MAX_ARRAY 32
+
+typedef enum xrSystemPropertyKind_ {
+    XRAPI_SYSTEM_PROPERTY_KIND_NONE = 0,
+    XRAPI_SYSTEM_PROPERTY_KIND_SCALAR = 1 << 0,
+    XRAPI_SYSTEM_PROPERTY_KIND_STRING = 1 << 1,
+    XRAPI_SYSTEM_PROPERTY_KIND_FLOAT_ARRAY = 1 << 2,
+    XRAPI_SYSTEM_PROPERTY_KIND_INT64_ARRAY = 1 << 3,
+} xrSystemPropertyKind;
+
+typedef struct xrSystemProperties_ {
+    // Indexed by xrSystemProperties_Slot().
+    int Ints[XRAPI_SYSTEM_PROPERTY_SLOT_COUNT];
+    float Floats[XRAPI_SYSTEM_PROPERTY_SLOT_COUNT];
+    // XRAPI_SYS_PROP_EXT_SDCARD_PATH and XRAPI_SYS_PROP_BUILD_PRODUCT.
+    char Strings[2][XRAPI_SYSTEM_PROPERTY_MAX_STRING];
+    // XRAPI_SYS_PROP_SUPPORTED_DISPLAY_REFRESH_RATES.
+    int NumFloatArrayValues;
+    float FloatArrayValues[XRAPI_SYSTEM_PROPERTY_MAX_ARRAY];
+    // XRAPI_SYS_PROP_SUPPORTED_SWAPCHAIN_FORMATS.
+    int NumInt64ArrayValues;
+    int64_t Int64ArrayValues[XRAPI_SYSTEM_PROPERTY_MAX_ARRAY];
+
+    // Runtime calls made by the last refresh.
+    int RefreshCalls;
+} xrSystemProperties;
+
+/// Returns the snapshot slot of a property ID, or -1 if the ID is outside the snapshot.
+static inline int xrSystemProperties_Slot(const int id) {
+    if (id >= XRAPI_SYS_PROP_DEVICE_TYPE && id <= XRAPI_SYS_PROP_HAS_POSITION_TRACKING) {
+        return id;
+    }
+    if (id >= XRAPI_SYS_PROP_NUM_SUPPORTED_DISPLAY_REFRESH_RATES &&
+        id <= XRAPI_SYS_PROP_SUPPORTED_SWAPCHAIN_FORMATS) {
+        return 18 + (id - XRAPI_SYS_PROP_NUM_SUPPORTED_DISPLAY_REFRESH_RATES);
+    }
+    if (id >= XRAPI_SYS_PROP_MULTIVIEW_AVAILABLE && id <= XRAPI_SYS_PROP_FOVEATION_AVAILABLE) {
+        return 22 + (id - XRAPI_SYS_PROP_MULTIVIEW_AVAILABLE);
+    }
+    if (id >= XRAPI_SYS_PROP_LENS_SEPERATION && id <= XRAPI_SYS_PROP_CHROMATIC_ABERRATION_3) {
+        return 25 + (id - XRAPI_SYS_PROP_LENS_SEPERATION);
+    }
+    return -1;
+}
+
+/// Returns how a property ID is read, as a mask of xrSystemPropertyKind.
+static inline int xrSystemProperties_Kind(const int id) {
+    switch (id) {
+        case 13: // used to be XRAPI_SYS_PROP_BACK_BUTTON_SHORTPRESS_TIME
+        case 14: // used to be XRAPI_SYS_PROP_BACK_BUTTON_DOUBLETAP_TIME
+            return XRAPI_SYSTEM_PROPERTY_KIND_NONE;
+        case XRAPI_SYS_PROP_EXT_SDCARD_PATH:
+            return XRAPI_SYSTEM_PROPERTY_KIND_STRING;
+        case XRAPI_SYS_PROP_SUPPORTED_DISPLAY_REFRESH_RATES:
+            return XRAPI_SYSTEM_PROPERTY_KIND_FLOAT_ARRAY;
+        case XRAPI_SYS_PROP_SUPPORTED_SWAPCHAIN_FORMATS:
+            return XRAPI_SYSTEM_PROPERTY_KIND_INT64_ARRAY;
+        case XRAPI_SYS_PROP_BUILD_PRODUCT:
+            // The extension reuses the ID of XRAPI_SYS_PROP_FOVEATION_AVAILABLE.
+            return XRAPI_SYSTEM_PROPERTY_KIND_SCALAR | XRAPI_SYSTEM_PROPERTY_KIND_STRING;
+        default:
+            return (xrSystemProperties_Slot(id) >= 0) ? XRAPI_SYSTEM_PROPERTY_KIND_SCALAR
+                                                      : XRAPI_SYSTEM_PROPERTY_KIND_NONE;
+    }
+}
+
+static inline int xrSystemProperties_StringIndex(const int id) {
+    return (id == XRAPI_SYS_PROP_EXT_SDCARD_PATH) ? 0 : 1;
+}
+
+/// Reads all properties of the snapshot from the runtime.
+static inline void xrSystemProperties_Refresh(xrSystemProperties* props, const xrJava* java) {
+    static const int ranges[4][2] = {
+        {XRAPI_SYS_PROP_DEVICE_TYPE, XRAPI_SYS_PROP_HAS_POSITION_TRACKING},
+        {XRAPI_SYS_PROP_NUM_SUPPORTED_DISPLAY_REFRESH_RATES,
+         XRAPI_SYS_PROP_SUPPORTED_SWAPCHAIN_FORMATS},
+        {XRAPI_SYS_PROP_MULTIVIEW_AVAILABLE, XRAPI_SYS_PROP_FOVEATION_AVAILABLE},
+        {XRAPI_SYS_PROP_LENS_SEPERATION, XRAPI_SYS_PROP_CHROMATIC_ABERRATION_3},
+    };
+
+    memset(props, 0, sizeof(xrSystemProperties));
+    for (int r = 0; r < 4; r++) {
+        for (int id = ranges[r][0]; id <= ranges[r][1]; id++) {
+            const xrSystemProperty prop = (xrSystemProperty)id;
+            const int slot = xrSystemProperties_Slot(id);
+            const int kind = xrSystemProperties_Kind(id);
+            if (kind & XRAPI_SYSTEM_PROPERTY_KIND_SCALAR) {
+                props->Ints[slot] = xrapiGetSystemPropertyInt(java, prop);
+                props->Floats[slot] = xrapiGetSystemPropertyFloat(java, prop);
+                props->RefreshCalls += 2;
+            }
+            if (kind & XRAPI_SYSTEM_PROPERTY_KIND_STRING) {
+                const char* value = xrapiGetSystemPropertyString(java, prop);
+                char* string = props->Strings[xrSystemProperties_StringIndex(id)];
+                if (value != NULL) {
+                    strncpy(string, value, XRAPI_SYSTEM_PROPERTY_MAX_STRING - 1);
+                }
+                props->RefreshCalls++;
+            }
+        }
+    }
+
+    // The array lengths are the scalar properties just before the arrays.
+    const int numRefreshRates =
+        props->Ints[xrSystemProperties_Slot(XRAPI_SYS_PROP_NUM_SUPPORTED_DISPLAY_REFRESH_RATES)];
+    if (numRefreshRates > 0) {
+        props->NumFloatArrayValues = xrapiGetSystemPropertyFloatArray(
+            java,
+            XRAPI_SYS_PROP_SUPPORTED_DISPLAY_REFRESH_RATES,
+            props->FloatArrayValues,
+            (numRefreshRates < XRAPI_SYSTEM_PROPERTY_MAX_ARRAY) ? numRefreshRates
+                                                               : XRAPI_SYSTEM_PROPERTY_MAX_ARRAY);
+        props->RefreshCalls++;
+    }
+    const int numFormats =
+        props->Ints[xrSystemProperties_Slot(XRAPI_SYS_PROP_NUM_SUPPORTED_SWAPCHAIN_FORMATS)];
+    if (numFormats > 0) {
+        props->NumInt64ArrayValues = xrapiGetSystemPropertyInt64Array(
+            java,
+            XRAPI_SYS_PROP_SUPPORTED_SWAPCHAIN_FORMATS,
+            props->Int64ArrayValues,
+            (numFormats < XRAPI_SYSTEM_PROPERTY_MAX_ARRAY) ? numFormats
+                                                          : XRAPI_SYSTEM_PROPERTY_MAX_ARRAY);
+        props->RefreshCalls++;
+    }
+}
+
+/// Same as xrapiGetSystemPropertyInt().
+static inline int xrSystemProperties_GetInt(const xrSystemProperties* props, const int id) {
+    const int slot = xrSystemProperties_Slot(id);
+    return (slot >= 0) ? props->Ints[slot] : 0;
+}
+
+/// Same as xrapiGetSystemPropertyFloat().
+static inline float xrSystemProperties_GetFloat(const xrSystemProperties* props, const int id) {
+    const int slot = xrSystemProperties_Slot(id);
+    return (slot >= 0) ? props->Floats[slot] : 0.0f;
+}
+
+/// Same as xrapiGetSystemPropertyString(), but the string stays valid until the next refresh.
+static inline const char* xrSystemProperties_GetString(
+    const xrSystemProperties* props,
+    const int id) {
+    if ((xrSystemProperties_Kind(id) & XRAPI_SYSTEM_PROPERTY_KIND_STRING) == 0) {
+        return "";
+    }
+    return props->Strings[xrSystemProperties_StringIndex(id)];
+}
+
+/// Same as xrapiGetSystemPropertyFloatArray(). Returns the number of values written.
+static inline int xrSystemProperties_GetFloatArray(
+    const xrSystemProperties* props,
+    const int id,
+    float* values,
+    const int numArrayValues) {
+    if (id != XRAPI_SYS_PROP_SUPPORTED_DISPLAY_REFRESH_RATES || numArrayValues <= 0) {
+        return 0;
+    }
+    const int count = (props->NumFloatArrayValues < numArrayValues) ? props->NumFloatArrayValues
+                                                                    : numArrayValues;
+    memcpy(values, props->FloatArrayValues, count * sizeof(float));
+    return count;
+}
+
+/// Same as xrapiGetSystemPropertyInt64Array(). Returns the number of values written.
+static inline int xrSystemProperties_GetInt64Array(
+    const xrSystemProperties* props,
+    const int id,
+    int64_t* values,
+    const int numArrayValues) {
+    if (id != XRAPI_SYS_PROP_SUPPORTED_SWAPCHAIN_FORMATS || numArrayValues <= 0) {
+        return 0;
+    }
+    const int count = (props->NumInt64ArrayValues < numArrayValues) ? props->NumInt64ArrayValues
+                                                                    : numArrayValues;
+    memcpy(values, props->Int64ArrayValues, count * sizeof(int64_t));
+    return count;
+}
+
+#endif // XR_XrApiSystemProperties_h
@@ -0,0 +1,776 @@
+
+#ifndef XR_XrApiTrackingTrace_h
+#define XR_XrApiTrackingTrace_h
+
+// ftruncate() is POSIX, so strict C modes like -std=c99 only declare it with _POSIX_C_SOURCE.
+// This only takes effect if no system header was included before this one.
+#if !defined(_POSIX_C_SOURCE) && !defined(_GNU_SOURCE)
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "math.h" // for floor(), sqrtf(), NAN
+#include "string.h" // for memset(), memcmp()
+#include <fcntl.h> // for open()
+#include <sys/mman.h> // for mmap(), munmap()
+#include <sys/stat.h> // for fstat()
+#include <unistd.h> // for close(), ftruncate(), sysconf()
+#include "XrApiConfig.h"
+#include "XrApiTypes.h"
+#include "XrApiInput.h"
+#include "XrApiHelpers.h"
+
+/*
+Binary tracking trace recorder and replayer.
+
+The recorder appends one record per frame with the head tracking returned by
+xrapiGetPredictedTracking2(), and optionally the tracking of input devices and hand poses,
+to a memory-mapped log. Records are written straight into the mapping and the chunk header
+is updated after every record, so a trace survives the application being killed.
+
+The log is a sequence of fixed-size chunks. Every chunk starts with a header and a keyframe,
+so chunks decode independently of each other. Within a chunk, poses are quantized and
+stored as zig-zag varint deltas against the previous record:
+
+    orientation                 1e-5
+    position                    1e-4 meters
+    velocity                    1e-3 per second
+    acceleration                1e-2 per second squared
+    hand bone rotations         1e-4
+    hand scale                  1e-4
+    times                       nanoseconds
+
+Values outside the range of a quantized value are clamped, and NaN values are stored as
+XRAPI_TRACKING_TRACE_NAN and replayed as NaN, except in orientations, which replay as
+identity because every replayed quaternion is normalized.
+
+A 120 Hz head trace takes roughly 40 bytes per frame, against 360 bytes for a raw
+xrTracking2. The eye view matrices are not stored per frame. They are stored as offsets from
+the head pose whenever those offsets or the projection matrices change, and the view
+matrices are rebuilt from the quantized head pose on replay.
+
+The replayer maps a trace read-only and returns the frames in recorded order. The result only
+depends on the file, so feeding it to the application in place of the runtime's tracking
+reproduces a session deterministically, with the recorded frame indices, display times and
+frame pacing. A trace that was cut off, for instance by copying it off the device while it
+was being recorded, replays up to its last complete record.
+
+Uses POSIX file mapping, so it is only available on Android and Linux. When compiling with a
+strict C mode like -std=c99, define _POSIX_C_SOURCE as 200112L or higher before including any
+system header, or include this header first.
+*/
+
+#define XRAPI_TRACKING_TRACE_MAGIC 0x54545258 // 'XRTT'
+#define XRAPI_TRACKING_TRACE_VERSION 1
+/// Default size of a chunk in bytes. Chunk sizes are rounded up to the page size.
+#define XRAPI_TRACKING_TRACE_CHUNK_SIZE (256 * 1024)
+/// Maximum number of input devices and hands per frame.
+#define XRAPI_TRACKING_TRACE_MAX_DEVICES 4
+#define XRAPI_TRACKING_TRACE_MAX_HANDS 2
+/// Upper bound on the size of an encoded record.
+#define XRAPI_TRACKING_TRACE_MAX_RECORD_SIZE 4096
+
+/// Number of quantized values of a rigid body pose.
+#define XRAPI_TRACKING_TRACE_RIGID_BODY_VALUES 19
+/// Number of quantized values of a hand pose.
+#define XRAPI_TRACKING_TRACE_HAND_VALUES (7 + 4 * xrHandBone_Max + 1)
+
+/// One recorded frame.
+typedef struct xrTrackingTraceFrame_ {
+    // Frame index passed to xrapiGetPredictedDisplayTime().
+    int64_t FrameIndex;
+    // Time at which the tracking was sampled.
+    double RecordTime;
+    // Predicted display time the tracking was predicted for.
+    double DisplayTime;
+    xrTracking2 Tracking;
+
+    int DeviceCount;
+    xrDeviceID DeviceIDs[XRAPI_TRACKING_TRACE_MAX_DEVICES];
+    xrTracking Devices[XRAPI_TRACKING_TRACE_MAX_DEVICES];
+
+    int HandCount;
+    xrDeviceID HandIDs[XRAPI_TRACKING_TRACE_MAX_HANDS];
+    xrHandPose Hands[XRAPI_TRACKING_TRACE_MAX_HANDS];
+} xrTrackingTraceFrame;
+
+/// Header at the start of every chunk.
+typedef struct xrTrackingTraceChunkHeader_ {
+    uint32_t Magic;
+    uint32_t Version;
+    uint32_t ChunkSize;
+    uint32_t ChunkIndex;
+    // Number of records in the chunk.
+    uint32_t FrameCount;
+    // Number of bytes used in the chunk, including this header.
+    uint32_t UsedBytes;
+    uint32_t Reserved[2];
+} xrTrackingTraceChunkHeader;
+
+/// Delta coding state of a rigid body pose.
+typedef struct xrTrackingTraceRigidBodyState_ {
+    int64_t Status;
+    int32_t Values[XRAPI_TRACKING_TRACE_RIGID_BODY_VALUES];
+    int64_t Time;
+    int64_t Prediction;
+} xrTrackingTraceRigidBodyState;
+
+/// Delta coding state of a hand pose.
+typedef struct xrTrackingTraceHandState_ {
+    int64_t ID;
+    int64_t Status;
+    int32_t Values[XRAPI_TRACKING_TRACE_HAND_VALUES];
+    int64_t RequestedTime;
+    int64_t SampleTime;
+    int64_t Confidences[1 + xrHandFinger_Max];
+} xrTrackingTraceHandState;
+
+/// Delta coding state shared by the recorder and the replayer. Reset at every chunk.
+typedef struct xrTrackingTraceState_ {
+    int64_t FrameIndex;
+    int64_t RecordTime;
+    int64_t DisplayTime;
+    xrTrackingTraceRigidBodyState Head;
+    // Eye parameters of the last record that stored them.
+    bool EyesValid;
+    xrMatrix4f Projection[XRAPI_EYE_COUNT];
+    xrMatrix4f EyeFromHead[XRAPI_EYE_COUNT];
+    int64_t DeviceIDs[XRAPI_TRACKING_TRACE_MAX_DEVICES];
+    xrTrackingTraceRigidBodyState Devices[XRAPI_TRACKING_TRACE_MAX_DEVICES];
+    xrTrackingTraceHandState Hands[XRAPI_TRACKING_TRACE_MAX_HANDS];
+} xrTrackingTraceState;
+
+//-----------------------------------------------------------------
+// Encoding.
+//-----------------------------------------------------------------
+
+/// Quantized value of NaN. Finite values are clamped to the range above it.
+#define XRAPI_TRACKING_TRACE_NAN INT32_MIN
+
+// Times are clamped to the int64_t range, and NaN times are stored as 0.
+static inline int64_t xrTrackingTrace_Nanoseconds(const double seconds) {
+    const double ns = floor(seconds * 1e9 + 0.5);
+    if (!(ns == ns)) {
+        return 0;
+    }
+    // 2^63 is the first double above the range; INT64_MAX itself is not representable.
+    return (ns >= 9223372036854775808.0) ? INT64_MAX
+        : ((ns <= -9223372036854775808.0) ? INT64_MIN : (int64_t)ns);
+}
+
+static inline int32_t xrTrackingTrace_Quantize(const float value, const float step) {
+    const double q = floor((double)value / step + 0.5);
+    if (!(q == q)) {
+        return XRAPI_TRACKING_TRACE_NAN;
+    }
+    return (q >= (double)INT32_MAX) ? INT32_MAX
+        : ((q <= -(double)INT32_MAX) ? -INT32_MAX : (int32_t)q);
+}
+
+static inline float xrTrackingTrace_Dequantize(const int32_t value, const float step) {
+    return (value == XRAPI_TRACKING_TRACE_NAN) ? NAN : (float)value * step;
+}
+
+static inline uint8_t* xrTrackingTrace_PutVarint(uint8_t* p, uint64_t value) {
+    while (value >= 0x80) {
+        *p++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *p++ = (uint8_t)value;
+    return p;
+}
+
+/// Stores the difference with the previous value as a zig-zag varint.
+static inline uint8_t* xrTrackingTrace_PutDelta(uint8_t* p, const int64_t value, int64_t* prev) {
+    const int64_t delta = (int64_t)((uint64_t)value - (uint64_t)*prev);
+    *prev = value;
+    return xrTrackingTrace_PutVarint(p, ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+}
+
+static inline uint8_t* xrTrackingTrace_PutQuantized(
+    uint8_t* p,
+    const float* values,
+    const float step,
+    const int count,
+    int32_t* prev) {
+    for (int i = 0; i < count; i++) {
+        int64_t previous = prev[i];
+        p = xrTrackingTrace_PutDelta(p, xrTrackingTrace_Quantize(values[i], step), &previous);
+        prev[i] = (int32_t)previous;
+    }
+    return p;
+}
+
+// Returns NULL if the data ends before the varint.
+static inline const uint8_t*
+xrTrackingTrace_GetVarint(const uint8_t* p, const uint8_t* end, uint64_t* value) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (p >= end) {
+            return NULL;
+        }
+        const uint8_t byte = *p++;
+        result |= (uint64_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = result;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static inline const uint8_t*
+xrTrackingTrace_GetDelta(const uint8_t* p, const uint8_t* end, int64_t* prev) {
+    uint64_t zigzag = 0;
+    p = (p != NULL) ? xrTrackingTrace_GetVarint(p, end, &zigzag) : NULL;
+    if (p != NULL) {
+        const int64_t delta = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+        *prev = (int64_t)((uint64_t)*prev + (uint64_t)delta);
+    }
+    return p;
+}
+
+static inline const uint8_t* xrTrackingTrace_GetQuantized(
+    const uint8_t* p,
+    const uint8_t* end,
+    float* values,
+    const float step,
+    const int count,
+    int32_t* prev) {
+    for (int i = 0; i < count && p != NULL; i++) {
+        int64_t previous = prev[i];
+        p = xrTrackingTrace_GetDelta(p, end, &previous);
+        prev[i] = (int32_t)previous;
+        values[i] = xrTrackingTrace_Dequantize(prev[i], step);
+    }
+    return p;
+}
+
+static inline void xrTrackingTrace_NormalizeQuat(xrQuatf* q) {
+    const float lengthSq = q->x * q->x + q->y * q->y + q->z * q->z + q->w * q->w;
+    if (lengthSq > 0.0f) {
+        const float scale = 1.0f / sqrtf(lengthSq);
+        q->x *= scale;
+        q->y *= scale;
+        q->z *= scale;
+        q->w *= scale;
+    } else {
+        q->x = q->y = q->z = 0.0f;
+        q->w = 1.0f;
+    }
+}
+
+// Quantization step of each group of rigid body values: orientation, position, angular and
+// linear velocity, angular and linear acceleration.
+static const float xrTrackingTrace_RigidBodySteps[6] = {1e-5f, 1e-4f, 1e-3f, 1e-3f, 1e-2f, 1e-2f};
+static const int xrTrackingTrace_RigidBodyCounts[6] = {4, 3, 3, 3, 3, 3};
+
+static inline uint8_t* xrTrackingTrace_PutRigidBody(
+    uint8_t* p,
+    const unsigned int status,
+    const xrRigidBodyPosef* pose,
+    xrTrackingTraceRigidBodyState* state) {
+    const float* groups[6] = {
+        &pose->Pose.Orientation.x,
+        &pose->Pose.Position.x,
+        &pose->AngularVelocity.x,
+        &pose->LinearVelocity.x,
+        &pose->AngularAcceleration.x,
+        &pose->LinearAcceleration.x,
+    };
+    p = xrTrackingTrace_PutDelta(p, status, &state->Status);
+    int32_t* prev = state->Values;
+    for (int i = 0; i < 6; i++) {
+        p = xrTrackingTrace_PutQuantized(
+            p,
+            groups[i],
+            xrTrackingTrace_RigidBodySteps[i],
+            xrTrackingTrace_RigidBodyCounts[i],
+            prev);
+        prev += xrTrackingTrace_RigidBodyCounts[i];
+    }
+    p = xrTrackingTrace_PutDelta(p, xrTrackingTrace_Nanoseconds(pose->TimeInSeconds), &state->Time);
+    p = xrTrackingTrace_PutDelta(
+        p, xrTrackingTrace_Nanoseconds(pose->PredictionInSeconds), &state->Prediction);
+    return p;
+}
+
+static inline const uint8_t* xrTrackingTrace_GetRigidBody(
+    const uint8_t* p,
+    const uint8_t* end,
+    unsigned int* status,
+    xrRigidBodyPosef* pose,
+    xrTrackingTraceRigidBodyState* state) {
+    memset(pose, 0, sizeof(xrRigidBodyPosef));
+    float* groups[6] = {
+        &pose->Pose.Orientation.x,
+        &pose->Pose.Position.x,
+        &pose->AngularVelocity.x,
+        &pose->LinearVelocity.x,
+        &pose->AngularAcceleration.x,
+        &pose->LinearAcceleration.x,
+    };
+    p = xrTrackingTrace_GetDelta(p, end, &state->Status);
+    *status = (unsigned int)state->Status;
+    int32_t* prev = state->Values;
+    for (int i = 0; i < 6; i++) {
+        p = xrTrackingTrace_GetQuantized(
+            p,
+            end,
+            groups[i],
+            xrTrackingTrace_RigidBodySteps[i],
+            xrTrackingTrace_RigidBodyCounts[i],
+            prev);
+        prev += xrTrackingTrace_RigidBodyCounts[i];
+    }
+    p = xrTrackingTrace_GetDelta(p, end, &state->Time);
+    p = xrTrackingTrace_GetDelta(p, end, &state->Prediction);
+    xrTrackingTrace_NormalizeQuat(&pose->Pose.Orientation);
+    pose->TimeInSeconds = state->Time * 1e-9;
+    pose->PredictionInSeconds = state->Prediction * 1e-9;
+    return p;
+}
+
+static inline uint8_t* xrTrackingTrace_PutHand(
+    uint8_t* p,
+    const xrDeviceID id,
+    const xrHandPose* hand,
+    xrTrackingTraceHandState* state) {
+    p = xrTrackingTrace_PutDelta(p, id, &state->ID);
+    p = xrTrackingTrace_PutDelta(p, hand->Status, &state->Status);
+    int32_t* prev = state->Values;
+    p = xrTrackingTrace_PutQuantized(p, &hand->RootPose.Orientation.x, 1e-5f, 4, prev);
+    p = xrTrackingTrace_PutQuantized(p, &hand->RootPose.Position.x, 1e-4f, 3, prev + 4);
+    p = xrTrackingTrace_PutQuantized(
+        p, &hand->BoneRotations[0].x, 1e-4f, 4 * xrHandBone_Max, prev + 7);
+    p = xrTrackingTrace_PutQuantized(
+        p, &hand->HandScale, 1e-4f, 1, prev + 7 + 4 * xrHandBone_Max);
+    p = xrTrackingTrace_PutDelta(
+        p, xrTrackingTrace_Nanoseconds(hand->RequestedTimeStamp), &state->RequestedTime);
+    p = xrTrackingTrace_PutDelta(
+        p, xrTrackingTrace_Nanoseconds(hand->SampleTimeStamp), &state->SampleTime);
+    p = xrTrackingTrace_PutDelta(p, (uint32_t)hand->HandConfidence, &state->Confidences[0]);
+    for (int i = 0; i < xrHandFinger_Max; i++) {
+        p = xrTrackingTrace_PutDelta(
+            p, (uint32_t)hand->FingerConfidences[i], &state->Confidences[1 + i]);
+    }
+    return p;
+}
+
+static inline const uint8_t* xrTrackingTrace_GetHand(
+    const uint8_t* p,
+    const uint8_t* end,
+    xrDeviceID* id,
+    xrHandPose* hand,
+    xrTrackingTraceHandState* state) {
+    memset(hand, 0, sizeof(xrHandPose));
+    hand->Header.Version = xrHandVersion_1;
+    p = xrTrackingTrace_GetDelta(p, end, &state->ID);
+    *id = (xrDeviceID)state->ID;
+    p = xrTrackingTrace_GetDelta(p, end, &state->Status);
+    hand->Status = (xrHandTrackingStatus)state->Status;
+    int32_t* prev = state->Values;
+    p = xrTrackingTrace_GetQuantized(p, end, &hand->RootPose.Orientation.x, 1e-5f, 4, prev);
+    p = xrTrackingTrace_GetQuantized(p, end, &hand->RootPose.Position.x, 1e-4f, 3, prev + 4);
+    p = xrTrackingTrace_GetQuantized(
+        p, end, &hand->BoneRotations[0].x, 1e-4f, 4 * xrHandBone_Max, prev + 7);
+    p = xrTrackingTrace_GetQuantized(
+        p, end, &hand->HandScale, 1e-4f, 1, prev + 7 + 4 * xrHandBone_Max);
+    p = xrTrackingTrace_GetDelta(p, end, &state->RequestedTime);
+    p = xrTrackingTrace_GetDelta(p, end, &state->SampleTime);
+    p = xrTrackingTrace_GetDelta(p, end, &state->Confidences[0]);
+    for (int i = 0; i < xrHandFinger_Max; i++) {
+        p = xrTrackingTrace_GetDelta(p, end, &state->Confidences[1 + i]);
+    }
+    xrTrackingTrace_NormalizeQuat(&hand->RootPose.Orientation);
+    for (int i = 0; i < xrHandBone_Max; i++) {
+        xrTrackingTrace_NormalizeQuat(&hand->BoneRotations[i]);
+    }
+    hand->RequestedTimeStamp = state->RequestedTime * 1e-9;
+    hand->SampleTimeStamp = state->SampleTime * 1e-9;
+    hand->HandConfidence = (xrConfidence)(uint32_t)state->Confidences[0];
+    for (int i = 0; i < xrHandFinger_Max; i++) {
+        hand->FingerConfidences[i] = (xrConfidence)(uint32_t)state->Confidences[1 + i];
+    }
+    return p;
+}
+
+// Record flags.
+#define XRAPI_TRACKING_TRACE_RECORD_EYES 1
+#define XRAPI_TRACKING_TRACE_RECORD_DEVICE_SHIFT 1
+#define XRAPI_TRACKING_TRACE_RECORD_HAND_SHIFT 4
+
+static inline bool xrTrackingTrace_MatrixChanged(const xrMatrix4f* a, const xrMatrix4f* b) {
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            const float d = a->M[i][j] - b->M[i][j];
+            if (d > 1e-5f || d < -1e-5f) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/// Encodes one frame. 'out' must have room for XRAPI_TRACKING_TRACE_MAX_RECORD_SIZE bytes.
+/// Returns the end of the record.
+static inline uint8_t* xrTrackingTrace_EncodeFrame(
+    uint8_t* out,
+    const xrTrackingTraceFrame* frame,
+    xrTrackingTraceState* state) {
+    const int deviceCount = (frame->DeviceCount < XRAPI_TRACKING_TRACE_MAX_DEVICES)
+        ? frame->DeviceCount
+        : XRAPI_TRACKING_TRACE_MAX_DEVICES;
+    const int handCount = (frame->HandCount < XRAPI_TRACKING_TRACE_MAX_HANDS)
+        ? frame->HandCount
+        : XRAPI_TRACKING_TRACE_MAX_HANDS;
+
+    // The view matrices are stored as offsets from the head pose.
+    xrMatrix4f eyeFromHead[XRAPI_EYE_COUNT];
+    const xrMatrix4f headTransform = xrapiGetTransformFromPose(&frame->Tracking.HeadPose.Pose);
+    bool eyesChanged = !state->EyesValid;
+    for (int eye = 0; eye < XRAPI_EYE_COUNT; eye++) {
+        eyeFromHead[eye] =
+            xrMatrix4f_Multiply(&frame->Tracking.Eye[eye].ViewMatrix, &headTransform);
+        eyesChanged = eyesChanged ||
+            xrTrackingTrace_MatrixChanged(&eyeFromHead[eye], &state->EyeFromHead[eye]) ||
+            xrTrackingTrace_MatrixChanged(
+                          &frame->Tracking.Eye[eye].ProjectionMatrix, &state->Projection[eye]);
+    }
+
+    uint8_t* p = out;
+    *p++ = (uint8_t)((eyesChanged ? XRAPI_TRACKING_TRACE_RECORD_EYES : 0) |
+                     (deviceCount << XRAPI_TRACKING_TRACE_RECORD_DEVICE_SHIFT) |
+                     (handCount << XRAPI_TRACKING_TRACE_RECORD_HAND_SHIFT));
+    p = xrTrackingTrace_PutDelta(p, frame->FrameIndex, &state->FrameIndex);
+    p = xrTrackingTrace_PutDelta(
+        p, xrTrackingTrace_Nanoseconds(frame->RecordTime), &state->RecordTime);
+    p = xrTrackingTrace_PutDelta(
+        p, xrTrackingTrace_Nanoseconds(frame->DisplayTime), &state->DisplayTime);
+    p = xrTrackingTrace_PutRigidBody(
+        p, frame->Tracking.Status, &frame->Tracking.HeadPose, &state->Head);
+
+    if (eyesChanged) {
+        for (int eye = 0; eye < XRAPI_EYE_COUNT; eye++) {
+            state->Projection[eye] = frame->Tracking.Eye[eye].ProjectionMatrix;
+            state->EyeFromHead[eye] = eyeFromHead[eye];
+        }
+        state->EyesValid = true;
+        memcpy(p, state->Projection, sizeof(state->Projection));
+        p += sizeof(state->Projection);
+        memcpy(p, state->EyeFromHead, sizeof(state->EyeFromHead));
+        p += sizeof(state->EyeFromHead);
+    }
+
+    for (int i = 0; i < deviceCount; i++) {
+        p = xrTrackingTrace_PutDelta(p, frame->DeviceIDs[i], &state->DeviceIDs[i]);
+        p = xrTrackingTrace_PutRigidBody(
+            p, frame->Devices[i].Status, &frame->Devices[i].HeadPose, &state->Devices[i]);
+    }
+    for (int i = 0; i < handCount; i++) {
+        p = xrTrackingTrace_PutHand(p, frame->HandIDs[i], &frame->Hands[i], &state->Hands[i]);
+    }
+    return p;
+}
+
+/// Decodes one frame. Returns the end of the record, or NULL if the record is truncated.
+static inline const uint8_t* xrTrackingTrace_DecodeFrame(
+    const uint8_t* p,
+    const uint8_t* end,
+    xrTrackingTraceFrame* frame,
+    xrTrackingTraceState* state) {
+    if (p >= end) {
+        return NULL;
+    }
+    const uint8_t flags = *p++;
+    frame->DeviceCount = (flags >> XRAPI_TRACKING_TRACE_RECORD_DEVICE_SHIFT) & 7;
+    frame->HandCount = (flags >> XRAPI_TRACKING_TRACE_RECORD_HAND_SHIFT) & 3;
+    if (frame->DeviceCount > XRAPI_TRACKING_TRACE_MAX_DEVICES ||
+        frame->HandCount > XRAPI_TRACKING_TRACE_MAX_HANDS) {
+        return NULL;
+    }
+
+    p = xrTrackingTrace_GetDelta(p, end, &state->FrameIndex);
+    p = xrTrackingTrace_GetDelta(p, end, &state->RecordTime);
+    p = xrTrackingTrace_GetDelta(p, end, &state->DisplayTime);
+    frame->FrameIndex = state->FrameIndex;
+    frame->RecordTime = state->RecordTime * 1e-9;
+    frame->DisplayTime = state->DisplayTime * 1e-9;
+    memset(&frame->Tracking, 0, sizeof(frame->Tracking));
+    p = xrTrackingTrace_GetRigidBody(
+        p, end, &frame->Tracking.Status, &frame->Tracking.HeadPose, &state->Head);
+
+    if (p != NULL && (flags & XRAPI_TRACKING_TRACE_RECORD_EYES) != 0) {
+        if ((size_t)(end - p) < sizeof(state->Projection) + sizeof(state->EyeFromHead)) {
+            return NULL;
+        }
+        memcpy(state->Projection, p, sizeof(state->Projection));
+        p += sizeof(state->Projection);
+        memcpy(state->EyeFromHead, p, sizeof(state->EyeFromHead));
+        p += sizeof(state->EyeFromHead);
+        state->EyesValid = true;
+    }
+    if (p == NULL || !state->EyesValid) {
+        return NULL;
+    }
+    const xrMatrix4f headView = xrapiGetViewMatrixFromPose(&frame->Tracking.HeadPose.Pose);
+    for (int eye = 0; eye < XRAPI_EYE_COUNT; eye++) {
+        frame->Tracking.Eye[eye].ProjectionMatrix = state->Projection[eye];
+        frame->Tracking.Eye[eye].ViewMatrix =
+            xrMatrix4f_Multiply(&state->EyeFromHead[eye], &headView);
+    }
+
+    for (int i = 0; i < frame->DeviceCount; i++) {
+        p = xrTrackingTrace_GetDelta(p, end, &state->DeviceIDs[i]);
+        frame->DeviceIDs[i] = (xrDeviceID)state->DeviceIDs[i];
+        memset(&frame->Devices[i], 0, sizeof(frame->Devices[i]));
+        p = xrTrackingTrace_GetRigidBody(
+            p, end, &frame->Devices[i].Status, &frame->Devices[i].HeadPose, &state->Devices[i]);
+    }
+    for (int i = 0; i < frame->HandCount; i++) {
+        p = xrTrackingTrace_GetHand(p, end, &frame->HandIDs[i], &frame->Hands[i], &state->Hands[i]);
+    }
+    return p;
+}
+
+//-----------------------------------------------------------------
+// Recorder.
+//-----------------------------------------------------------------
+
+typedef struct xrTrackingTraceWriter_ {
+    int File;
+    uint32_t ChunkSize;
+    uint32_t ChunkIndex;
+    // Mapping of the current chunk.
+    uint8_t* Chunk;
+    xrTrackingTraceState State;
+    // Totals since the trace was opened.
+    uint64_t Frames;
+    uint64_t Bytes;
+} xrTrackingTraceWriter;
+
+static inline void xrTrackingTraceWriter_Clear(xrTrackingTraceWriter* writer) {
+    memset(writer, 0, sizeof(xrTrackingTraceWriter));
+    writer->File = -1;
+}
+
+static inline bool xrTrackingTraceWriter_IsOpen(const xrTrackingTraceWriter* writer) {
+    return writer->Chunk != NULL;
+}
+
+static inline xrTrackingTraceChunkHeader* xrTrackingTraceWriter_Header(
+    xrTrackingTraceWriter* writer) {
+    return (xrTrackingTraceChunkHeader*)writer->Chunk;
+}
+
+// Unmaps the current chunk and maps a new one at the end of the file.
+static inline bool xrTrackingTraceWriter_BeginChunk(xrTrackingTraceWriter* writer) {
+    if (writer->Chunk != NULL) {
+        munmap(writer->Chunk, writer->ChunkSize);
+        writer->Chunk = NULL;
+        writer->ChunkIndex++;
+    }
+    const off_t offset = (off_t)writer->ChunkIndex * writer->ChunkSize;
+    if (ftruncate(writer->File, offset + writer->ChunkSize) != 0) {
+        return false;
+    }
+    void* chunk =
+        mmap(NULL, writer->ChunkSize, PROT_READ | PROT_WRITE, MAP_SHARED, writer->File, offset);
+    if (chunk == MAP_FAILED) {
+        return false;
+    }
+    writer->Chunk = (uint8_t*)chunk;
+
+    xrTrackingTraceChunkHeader* header = xrTrackingTraceWriter_Header(writer);
+    memset(header, 0, sizeof(xrTrackingTraceChunkHeader));
+    header->Magic = XRAPI_TRACKING_TRACE_MAGIC;
+    header->Version = XRAPI_TRACKING_TRACE_VERSION;
+    header->ChunkSize = writer->ChunkSize;
+    header->ChunkIndex = writer->ChunkIndex;
+    header->UsedBytes = sizeof(xrTrackingTraceChunkHeader);
+
+    // Every chunk starts with a keyframe.
+    memset(&writer->State, 0, sizeof(writer->State));
+    return true;
+}
+
+/// Creates or truncates the trace file. Pass 0 for the default chunk size.
+static inline bool xrTrackingTraceWriter_Open(
+    xrTrackingTraceWriter* writer,
+    const char* path,
+    const uint32_t chunkSize) {
+    xrTrackingTraceWriter_Clear(writer);
+    const uint32_t pageSize = (uint32_t)sysconf(_SC_PAGESIZE);
+    const uint32_t minSize = 4 * XRAPI_TRACKING_TRACE_MAX_RECORD_SIZE;
+    uint32_t size = (chunkSize > 0) ? chunkSize : XRAPI_TRACKING_TRACE_CHUNK_SIZE;
+    size = (size < minSize) ? minSize : size;
+    writer->ChunkSize = (size + pageSize - 1) / pageSize * pageSize;
+    writer->File = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (writer->File < 0) {
+        return false;
+    }
+    if (!xrTrackingTraceWriter_BeginChunk(writer)) {
+        close(writer->File);
+        xrTrackingTraceWriter_Clear(writer);
+        return false;
+    }
+    return true;
+}
+
+/// Appends a frame. Returns false if the trace is not open or the file could not grow.
+static inline bool xrTrackingTraceWriter_Append(
+    xrTrackingTraceWriter* writer,
+    const xrTrackingTraceFrame* frame) {
+    if (writer->Chunk == NULL) {
+        return false;
+    }
+    if (xrTrackingTraceWriter_Header(writer)->UsedBytes + XRAPI_TRACKING_TRACE_MAX_RECORD_SIZE >
+        writer->ChunkSize) {
+        if (!xrTrackingTraceWriter_BeginChunk(writer)) {
+            return false;
+        }
+    }
+    xrTrackingTraceChunkHeader* header = xrTrackingTraceWriter_Header(writer);
+    uint8_t* start = writer->Chunk + header->UsedBytes;
+    const uint8_t* end = xrTrackingTrace_EncodeFrame(start, frame, &writer->State);
+    header->UsedBytes += (uint32_t)(end - start);
+    header->FrameCount++;
+    writer->Frames++;
+    writer->Bytes += (uint64_t)(end - start);
+    return true;
+}
+
+/// Unmaps the last chunk and trims the file to the used size.
+static inline void xrTrackingTraceWriter_Close(xrTrackingTraceWriter* writer) {
+    if (writer->Chunk != NULL) {
+        const off_t size = (off_t)writer->ChunkIndex * writer->ChunkSize +
+            xrTrackingTraceWriter_Header(writer)->UsedBytes;
+        munmap(writer->Chunk, writer->ChunkSize);
+        if (ftruncate(writer->File, size) != 0) {
+            // The trace stays readable with the unused tail of the last chunk.
+        }
+    }
+    if (writer->File >= 0) {
+        close(writer->File);
+    }
+    xrTrackingTraceWriter_Clear(writer);
+}
+
+//-----------------------------------------------------------------
+// Replayer.
+//-----------------------------------------------------------------
+
+typedef struct xrTrackingTraceReader_ {
+    int File;
+    const uint8_t* Data;
+    size_t Size;
+    // Offset of the current chunk, and of the next record in it.
+    size_t ChunkOffset;
+    size_t Offset;
+    uint32_t FramesLeft;
+    xrTrackingTraceState State;
+} xrTrackingTraceReader;
+
+static inline void xrTrackingTraceReader_Clear(xrTrackingTraceReader* reader) {
+    memset(reader, 0, sizeof(xrTrackingTraceReader));
+    reader->File = -1;
+}
+
+static inline const xrTrackingTraceChunkHeader* xrTrackingTraceReader_Header(
+    const xrTrackingTraceReader* reader) {
+    return (const xrTrackingTraceChunkHeader*)(reader->Data + reader->ChunkOffset);
+}
+
+// Validates the chunk at ChunkOffset and starts reading it.
+static inline bool xrTrackingTraceReader_EnterChunk(xrTrackingTraceReader* reader) {
+    if (reader->ChunkOffset + sizeof(xrTrackingTraceChunkHeader) > reader->Size) {
+        return false;
+    }
+    const xrTrackingTraceChunkHeader* header = xrTrackingTraceReader_Header(reader);
+    if (header->Magic != XRAPI_TRACKING_TRACE_MAGIC ||
+        header->Version != XRAPI_TRACKING_TRACE_VERSION || header->ChunkSize == 0 ||
+        header->UsedBytes < sizeof(xrTrackingTraceChunkHeader) ||
+        header->UsedBytes > header->ChunkSize) {
+        return false;
+    }
+    reader->Offset = reader->ChunkOffset + sizeof(xrTrackingTraceChunkHeader);
+    reader->FramesLeft = header->FrameCount;
+    memset(&reader->State, 0, sizeof(reader->State));
+    return true;
+}
+
+/// Restarts the replay at the first frame.
+static inline bool xrTrackingTraceReader_Rewind(xrTrackingTraceReader* reader) {
+    reader->ChunkOffset = 0;
+    if (!xrTrackingTraceReader_EnterChunk(reader)) {
+        reader->ChunkOffset = reader->Size;
+        reader->FramesLeft = 0;
+        return false;
+    }
+    return true;
+}
+
+static inline bool xrTrackingTraceReader_Open(xrTrackingTraceReader* reader, const char* path) {
+    xrTrackingTraceReader_Clear(reader);
+    reader->File = open(path, O_RDONLY);
+    if (reader->File < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(reader->File, &st) != 0 || st.st_size < (off_t)sizeof(xrTrackingTraceChunkHeader)) {
+        close(reader->File);
+        xrTrackingTraceReader_Clear(reader);
+        return false;
+    }
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, reader->File, 0);
+    if (data == MAP_FAILED) {
+        close(reader->File);
+        xrTrackingTraceReader_Clear(reader);
+        return false;
+    }
+    reader->Data = (const uint8_t*)data;
+    reader->Size = (size_t)st.st_size;
+    return xrTrackingTraceReader_Rewind(reader);
+}
+
+static inline void xrTrackingTraceReader_Close(xrTrackingTraceReader* reader) {
+    if (reader->Data != NULL) {
+        munmap((void*)reader->Data, reader->Size);
+    }
+    if (reader->File >= 0) {
+        close(reader->File);
+    }
+    xrTrackingTraceReader_Clear(reader);
+}
+
+/// Reads the next frame. Returns false at the end of the trace or on a corrupt record.
+static inline bool xrTrackingTraceReader_Next(
+    xrTrackingTraceReader* reader,
+    xrTrackingTraceFrame* frame) {
+    if (reader->Data == NULL || reader->ChunkOffset >= reader->Size) {
+        return false;
+    }
+    while (reader->FramesLeft == 0) {
+        const uint32_t chunkSize = xrTrackingTraceReader_Header(reader)->ChunkSize;
+        reader->ChunkOffset += chunkSize;
+        if (reader->ChunkOffset >= reader->Size || !xrTrackingTraceReader_EnterChunk(reader)) {
+            reader->ChunkOffset = reader->Size;
+            reader->FramesLeft = 0;
+            return false;
+        }
+    }
+    // A file cut off after the header was written ends at the last complete record.
+    const size_t used = reader->ChunkOffset + xrTrackingTraceReader_Header(reader)->UsedBytes;
+    const uint8_t* end = reader->Data + ((used < reader->Size) ? used : reader->Size);
+    const uint8_t* next =
+        xrTrackingTrace_DecodeFrame(reader->Data + reader->Offset, end, frame, &reader->State);
+    if (next == NULL) {
+        reader->FramesLeft = 0;
+        reader->ChunkOffset = reader->Size;
+        return false;
+    }
+    reader->Offset = (size_t)(next - reader->Data);
+    reader->FramesLeft--;
+    return true;
+}
+
+#endif // XR_XrApiTrackingTrace_h
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <float.h> // for FLT_MAX
 #include <time.h>
 #include <unistd.h>
 #include <pthread.h>
@@ -15,6 +16,10 @@
 #include <GLES3/gl3.h>
 #include <GLES3/gl3ext.h>
 
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 #if !defined(EGL_OPENGL_ES3_BIT_KHR)
 #define EGL_OPENGL_ES3_BIT_KHR 0x0040
 #endif
@@ -68,10 +73,28 @@ typedef void(GL_APIENTRY* PFNGLFRAMEBUFFERTEXTUREMULTISAMPLEMULTIVIEWOVRPROC)(
         GLsizei numViews);
 #endif
 
+#if !defined(GL_EXT_disjoint_timer_query)
+static const int GL_TIME_ELAPSED_EXT = 0x88BF;
+static const int GL_GPU_DISJOINT_EXT = 0x8FBB;
+typedef void(GL_APIENTRY* PFNGLGETQUERYOBJECTUI64VEXTPROC)(
+        GLuint id,
+        GLenum pname,
+        GLuint64* params);
+#endif
+
 #include "XrApi.h"
 #include "XrApiHelpers.h"
 #include "XrApiSystemUtils.h"
 #include "XrApiInput.h"
+#include "XrApiInputSnapshot.h"
+#include "XrApiSpaceCache.h"
+#include "XrApiSystemProperties.h"
+#include "XrApiEvents.h"
+#include "XrApiPerformance.h"
+#include "XrApiTrackingTrace.h"
+#include "XrApiProgramCache.h"
+#include "XrApiInstancePacking.h"
+#include "XrApiFrameBuilder.h"
 
 #define DEBUG 1
 #define OVR_LOG_TAG "VrCubeWorld"
@@ -87,8 +110,25 @@ static const int CPU_LEVEL = 2;
 static const int GPU_LEVEL = 3;
 static const int NUM_MULTI_SAMPLES = 4;
 
+// Set to 1 to pipeline the frame loop: the main thread predicts and simulates frame N+1 while
+// a renderer thread renders and submits frame N.
 #define MULTI_THREADED 0
 
+// Set to 1 to time the instance culling on a large synthetic scene at startup.
+#define CULL_BENCHMARK 0
+
+// Set to 0 to draw the visible instances in creation order instead of front to back.
+#define SORT_INSTANCES 1
+
+// Set to 0 to upload a 4x4 matrix per instance instead of a 16-byte packed quaternion and
+// half float position.
+#define COMPACT_INSTANCES 1
+
+// Set to 1 to record the predicted head tracking and the tracked input devices of every frame
+// to tracking.trace in the application's internal storage, for replay with
+// XrApiTrackingTrace.h. The sample does not query hand skeletons, so none are recorded.
+#define RECORD_TRACKING_TRACE 0
+
 /*
 ================================================================================
 
@@ -114,6 +154,7 @@ OpenGL-ES Utility Functions
 typedef struct {
     bool multi_view; // GL_OVR_multiview, GL_OVR_multiview2
     bool EXT_texture_border_clamp; // GL_EXT_texture_border_clamp, GL_OES_texture_border_clamp
+    bool EXT_disjoint_timer_query; // GL_EXT_disjoint_timer_query
 } OpenGLExtensions_t;
 
 OpenGLExtensions_t glExtensions;
@@ -127,6 +168,9 @@ static void EglInitExtensions() {
         glExtensions.EXT_texture_border_clamp =
                 strstr(allExtensions, "GL_EXT_texture_border_clamp") ||
                 strstr(allExtensions, "GL_OES_texture_border_clamp");
+
+        glExtensions.EXT_disjoint_timer_query =
+                strstr(allExtensions, "GL_EXT_disjoint_timer_query");
     }
 }
 
@@ -424,7 +468,12 @@ static xrVertexAttribute ProgramVertexAttributes[] = {
         {VERTEX_ATTRIBUTE_LOCATION_POSITION, "vertexPosition"},
         {VERTEX_ATTRIBUTE_LOCATION_COLOR, "vertexColor"},
         {VERTEX_ATTRIBUTE_LOCATION_UV, "vertexUv"},
+#if COMPACT_INSTANCES
+        {VERTEX_ATTRIBUTE_LOCATION_TRANSFORM, "vertexOrientation"},
+        {(VertexAttributeLocation)(VERTEX_ATTRIBUTE_LOCATION_TRANSFORM + 1), "vertexTranslation"}};
+#else
         {VERTEX_ATTRIBUTE_LOCATION_TRANSFORM, "vertexTransform"}};
+#endif
 
 static void xrGeometry_Clear(xrGeometry* geometry) {
     geometry->VertexBuffer = 0;
@@ -592,30 +641,95 @@ static void xrProgram_Clear(xrProgram* program) {
 
 static const char* programVersion = "#version 300 es\n";
 
-static bool xrProgram_Create(
+static int xrProgramCache_GlGetBinarySize(void* userData, unsigned int program) {
+    (void)userData;
+    GLint length = 0;
+    GL(glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length));
+    return length;
+}
+
+static bool xrProgramCache_GlGetBinary(
+        void* userData,
+        unsigned int program,
+        void* binary,
+        int size,
+        unsigned int* format) {
+    (void)userData;
+    GLsizei length = 0;
+    GLenum binaryFormat = 0;
+    GL(glGetProgramBinary(program, size, &length, &binaryFormat, binary));
+    *format = binaryFormat;
+    return length == size;
+}
+
+static bool xrProgramCache_GlLoadBinary(
+        void* userData,
+        unsigned int program,
+        unsigned int format,
+        const void* binary,
+        int size) {
+    (void)userData;
+    // A binary from an incompatible driver fails with GL_INVALID_ENUM or an unlinked program,
+    // so do not report it as a GL error.
+    glProgramBinary(program, format, binary, size);
+    while (glGetError() != GL_NO_ERROR) {
+    }
+    GLint linked = GL_FALSE;
+    GL(glGetProgramiv(program, GL_LINK_STATUS, &linked));
+    return linked == GL_TRUE;
+}
+
+// Sets up a program binary cache in 'directory' for the driver of the current context.
+static bool xrProgramCache_Create(xrProgramCache* cache, const char* directory) {
+    memset(cache, 0, sizeof(xrProgramCache));
+
+    GLint numFormats = 0;
+    GL(glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats));
+    if (numFormats <= 0) {
+        ALOGV("Program binaries are not supported");
+        return false;
+    }
+
+    char driverVersion[1024];
+    snprintf(
+            driverVersion,
+            sizeof(driverVersion),
+            "%s|%s|%s",
+            (const char*)glGetString(GL_VENDOR),
+            (const char*)glGetString(GL_RENDERER),
+            (const char*)glGetString(GL_VERSION));
+
+    xrProgramCacheBackend backend;
+    backend.UserData = NULL;
+    backend.GetBinarySize = xrProgramCache_GlGetBinarySize;
+    backend.GetBinary = xrProgramCache_GlGetBinary;
+    backend.LoadBinary = xrProgramCache_GlLoadBinary;
+    if (!xrProgramCache_Init(cache, directory, driverVersion, &backend)) {
+        ALOGE("Failed to create program cache %s", directory);
+        return false;
+    }
+    return true;
+}
+
+// Compiles the shaders and links them into program->Program.
+static bool xrProgram_Build(
         xrProgram* program,
-        const char* vertexSource,
-        const char* fragmentSource,
-        const bool useMultiview) {
+        const char* const* vertexSources,
+        const char* const* fragmentSources,
+        const bool retrievable) {
     GLint r;
 
     GL(program->VertexShader = glCreateShader(GL_VERTEX_SHADER));
-
-    const char* vertexSources[3] = {
-            programVersion,
-            (useMultiview) ? "#define DISABLE_MULTIVIEW 0\n" : "#define DISABLE_MULTIVIEW 1\n",
-            vertexSource};
     GL(glShaderSource(program->VertexShader, 3, vertexSources, 0));
     GL(glCompileShader(program->VertexShader));
     GL(glGetShaderiv(program->VertexShader, GL_COMPILE_STATUS, &r));
     if (r == GL_FALSE) {
         GLchar msg[4096];
         GL(glGetShaderInfoLog(program->VertexShader, sizeof(msg), 0, msg));
-        ALOGE("%s\n%s\n", vertexSource, msg);
+        ALOGE("%s\n%s\n", vertexSources[2], msg);
         return false;
     }
 
-    const char* fragmentSources[2] = {programVersion, fragmentSource};
     GL(program->FragmentShader = glCreateShader(GL_FRAGMENT_SHADER));
     GL(glShaderSource(program->FragmentShader, 2, fragmentSources, 0));
     GL(glCompileShader(program->FragmentShader));
@@ -623,22 +737,27 @@ static bool xrProgram_Create(
     if (r == GL_FALSE) {
         GLchar msg[4096];
         GL(glGetShaderInfoLog(program->FragmentShader, sizeof(msg), 0, msg));
-        ALOGE("%s\n%s\n", fragmentSource, msg);
+        ALOGE("%s\n%s\n", fragmentSources[1], msg);
         return false;
     }
 
-    GL(program->Program = glCreateProgram());
     GL(glAttachShader(program->Program, program->VertexShader));
     GL(glAttachShader(program->Program, program->FragmentShader));
 
     // Bind the vertex attribute locations.
-    for (int i = 0; i < sizeof(ProgramVertexAttributes) / sizeof(ProgramVertexAttributes[0]); i++) {
+    const int numAttributes =
+            (int)(sizeof(ProgramVertexAttributes) / sizeof(ProgramVertexAttributes[0]));
+    for (int i = 0; i < numAttributes; i++) {
         GL(glBindAttribLocation(
                 program->Program,
                 ProgramVertexAttributes[i].location,
                 ProgramVertexAttributes[i].name));
     }
 
+    if (retrievable) {
+        GL(glProgramParameteri(program->Program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+    }
+
     GL(glLinkProgram(program->Program));
     GL(glGetProgramiv(program->Program, GL_LINK_STATUS, &r));
     if (r == GL_FALSE) {
@@ -648,11 +767,56 @@ static bool xrProgram_Create(
         return false;
     }
 
+    return true;
+}
+
+// Loads the program from 'cache' if it holds a binary for these sources, otherwise builds it
+// from source and stores the binary. 'cache' may be NULL.
+static bool xrProgram_Create(
+        xrProgram* program,
+        const char* vertexSource,
+        const char* fragmentSource,
+        const bool useMultiview,
+        xrProgramCache* cache) {
+    const char* vertexSources[3] = {
+            programVersion,
+            (useMultiview) ? "#define DISABLE_MULTIVIEW 0\n" : "#define DISABLE_MULTIVIEW 1\n",
+            vertexSource};
+    const char* fragmentSources[2] = {programVersion, fragmentSource};
+
+    const bool useCache = (cache != NULL && xrProgramCache_IsEnabled(cache));
+    uint64_t key = 0;
+    if (useCache) {
+        const char* sources[5] = {
+                vertexSources[0],
+                vertexSources[1],
+                vertexSources[2],
+                fragmentSources[0],
+                fragmentSources[1]};
+        key = xrProgramCache_ComputeKey(cache, sources, 5);
+    }
+
+    GL(program->Program = glCreateProgram());
+    if (!useCache || !xrProgramCache_Load(cache, key, program->Program)) {
+        if (useCache) {
+            // The program object may be left in a failed state by the binary.
+            GL(glDeleteProgram(program->Program));
+            GL(program->Program = glCreateProgram());
+        }
+        if (!xrProgram_Build(program, vertexSources, fragmentSources, useCache)) {
+            return false;
+        }
+        if (useCache) {
+            xrProgramCache_Store(cache, key, program->Program);
+        }
+    }
+
     int numBufferBindings = 0;
 
     // Get the uniform locations.
     memset(program->UniformLocation, -1, sizeof(program->UniformLocation));
-    for (int i = 0; i < sizeof(ProgramUniforms) / sizeof(ProgramUniforms[0]); i++) {
+    const int numUniforms = (int)(sizeof(ProgramUniforms) / sizeof(ProgramUniforms[0]));
+    for (int i = 0; i < numUniforms; i++) {
         const int uniformIndex = ProgramUniforms[i].index;
         if (ProgramUniforms[i].type == xrUniform::UNIFORM_TYPE_BUFFER) {
             GL(program->UniformLocation[uniformIndex] =
@@ -716,7 +880,12 @@ static const char VERTEX_SHADER[] =
         "#endif\n"
         "in vec3 vertexPosition;\n"
         "in vec4 vertexColor;\n"
+#if COMPACT_INSTANCES
+        "in vec4 vertexOrientation;\n"
+        "in vec4 vertexTranslation;\n"
+#else
         "in mat4 vertexTransform;\n"
+#endif
         "uniform SceneMatrices\n"
         "{\n"
         "	uniform mat4 ViewMatrix[NUM_VIEWS];\n"
@@ -725,7 +894,14 @@ static const char VERTEX_SHADER[] =
         "out vec4 fragmentColor;\n"
         "void main()\n"
         "{\n"
+#if COMPACT_INSTANCES
+        "	vec4 q = vertexOrientation;\n"
+        "	vec3 p = vertexPosition * 0.1;\n"
+        "	p += 2.0 * cross( q.xyz, cross( q.xyz, p ) + q.w * p ) + vertexTranslation.xyz;\n"
+        "	gl_Position = sm.ProjectionMatrix[VIEW_ID] * ( sm.ViewMatrix[VIEW_ID] * vec4( p, 1.0 ) );\n"
+#else
         "	gl_Position = sm.ProjectionMatrix[VIEW_ID] * ( sm.ViewMatrix[VIEW_ID] * ( vertexTransform * vec4( vertexPosition * 0.1, 1.0 ) ) );\n"
+#endif
         "	fragmentColor = vertexColor;\n"
         "}\n";
 
@@ -740,6 +916,181 @@ static const char FRAGMENT_SHADER[] =
 /*
 ================================================================================
 
+xrProgramWorker
+
+================================================================================
+*/
+
+#define MAX_PROGRAM_JOBS 4
+
+typedef struct {
+    const char* VertexSource;
+    const char* FragmentSource;
+    bool UseMultiview;
+    bool Done;
+    bool Taken;
+    bool Result;
+    xrProgram Program;
+} xrProgramJob;
+
+// Builds program permutations on a thread with a context that shares objects with the main
+// context, while the main thread initializes and enters VR mode. Programs go through the
+// program cache, so after the first launch the worker only loads binaries.
+typedef struct {
+    const xrEgl* ShareEgl;
+    xrProgramCache Cache;
+    pthread_t Thread;
+    bool Started;
+    pthread_mutex_t Mutex;
+    pthread_cond_t JobDoneCondition;
+    int JobCount;
+    xrProgramJob Jobs[MAX_PROGRAM_JOBS];
+} xrProgramWorker;
+
+void* ProgramWorkerFunction(void* parm) {
+    xrProgramWorker* worker = (xrProgramWorker*)parm;
+
+    prctl(PR_SET_NAME, (long)"OVR::Programs", 0, 0, 0);
+
+    xrEgl egl;
+    xrEgl_Clear(&egl);
+    xrEgl_CreateContext(&egl, worker->ShareEgl);
+
+    const double startTime = GetTimeInSeconds();
+    for (int i = 0; i < worker->JobCount; i++) {
+        xrProgramJob* job = &worker->Jobs[i];
+        bool result = false;
+        if (egl.Context != EGL_NO_CONTEXT) {
+            result = xrProgram_Create(
+                    &job->Program,
+                    job->VertexSource,
+                    job->FragmentSource,
+                    job->UseMultiview,
+                    &worker->Cache);
+            // Make sure the program is complete before another context uses it.
+            GL(glFinish());
+        }
+
+        pthread_mutex_lock(&worker->Mutex);
+        job->Result = result;
+        job->Done = true;
+        pthread_cond_broadcast(&worker->JobDoneCondition);
+        pthread_mutex_unlock(&worker->Mutex);
+    }
+    ALOGV(
+            "Built %d programs in %.2f ms: %u cache hits, %u misses, %u rejected, %u stored",
+            worker->JobCount,
+            (GetTimeInSeconds() - startTime) * 1e3,
+            worker->Cache.Stats.Hits,
+            worker->Cache.Stats.Misses,
+            worker->Cache.Stats.Rejected,
+            worker->Cache.Stats.Stored);
+
+    xrEgl_DestroyContext(&egl);
+
+    return NULL;
+}
+
+static void xrProgramWorker_Clear(xrProgramWorker* worker) {
+    worker->ShareEgl = NULL;
+    memset(&worker->Cache, 0, sizeof(worker->Cache));
+    worker->Thread = 0;
+    worker->Started = false;
+    worker->JobCount = 0;
+}
+
+// Queues a program permutation. Must be called before xrProgramWorker_Start().
+static void xrProgramWorker_Add(
+        xrProgramWorker* worker,
+        const char* vertexSource,
+        const char* fragmentSource,
+        const bool useMultiview) {
+    if (worker->Started || worker->JobCount >= MAX_PROGRAM_JOBS) {
+        return;
+    }
+    xrProgramJob* job = &worker->Jobs[worker->JobCount++];
+    job->VertexSource = vertexSource;
+    job->FragmentSource = fragmentSource;
+    job->UseMultiview = useMultiview;
+    job->Done = false;
+    job->Taken = false;
+    job->Result = false;
+    xrProgram_Clear(&job->Program);
+}
+
+static void
+xrProgramWorker_Start(xrProgramWorker* worker, const xrEgl* shareEgl, const xrProgramCache* cache) {
+    worker->ShareEgl = shareEgl;
+    // The worker has its own copy, so the cache statistics are not shared between threads.
+    worker->Cache = *cache;
+    pthread_mutex_init(&worker->Mutex, NULL);
+    pthread_cond_init(&worker->JobDoneCondition, NULL);
+
+    const int createErr = pthread_create(&worker->Thread, NULL, ProgramWorkerFunction, worker);
+    if (createErr != 0) {
+        ALOGE("pthread_create returned %i", createErr);
+        pthread_cond_destroy(&worker->JobDoneCondition);
+        pthread_mutex_destroy(&worker->Mutex);
+        return;
+    }
+    worker->Started = true;
+}
+
+// Waits for the permutation to be built and moves it to 'program'. Returns false if the
+// permutation was not queued or failed to build.
+static bool xrProgramWorker_Take(
+        xrProgramWorker* worker,
+        const char* vertexSource,
+        const char* fragmentSource,
+        const bool useMultiview,
+        xrProgram* program) {
+    if (!worker->Started) {
+        return false;
+    }
+    for (int i = 0; i < worker->JobCount; i++) {
+        xrProgramJob* job = &worker->Jobs[i];
+        if (job->Taken || job->VertexSource != vertexSource ||
+            job->FragmentSource != fragmentSource || job->UseMultiview != useMultiview) {
+            continue;
+        }
+
+        const double startTime = GetTimeInSeconds();
+        pthread_mutex_lock(&worker->Mutex);
+        while (!job->Done) {
+            pthread_cond_wait(&worker->JobDoneCondition, &worker->Mutex);
+        }
+        pthread_mutex_unlock(&worker->Mutex);
+        ALOGV("Waited %.2f ms for program", (GetTimeInSeconds() - startTime) * 1e3);
+
+        job->Taken = true;
+        if (!job->Result) {
+            xrProgram_Destroy(&job->Program);
+            return false;
+        }
+        *program = job->Program;
+        return true;
+    }
+    return false;
+}
+
+// Must be called with a context current that shares objects with the worker.
+static void xrProgramWorker_Destroy(xrProgramWorker* worker) {
+    if (worker->Started) {
+        pthread_join(worker->Thread, NULL);
+        pthread_cond_destroy(&worker->JobDoneCondition);
+        pthread_mutex_destroy(&worker->Mutex);
+        for (int i = 0; i < worker->JobCount; i++) {
+            if (!worker->Jobs[i].Taken) {
+                xrProgram_Destroy(&worker->Jobs[i].Program);
+            }
+        }
+    }
+    xrProgramWorker_Clear(worker);
+}
+
+/*
+================================================================================
+
 xrFramebuffer
 
 ================================================================================
@@ -805,10 +1156,11 @@ static bool xrFramebuffer_Create(
             3);
     frameBuffer->TextureSwapChainLength =
             xrapiGetTextureSwapChainLength(frameBuffer->ColorTextureSwapChain);
+    // Zeroed, so xrFramebuffer_Destroy() can clean up after a failure part way through.
     frameBuffer->DepthBuffers =
-            (GLuint*)malloc(frameBuffer->TextureSwapChainLength * sizeof(GLuint));
+            (GLuint*)calloc(frameBuffer->TextureSwapChainLength, sizeof(GLuint));
     frameBuffer->FrameBuffers =
-            (GLuint*)malloc(frameBuffer->TextureSwapChainLength * sizeof(GLuint));
+            (GLuint*)calloc(frameBuffer->TextureSwapChainLength, sizeof(GLuint));
 
     ALOGV("        frameBuffer->UseMultiview = %d", frameBuffer->UseMultiview);
 
@@ -969,6 +1321,7 @@ static void xrFramebuffer_SetNone() {
 }
 
 static void xrFramebuffer_Resolve(xrFramebuffer* frameBuffer) {
+    (void)frameBuffer;
     // Discard the depth buffer, so the tiler won't need to write it back out to memory.
     const GLenum depthAttachment[1] = {GL_DEPTH_ATTACHMENT};
     glInvalidateFramebuffer(GL_DRAW_FRAMEBUFFER, 1, depthAttachment);
@@ -985,116 +1338,713 @@ static void xrFramebuffer_Advance(xrFramebuffer* frameBuffer) {
 /*
 ================================================================================
 
-xrScene
+xrFramebufferPool
 
 ================================================================================
 */
 
-#define NUM_INSTANCES 1500
-#define NUM_ROTATIONS 16
+// Enough for two sets of eye buffers, so switching back and forth between two configurations
+// never allocates.
+#define MAX_POOLED_FRAMEBUFFERS (2 * XRAPI_FRAME_LAYER_EYE_MAX)
 
 typedef struct {
-    bool CreatedScene;
-    bool CreatedVAOs;
-    unsigned int Random;
-    xrProgram Program;
-    xrGeometry Cube;
-    GLuint SceneMatrices;
-    GLuint InstanceTransformBuffer;
-    xrVector3f Rotations[NUM_ROTATIONS];
-    xrVector3f CubePositions[NUM_INSTANCES];
-    int CubeRotations[NUM_INSTANCES];
-} xrScene;
+    // Parameters the frame buffer was requested with. UseMultiview is the requested value, which
+    // may differ from the one in the frame buffer when multiview is not supported.
+    bool UseMultiview;
+    GLenum ColorFormat;
+    int Width;
+    int Height;
+    int Multisamples;
+    bool Allocated;
+    bool InUse;
+    // Time the frame buffer was released, to evict the least recently used one first.
+    double ReleaseTime;
+    xrFramebuffer FrameBuffer;
+} xrPooledFramebuffer;
+
+// Keeps released frame buffers, with their texture swap chains and depth buffers, for reuse by
+// a later request with the same parameters. Must only be used on the thread of the context
+// that created the frame buffers.
+typedef struct {
+    xrPooledFramebuffer Entries[MAX_POOLED_FRAMEBUFFERS];
+    int Created;
+    int Reused;
+} xrFramebufferPool;
+
+static void xrFramebufferPool_Clear(xrFramebufferPool* pool) {
+    for (int i = 0; i < MAX_POOLED_FRAMEBUFFERS; i++) {
+        xrPooledFramebuffer* entry = &pool->Entries[i];
+        entry->UseMultiview = false;
+        entry->ColorFormat = 0;
+        entry->Width = 0;
+        entry->Height = 0;
+        entry->Multisamples = 0;
+        entry->Allocated = false;
+        entry->InUse = false;
+        entry->ReleaseTime = 0.0;
+        xrFramebuffer_Clear(&entry->FrameBuffer);
+    }
+    pool->Created = 0;
+    pool->Reused = 0;
+}
 
-static void xrScene_Clear(xrScene* scene) {
-    scene->CreatedScene = false;
-    scene->CreatedVAOs = false;
-    scene->Random = 2;
-    scene->SceneMatrices = 0;
-    scene->InstanceTransformBuffer = 0;
+static xrFramebuffer* xrFramebufferPool_Acquire(
+        xrFramebufferPool* pool,
+        const bool useMultiview,
+        const GLenum colorFormat,
+        const int width,
+        const int height,
+        const int multisamples) {
+    // Reuse an idle frame buffer with the same parameters.
+    for (int i = 0; i < MAX_POOLED_FRAMEBUFFERS; i++) {
+        xrPooledFramebuffer* entry = &pool->Entries[i];
+        if (entry->Allocated && !entry->InUse && entry->UseMultiview == useMultiview &&
+            entry->ColorFormat == colorFormat && entry->Width == width &&
+            entry->Height == height && entry->Multisamples == multisamples) {
+            entry->InUse = true;
+            pool->Reused++;
+            return &entry->FrameBuffer;
+        }
+    }
 
-    xrProgram_Clear(&scene->Program);
-    xrGeometry_Clear(&scene->Cube);
-}
+    // Otherwise take an empty entry, or evict the least recently released idle frame buffer.
+    xrPooledFramebuffer* slot = NULL;
+    for (int i = 0; i < MAX_POOLED_FRAMEBUFFERS; i++) {
+        xrPooledFramebuffer* entry = &pool->Entries[i];
+        if (!entry->Allocated) {
+            slot = entry;
+            break;
+        }
+        if (!entry->InUse && (slot == NULL || entry->ReleaseTime < slot->ReleaseTime)) {
+            slot = entry;
+        }
+    }
+    if (slot == NULL) {
+        ALOGE(
+                "xrFramebufferPool_Acquire: all %d frame buffers are in use",
+                MAX_POOLED_FRAMEBUFFERS);
+        return NULL;
+    }
+    if (slot->Allocated) {
+        xrFramebuffer_Destroy(&slot->FrameBuffer);
+        slot->Allocated = false;
+    }
 
-static bool xrScene_IsCreated(xrScene* scene) {
-    return scene->CreatedScene;
+    if (!xrFramebuffer_Create(
+                &slot->FrameBuffer, useMultiview, colorFormat, width, height, multisamples)) {
+        // Free what was created and leave the slot empty.
+        xrFramebuffer_Destroy(&slot->FrameBuffer);
+        return NULL;
+    }
+    slot->UseMultiview = useMultiview;
+    slot->ColorFormat = colorFormat;
+    slot->Width = width;
+    slot->Height = height;
+    slot->Multisamples = multisamples;
+    slot->Allocated = true;
+    slot->InUse = true;
+    pool->Created++;
+    return &slot->FrameBuffer;
 }
 
-static void xrScene_CreateVAOs(xrScene* scene) {
-    if (!scene->CreatedVAOs) {
-        xrGeometry_CreateVAO(&scene->Cube);
-
-        // Modify the VAO to use the instance transform attributes.
-        GL(glBindVertexArray(scene->Cube.VertexArrayObject));
-        GL(glBindBuffer(GL_ARRAY_BUFFER, scene->InstanceTransformBuffer));
-        for (int i = 0; i < 4; i++) {
-            GL(glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOCATION_TRANSFORM + i));
-            GL(glVertexAttribPointer(
-                    VERTEX_ATTRIBUTE_LOCATION_TRANSFORM + i,
-                    4,
-                    GL_FLOAT,
-                    false,
-                    4 * 4 * sizeof(float),
-                    (void*)(i * 4 * sizeof(float))));
-            GL(glVertexAttribDivisor(VERTEX_ATTRIBUTE_LOCATION_TRANSFORM + i, 1));
+static void xrFramebufferPool_Release(xrFramebufferPool* pool, xrFramebuffer* frameBuffer) {
+    for (int i = 0; i < MAX_POOLED_FRAMEBUFFERS; i++) {
+        xrPooledFramebuffer* entry = &pool->Entries[i];
+        if (&entry->FrameBuffer == frameBuffer) {
+            entry->InUse = false;
+            entry->ReleaseTime = GetTimeInSeconds();
+            return;
         }
-        GL(glBindVertexArray(0));
+    }
+}
 
-        scene->CreatedVAOs = true;
+static void xrFramebufferPool_Destroy(xrFramebufferPool* pool) {
+    for (int i = 0; i < MAX_POOLED_FRAMEBUFFERS; i++) {
+        if (pool->Entries[i].Allocated) {
+            xrFramebuffer_Destroy(&pool->Entries[i].FrameBuffer);
+        }
     }
+    xrFramebufferPool_Clear(pool);
 }
 
-static void xrScene_DestroyVAOs(xrScene* scene) {
-    if (scene->CreatedVAOs) {
-        xrGeometry_DestroyVAO(&scene->Cube);
+/*
+================================================================================
 
-        scene->CreatedVAOs = false;
+xrFrustum
+
+================================================================================
+*/
+
+// A plane is stored as an inward facing unit normal in xyz and the distance in w.
+// A point p is inside the plane when dot( xyz, p ) + w >= 0.
+typedef struct {
+    xrVector4f Planes[6];
+} xrFrustum;
+
+enum xrFrustumPlane {
+    FRUSTUM_PLANE_LEFT,
+    FRUSTUM_PLANE_RIGHT,
+    FRUSTUM_PLANE_BOTTOM,
+    FRUSTUM_PLANE_TOP,
+    FRUSTUM_PLANE_NEAR,
+    FRUSTUM_PLANE_FAR
+};
+
+// A plane that every point is inside of.
+static xrVector4f xrFrustum_DisabledPlane() {
+    xrVector4f plane = {0.0f, 0.0f, 0.0f, FLT_MAX};
+    return plane;
+}
+
+static xrVector4f xrFrustum_NormalizePlane(const xrVector4f plane) {
+    const float length = sqrtf(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+    if (length < 1e-6f) {
+        // The far plane of an infinite projection degenerates.
+        return xrFrustum_DisabledPlane();
     }
+    const float scale = 1.0f / length;
+    xrVector4f out = {plane.x * scale, plane.y * scale, plane.z * scale, plane.w * scale};
+    return out;
 }
 
-// Returns a random float in the range [0, 1].
-static float xrScene_RandomFloat(xrScene* scene) {
-    scene->Random = 1664525L * scene->Random + 1013904223L;
-    unsigned int rf = 0x3F800000 | (scene->Random & 0x007FFFFF);
-    return (*(float*)&rf) - 1.0f;
+// Extracts the world space planes of a projection * view matrix (Gribb & Hartmann).
+static void xrFrustum_ExtractPlanes(const xrMatrix4f* m, xrVector4f planes[6]) {
+    for (int i = 0; i < 3; i++) {
+        xrVector4f lower = {
+                m->M[3][0] + m->M[i][0],
+                m->M[3][1] + m->M[i][1],
+                m->M[3][2] + m->M[i][2],
+                m->M[3][3] + m->M[i][3]};
+        xrVector4f upper = {
+                m->M[3][0] - m->M[i][0],
+                m->M[3][1] - m->M[i][1],
+                m->M[3][2] - m->M[i][2],
+                m->M[3][3] - m->M[i][3]};
+        planes[i * 2 + 0] = xrFrustum_NormalizePlane(lower);
+        planes[i * 2 + 1] = xrFrustum_NormalizePlane(upper);
+    }
 }
 
-static void xrScene_Create(xrScene* scene, bool useMultiview) {
-    xrProgram_Create(&scene->Program, VERTEX_SHADER, FRAGMENT_SHADER, useMultiview);
-    xrGeometry_CreateCube(&scene->Cube);
+static float xrFrustum_PlaneDot(const xrVector4f* plane, const xrVector3f* v) {
+    return plane->x * v->x + plane->y * v->y + plane->z * v->z;
+}
 
-    // Create the instance transform attribute buffer.
-    GL(glGenBuffers(1, &scene->InstanceTransformBuffer));
-    GL(glBindBuffer(GL_ARRAY_BUFFER, scene->InstanceTransformBuffer));
-    GL(glBufferData(GL_ARRAY_BUFFER, NUM_INSTANCES * 4 * 4 * sizeof(float), NULL, GL_DYNAMIC_DRAW));
-    GL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+static xrVector3f xrFrustum_EdgeDirection(
+        const xrVector4f* a,
+        const xrVector4f* b,
+        const xrVector3f* forward) {
+    xrVector3f dir = {
+            a->y * b->z - a->z * b->y, a->z * b->x - a->x * b->z, a->x * b->y - a->y * b->x};
+    if (dir.x * forward->x + dir.y * forward->y + dir.z * forward->z < 0.0f) {
+        dir.x = -dir.x;
+        dir.y = -dir.y;
+        dir.z = -dir.z;
+    }
+    return dir;
+}
 
-    // Setup the scene matrices.
-    GL(glGenBuffers(1, &scene->SceneMatrices));
-    GL(glBindBuffer(GL_UNIFORM_BUFFER, scene->SceneMatrices));
-    GL(glBufferData(
-            GL_UNIFORM_BUFFER,
-            2 * sizeof(xrMatrix4f) /* 2 view matrices */ +
-            2 * sizeof(xrMatrix4f) /* 2 projection matrices */,
-            NULL,
-            GL_STATIC_DRAW));
-    GL(glBindBuffer(GL_UNIFORM_BUFFER, 0));
+// Builds a single conservative frustum that contains the view frusta of both eyes, so the
+// instances only have to be tested once for both views. Each side plane is taken from the
+// eye whose plane also contains the apex and the edges of the other eye's frustum. For the
+// usual parallel or slightly canted eyes this is the outer eye's plane. A side for which
+// neither eye's plane qualifies is not culled against.
+static void xrFrustum_CreateStereo(xrFrustum* frustum, const xrTracking2* tracking) {
+    xrVector4f eyePlanes[2][6];
+    xrVector3f eyeApex[2];
+    xrVector3f eyeEdges[2][4];
+    for (int eye = 0; eye < 2; eye++) {
+        const xrMatrix4f viewProjection = xrMatrix4f_Multiply(
+                &tracking->Eye[eye].ProjectionMatrix, &tracking->Eye[eye].ViewMatrix);
+        xrFrustum_ExtractPlanes(&viewProjection, eyePlanes[eye]);
+
+        const xrMatrix4f eyeTransform = xrMatrix4f_Inverse(&tracking->Eye[eye].ViewMatrix);
+        eyeApex[eye].x = eyeTransform.M[0][3];
+        eyeApex[eye].y = eyeTransform.M[1][3];
+        eyeApex[eye].z = eyeTransform.M[2][3];
+        const xrVector3f forward = {
+                -eyeTransform.M[0][2], -eyeTransform.M[1][2], -eyeTransform.M[2][2]};
+
+        const xrVector4f* planes = eyePlanes[eye];
+        eyeEdges[eye][0] = xrFrustum_EdgeDirection(
+                &planes[FRUSTUM_PLANE_LEFT], &planes[FRUSTUM_PLANE_BOTTOM], &forward);
+        eyeEdges[eye][1] = xrFrustum_EdgeDirection(
+                &planes[FRUSTUM_PLANE_LEFT], &planes[FRUSTUM_PLANE_TOP], &forward);
+        eyeEdges[eye][2] = xrFrustum_EdgeDirection(
+                &planes[FRUSTUM_PLANE_RIGHT], &planes[FRUSTUM_PLANE_BOTTOM], &forward);
+        eyeEdges[eye][3] = xrFrustum_EdgeDirection(
+                &planes[FRUSTUM_PLANE_RIGHT], &planes[FRUSTUM_PLANE_TOP], &forward);
+    }
 
-    // Setup random rotations.
-    for (int i = 0; i < NUM_ROTATIONS; i++) {
-        scene->Rotations[i].x = xrScene_RandomFloat(scene);
-        scene->Rotations[i].y = xrScene_RandomFloat(scene);
-        scene->Rotations[i].z = xrScene_RandomFloat(scene);
+    const float epsilon = 1e-5f;
+    for (int p = FRUSTUM_PLANE_LEFT; p <= FRUSTUM_PLANE_TOP; p++) {
+        frustum->Planes[p] = xrFrustum_DisabledPlane();
+        for (int eye = 0; eye < 2; eye++) {
+            const xrVector4f* plane = &eyePlanes[eye][p];
+            const int other = eye ^ 1;
+            bool contains = xrFrustum_PlaneDot(plane, &eyeApex[other]) + plane->w >= -epsilon;
+            for (int e = 0; e < 4 && contains; e++) {
+                contains = xrFrustum_PlaneDot(plane, &eyeEdges[other][e]) >= -epsilon;
+            }
+            if (contains) {
+                frustum->Planes[p] = *plane;
+                break;
+            }
+        }
     }
 
-    // Setup random cube positions and rotations.
-    for (int i = 0; i < NUM_INSTANCES; i++) {
-        // Using volatile keeps the compiler from optimizing away multiple calls to
-        // xrScene_RandomFloat().
-        volatile float rx, ry, rz;
-        for (;;) {
-            rx = (xrScene_RandomFloat(scene) - 0.5f) * (50.0f + sqrt(NUM_INSTANCES));
+    // Move the near plane back to the rearmost eye.
+    xrVector4f nearPlane = eyePlanes[0][FRUSTUM_PLANE_NEAR];
+    for (int eye = 0; eye < 2; eye++) {
+        const float w = -xrFrustum_PlaneDot(&nearPlane, &eyeApex[eye]);
+        nearPlane.w = (eye == 0 || w > nearPlane.w) ? w : nearPlane.w;
+    }
+    frustum->Planes[FRUSTUM_PLANE_NEAR] = nearPlane;
+
+    // Use the farther of the two far planes when they are parallel.
+    const xrVector4f* far0 = &eyePlanes[0][FRUSTUM_PLANE_FAR];
+    const xrVector4f* far1 = &eyePlanes[1][FRUSTUM_PLANE_FAR];
+    if (far0->w != FLT_MAX && far1->w != FLT_MAX &&
+        far0->x * far1->x + far0->y * far1->y + far0->z * far1->z > 0.9999f) {
+        frustum->Planes[FRUSTUM_PLANE_FAR] = *far0;
+        frustum->Planes[FRUSTUM_PLANE_FAR].w = (far0->w > far1->w) ? far0->w : far1->w;
+    } else {
+        frustum->Planes[FRUSTUM_PLANE_FAR] = xrFrustum_DisabledPlane();
+    }
+}
+
+// Tests spheres with centers in structure-of-arrays layout and a common radius against the
+// frustum. Writes the indices of the spheres that are not completely outside to 'visible'
+// in ascending order and returns their count.
+static int xrFrustum_CullSpheresScalar(
+        const xrFrustum* frustum,
+        const float* x,
+        const float* y,
+        const float* z,
+        const float radius,
+        const int first,
+        const int count,
+        int* visible) {
+    int numVisible = 0;
+    for (int i = first; i < count; i++) {
+        bool inside = true;
+        for (int p = 0; p < 6; p++) {
+            const xrVector4f* plane = &frustum->Planes[p];
+            inside &= plane->x * x[i] + plane->y * y[i] + plane->z * z[i] + plane->w > -radius;
+        }
+        // Always write and only advance for visible spheres to avoid a branch.
+        visible[numVisible] = i;
+        numVisible += inside;
+    }
+    return numVisible;
+}
+
+static int xrFrustum_CullSpheres(
+        const xrFrustum* frustum,
+        const float* x,
+        const float* y,
+        const float* z,
+        const float radius,
+        const int count,
+        int* visible) {
+    int numVisible = 0;
+    int i = 0;
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    const float32x4_t negRadius = vdupq_n_f32(-radius);
+    for (; i + 4 <= count; i += 4) {
+        const float32x4_t px = vld1q_f32(x + i);
+        const float32x4_t py = vld1q_f32(y + i);
+        const float32x4_t pz = vld1q_f32(z + i);
+        uint32x4_t inside = vdupq_n_u32(0xFFFFFFFF);
+        for (int p = 0; p < 6; p++) {
+            const xrVector4f* plane = &frustum->Planes[p];
+            float32x4_t d = vdupq_n_f32(plane->w);
+            d = vmlaq_n_f32(d, px, plane->x);
+            d = vmlaq_n_f32(d, py, plane->y);
+            d = vmlaq_n_f32(d, pz, plane->z);
+            inside = vandq_u32(inside, vcgtq_f32(d, negRadius));
+        }
+        visible[numVisible] = i + 0;
+        numVisible += vgetq_lane_u32(inside, 0) & 1;
+        visible[numVisible] = i + 1;
+        numVisible += vgetq_lane_u32(inside, 1) & 1;
+        visible[numVisible] = i + 2;
+        numVisible += vgetq_lane_u32(inside, 2) & 1;
+        visible[numVisible] = i + 3;
+        numVisible += vgetq_lane_u32(inside, 3) & 1;
+    }
+#endif
+    numVisible += xrFrustum_CullSpheresScalar(
+            frustum, x, y, z, radius, i, count, visible + numVisible);
+    return numVisible;
+}
+
+#if CULL_BENCHMARK
+static void xrFrustum_Benchmark() {
+    const int count = 100000;
+    const int iterations = 100;
+    float* x = (float*)malloc(count * sizeof(float));
+    float* y = (float*)malloc(count * sizeof(float));
+    float* z = (float*)malloc(count * sizeof(float));
+    int* visible = (int*)malloc(count * sizeof(int));
+
+    unsigned int random = 2;
+    for (int i = 0; i < count; i++) {
+        float* dst[3] = {&x[i], &y[i], &z[i]};
+        for (int j = 0; j < 3; j++) {
+            random = 1664525L * random + 1013904223L;
+            *dst[j] = ((random >> 8) * (1.0f / 16777216.0f) - 0.5f) * 100.0f;
+        }
+    }
+
+    xrTracking2 tracking;
+    memset(&tracking, 0, sizeof(tracking));
+    for (int eye = 0; eye < 2; eye++) {
+        tracking.Eye[eye].ProjectionMatrix =
+                xrMatrix4f_CreateProjectionFov(90.0f, 90.0f, 0.0f, 0.0f, 0.1f, 0.0f);
+        tracking.Eye[eye].ViewMatrix =
+                xrMatrix4f_CreateTranslation(eye ? -0.032f : 0.032f, 0.0f, 0.0f);
+    }
+    xrFrustum frustum;
+    xrFrustum_CreateStereo(&frustum, &tracking);
+
+    int numVisible = 0;
+    const double simdStart = GetTimeInSeconds();
+    for (int i = 0; i < iterations; i++) {
+        numVisible = xrFrustum_CullSpheres(&frustum, x, y, z, 0.2f, count, visible);
+    }
+    const double simdTime = (GetTimeInSeconds() - simdStart) / iterations;
+    const double scalarStart = GetTimeInSeconds();
+    for (int i = 0; i < iterations; i++) {
+        numVisible = xrFrustum_CullSpheresScalar(&frustum, x, y, z, 0.2f, 0, count, visible);
+    }
+    const double scalarTime = (GetTimeInSeconds() - scalarStart) / iterations;
+
+    ALOGV(
+            "Cull benchmark: %d of %d spheres visible, %.3f ms per frame, %.3f ms scalar",
+            numVisible,
+            count,
+            simdTime * 1000.0,
+            scalarTime * 1000.0);
+
+    free(x);
+    free(y);
+    free(z);
+    free(visible);
+}
+#endif // CULL_BENCHMARK
+
+/*
+================================================================================
+
+xrInstanceSort
+
+================================================================================
+*/
+
+// Scratch memory for sorting up to 'Capacity' instances.
+typedef struct {
+    uint32_t* Keys[2];
+    int* Indices;
+    int Capacity;
+} xrInstanceSort;
+
+static void xrInstanceSort_Clear(xrInstanceSort* sort) {
+    sort->Keys[0] = NULL;
+    sort->Keys[1] = NULL;
+    sort->Indices = NULL;
+    sort->Capacity = 0;
+}
+
+static void xrInstanceSort_Create(xrInstanceSort* sort, const int capacity) {
+    sort->Keys[0] = (uint32_t*)malloc(capacity * sizeof(uint32_t));
+    sort->Keys[1] = (uint32_t*)malloc(capacity * sizeof(uint32_t));
+    sort->Indices = (int*)malloc(capacity * sizeof(int));
+    sort->Capacity = capacity;
+}
+
+static void xrInstanceSort_Destroy(xrInstanceSort* sort) {
+    free(sort->Keys[0]);
+    free(sort->Keys[1]);
+    free(sort->Indices);
+    xrInstanceSort_Clear(sort);
+}
+
+// Maps a float to an unsigned key with the same order: negative values have all bits flipped,
+// positive values only the sign bit.
+static inline uint32_t xrInstanceSort_FloatKey(const float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    const uint32_t mask = (uint32_t)(-(int32_t)(bits >> 31)) | 0x80000000u;
+    return bits ^ mask;
+}
+
+// Sorts the instance indices front to back by their depth along the view direction of
+// 'headPose'. The depths are turned into order preserving 32-bit keys and ordered with an LSD
+// radix sort of four 8-bit passes, which is stable and linear in the count. Passes where all
+// keys have the same byte are skipped.
+static void xrInstanceSort_FrontToBack(
+        xrInstanceSort* sort,
+        const float* x,
+        const float* y,
+        const float* z,
+        const xrPosef* headPose,
+        int* indices,
+        const int count) {
+    if (count < 2 || count > sort->Capacity) {
+        return;
+    }
+
+    const xrQuatf* q = &headPose->Orientation;
+    const xrVector3f forward = {
+            -2.0f * (q->x * q->z + q->w * q->y),
+            -2.0f * (q->y * q->z - q->w * q->x),
+            -(1.0f - 2.0f * (q->x * q->x + q->y * q->y))};
+    const float bias = -(forward.x * headPose->Position.x + forward.y * headPose->Position.y +
+                         forward.z * headPose->Position.z);
+
+    // Build the keys and the histograms of all passes in one sweep.
+    int histograms[4][256];
+    memset(histograms, 0, sizeof(histograms));
+    uint32_t* keys = sort->Keys[0];
+    for (int i = 0; i < count; i++) {
+        const int instance = indices[i];
+        const float depth = forward.x * x[instance] + forward.y * y[instance] +
+                            forward.z * z[instance] + bias;
+        const uint32_t key = xrInstanceSort_FloatKey(depth);
+        keys[i] = key;
+        histograms[0][key & 255]++;
+        histograms[1][(key >> 8) & 255]++;
+        histograms[2][(key >> 16) & 255]++;
+        histograms[3][key >> 24]++;
+    }
+
+    // Ping-pong between 'indices' and the scratch buffers.
+    uint32_t* srcKeys = sort->Keys[0];
+    uint32_t* dstKeys = sort->Keys[1];
+    int* srcIndices = indices;
+    int* dstIndices = sort->Indices;
+    for (int pass = 0; pass < 4; pass++) {
+        const int shift = pass * 8;
+        if (histograms[pass][(srcKeys[0] >> shift) & 255] == count) {
+            continue;
+        }
+        int offset = 0;
+        for (int i = 0; i < 256; i++) {
+            const int n = histograms[pass][i];
+            histograms[pass][i] = offset;
+            offset += n;
+        }
+        for (int i = 0; i < count; i++) {
+            const uint32_t key = srcKeys[i];
+            const int dst = histograms[pass][(key >> shift) & 255]++;
+            dstKeys[dst] = key;
+            dstIndices[dst] = srcIndices[i];
+        }
+        uint32_t* nextKeys = srcKeys;
+        srcKeys = dstKeys;
+        dstKeys = nextKeys;
+        int* nextIndices = srcIndices;
+        srcIndices = dstIndices;
+        dstIndices = nextIndices;
+    }
+    if (srcIndices != indices) {
+        memcpy(indices, srcIndices, count * sizeof(int));
+    }
+}
+
+/*
+================================================================================
+
+xrScene
+
+================================================================================
+*/
+
+#define NUM_INSTANCES 1500
+#define NUM_ROTATIONS 16
+
+// Radius of the bounding sphere of a cube with half extents of 0.1.
+static const float CUBE_BOUNDING_RADIUS = 0.1f * 1.7320508f;
+
+#if COMPACT_INSTANCES
+#define INSTANCE_TRANSFORM_SIZE sizeof(xrPackedInstance)
+#else
+#define INSTANCE_TRANSFORM_SIZE sizeof(xrMatrix4f)
+#endif
+
+typedef struct {
+    bool CreatedScene;
+    bool CreatedVAOs;
+    unsigned int Random;
+    xrProgram Program;
+    xrGeometry Cube;
+    GLuint SceneMatrices;
+    GLuint InstanceTransformBuffer;
+    xrVector3f Rotations[NUM_ROTATIONS];
+    xrVector3f CubePositions[NUM_INSTANCES];
+    int CubeRotations[NUM_INSTANCES];
+    // Structure-of-arrays copy of the cube positions for culling.
+    float CubeCentersX[NUM_INSTANCES];
+    float CubeCentersY[NUM_INSTANCES];
+    float CubeCentersZ[NUM_INSTANCES];
+#if COMPACT_INSTANCES
+    // Cube positions packed for the instance transform buffer.
+    uint16_t PackedCubePositions[NUM_INSTANCES][4];
+#endif
+} xrScene;
+
+static void xrScene_Clear(xrScene* scene) {
+    scene->CreatedScene = false;
+    scene->CreatedVAOs = false;
+    scene->Random = 2;
+    scene->SceneMatrices = 0;
+    scene->InstanceTransformBuffer = 0;
+
+    xrProgram_Clear(&scene->Program);
+    xrGeometry_Clear(&scene->Cube);
+}
+
+static bool xrScene_IsCreated(xrScene* scene) {
+    return scene->CreatedScene;
+}
+
+static void xrScene_CreateVAOs(xrScene* scene) {
+    if (!scene->CreatedVAOs) {
+        xrGeometry_CreateVAO(&scene->Cube);
+
+        // Modify the VAO to use the instance transform attributes.
+        GL(glBindVertexArray(scene->Cube.VertexArrayObject));
+        GL(glBindBuffer(GL_ARRAY_BUFFER, scene->InstanceTransformBuffer));
+#if COMPACT_INSTANCES
+        GL(glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOCATION_TRANSFORM));
+        GL(glVertexAttribPointer(
+                VERTEX_ATTRIBUTE_LOCATION_TRANSFORM,
+                4,
+                GL_SHORT,
+                true,
+                sizeof(xrPackedInstance),
+                (void*)offsetof(xrPackedInstance, Orientation)));
+        GL(glVertexAttribDivisor(VERTEX_ATTRIBUTE_LOCATION_TRANSFORM, 1));
+        GL(glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOCATION_TRANSFORM + 1));
+        GL(glVertexAttribPointer(
+                VERTEX_ATTRIBUTE_LOCATION_TRANSFORM + 1,
+                4,
+                GL_HALF_FLOAT,
+                false,
+                sizeof(xrPackedInstance),
+                (void*)offsetof(xrPackedInstance, Position)));
+        GL(glVertexAttribDivisor(VERTEX_ATTRIBUTE_LOCATION_TRANSFORM + 1, 1));
+#else
+        for (int i = 0; i < 4; i++) {
+            GL(glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOCATION_TRANSFORM + i));
+            GL(glVertexAttribPointer(
+                    VERTEX_ATTRIBUTE_LOCATION_TRANSFORM + i,
+                    4,
+                    GL_FLOAT,
+                    false,
+                    4 * 4 * sizeof(float),
+                    (void*)(i * 4 * sizeof(float))));
+            GL(glVertexAttribDivisor(VERTEX_ATTRIBUTE_LOCATION_TRANSFORM + i, 1));
+        }
+#endif
+        GL(glBindVertexArray(0));
+
+        scene->CreatedVAOs = true;
+    }
+}
+
+static void xrScene_DestroyVAOs(xrScene* scene) {
+    if (scene->CreatedVAOs) {
+        xrGeometry_DestroyVAO(&scene->Cube);
+
+        scene->CreatedVAOs = false;
+    }
+}
+
+// Returns a random float in the range [0, 1].
+static float xrScene_RandomFloat(xrScene* scene) {
+    scene->Random = 1664525L * scene->Random + 1013904223L;
+    unsigned int rf = 0x3F800000 | (scene->Random & 0x007FFFFF);
+    return (*(float*)&rf) - 1.0f;
+}
+
+#if COMPACT_INSTANCES
+// Returns the quaternions the compact instance shader rotates by. The matrix path uploads the
+// rows of xrMatrix4f_CreateRotation() as the columns of the instance transform, which rotates
+// by the transpose, so each is the conjugate of the rotation Z * Y * X.
+static void xrScene_CreateInstanceOrientations(
+        xrQuatf orientations[NUM_ROTATIONS],
+        const xrVector3f radians[NUM_ROTATIONS]) {
+    float halfAngles[NUM_ROTATIONS * 3];
+    for (int i = 0; i < NUM_ROTATIONS; i++) {
+        halfAngles[i * 3 + 0] = radians[i].x * 0.5f;
+        halfAngles[i * 3 + 1] = radians[i].y * 0.5f;
+        halfAngles[i * 3 + 2] = radians[i].z * 0.5f;
+    }
+    // The orientations are packed to 16 bits, which is coarser than the fast sine and cosine.
+    float sines[NUM_ROTATIONS * 3];
+    float cosines[NUM_ROTATIONS * 3];
+    xrSinCos_Array(sines, cosines, halfAngles, NUM_ROTATIONS * 3, XRAPI_SINCOS_ACCURACY_FAST);
+    for (int i = 0; i < NUM_ROTATIONS; i++) {
+        const float sinX = sines[i * 3 + 0];
+        const float cosX = cosines[i * 3 + 0];
+        const float sinY = sines[i * 3 + 1];
+        const float cosY = cosines[i * 3 + 1];
+        const float sinZ = sines[i * 3 + 2];
+        const float cosZ = cosines[i * 3 + 2];
+        xrQuatf* q = &orientations[i];
+        q->x = -(cosZ * cosY * sinX - sinZ * cosX * sinY);
+        q->y = -(cosZ * cosX * sinY + sinZ * cosY * sinX);
+        q->z = -(sinZ * cosX * cosY - cosZ * sinX * sinY);
+        q->w = cosZ * cosX * cosY + sinZ * sinX * sinY;
+    }
+}
+#endif
+
+static void xrScene_Create(
+        xrScene* scene,
+        bool useMultiview,
+        xrProgramWorker* programWorker,
+        xrProgramCache* programCache) {
+    if (!xrProgramWorker_Take(
+                programWorker, VERTEX_SHADER, FRAGMENT_SHADER, useMultiview, &scene->Program)) {
+        xrProgram_Create(
+                &scene->Program, VERTEX_SHADER, FRAGMENT_SHADER, useMultiview, programCache);
+    }
+    xrGeometry_CreateCube(&scene->Cube);
+
+    // Create the instance transform attribute buffer.
+    GL(glGenBuffers(1, &scene->InstanceTransformBuffer));
+    GL(glBindBuffer(GL_ARRAY_BUFFER, scene->InstanceTransformBuffer));
+    GL(glBufferData(
+            GL_ARRAY_BUFFER, NUM_INSTANCES * INSTANCE_TRANSFORM_SIZE, NULL, GL_DYNAMIC_DRAW));
+    GL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+
+    // Setup the scene matrices.
+    GL(glGenBuffers(1, &scene->SceneMatrices));
+    GL(glBindBuffer(GL_UNIFORM_BUFFER, scene->SceneMatrices));
+    GL(glBufferData(
+            GL_UNIFORM_BUFFER,
+            2 * sizeof(xrMatrix4f) /* 2 view matrices */ +
+            2 * sizeof(xrMatrix4f) /* 2 projection matrices */,
+            NULL,
+            GL_STATIC_DRAW));
+    GL(glBindBuffer(GL_UNIFORM_BUFFER, 0));
+
+    // Setup random rotations.
+    for (int i = 0; i < NUM_ROTATIONS; i++) {
+        scene->Rotations[i].x = xrScene_RandomFloat(scene);
+        scene->Rotations[i].y = xrScene_RandomFloat(scene);
+        scene->Rotations[i].z = xrScene_RandomFloat(scene);
+    }
+
+    // Setup random cube positions and rotations.
+    for (int i = 0; i < NUM_INSTANCES; i++) {
+        // Using volatile keeps the compiler from optimizing away multiple calls to
+        // xrScene_RandomFloat().
+        volatile float rx, ry, rz;
+        for (;;) {
+            rx = (xrScene_RandomFloat(scene) - 0.5f) * (50.0f + sqrt(NUM_INSTANCES));
             ry = (xrScene_RandomFloat(scene) - 0.5f) * (50.0f + sqrt(NUM_INSTANCES));
             rz = (xrScene_RandomFloat(scene) - 0.5f) * (50.0f + sqrt(NUM_INSTANCES));
             // If too close to 0,0,0
@@ -1142,11 +2092,19 @@ static void xrScene_Create(xrScene* scene, bool useMultiview) {
         scene->CubeRotations[insert] = (int)(xrScene_RandomFloat(scene) * (NUM_ROTATIONS - 0.1f));
     }
 
-    scene->CreatedScene = true;
+    for (int i = 0; i < NUM_INSTANCES; i++) {
+        scene->CubeCentersX[i] = scene->CubePositions[i].x;
+        scene->CubeCentersY[i] = scene->CubePositions[i].y;
+        scene->CubeCentersZ[i] = scene->CubePositions[i].z;
+    }
 
-#if !MULTI_THREADED
-    xrScene_CreateVAOs(scene);
+#if COMPACT_INSTANCES
+    // The cubes do not move, so their positions are only packed once.
+    xrPackedInstance_PackPositions(
+            &scene->PackedCubePositions[0][0], scene->CubePositions, NUM_INSTANCES);
 #endif
+
+    scene->CreatedScene = true;
 }
 
 static void xrScene_Destroy(xrScene* scene) {
@@ -1164,6 +2122,192 @@ static void xrScene_Destroy(xrScene* scene) {
 /*
 ================================================================================
 
+xrSceneLoader
+
+================================================================================
+*/
+
+// Builds the scene on a thread with a context that shares objects with the main context, so
+// the main thread can keep submitting loading icon frames. The scene is built into the
+// loader's own copy and only handed over once it is complete.
+typedef struct {
+    const xrEgl* ShareEgl;
+    bool UseMultiview;
+    xrProgramWorker* ProgramWorker;
+    xrProgramCache ProgramCache;
+    pthread_t Thread;
+    bool Requested;
+    bool Started;
+    pthread_mutex_t Mutex;
+    // Written by the loader thread.
+    bool Done;
+    bool Succeeded;
+    double DoneTime;
+    xrScene Scene;
+    // Loading statistics, only accessed by the main thread.
+    double StartTime;
+    int LoadingFrames;
+    double LastLoadingFrameTime;
+    double MaxLoadingFrameInterval;
+    bool ReportedFirstSceneFrame;
+} xrSceneLoader;
+
+void* SceneLoaderFunction(void* parm) {
+    xrSceneLoader* loader = (xrSceneLoader*)parm;
+
+    prctl(PR_SET_NAME, (long)"OVR::Loader", 0, 0, 0);
+
+    xrEgl egl;
+    xrEgl_Clear(&egl);
+    xrEgl_CreateContext(&egl, loader->ShareEgl);
+
+    const bool succeeded = (egl.Context != EGL_NO_CONTEXT);
+    if (succeeded) {
+        xrScene_Create(
+                &loader->Scene, loader->UseMultiview, loader->ProgramWorker, &loader->ProgramCache);
+        // Make sure all objects are complete before another context uses them.
+        GL(glFinish());
+    }
+
+    xrEgl_DestroyContext(&egl);
+
+    pthread_mutex_lock(&loader->Mutex);
+    loader->Succeeded = succeeded;
+    loader->DoneTime = GetTimeInSeconds();
+    loader->Done = true;
+    pthread_mutex_unlock(&loader->Mutex);
+
+    return NULL;
+}
+
+static void xrSceneLoader_Clear(xrSceneLoader* loader) {
+    loader->ShareEgl = NULL;
+    loader->UseMultiview = false;
+    loader->ProgramWorker = NULL;
+    memset(&loader->ProgramCache, 0, sizeof(loader->ProgramCache));
+    loader->Thread = 0;
+    loader->Requested = false;
+    loader->Started = false;
+    loader->Done = false;
+    loader->Succeeded = false;
+    loader->DoneTime = 0.0;
+    xrScene_Clear(&loader->Scene);
+    loader->StartTime = 0.0;
+    loader->LoadingFrames = 0;
+    loader->LastLoadingFrameTime = 0.0;
+    loader->MaxLoadingFrameInterval = 0.0;
+    loader->ReportedFirstSceneFrame = false;
+}
+
+static void xrSceneLoader_Start(
+        xrSceneLoader* loader,
+        const xrEgl* shareEgl,
+        const bool useMultiview,
+        xrProgramWorker* programWorker,
+        const xrProgramCache* programCache) {
+    loader->ShareEgl = shareEgl;
+    loader->UseMultiview = useMultiview;
+    loader->ProgramWorker = programWorker;
+    // The loader has its own copy, so the cache statistics are not shared between threads.
+    loader->ProgramCache = *programCache;
+    loader->Requested = true;
+    loader->StartTime = GetTimeInSeconds();
+    pthread_mutex_init(&loader->Mutex, NULL);
+
+    const int createErr = pthread_create(&loader->Thread, NULL, SceneLoaderFunction, loader);
+    if (createErr != 0) {
+        ALOGE("pthread_create returned %i", createErr);
+        pthread_mutex_destroy(&loader->Mutex);
+        return;
+    }
+    loader->Started = true;
+}
+
+// Call for every loading icon frame that is submitted.
+static void xrSceneLoader_CountLoadingFrame(xrSceneLoader* loader) {
+    const double now = GetTimeInSeconds();
+    if (loader->LastLoadingFrameTime > 0.0) {
+        const double interval = now - loader->LastLoadingFrameTime;
+        if (interval > loader->MaxLoadingFrameInterval) {
+            loader->MaxLoadingFrameInterval = interval;
+        }
+    }
+    loader->LastLoadingFrameTime = now;
+    loader->LoadingFrames++;
+}
+
+// Moves the scene to 'scene' once the loader is done. Returns false while it is still
+// loading. Falls back to building the scene on the calling thread if the loader could not
+// run.
+static bool xrSceneLoader_Finish(xrSceneLoader* loader, xrScene* scene) {
+    bool succeeded = false;
+    if (loader->Started) {
+        pthread_mutex_lock(&loader->Mutex);
+        const bool done = loader->Done;
+        pthread_mutex_unlock(&loader->Mutex);
+        if (!done) {
+            return false;
+        }
+        pthread_join(loader->Thread, NULL);
+        pthread_mutex_destroy(&loader->Mutex);
+        loader->Started = false;
+        succeeded = loader->Succeeded;
+    }
+
+    if (succeeded) {
+        *scene = loader->Scene;
+        xrScene_Clear(&loader->Scene);
+    } else {
+        ALOGE("Scene loader failed, creating the scene on the main thread");
+        xrScene_Create(
+                scene, loader->UseMultiview, loader->ProgramWorker, &loader->ProgramCache);
+        loader->DoneTime = GetTimeInSeconds();
+    }
+
+#if !MULTI_THREADED
+    // Vertex array objects are not shared between contexts.
+    xrScene_CreateVAOs(scene);
+#endif
+
+    const double loadTime = loader->DoneTime - loader->StartTime;
+    const double frameTime = (loader->LoadingFrames > 1)
+            ? (loader->LastLoadingFrameTime - loader->StartTime) / (loader->LoadingFrames - 1)
+            : 0.0;
+    ALOGV(
+            "Scene loaded in %.1f ms, %d loading frames, %.2f ms average and %.2f ms max interval",
+            loadTime * 1e3,
+            loader->LoadingFrames,
+            frameTime * 1e3,
+            loader->MaxLoadingFrameInterval * 1e3);
+    return true;
+}
+
+// Call after every submitted scene frame.
+static void xrSceneLoader_ReportFirstSceneFrame(xrSceneLoader* loader) {
+    if (loader->ReportedFirstSceneFrame || !loader->Requested) {
+        return;
+    }
+    loader->ReportedFirstSceneFrame = true;
+    ALOGV(
+            "Time to first scene frame: %.1f ms",
+            (GetTimeInSeconds() - loader->StartTime) * 1e3);
+}
+
+// Waits for a scene that was never handed over and destroys it.
+static void xrSceneLoader_Destroy(xrSceneLoader* loader) {
+    if (loader->Started) {
+        pthread_join(loader->Thread, NULL);
+        pthread_mutex_destroy(&loader->Mutex);
+        if (loader->Succeeded) {
+            xrScene_Destroy(&loader->Scene);
+        }
+    }
+    xrSceneLoader_Clear(loader);
+}
+
+/*
+================================================================================
+
 xrSimulation
 
 ================================================================================
@@ -1189,69 +2333,345 @@ static void xrSimulation_Advance(xrSimulation* simulation, double elapsedDisplay
 /*
 ================================================================================
 
+xrGpuTimer
+
+================================================================================
+*/
+
+// Number of frames a timer query may stay in flight before its result is read back.
+#define MAX_GPU_TIMER_QUERIES 4
+
+typedef struct {
+    GLuint Queries[MAX_GPU_TIMER_QUERIES];
+    bool Pending[MAX_GPU_TIMER_QUERIES];
+    int Next;
+    bool Active;
+    PFNGLGETQUERYOBJECTUI64VEXTPROC GetQueryObjectui64v;
+    // GPU time of the most recently completed frame in seconds, or 0 if unknown.
+    float LastGpuTime;
+} xrGpuTimer;
+
+static void xrGpuTimer_Clear(xrGpuTimer* timer) {
+    for (int i = 0; i < MAX_GPU_TIMER_QUERIES; i++) {
+        timer->Queries[i] = 0;
+        timer->Pending[i] = false;
+    }
+    timer->Next = 0;
+    timer->Active = false;
+    timer->GetQueryObjectui64v = NULL;
+    timer->LastGpuTime = 0.0f;
+}
+
+static void xrGpuTimer_Create(xrGpuTimer* timer) {
+    if (!glExtensions.EXT_disjoint_timer_query) {
+        return;
+    }
+    timer->GetQueryObjectui64v =
+            (PFNGLGETQUERYOBJECTUI64VEXTPROC)eglGetProcAddress("glGetQueryObjectui64vEXT");
+    if (timer->GetQueryObjectui64v == NULL) {
+        return;
+    }
+    GL(glGenQueries(MAX_GPU_TIMER_QUERIES, timer->Queries));
+}
+
+static void xrGpuTimer_Destroy(xrGpuTimer* timer) {
+    if (timer->Queries[0] != 0) {
+        GL(glDeleteQueries(MAX_GPU_TIMER_QUERIES, timer->Queries));
+    }
+    xrGpuTimer_Clear(timer);
+}
+
+// Reads back the results of all completed queries without stalling.
+static void xrGpuTimer_Update(xrGpuTimer* timer) {
+    if (timer->Queries[0] == 0) {
+        return;
+    }
+    // Any query that overlapped a disjoint event has a meaningless result.
+    GLint disjoint = 0;
+    GL(glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint));
+    for (int i = 0; i < MAX_GPU_TIMER_QUERIES; i++) {
+        const int index = (timer->Next + i) % MAX_GPU_TIMER_QUERIES;
+        if (!timer->Pending[index]) {
+            continue;
+        }
+        GLuint available = 0;
+        GL(glGetQueryObjectuiv(timer->Queries[index], GL_QUERY_RESULT_AVAILABLE, &available));
+        if (!available) {
+            break;
+        }
+        GLuint64 elapsed = 0;
+        GL(timer->GetQueryObjectui64v(timer->Queries[index], GL_QUERY_RESULT, &elapsed));
+        timer->Pending[index] = false;
+        if (!disjoint) {
+            timer->LastGpuTime = (float)(elapsed * 1e-9);
+        }
+    }
+}
+
+static void xrGpuTimer_Begin(xrGpuTimer* timer) {
+    xrGpuTimer_Update(timer);
+    // Skip timing this frame if all queries are still in flight.
+    timer->Active = timer->Queries[0] != 0 && !timer->Pending[timer->Next];
+    if (timer->Active) {
+        GL(glBeginQuery(GL_TIME_ELAPSED_EXT, timer->Queries[timer->Next]));
+    }
+}
+
+static void xrGpuTimer_End(xrGpuTimer* timer) {
+    if (timer->Active) {
+        GL(glEndQuery(GL_TIME_ELAPSED_EXT));
+        timer->Pending[timer->Next] = true;
+        timer->Next = (timer->Next + 1) % MAX_GPU_TIMER_QUERIES;
+        timer->Active = false;
+    }
+}
+
+/*
+================================================================================
+
 xrRenderer
 
 ================================================================================
 */
 
+// Number of frames over which the instance statistics are averaged before they are logged.
+#define INSTANCE_STATS_FRAMES 300
+
 typedef struct {
-    xrFramebuffer FrameBuffer[XRAPI_FRAME_LAYER_EYE_MAX];
+    xrFramebufferPool FramebufferPool;
+    xrFramebuffer* FrameBuffer[XRAPI_FRAME_LAYER_EYE_MAX];
     int NumBuffers;
+    bool UseMultiview;
+    // VR mode session the frame buffers were last validated for.
+    int SessionCount;
+    xrGpuTimer GpuTimer;
+    // Instances that passed culling this frame, in draw order.
+    int VisibleInstances[NUM_INSTANCES];
+    int NumVisibleInstances;
+    xrInstanceSort InstanceSort;
+    // Accumulated instance statistics.
+    int StatsFrames;
+    long long StatsVisibleInstances;
+    double StatsCullTime;
+    double StatsSortTime;
 } xrRenderer;
 
 static void xrRenderer_Clear(xrRenderer* renderer) {
+    xrFramebufferPool_Clear(&renderer->FramebufferPool);
     for (int eye = 0; eye < XRAPI_FRAME_LAYER_EYE_MAX; eye++) {
-        xrFramebuffer_Clear(&renderer->FrameBuffer[eye]);
+        renderer->FrameBuffer[eye] = NULL;
     }
     renderer->NumBuffers = XRAPI_FRAME_LAYER_EYE_MAX;
+    renderer->UseMultiview = false;
+    renderer->SessionCount = 0;
+    xrGpuTimer_Clear(&renderer->GpuTimer);
+    renderer->NumVisibleInstances = 0;
+    xrInstanceSort_Clear(&renderer->InstanceSort);
+    renderer->StatsFrames = 0;
+    renderer->StatsVisibleInstances = 0;
+    renderer->StatsCullTime = 0.0;
+    renderer->StatsSortTime = 0.0;
 }
 
-static void
-xrRenderer_Create(xrRenderer* renderer, const xrJava* java, const bool useMultiview) {
-    renderer->NumBuffers = useMultiview ? 1 : XRAPI_FRAME_LAYER_EYE_MAX;
+static void xrRenderer_UpdateInstanceStats(
+        xrRenderer* renderer,
+        const double cullTime,
+        const double sortTime) {
+    renderer->StatsFrames++;
+    renderer->StatsVisibleInstances += renderer->NumVisibleInstances;
+    renderer->StatsCullTime += cullTime;
+    renderer->StatsSortTime += sortTime;
+    if (renderer->StatsFrames >= INSTANCE_STATS_FRAMES) {
+        ALOGV(
+                "Instances: %.0f of %d visible, cull %.1f us, sort %.1f us per frame",
+                (double)renderer->StatsVisibleInstances / renderer->StatsFrames,
+                NUM_INSTANCES,
+                renderer->StatsCullTime * 1e6 / renderer->StatsFrames,
+                renderer->StatsSortTime * 1e6 / renderer->StatsFrames);
+        renderer->StatsFrames = 0;
+        renderer->StatsVisibleInstances = 0;
+        renderer->StatsCullTime = 0.0;
+        renderer->StatsSortTime = 0.0;
+    }
+}
 
-    // Create the frame buffers.
+// Makes sure the frame buffers match the suggested eye texture size. Frame buffers that no
+// longer match go back to the pool, so returning to an earlier size does not allocate. If the
+// new frame buffers cannot be created the previous ones are kept, if there are any.
+static void xrRenderer_AcquireFramebuffers(
+        xrRenderer* renderer,
+        const xrSystemProperties* properties) {
+    const int width =
+            xrSystemProperties_GetInt(properties, XRAPI_SYS_PROP_SUGGESTED_EYE_TEXTURE_WIDTH);
+    const int height =
+            xrSystemProperties_GetInt(properties, XRAPI_SYS_PROP_SUGGESTED_EYE_TEXTURE_HEIGHT);
+    if (renderer->FrameBuffer[0] != NULL && renderer->FrameBuffer[0]->Width == width &&
+        renderer->FrameBuffer[0]->Height == height) {
+        return;
+    }
+
+    // Acquire the new set before releasing the current one, so a failure keeps the current
+    // set. The pool has room for both sets.
+    const double startTime = GetTimeInSeconds();
+    const int created = renderer->FramebufferPool.Created;
+    xrFramebuffer* frameBuffers[XRAPI_FRAME_LAYER_EYE_MAX] = {};
     for (int eye = 0; eye < renderer->NumBuffers; eye++) {
-        xrFramebuffer_Create(
-                &renderer->FrameBuffer[eye],
-                useMultiview,
+        frameBuffers[eye] = xrFramebufferPool_Acquire(
+                &renderer->FramebufferPool,
+                renderer->UseMultiview,
                 GL_RGBA8,
-                xrapiGetSystemPropertyInt(java, XRAPI_SYS_PROP_SUGGESTED_EYE_TEXTURE_WIDTH),
-                xrapiGetSystemPropertyInt(java, XRAPI_SYS_PROP_SUGGESTED_EYE_TEXTURE_HEIGHT),
+                width,
+                height,
                 NUM_MULTI_SAMPLES);
+        if (frameBuffers[eye] == NULL) {
+            ALOGE(
+                    "Failed to create %dx%d eye frame buffers, keeping the previous ones",
+                    width,
+                    height);
+            for (int i = 0; i < eye; i++) {
+                xrFramebufferPool_Release(&renderer->FramebufferPool, frameBuffers[i]);
+            }
+            return;
+        }
+    }
+    for (int eye = 0; eye < renderer->NumBuffers; eye++) {
+        if (renderer->FrameBuffer[eye] != NULL) {
+            xrFramebufferPool_Release(&renderer->FramebufferPool, renderer->FrameBuffer[eye]);
+        }
+        renderer->FrameBuffer[eye] = frameBuffers[eye];
     }
+    ALOGV(
+            "Eye frame buffers %dx%d: %d created, %d reused in %.2f ms",
+            width,
+            height,
+            renderer->FramebufferPool.Created - created,
+            renderer->NumBuffers - (renderer->FramebufferPool.Created - created),
+            (GetTimeInSeconds() - startTime) * 1e3);
+}
+
+static void xrRenderer_Create(
+        xrRenderer* renderer,
+        const xrSystemProperties* properties,
+        const bool useMultiview) {
+    renderer->NumBuffers = useMultiview ? 1 : XRAPI_FRAME_LAYER_EYE_MAX;
+    renderer->UseMultiview = useMultiview;
+
+    // Create the frame buffers.
+    xrRenderer_AcquireFramebuffers(renderer, properties);
+
+    xrInstanceSort_Create(&renderer->InstanceSort, NUM_INSTANCES);
+    xrGpuTimer_Create(&renderer->GpuTimer);
 }
 
 static void xrRenderer_Destroy(xrRenderer* renderer) {
     for (int eye = 0; eye < renderer->NumBuffers; eye++) {
-        xrFramebuffer_Destroy(&renderer->FrameBuffer[eye]);
+        renderer->FrameBuffer[eye] = NULL;
     }
+    xrFramebufferPool_Destroy(&renderer->FramebufferPool);
+
+    xrInstanceSort_Destroy(&renderer->InstanceSort);
+    xrGpuTimer_Destroy(&renderer->GpuTimer);
 }
 
 static xrLayerProjection2 xrRenderer_RenderFrame(
         xrRenderer* renderer,
-        const xrJava* java,
+        const xrSystemProperties* properties,
         const xrScene* scene,
         const xrSimulation* simulation,
         const xrTracking2* tracking,
-        xrMobile* xr) {
-    xrMatrix4f rotationMatrices[NUM_ROTATIONS];
+        const float resolutionScale,
+        const int sessionCount) {
+    // The suggested eye texture size may change while the application is out of VR mode.
+    if (sessionCount != renderer->SessionCount) {
+        xrRenderer_AcquireFramebuffers(renderer, properties);
+        renderer->SessionCount = sessionCount;
+    }
+    if (renderer->FrameBuffer[0] == NULL) {
+        // There is nothing to render to, so skip the frame.
+        xrLayerProjection2 layer = xrapiDefaultLayerBlackProjection2();
+        layer.Header.Flags |= XRAPI_FRAME_LAYER_FLAG_INHIBIT_SRGB_FRAMEBUFFER;
+        return layer;
+    }
+
+    xrVector3f rotationAngles[NUM_ROTATIONS];
     for (int i = 0; i < NUM_ROTATIONS; i++) {
-        rotationMatrices[i] = xrMatrix4f_CreateRotation(
-                scene->Rotations[i].x * simulation->CurrentRotation.x,
-                scene->Rotations[i].y * simulation->CurrentRotation.y,
-                scene->Rotations[i].z * simulation->CurrentRotation.z);
+        rotationAngles[i].x = scene->Rotations[i].x * simulation->CurrentRotation.x;
+        rotationAngles[i].y = scene->Rotations[i].y * simulation->CurrentRotation.y;
+        rotationAngles[i].z = scene->Rotations[i].z * simulation->CurrentRotation.z;
     }
+#if COMPACT_INSTANCES
+    xrQuatf rotations[NUM_ROTATIONS];
+    xrScene_CreateInstanceOrientations(rotations, rotationAngles);
+    int16_t packedRotations[NUM_ROTATIONS][4];
+    xrPackedInstance_PackOrientations(&packedRotations[0][0], rotations, NUM_ROTATIONS);
+#else
+    // An error of 1.5e-5 in the rotation is well below a pixel at any cube distance.
+    xrMatrix4f rotationMatrices[NUM_ROTATIONS];
+    xrMatrix4f_CreateRotations(
+            rotationMatrices, rotationAngles, NUM_ROTATIONS, XRAPI_SINCOS_ACCURACY_FAST);
+#endif
+
+    // Cull the instances against a frustum that contains both eye frusta.
+    const double cullStartTime = GetTimeInSeconds();
+    xrFrustum frustum;
+    xrFrustum_CreateStereo(&frustum, tracking);
+    renderer->NumVisibleInstances = xrFrustum_CullSpheres(
+            &frustum,
+            scene->CubeCentersX,
+            scene->CubeCentersY,
+            scene->CubeCentersZ,
+            CUBE_BOUNDING_RADIUS,
+            NUM_INSTANCES,
+            renderer->VisibleInstances);
+    const double cullTime = GetTimeInSeconds() - cullStartTime;
+
+    // Sort the visible instances front to back relative to the current head pose so the
+    // depth test rejects as many occluded fragments as possible. When MULTI_THREADED is
+    // enabled this runs on the renderer thread.
+    const double sortStartTime = GetTimeInSeconds();
+#if SORT_INSTANCES
+    xrInstanceSort_FrontToBack(
+            &renderer->InstanceSort,
+            scene->CubeCentersX,
+            scene->CubeCentersY,
+            scene->CubeCentersZ,
+            &tracking->HeadPose.Pose,
+            renderer->VisibleInstances,
+            renderer->NumVisibleInstances);
+#endif
+    const double sortTime = GetTimeInSeconds() - sortStartTime;
+
+    xrRenderer_UpdateInstanceStats(renderer, cullTime, sortTime);
 
-    // Update the instance transform attributes.
+    // Update the instance transform attributes of the visible instances.
+    const int numVisible = renderer->NumVisibleInstances;
     GL(glBindBuffer(GL_ARRAY_BUFFER, scene->InstanceTransformBuffer));
+#if COMPACT_INSTANCES
+    GL(xrPackedInstance* cubeTransforms = (xrPackedInstance*)glMapBufferRange(
+            GL_ARRAY_BUFFER,
+            0,
+            NUM_INSTANCES * sizeof(xrPackedInstance),
+               GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+    for (int i = 0; i < numVisible; i++) {
+        const int instance = renderer->VisibleInstances[i];
+        const int index = scene->CubeRotations[instance];
+
+        // Write in order in case the mapped buffer lives on write-combined memory.
+        memcpy(cubeTransforms[i].Orientation, packedRotations[index], 4 * sizeof(int16_t));
+        memcpy(
+                cubeTransforms[i].Position,
+                scene->PackedCubePositions[instance],
+                4 * sizeof(uint16_t));
+    }
+#else
     GL(xrMatrix4f* cubeTransforms = (xrMatrix4f*)glMapBufferRange(
             GL_ARRAY_BUFFER,
             0,
             NUM_INSTANCES * sizeof(xrMatrix4f),
                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
-    for (int i = 0; i < NUM_INSTANCES; i++) {
-        const int index = scene->CubeRotations[i];
+    for (int i = 0; i < numVisible; i++) {
+        const int instance = renderer->VisibleInstances[i];
+        const int index = scene->CubeRotations[instance];
 
         // Write in order in case the mapped buffer lives on write-combined memory.
         cubeTransforms[i].M[0][0] = rotationMatrices[index].M[0][0];
@@ -1269,11 +2689,12 @@ static xrLayerProjection2 xrRenderer_RenderFrame(
         cubeTransforms[i].M[2][2] = rotationMatrices[index].M[2][2];
         cubeTransforms[i].M[2][3] = rotationMatrices[index].M[2][3];
 
-        cubeTransforms[i].M[3][0] = scene->CubePositions[i].x;
-        cubeTransforms[i].M[3][1] = scene->CubePositions[i].y;
-        cubeTransforms[i].M[3][2] = scene->CubePositions[i].z;
+        cubeTransforms[i].M[3][0] = scene->CubePositions[instance].x;
+        cubeTransforms[i].M[3][1] = scene->CubePositions[instance].y;
+        cubeTransforms[i].M[3][2] = scene->CubePositions[instance].z;
         cubeTransforms[i].M[3][3] = 1.0f;
     }
+#endif
     GL(glUnmapBuffer(GL_ARRAY_BUFFER));
     GL(glBindBuffer(GL_ARRAY_BUFFER, 0));
 
@@ -1307,22 +2728,43 @@ static xrLayerProjection2 xrRenderer_RenderFrame(
     GL(glUnmapBuffer(GL_UNIFORM_BUFFER));
     GL(glBindBuffer(GL_UNIFORM_BUFFER, 0));
 
+    // Render into the lower left part of the eye textures selected by the resolution scale.
+    // All eye frame buffers have the same size.
+    const int textureWidth = renderer->FrameBuffer[0]->Width;
+    const int textureHeight = renderer->FrameBuffer[0]->Height;
+    int viewportWidth;
+    int viewportHeight;
+    xrResolutionScale_GetViewport(
+            resolutionScale, textureWidth, textureHeight, &viewportWidth, &viewportHeight);
+
     xrLayerProjection2 layer = xrapiDefaultLayerProjection2();
     layer.HeadPose = updatedTracking.HeadPose;
     for (int eye = 0; eye < XRAPI_FRAME_LAYER_EYE_MAX; eye++) {
-        xrFramebuffer* frameBuffer = &renderer->FrameBuffer[renderer->NumBuffers == 1 ? 0 : eye];
+        xrFramebuffer* frameBuffer = renderer->FrameBuffer[renderer->NumBuffers == 1 ? 0 : eye];
+        const xrMatrix4f texCoordsFromTanAngles =
+                xrMatrix4f_TanAngleMatrixFromProjection(&updatedTracking.Eye[eye].ProjectionMatrix);
         layer.Textures[eye].ColorSwapChain = frameBuffer->ColorTextureSwapChain;
         layer.Textures[eye].SwapChainIndex = frameBuffer->TextureSwapChainIndex;
-        layer.Textures[eye].TexCoordsFromTanAngles =
-                xrMatrix4f_TanAngleMatrixFromProjection(&updatedTracking.Eye[eye].ProjectionMatrix);
+        layer.Textures[eye].TexCoordsFromTanAngles = xrResolutionScale_GetTexCoordsFromTanAngles(
+                &texCoordsFromTanAngles,
+                viewportWidth,
+                viewportHeight,
+                textureWidth,
+                textureHeight);
+        layer.Textures[eye].TextureRect = xrResolutionScale_GetTextureRect(
+                viewportWidth, viewportHeight, textureWidth, textureHeight);
     }
     layer.Header.Flags |= XRAPI_FRAME_LAYER_FLAG_CHROMATIC_ABERRATION_CORRECTION;
+    if (viewportWidth < textureWidth || viewportHeight < textureHeight) {
+        layer.Header.Flags |= XRAPI_FRAME_LAYER_FLAG_CLIP_TO_TEXTURE_RECT;
+    }
 
     // Render the eye images.
+    xrGpuTimer_Begin(&renderer->GpuTimer);
     for (int eye = 0; eye < renderer->NumBuffers; eye++) {
         // NOTE: In the non-mv case, latency can be further reduced by updating the sensor
         // prediction for each eye (updates orientation, not position)
-        xrFramebuffer* frameBuffer = &renderer->FrameBuffer[eye];
+        xrFramebuffer* frameBuffer = renderer->FrameBuffer[eye];
         xrFramebuffer_SetCurrent(frameBuffer);
 
         GL(glUseProgram(scene->Program.Program));
@@ -1341,19 +2783,20 @@ static xrLayerProjection2 xrRenderer_RenderFrame(
         GL(glDepthFunc(GL_LEQUAL));
         GL(glEnable(GL_CULL_FACE));
         GL(glCullFace(GL_BACK));
-        GL(glViewport(0, 0, frameBuffer->Width, frameBuffer->Height));
-        GL(glScissor(0, 0, frameBuffer->Width, frameBuffer->Height));
+        GL(glViewport(0, 0, viewportWidth, viewportHeight));
+        GL(glScissor(0, 0, viewportWidth, viewportHeight));
         GL(glClearColor(0.125f, 0.0f, 0.125f, 1.0f));
         GL(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
         GL(glBindVertexArray(scene->Cube.VertexArrayObject));
         GL(glDrawElementsInstanced(
-                GL_TRIANGLES, scene->Cube.IndexCount, GL_UNSIGNED_SHORT, NULL, NUM_INSTANCES));
+                GL_TRIANGLES, scene->Cube.IndexCount, GL_UNSIGNED_SHORT, NULL, numVisible));
         GL(glBindVertexArray(0));
         GL(glUseProgram(0));
 
         xrFramebuffer_Resolve(frameBuffer);
         xrFramebuffer_Advance(frameBuffer);
     }
+    xrGpuTimer_End(&renderer->GpuTimer);
 
     xrFramebuffer_SetNone();
 
@@ -1376,6 +2819,8 @@ typedef struct {
     JavaVM* JavaVm;
     jobject ActivityObject;
     const xrEgl* ShareEgl;
+    // Refreshed by the main thread only while the renderer thread is idle.
+    const xrSystemProperties* SystemProperties;
     pthread_t Thread;
     int Tid;
     bool UseMultiview;
@@ -1388,6 +2833,7 @@ typedef struct {
     pthread_mutex_t Mutex;
     // Latched data for rendering.
     xrMobile* Ovr;
+    int SessionCount;
     xrRenderType RenderType;
     long long FrameIndex;
     double DisplayTime;
@@ -1395,6 +2841,11 @@ typedef struct {
     xrScene* Scene;
     xrSimulation Simulation;
     xrTracking2 Tracking;
+    float ResolutionScale;
+    // GPU time of the last completed frame, written by the renderer thread under the mutex.
+    float GpuTime;
+    // Copy of GpuTime latched by xrRenderThread_Submit(), read by the main thread.
+    float LatchedGpuTime;
 } xrRenderThread;
 
 void* RenderThreadFunction(void* parm) {
@@ -1403,7 +2854,7 @@ void* RenderThreadFunction(void* parm) {
 
     xrJava java;
     java.Vm = renderThread->JavaVm;
-    (*java.Vm)->AttachCurrentThread(java.Vm, &java.Env, NULL);
+    java.Vm->AttachCurrentThread(&java.Env, NULL);
     java.ActivityObject = renderThread->ActivityObject;
 
     // Note that AttachCurrentThread will reset the thread name.
@@ -1413,13 +2864,16 @@ void* RenderThreadFunction(void* parm) {
     xrEgl_CreateContext(&egl, renderThread->ShareEgl);
 
     xrRenderer renderer;
-    xrRenderer_Create(&renderer, &java, renderThread->UseMultiview);
+    xrRenderer_Create(&renderer, renderThread->SystemProperties, renderThread->UseMultiview);
 
     xrScene* lastScene = NULL;
+    xrFrameBuilder frameBuilder;
+    float gpuTime = 0.0f;
 
     for (;;) {
         // Signal work completed.
         pthread_mutex_lock(&renderThread->Mutex);
+        renderThread->GpuTime = gpuTime;
         renderThread->WorkDoneFlag = true;
         pthread_cond_signal(&renderThread->WorkDoneCondition);
         pthread_mutex_unlock(&renderThread->Mutex);
@@ -1447,53 +2901,47 @@ void* RenderThreadFunction(void* parm) {
         }
 
         // Render.
-        xrLayer_Union2 layers[xrMaxLayerCount] = {0};
-        int layerCount = 0;
         int frameFlags = 0;
+        if (renderThread->RenderType == RENDER_LOADING_ICON) {
+            frameFlags |= XRAPI_FRAME_FLAG_FLUSH;
+        } else if (renderThread->RenderType == RENDER_BLACK_FINAL) {
+            frameFlags |= XRAPI_FRAME_FLAG_FLUSH | XRAPI_FRAME_FLAG_FINAL;
+        }
+        xrFrameBuilder_Begin(
+            &frameBuilder,
+            frameFlags,
+            renderThread->SwapInterval,
+            renderThread->FrameIndex,
+            renderThread->DisplayTime);
 
         if (renderThread->RenderType == RENDER_FRAME) {
             xrLayerProjection2 layer;
             layer = xrRenderer_RenderFrame(
                 &renderer,
-                &java,
+                renderThread->SystemProperties,
                 renderThread->Scene,
                 &renderThread->Simulation,
                 &renderThread->Tracking,
-                renderThread->Ovr);
+                renderThread->ResolutionScale,
+                renderThread->SessionCount);
 
-            layers[layerCount++].Projection = layer;
+            xrFrameBuilder_AddProjection2(&frameBuilder, &layer);
+            gpuTime = renderer.GpuTimer.LastGpuTime;
         } else if (renderThread->RenderType == RENDER_LOADING_ICON) {
             xrLayerProjection2 blackLayer = xrapiDefaultLayerBlackProjection2();
             blackLayer.Header.Flags |= XRAPI_FRAME_LAYER_FLAG_INHIBIT_SRGB_FRAMEBUFFER;
-            layers[layerCount++].Projection = blackLayer;
+            xrFrameBuilder_AddProjection2(&frameBuilder, &blackLayer);
 
             xrLayerLoadingIcon2 iconLayer = xrapiDefaultLayerLoadingIcon2();
             iconLayer.Header.Flags |= XRAPI_FRAME_LAYER_FLAG_INHIBIT_SRGB_FRAMEBUFFER;
-            layers[layerCount++].LoadingIcon = iconLayer;
-
-            frameFlags |= XRAPI_FRAME_FLAG_FLUSH;
+            xrFrameBuilder_AddLoadingIcon2(&frameBuilder, &iconLayer);
         } else if (renderThread->RenderType == RENDER_BLACK_FINAL) {
             xrLayerProjection2 layer = xrapiDefaultLayerBlackProjection2();
             layer.Header.Flags |= XRAPI_FRAME_LAYER_FLAG_INHIBIT_SRGB_FRAMEBUFFER;
-            layers[layerCount++].Projection = layer;
-
-            frameFlags |= XRAPI_FRAME_FLAG_FLUSH | XRAPI_FRAME_FLAG_FINAL;
+            xrFrameBuilder_AddProjection2(&frameBuilder, &layer);
         }
 
-        const xrLayerHeader2* layerList[xrMaxLayerCount] = {0};
-        for (int i = 0; i < layerCount; i++) {
-            layerList[i] = &layers[i].Header;
-        }
-
-        xrSubmitFrameDescription2 frameDesc = {0};
-        frameDesc.Flags = frameFlags;
-        frameDesc.SwapInterval = renderThread->SwapInterval;
-        frameDesc.FrameIndex = renderThread->FrameIndex;
-        frameDesc.DisplayTime = renderThread->DisplayTime;
-        frameDesc.LayerCount = layerCount;
-        frameDesc.Layers = layerList;
-
-        xrapiSubmitFrame2(renderThread->Ovr, &frameDesc);
+        xrapiSubmitFrame2(renderThread->Ovr, xrFrameBuilder_End(&frameBuilder));
     }
 
     if (lastScene != NULL) {
@@ -1503,7 +2951,7 @@ void* RenderThreadFunction(void* parm) {
     xrRenderer_Destroy(&renderer);
     xrEgl_DestroyContext(&egl);
 
-    (*java.Vm)->DetachCurrentThread(java.Vm);
+    java.Vm->DetachCurrentThread();
 
     return NULL;
 }
@@ -1519,22 +2967,28 @@ static void xrRenderThread_Clear(xrRenderThread* renderThread) {
     renderThread->WorkAvailableFlag = false;
     renderThread->WorkDoneFlag = false;
     renderThread->Ovr = NULL;
+    renderThread->SessionCount = 0;
     renderThread->RenderType = RENDER_FRAME;
     renderThread->FrameIndex = 1;
     renderThread->DisplayTime = 0;
     renderThread->SwapInterval = 1;
     renderThread->Scene = NULL;
     xrSimulation_Clear(&renderThread->Simulation);
+    renderThread->ResolutionScale = 1.0f;
+    renderThread->GpuTime = 0.0f;
+    renderThread->LatchedGpuTime = 0.0f;
 }
 
 static void xrRenderThread_Create(
     xrRenderThread* renderThread,
     const xrJava* java,
+    const xrSystemProperties* systemProperties,
     const xrEgl* shareEgl,
     const bool useMultiview) {
     renderThread->JavaVm = java->Vm;
     renderThread->ActivityObject = java->ActivityObject;
     renderThread->ShareEgl = shareEgl;
+    renderThread->SystemProperties = systemProperties;
     renderThread->Thread = 0;
     renderThread->Tid = 0;
     renderThread->UseMultiview = useMultiview;
@@ -1568,21 +3022,25 @@ static void xrRenderThread_Destroy(xrRenderThread* renderThread) {
 static void xrRenderThread_Submit(
     xrRenderThread* renderThread,
     xrMobile* xr,
+    const int sessionCount,
     xrRenderType type,
     long long frameIndex,
     double displayTime,
     int swapInterval,
     xrScene* scene,
     const xrSimulation* simulation,
-    const xrTracking2* tracking) {
+    const xrTracking2* tracking,
+    const float resolutionScale) {
     // Wait for the renderer thread to finish the last frame.
     pthread_mutex_lock(&renderThread->Mutex);
     while (!renderThread->WorkDoneFlag) {
         pthread_cond_wait(&renderThread->WorkDoneCondition, &renderThread->Mutex);
     }
     renderThread->WorkDoneFlag = false;
+    renderThread->LatchedGpuTime = renderThread->GpuTime;
     // Latch the render data.
     renderThread->Ovr = xr;
+    renderThread->SessionCount = sessionCount;
     renderThread->RenderType = type;
     renderThread->FrameIndex = frameIndex;
     renderThread->DisplayTime = displayTime;
@@ -1594,6 +3052,7 @@ static void xrRenderThread_Submit(
     if (tracking != NULL) {
         renderThread->Tracking = *tracking;
     }
+    renderThread->ResolutionScale = resolutionScale;
     // Signal work is available.
     renderThread->WorkAvailableFlag = true;
     pthread_cond_signal(&renderThread->WorkAvailableCondition);
@@ -1624,19 +3083,73 @@ xrApp
 ================================================================================
 */
 
+static void xrApp_HandleDataLost(void* userData, const xrEventHeader* event) {
+    (void)userData;
+    (void)event;
+    ALOGV("xrApp_HandleXrApiEvents: Received XRAPI_EVENT_DATA_LOST");
+}
+
+static void xrApp_HandleVisibilityChanged(void* userData, const xrEventHeader* event) {
+    (void)userData;
+    ALOGV(
+        "xrApp_HandleXrApiEvents: Received %s",
+        event->EventType == XRAPI_EVENT_VISIBILITY_GAINED ? "XRAPI_EVENT_VISIBILITY_GAINED"
+                                                          : "XRAPI_EVENT_VISIBILITY_LOST");
+}
+
+static void xrApp_HandleFocusChanged(void* userData, const xrEventHeader* event) {
+    (void)userData;
+    ALOGV(
+        "xrApp_HandleXrApiEvents: Received %s",
+        event->EventType == XRAPI_EVENT_FOCUS_GAINED ? "XRAPI_EVENT_FOCUS_GAINED"
+                                                     : "XRAPI_EVENT_FOCUS_LOST");
+}
+
+static void xrApp_HandleUnknownEvent(void* userData, const xrEventHeader* event) {
+    (void)userData;
+    ALOGV("xrApp_HandleXrApiEvents: Unknown event type %d", (int)event->EventType);
+}
+
 typedef struct {
     xrJava Java;
+    xrSystemProperties SystemProperties;
     xrEgl Egl;
     ANativeWindow* NativeWindow;
     bool Resumed;
     xrMobile* Ovr;
+    // Number of times VR mode was entered. A new session may reuse the address of the previous
+    // xrMobile, so the renderer compares this count to find out about a new VR mode.
+    int VrSessionCount;
+    xrEventPump EventPump;
+    xrInputCache InputCache;
+    xrInputSnapshot Input;
+    xrSpaceCache SpaceCache;
+    xrProgramCache ProgramCache;
+    xrProgramWorker ProgramWorker;
+    xrSceneLoader SceneLoader;
     xrScene Scene;
     xrSimulation Simulation;
+    xrFrameBuilder FrameBuilder;
     long long FrameIndex;
     double DisplayTime;
     int SwapInterval;
     int CpuLevel;
     int GpuLevel;
+    float DisplayRefreshRate;
+    xrFrameTiming FrameTiming;
+    double StaleFramesPollTime;
+    float StaleFramesPerSecond;
+    bool Throttled;
+    xrClockGovernor ClockGovernor;
+    float ResolutionScale;
+    xrResolutionScaleController ResolutionScaleController;
+    xrRefreshRateManager RefreshRateManager;
+    xrExtraLatencyMode ExtraLatencyMode;
+    xrExtraLatencyGovernor ExtraLatencyGovernor;
+    double LatencyStatsTime;
+    bool FoveationAvailable;
+    int FoveationLevel;
+    xrFoveationGovernor FoveationGovernor;
     int MainThreadTid;
     int RenderThreadTid;
 #if MULTI_THREADED
@@ -1645,25 +3158,68 @@ typedef struct {
     xrRenderer Renderer;
 #endif
     bool UseMultiview;
+#if RECORD_TRACKING_TRACE
+    xrTrackingTraceWriter TrackingTrace;
+#endif
 } xrApp;
 
 static void xrApp_Clear(xrApp* app) {
     app->Java.Vm = NULL;
     app->Java.Env = NULL;
     app->Java.ActivityObject = NULL;
+    memset(&app->SystemProperties, 0, sizeof(app->SystemProperties));
     app->NativeWindow = NULL;
     app->Resumed = false;
     app->Ovr = NULL;
+    app->VrSessionCount = 0;
     app->FrameIndex = 1;
     app->DisplayTime = 0;
     app->SwapInterval = 1;
     app->CpuLevel = 2;
     app->GpuLevel = 2;
+    app->DisplayRefreshRate = 60.0f;
+    memset(&app->FrameTiming, 0, sizeof(app->FrameTiming));
+    app->StaleFramesPollTime = 0.0;
+    app->StaleFramesPerSecond = 0.0f;
+    app->Throttled = false;
+    const xrClockGovernorParms clockParms = xrapiDefaultClockGovernorParms();
+    xrClockGovernor_Init(&app->ClockGovernor, &clockParms, app->CpuLevel, app->GpuLevel);
+    app->ResolutionScale = 1.0f;
+    const xrResolutionScaleParms resolutionParms = xrapiDefaultResolutionScaleParms();
+    xrResolutionScaleController_Init(
+            &app->ResolutionScaleController, &resolutionParms, app->ResolutionScale);
+    app->ExtraLatencyMode = XRAPI_EXTRA_LATENCY_MODE_OFF;
+    const xrExtraLatencyGovernorParms extraLatencyParms = xrapiDefaultExtraLatencyGovernorParms();
+    xrExtraLatencyGovernor_Init(
+            &app->ExtraLatencyGovernor, &extraLatencyParms, app->ExtraLatencyMode);
+    app->LatencyStatsTime = 0.0;
+    app->FoveationAvailable = false;
+    app->FoveationLevel = 0;
+    const xrFoveationGovernorParms foveationParms = xrapiDefaultFoveationGovernorParms();
+    xrFoveationGovernor_Init(&app->FoveationGovernor, &foveationParms, 0, 0.0);
     app->MainThreadTid = 0;
     app->RenderThreadTid = 0;
     app->UseMultiview = true;
+#if RECORD_TRACKING_TRACE
+    xrTrackingTraceWriter_Clear(&app->TrackingTrace);
+#endif
 
+    xrInputCache_Init(&app->InputCache);
+    app->Input.DeviceCount = 0;
+    xrSpaceCache_Init(&app->SpaceCache);
+    xrEventPump_Init(&app->EventPump, app);
+    xrEventPump_SetHandler(&app->EventPump, XRAPI_EVENT_DATA_LOST, xrApp_HandleDataLost);
+    xrEventPump_SetHandler(
+        &app->EventPump, XRAPI_EVENT_VISIBILITY_GAINED, xrApp_HandleVisibilityChanged);
+    xrEventPump_SetHandler(
+        &app->EventPump, XRAPI_EVENT_VISIBILITY_LOST, xrApp_HandleVisibilityChanged);
+    xrEventPump_SetHandler(&app->EventPump, XRAPI_EVENT_FOCUS_GAINED, xrApp_HandleFocusChanged);
+    xrEventPump_SetHandler(&app->EventPump, XRAPI_EVENT_FOCUS_LOST, xrApp_HandleFocusChanged);
+    app->EventPump.UnknownHandler = xrApp_HandleUnknownEvent;
     xrEgl_Clear(&app->Egl);
+    memset(&app->ProgramCache, 0, sizeof(app->ProgramCache));
+    xrProgramWorker_Clear(&app->ProgramWorker);
+    xrSceneLoader_Clear(&app->SceneLoader);
     xrScene_Clear(&app->Scene);
     xrSimulation_Clear(&app->Simulation);
 #if MULTI_THREADED
@@ -1699,6 +3255,24 @@ static void xrApp_HandleVrModeChanges(xrApp* app) {
                 app->NativeWindow = NULL;
             }
 
+            if (app->Ovr != NULL) {
+                app->VrSessionCount++;
+                // The refresh rate and suggested eye texture size depend on the VR mode.
+                xrSystemProperties_Refresh(&app->SystemProperties, &app->Java);
+                const float refreshRate = xrSystemProperties_GetFloat(
+                        &app->SystemProperties, XRAPI_SYS_PROP_DISPLAY_REFRESH_RATE);
+                if (refreshRate > 0.0f) {
+                    app->DisplayRefreshRate = refreshRate;
+                }
+                xrRefreshRateManager_SetCurrent(
+                        &app->RefreshRateManager,
+                        app->DisplayRefreshRate,
+                        app->SwapInterval,
+                        GetTimeInSeconds());
+                xrapiSetClockLevels(app->Ovr, app->CpuLevel, app->GpuLevel);
+                xrapiSetExtraLatencyMode(app->Ovr, app->ExtraLatencyMode);
+            }
+
         }
     } else {
         if (app->Ovr != NULL) {
@@ -1712,13 +3286,235 @@ static void xrApp_HandleVrModeChanges(xrApp* app) {
 
             xrapiLeaveVrMode(app->Ovr);
             app->Ovr = NULL;
+            // Device IDs are not kept across VR mode sessions.
+            xrInputCache_Invalidate(&app->InputCache);
+            app->Input.DeviceCount = 0;
+            xrSpaceCache_Invalidate(&app->SpaceCache);
 
             ALOGV("        eglGetCurrentSurface( EGL_DRAW ) = %p", eglGetCurrentSurface(EGL_DRAW));
         }
     }
 }
 
-static void xrApp_HandleInput(xrApp* app) {}
+static void xrApp_InitPerformance(xrApp* app) {
+    const xrClockGovernorParms clockParms = xrapiDefaultClockGovernorParms();
+    xrClockGovernor_Init(&app->ClockGovernor, &clockParms, app->CpuLevel, app->GpuLevel);
+
+    float supportedRates[XRAPI_REFRESH_RATE_MAX_CONFIGS] = {0};
+    int numSupportedRates = xrSystemProperties_GetInt(
+            &app->SystemProperties, XRAPI_SYS_PROP_NUM_SUPPORTED_DISPLAY_REFRESH_RATES);
+    numSupportedRates = (numSupportedRates < XRAPI_REFRESH_RATE_MAX_CONFIGS)
+            ? numSupportedRates
+            : XRAPI_REFRESH_RATE_MAX_CONFIGS;
+    if (numSupportedRates > 0) {
+        numSupportedRates = xrSystemProperties_GetFloatArray(
+                &app->SystemProperties,
+                XRAPI_SYS_PROP_SUPPORTED_DISPLAY_REFRESH_RATES,
+                supportedRates,
+                numSupportedRates);
+    }
+    const float refreshRate = xrSystemProperties_GetFloat(
+            &app->SystemProperties, XRAPI_SYS_PROP_DISPLAY_REFRESH_RATE);
+    if (refreshRate > 0.0f) {
+        app->DisplayRefreshRate = refreshRate;
+    }
+    const xrRefreshRateManagerParms refreshRateParms = xrapiDefaultRefreshRateManagerParms();
+    xrRefreshRateManager_Init(
+            &app->RefreshRateManager,
+            &refreshRateParms,
+            supportedRates,
+            numSupportedRates,
+            app->DisplayRefreshRate,
+            app->SwapInterval,
+            GetTimeInSeconds());
+    for (int i = 0; i < app->RefreshRateManager.NumConfigs; i++) {
+        ALOGV(
+                "AppState RefreshRateConfig %d : %.0f Hz, swap interval %d",
+                i,
+                app->RefreshRateManager.Configs[i].RefreshRate,
+                app->RefreshRateManager.Configs[i].SwapInterval);
+    }
+
+    app->FoveationAvailable = xrSystemProperties_GetInt(
+            &app->SystemProperties, XRAPI_SYS_PROP_FOVEATION_AVAILABLE) == XRAPI_TRUE;
+    if (app->FoveationAvailable) {
+        // The governor replaces the runtime's own dynamic foveation.
+        xrapiSetPropertyInt(&app->Java, XRAPI_DYNAMIC_FOVEATION_ENABLED, 0);
+        xrapiSetPropertyInt(&app->Java, XRAPI_FOVEATION_LEVEL, app->FoveationLevel);
+    }
+    ALOGV("AppState FoveationAvailable : %d", app->FoveationAvailable);
+}
+
+// Feeds the timing of the last frame to the performance governors and applies their decisions.
+static void xrApp_UpdatePerformance(xrApp* app, const xrFrameTiming* timing) {
+    const double now = GetTimeInSeconds();
+
+    // The stale frame count is a per second statistic, so there is no need to poll it faster.
+    // The throttled state changes on a thermal time scale and is polled along with it.
+    if (now - app->StaleFramesPollTime >= 1.0) {
+        app->StaleFramesPerSecond = (float)xrapiGetSystemStatusInt(
+                &app->Java, XRAPI_SYS_STATUS_STALE_FRAMES_PER_SECOND);
+        app->Throttled =
+                xrapiGetSystemStatusInt(&app->Java, XRAPI_SYS_STATUS_THROTTLED) == XRAPI_TRUE;
+        app->StaleFramesPollTime = now;
+    }
+
+    if (xrClockGovernor_Update(&app->ClockGovernor, timing, app->Throttled, now)) {
+        ALOGV(
+                "Clock levels CPU %d -> %d, GPU %d -> %d (load CPU %.2f GPU %.2f%s, "
+                "%.1f frames/energy)",
+                app->CpuLevel,
+                app->ClockGovernor.CpuLevel,
+                app->GpuLevel,
+                app->ClockGovernor.GpuLevel,
+                xrFrameTiming_CpuLoad(timing),
+                xrFrameTiming_GpuLoad(timing),
+                app->Throttled ? ", throttled" : "",
+                xrClockGovernor_FramesPerEnergy(&app->ClockGovernor));
+        app->CpuLevel = app->ClockGovernor.CpuLevel;
+        app->GpuLevel = app->ClockGovernor.GpuLevel;
+        if (app->Ovr != NULL) {
+            xrapiSetClockLevels(app->Ovr, app->CpuLevel, app->GpuLevel);
+        }
+    }
+
+    if (app->Ovr != NULL && xrRefreshRateManager_Update(&app->RefreshRateManager, timing, now)) {
+        const float refreshRate = app->RefreshRateManager.RefreshRate;
+        const int swapInterval = app->RefreshRateManager.SwapInterval;
+        ALOGV(
+                "Display refresh rate %.0f Hz / %d -> %.0f Hz / %d (frame cost %.1f ms)",
+                app->DisplayRefreshRate,
+                app->SwapInterval,
+                refreshRate,
+                swapInterval,
+                xrFrameTiming_Cost(timing) * 1e3f);
+        if (refreshRate == app->DisplayRefreshRate ||
+            xrapiSetDisplayRefreshRate(app->Ovr, refreshRate) == xrSuccess) {
+            app->DisplayRefreshRate = refreshRate;
+            app->SwapInterval = swapInterval;
+        } else {
+            ALOGE("xrapiSetDisplayRefreshRate( %.0f ) failed", refreshRate);
+            xrRefreshRateManager_SetCurrent(
+                    &app->RefreshRateManager, app->DisplayRefreshRate, app->SwapInterval, now);
+        }
+    }
+
+    // The resolution scale targets a lower GPU load than the foveation governor, so resolution
+    // absorbs load changes first and foveation only rises once the scale is at its minimum.
+    const float resolutionScale =
+            xrResolutionScaleController_Update(&app->ResolutionScaleController, timing);
+    if (resolutionScale != app->ResolutionScale) {
+        ALOGV(
+                "Resolution scale %.2f -> %.2f (GPU load %.2f)",
+                app->ResolutionScale,
+                resolutionScale,
+                xrFrameTiming_GpuLoad(timing));
+        app->ResolutionScale = resolutionScale;
+    }
+
+    if (app->FoveationAvailable) {
+        const int level = xrFoveationGovernor_Update(
+                &app->FoveationGovernor, timing, app->StaleFramesPerSecond, now);
+        if (level != app->FoveationLevel) {
+            ALOGV(
+                    "Foveation level %d -> %d (GPU load %.2f, %.0f stale frames/s)",
+                    app->FoveationLevel,
+                    level,
+                    xrFrameTiming_GpuLoad(timing),
+                    app->StaleFramesPerSecond);
+            xrapiSetPropertyInt(&app->Java, XRAPI_FOVEATION_LEVEL, level);
+            app->FoveationLevel = level;
+        }
+    }
+
+    // The new mode is applied by xrApp_ApplyExtraLatencyMode() at the start of the next frame.
+    if (xrExtraLatencyGovernor_Update(&app->ExtraLatencyGovernor, timing, now)) {
+        ALOGV(
+                "Extra latency mode -> %s (GPU load %.2f)",
+                app->ExtraLatencyGovernor.Mode == XRAPI_EXTRA_LATENCY_MODE_ON ? "on" : "off",
+                xrFrameTiming_GpuLoad(timing));
+    }
+
+    if (now - app->LatencyStatsTime >= 10.0) {
+        const xrExtraLatencyGovernor* governor = &app->ExtraLatencyGovernor;
+        ALOGV(
+                "Extra latency off: %.1f fps, %.1f ms latency; on: %.1f fps, %.1f ms latency",
+                xrExtraLatencyGovernor_Throughput(governor, XRAPI_EXTRA_LATENCY_MODE_OFF),
+                xrExtraLatencyGovernor_Latency(governor, XRAPI_EXTRA_LATENCY_MODE_OFF) * 1e3f,
+                xrExtraLatencyGovernor_Throughput(governor, XRAPI_EXTRA_LATENCY_MODE_ON),
+                xrExtraLatencyGovernor_Latency(governor, XRAPI_EXTRA_LATENCY_MODE_ON) * 1e3f);
+        app->LatencyStatsTime = now;
+    }
+}
+
+// Applies a pending extra latency mode change. Must be called before predicting the display
+// time of a frame, so the prediction and the submission of every frame use the same mode.
+static void xrApp_ApplyExtraLatencyMode(xrApp* app) {
+    const xrExtraLatencyMode mode = app->ExtraLatencyGovernor.Mode;
+    if (mode == app->ExtraLatencyMode || app->Ovr == NULL) {
+        return;
+    }
+#if MULTI_THREADED
+    // The runtime applies the mode on the next submission, which must not be the frame that
+    // is still in flight on the renderer thread and was predicted with the old mode.
+    xrRenderThread_Wait(&app->RenderThread);
+#endif
+    xrapiSetExtraLatencyMode(app->Ovr, mode);
+    app->ExtraLatencyMode = mode;
+}
+
+static void xrApp_HandleInput(xrApp* app) {
+    if (app->Ovr == NULL) {
+        return;
+    }
+
+    // One call reads the state of all devices. Capabilities are only queried on a rescan.
+    xrInputCache_Update(&app->InputCache, app->Ovr, 0.0, &app->Input);
+
+    if (app->InputCache.Stats.DevicesChanged) {
+        ALOGV("xrApp_HandleInput: %d input devices", app->Input.DeviceCount);
+    }
+    for (int i = 0; i < app->Input.DeviceCount; i++) {
+        const xrInputDeviceSnapshot* device = &app->Input.Devices[i];
+        if (device->Pressed != 0 || device->Released != 0) {
+            ALOGV(
+                "xrApp_HandleInput: device %u pressed 0x%08x released 0x%08x",
+                device->DeviceID,
+                device->Pressed,
+                device->Released);
+        }
+    }
+}
+
+// Only locates the tracking spaces again after a recenter.
+static void xrApp_UpdateTrackingSpaces(xrApp* app) {
+    if (app->Ovr == NULL) {
+        return;
+    }
+    if (xrSpaceCache_Update(&app->SpaceCache, app->Ovr, &app->Java)) {
+        const xrPosef floor =
+                xrSpaceCache_GetPose(&app->SpaceCache, XRAPI_TRACKING_SPACE_LOCAL_FLOOR);
+        ALOGV(
+                "xrApp_UpdateTrackingSpaces: recenter count %d, user %d, floor at %.2f m",
+                app->SpaceCache.RecenterCount,
+                app->SpaceCache.UserRecenterCount,
+                floor.Position.y);
+    }
+}
+
+static void xrApp_HandleXrApiEvents(xrApp* app) {
+    xrEventPump* pump = &app->EventPump;
+    xrEventPump_Pump(pump);
+
+    if (pump->Stats.Coalesced > 0 || pump->Stats.Truncated) {
+        ALOGV(
+            "xrApp_HandleXrApiEvents: polled %u, dispatched %u, coalesced %u%s",
+            pump->Stats.Polled,
+            pump->Stats.Dispatched,
+            pump->Stats.Coalesced,
+            pump->Stats.Truncated ? ", more pending" : "");
+    }
+}
 
 /*
 ================================================================================
@@ -1811,6 +3607,7 @@ void android_main(struct android_app* app) {
     xrApp appState;
     xrApp_Clear(&appState);
     appState.Java = java;
+    xrSystemProperties_Refresh(&appState.SystemProperties, &appState.Java);
 
     xrEgl_CreateContext(&appState.Egl, NULL);
 
@@ -1820,23 +3617,54 @@ void android_main(struct android_app* app) {
 
     ALOGV("AppState UseMultiview : %d", appState.UseMultiview);
 
+#if CULL_BENCHMARK
+    xrFrustum_Benchmark();
+#endif
+
     appState.CpuLevel = CPU_LEVEL;
     appState.GpuLevel = GPU_LEVEL;
     appState.MainThreadTid = gettid();
 
+    xrApp_InitPerformance(&appState);
+
+    // Build the scene program while entering VR mode, from the cache when possible.
+    char programCachePath[1024];
+    snprintf(
+            programCachePath,
+            sizeof(programCachePath),
+            "%s/programs",
+            app->activity->internalDataPath);
+    xrProgramCache_Create(&appState.ProgramCache, programCachePath);
+    xrProgramWorker_Add(
+            &appState.ProgramWorker, VERTEX_SHADER, FRAGMENT_SHADER, appState.UseMultiview);
+    xrProgramWorker_Start(&appState.ProgramWorker, &appState.Egl, &appState.ProgramCache);
+
+#if RECORD_TRACKING_TRACE
+    char tracePath[1024];
+    snprintf(tracePath, sizeof(tracePath), "%s/tracking.trace", app->activity->internalDataPath);
+    if (!xrTrackingTraceWriter_Open(&appState.TrackingTrace, tracePath, 0)) {
+        ALOGE("Failed to create %s", tracePath);
+    }
+#endif
+
 #if MULTI_THREADED
     xrRenderThread_Create(
-        &appState.RenderThread, &appState.Java, &appState.Egl, appState.UseMultiview);
+        &appState.RenderThread,
+        &appState.Java,
+        &appState.SystemProperties,
+        &appState.Egl,
+        appState.UseMultiview);
     // Also set the renderer thread to SCHED_FIFO.
     appState.RenderThreadTid = xrRenderThread_GetTid(&appState.RenderThread);
 #else
-    xrRenderer_Create(&appState.Renderer, &java, appState.UseMultiview);
+    xrRenderer_Create(&appState.Renderer, &appState.SystemProperties, appState.UseMultiview);
 #endif
 
     app->userData = &appState;
     app->onAppCmd = app_handle_cmd;
 
     const double startTime = GetTimeInSeconds();
+    double lastFrameStartTime = 0.0;
 
     while (app->destroyRequested == 0) {
         // Read all pending events.
@@ -1859,68 +3687,117 @@ void android_main(struct android_app* app) {
 
         xrApp_HandleInput(&appState);
 
+        xrApp_UpdateTrackingSpaces(&appState);
+
         if (appState.Ovr == NULL) {
             continue;
         }
 
+        xrApp_HandleXrApiEvents(&appState);
+
         // Create the scene if not yet created.
-        // The scene is created here to be able to show a loading icon.
+        // The scene is built on the loader thread while a loading icon is shown.
         if (!xrScene_IsCreated(&appState.Scene)) {
+            if (!appState.SceneLoader.Requested) {
+                xrSceneLoader_Start(
+                        &appState.SceneLoader,
+                        &appState.Egl,
+                        appState.UseMultiview,
+                        &appState.ProgramWorker,
+                        &appState.ProgramCache);
+            }
+            if (!xrSceneLoader_Finish(&appState.SceneLoader, &appState.Scene)) {
+                // Keep submitting loading icon frames, so the compositor gets a new frame every
+                // vsync while the scene is loading.
+                appState.FrameIndex++;
+                appState.DisplayTime =
+                        xrapiGetPredictedDisplayTime(appState.Ovr, appState.FrameIndex);
+                xrSceneLoader_CountLoadingFrame(&appState.SceneLoader);
 #if MULTI_THREADED
-            // Show a loading icon.
-            xrRenderThread_Submit(
-                &appState.RenderThread,
-                appState.Ovr,
-                RENDER_LOADING_ICON,
-                appState.FrameIndex,
-                appState.DisplayTime,
-                appState.SwapInterval,
-                NULL,
-                NULL,
-                NULL);
+                // Show a loading icon.
+                xrRenderThread_Submit(
+                    &appState.RenderThread,
+                    appState.Ovr,
+                    appState.VrSessionCount,
+                    RENDER_LOADING_ICON,
+                    appState.FrameIndex,
+                    appState.DisplayTime,
+                    appState.SwapInterval,
+                    NULL,
+                    NULL,
+                    NULL,
+                    1.0f);
 #else
-            // Show a loading icon.
-            int frameFlags = 0;
-            frameFlags |= XRAPI_FRAME_FLAG_FLUSH;
-
-            xrLayerProjection2 blackLayer = xrapiDefaultLayerBlackProjection2();
-            blackLayer.Header.Flags |= XRAPI_FRAME_LAYER_FLAG_INHIBIT_SRGB_FRAMEBUFFER;
-
-            xrLayerLoadingIcon2 iconLayer = xrapiDefaultLayerLoadingIcon2();
-            iconLayer.Header.Flags |= XRAPI_FRAME_LAYER_FLAG_INHIBIT_SRGB_FRAMEBUFFER;
-
-            const xrLayerHeader2* layers[] = {
-                    &blackLayer.Header,
-                    &iconLayer.Header,
-            };
-
-            xrSubmitFrameDescription2 frameDesc = {0};
-            frameDesc.Flags = frameFlags;
-            frameDesc.SwapInterval = 1;
-            frameDesc.FrameIndex = appState.FrameIndex;
-            frameDesc.DisplayTime = appState.DisplayTime;
-            frameDesc.LayerCount = 2;
-            frameDesc.Layers = layers;
-
-            xrapiSubmitFrame2(appState.Ovr, &frameDesc);
+                // Show a loading icon.
+                xrFrameBuilder_Begin(
+                        &appState.FrameBuilder,
+                        XRAPI_FRAME_FLAG_FLUSH,
+                        1,
+                        appState.FrameIndex,
+                        appState.DisplayTime);
+
+                xrLayerProjection2 blackLayer = xrapiDefaultLayerBlackProjection2();
+                blackLayer.Header.Flags |= XRAPI_FRAME_LAYER_FLAG_INHIBIT_SRGB_FRAMEBUFFER;
+                xrFrameBuilder_AddProjection2(&appState.FrameBuilder, &blackLayer);
+
+                xrLayerLoadingIcon2 iconLayer = xrapiDefaultLayerLoadingIcon2();
+                iconLayer.Header.Flags |= XRAPI_FRAME_LAYER_FLAG_INHIBIT_SRGB_FRAMEBUFFER;
+                xrFrameBuilder_AddLoadingIcon2(&appState.FrameBuilder, &iconLayer);
+
+                xrapiSubmitFrame2(appState.Ovr, xrFrameBuilder_End(&appState.FrameBuilder));
 #endif
-
-            // Create the scene.
-            xrScene_Create(&appState.Scene, appState.UseMultiview);
+                continue;
+            }
         }
 
-        // This is the only place the frame index is incremented, right before
-        // calling xrapiGetPredictedDisplayTime().
+        // Apart from the loading icon frames above, this is the only place the frame index is
+        // incremented, right before calling xrapiGetPredictedDisplayTime().
         appState.FrameIndex++;
 
+        const double frameStartTime = GetTimeInSeconds();
+        xrFrameTiming* frameTiming = &appState.FrameTiming;
+        frameTiming->FrameInterval = (lastFrameStartTime > 0.0)
+                ? (float)(frameStartTime - lastFrameStartTime)
+                : 0.0f;
+        frameTiming->FrameBudget = appState.SwapInterval / appState.DisplayRefreshRate;
+        lastFrameStartTime = frameStartTime;
+
         // Get the HMD pose, predicted for the middle of the time period during which
         // the new eye images will be displayed. The number of frames predicted ahead
         // depends on the pipeline depth of the engine and the synthesis rate.
         // The better the prediction, the less black will be pulled in at the edges.
+        // With MULTI_THREADED the previous frame may still be in flight on the renderer
+        // thread. It is submitted with its own FrameIndex, so this frame still predicts for
+        // FrameIndex, and the extra latency mode tells the runtime how far ahead that is.
+        xrApp_ApplyExtraLatencyMode(&appState);
         const double predictedDisplayTime =
                 xrapiGetPredictedDisplayTime(appState.Ovr, appState.FrameIndex);
         const xrTracking2 tracking =
                 xrapiGetPredictedTracking2(appState.Ovr, predictedDisplayTime);
+        // The predicted display time is on the runtime clock, so measure against that.
+        frameTiming->Latency = (float)(predictedDisplayTime - xrapiGetTimeInSeconds());
+
+#if RECORD_TRACKING_TRACE
+        if (xrTrackingTraceWriter_IsOpen(&appState.TrackingTrace)) {
+            static xrTrackingTraceFrame traceFrame;
+            memset(&traceFrame, 0, sizeof(traceFrame));
+            traceFrame.FrameIndex = appState.FrameIndex;
+            traceFrame.RecordTime = xrapiGetTimeInSeconds();
+            traceFrame.DisplayTime = predictedDisplayTime;
+            traceFrame.Tracking = tracking;
+            for (int i = 0; i < appState.Input.DeviceCount &&
+                 traceFrame.DeviceCount < XRAPI_TRACKING_TRACE_MAX_DEVICES;
+                 i++) {
+                const xrInputDeviceSnapshot* device = &appState.Input.Devices[i];
+                if (device->Flags & XRAPI_INPUT_SNAPSHOT_TRACKING_VALID) {
+                    traceFrame.DeviceIDs[traceFrame.DeviceCount] = device->DeviceID;
+                    traceFrame.Devices[traceFrame.DeviceCount] = device->Tracking;
+                    traceFrame.DeviceCount++;
+                }
+            }
+            xrTrackingTraceWriter_Append(&appState.TrackingTrace, &traceFrame);
+        }
+#endif
 
         appState.DisplayTime = predictedDisplayTime;
 
@@ -1930,39 +3807,51 @@ void android_main(struct android_app* app) {
 
 #if MULTI_THREADED
         // Render the eye images on a separate thread.
+        const double submitStartTime = GetTimeInSeconds();
         xrRenderThread_Submit(
             &appState.RenderThread,
             appState.Ovr,
+            appState.VrSessionCount,
             RENDER_FRAME,
             appState.FrameIndex,
             appState.DisplayTime,
             appState.SwapInterval,
             &appState.Scene,
             &appState.Simulation,
-            &tracking);
+            &tracking,
+            appState.ResolutionScale);
+        const double submitEndTime = GetTimeInSeconds();
+        frameTiming->GpuTime = appState.RenderThread.LatchedGpuTime;
 #else
         // Render eye images and setup the primary layer using xrTracking2.
         const xrLayerProjection2 worldLayer = xrRenderer_RenderFrame(
                 &appState.Renderer,
-                &appState.Java,
+                &appState.SystemProperties,
                 &appState.Scene,
                 &appState.Simulation,
                 &tracking,
-                appState.Ovr);
+                appState.ResolutionScale,
+                appState.VrSessionCount);
 
-        const xrLayerHeader2* layers[] = {&worldLayer.Header};
-
-        xrSubmitFrameDescription2 frameDesc = {0};
-        frameDesc.Flags = 0;
-        frameDesc.SwapInterval = appState.SwapInterval;
-        frameDesc.FrameIndex = appState.FrameIndex;
-        frameDesc.DisplayTime = appState.DisplayTime;
-        frameDesc.LayerCount = 1;
-        frameDesc.Layers = layers;
+        xrFrameBuilder_Begin(
+                &appState.FrameBuilder,
+                0,
+                appState.SwapInterval,
+                appState.FrameIndex,
+                appState.DisplayTime);
+        xrFrameBuilder_AddProjection2(&appState.FrameBuilder, &worldLayer);
 
         // Hand over the eye images to the time warp.
-        xrapiSubmitFrame2(appState.Ovr, &frameDesc);
+        const double submitStartTime = GetTimeInSeconds();
+        xrapiSubmitFrame2(appState.Ovr, xrFrameBuilder_End(&appState.FrameBuilder));
+        const double submitEndTime = GetTimeInSeconds();
+        frameTiming->GpuTime = appState.Renderer.GpuTimer.LastGpuTime;
 #endif
+
+        frameTiming->CpuTime = (float)(submitStartTime - frameStartTime);
+        frameTiming->SubmitWaitTime = (float)(submitEndTime - submitStartTime);
+        xrApp_UpdatePerformance(&appState, frameTiming);
+        xrSceneLoader_ReportFirstSceneFrame(&appState.SceneLoader);
     }
 
 #if MULTI_THREADED
@@ -1971,9 +3860,19 @@ void android_main(struct android_app* app) {
     xrRenderer_Destroy(&appState.Renderer);
 #endif
 
+    xrSceneLoader_Destroy(&appState.SceneLoader);
+    xrProgramWorker_Destroy(&appState.ProgramWorker);
     xrScene_Destroy(&appState.Scene);
     xrEgl_DestroyContext(&appState.Egl);
 
+#if RECORD_TRACKING_TRACE
+    ALOGV(
+            "Recorded %llu frames, %llu bytes of tracking trace",
+            (unsigned long long)appState.TrackingTrace.Frames,
+            (unsigned long long)appState.TrackingTrace.Bytes);
+    xrTrackingTraceWriter_Close(&appState.TrackingTrace);
+#endif
+
     xrapiShutdown();
 
     java.Vm->DetachCurrentThread();
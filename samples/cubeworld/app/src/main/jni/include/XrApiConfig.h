@@ -48,6 +48,7 @@ XRAPI_ASSERT_TYPE_SIZE( type, bytes )			// assert the size of a type
 XRAPI_ASSERT_TYPE_SIZE_32_BIT( type, bytes )	// assert the size of a type only when using a 32-bit compiler
 XRAPI_ASSERT_TYPE_SIZE_64_BIT( type, bytes )	// assert the size of a type only when using a 64-bit compiler
 XRAPI_ALIGN( value, boundary )					// align memory to the given boundary value
+XRAPI_CONSTEXPR									// constexpr when compiled as C++14 or later
 
 */
 // clang-format on
@@ -109,4 +110,10 @@ XRAPI_ALIGN( value, boundary )					// align memory to the given boundary value
 #define XRAPI_ALIGN(value, boundary) ((value + boundary - 1) & (~(boundary - 1)))
 #endif
 
+#if defined(__cplusplus) && __cplusplus >= 201402L
+#define XRAPI_CONSTEXPR constexpr
+#else
+#define XRAPI_CONSTEXPR
+#endif
+
 #endif // !XR_XrApiConfig_h
@@ -0,0 +1,226 @@
+
+#ifndef XR_XrApiFrameBuilder_h
+#define XR_XrApiFrameBuilder_h
+
+#include <assert.h> // for assert()
+#include <stddef.h> // for offsetof()
+#include "string.h" // for memset()
+#include "XrApiConfig.h"
+#include "XrApiTypes.h"
+#include "XrApiExtension.h"
+#include "XrApi.h"
+
+/*
+Builds an xrSubmitFrameDescription2 in fixed storage.
+
+The builder holds xrMaxLayerCount layers inline, next to the list of layer header pointers
+that xrapiSubmitFrame2() takes. Adding a layer copies it into the next slot and appends the
+address of the slot to the list, so the finished description refers straight into the
+builder without further copies or allocations. The builder must not be copied or moved
+between xrFrameBuilder_Begin() and the submit, because the list points into it.
+
+    xrFrameBuilder builder;
+    xrFrameBuilder_Begin( &builder, 0, swapInterval, frameIndex, displayTime );
+    xrFrameBuilder_AddProjection2( &builder, &worldLayer );
+    xrapiSubmitFrame2( ovr, xrFrameBuilder_End( &builder ) );
+
+There is one add function per layer type, so adding a layer through the wrong member of
+xrLayer_Union2 does not compile. The remaining rules are checked with assert() while
+XRAPI_FRAME_BUILDER_VALIDATE is set, which by default is when NDEBUG is not defined:
+
+    - no more than xrMaxLayerCount layers are added,
+    - the Header.Type of each layer matches the add function,
+    - every swap chain index is within the length of its swap chain.
+
+Release builds compile the checks out entirely.
+*/
+
+#if !defined(XRAPI_FRAME_BUILDER_VALIDATE)
+#if defined(NDEBUG)
+#define XRAPI_FRAME_BUILDER_VALIDATE 0
+#else
+#define XRAPI_FRAME_BUILDER_VALIDATE 1
+#endif
+#endif
+
+// The slots are written through the union and submitted through the header.
+XRAPI_STATIC_ASSERT(offsetof(xrLayerProjection2, Header) == 0);
+XRAPI_STATIC_ASSERT(offsetof(xrLayerCylinder2, Header) == 0);
+XRAPI_STATIC_ASSERT(offsetof(xrLayerCube2, Header) == 0);
+XRAPI_STATIC_ASSERT(offsetof(xrLayerEquirect2, Header) == 0);
+XRAPI_STATIC_ASSERT(offsetof(xrLayerLoadingIcon2, Header) == 0);
+XRAPI_STATIC_ASSERT(offsetof(xrLayerFishEye2, Header) == 0);
+
+typedef struct xrFrameBuilder_ {
+    xrSubmitFrameDescription2 Description;
+    const xrLayerHeader2* LayerList[xrMaxLayerCount];
+    xrLayer_Union2 Layers[xrMaxLayerCount];
+} xrFrameBuilder;
+
+/// Returns true if 'index' can be submitted with 'swapChain'. The default swap chains only
+/// have a single image.
+static inline bool xrFrameBuilder_IsValidSwapChainIndex(
+    xrTextureSwapChain* swapChain,
+    const int index) {
+    const uintptr_t id = (uintptr_t)swapChain;
+    if (id == XRAPI_DEFAULT_TEXTURE_SWAPCHAIN ||
+        id == XRAPI_DEFAULT_TEXTURE_SWAPCHAIN_LOADING_ICON ||
+        id == XRAPI_DEFAULT_TEXTURE_SWAPCHAIN_BLACK) {
+        return index == 0;
+    }
+    return swapChain != NULL && index >= 0 && index < xrapiGetTextureSwapChainLength(swapChain);
+}
+
+/// Starts a new frame. Layers from the previous frame are dropped.
+static inline void xrFrameBuilder_Begin(
+    xrFrameBuilder* builder,
+    const uint32_t flags,
+    const uint32_t swapInterval,
+    const uint64_t frameIndex,
+    const double displayTime) {
+    memset(&builder->Description, 0, sizeof(builder->Description));
+    builder->Description.Flags = flags;
+    builder->Description.SwapInterval = swapInterval;
+    builder->Description.FrameIndex = frameIndex;
+    builder->Description.DisplayTime = displayTime;
+    builder->Description.LayerCount = 0;
+    builder->Description.Layers = builder->LayerList;
+}
+
+/// Appends an empty slot and returns it.
+static inline xrLayer_Union2* xrFrameBuilder_Append(
+    xrFrameBuilder* builder,
+    const xrLayerType2 type,
+    const xrLayerHeader2* header) {
+#if XRAPI_FRAME_BUILDER_VALIDATE
+    assert(builder->Description.LayerCount < (uint32_t)xrMaxLayerCount);
+    assert(header->Type == type);
+#else
+    (void)type;
+    (void)header;
+#endif
+    const uint32_t index = builder->Description.LayerCount++;
+    builder->LayerList[index] = &builder->Layers[index].Header;
+    return &builder->Layers[index];
+}
+
+/// Each add function copies the layer into the builder and returns the copy, which can
+/// still be changed until the frame is submitted.
+static inline xrLayerProjection2* xrFrameBuilder_AddProjection2(
+    xrFrameBuilder* builder,
+    const xrLayerProjection2* layer) {
+    xrLayer_Union2* slot =
+        xrFrameBuilder_Append(builder, XRAPI_LAYER_TYPE_PROJECTION2, &layer->Header);
+    slot->Projection = *layer;
+    return &slot->Projection;
+}
+
+static inline xrLayerCylinder2* xrFrameBuilder_AddCylinder2(
+    xrFrameBuilder* builder,
+    const xrLayerCylinder2* layer) {
+    xrLayer_Union2* slot =
+        xrFrameBuilder_Append(builder, XRAPI_LAYER_TYPE_CYLINDER2, &layer->Header);
+    slot->Cylinder = *layer;
+    return &slot->Cylinder;
+}
+
+static inline xrLayerCube2* xrFrameBuilder_AddCube2(
+    xrFrameBuilder* builder,
+    const xrLayerCube2* layer) {
+    xrLayer_Union2* slot =
+        xrFrameBuilder_Append(builder, XRAPI_LAYER_TYPE_CUBE2, &layer->Header);
+    slot->Cube = *layer;
+    return &slot->Cube;
+}
+
+static inline xrLayerEquirect2* xrFrameBuilder_AddEquirect2(
+    xrFrameBuilder* builder,
+    const xrLayerEquirect2* layer) {
+    xrLayer_Union2* slot =
+        xrFrameBuilder_Append(builder, XRAPI_LAYER_TYPE_EQUIRECT2, &layer->Header);
+    slot->Equirect = *layer;
+    return &slot->Equirect;
+}
+
+static inline xrLayerLoadingIcon2* xrFrameBuilder_AddLoadingIcon2(
+    xrFrameBuilder* builder,
+    const xrLayerLoadingIcon2* layer) {
+    xrLayer_Union2* slot =
+        xrFrameBuilder_Append(builder, XRAPI_LAYER_TYPE_LOADING_ICON2, &layer->Header);
+    slot->LoadingIcon = *layer;
+    return &slot->LoadingIcon;
+}
+
+static inline xrLayerFishEye2* xrFrameBuilder_AddFishEye2(
+    xrFrameBuilder* builder,
+    const xrLayerFishEye2* layer) {
+    xrLayer_Union2* slot =
+        xrFrameBuilder_Append(builder, XRAPI_LAYER_TYPE_FISHEYE2, &layer->Header);
+    slot->FishEye = *layer;
+    return &slot->FishEye;
+}
+
+#if XRAPI_FRAME_BUILDER_VALIDATE
+static inline void xrFrameBuilder_ValidateLayer(const xrLayer_Union2* layer) {
+    switch (layer->Header.Type) {
+        case XRAPI_LAYER_TYPE_PROJECTION2:
+            for (int eye = 0; eye < XRAPI_FRAME_LAYER_EYE_MAX; eye++) {
+                assert(xrFrameBuilder_IsValidSwapChainIndex(
+                    layer->Projection.Textures[eye].ColorSwapChain,
+                    layer->Projection.Textures[eye].SwapChainIndex));
+            }
+            break;
+        case XRAPI_LAYER_TYPE_CYLINDER2:
+            for (int eye = 0; eye < XRAPI_FRAME_LAYER_EYE_MAX; eye++) {
+                assert(xrFrameBuilder_IsValidSwapChainIndex(
+                    layer->Cylinder.Textures[eye].ColorSwapChain,
+                    layer->Cylinder.Textures[eye].SwapChainIndex));
+            }
+            break;
+        case XRAPI_LAYER_TYPE_CUBE2:
+            for (int eye = 0; eye < XRAPI_FRAME_LAYER_EYE_MAX; eye++) {
+                assert(xrFrameBuilder_IsValidSwapChainIndex(
+                    layer->Cube.Textures[eye].ColorSwapChain,
+                    layer->Cube.Textures[eye].SwapChainIndex));
+            }
+            break;
+        case XRAPI_LAYER_TYPE_EQUIRECT2:
+            for (int eye = 0; eye < XRAPI_FRAME_LAYER_EYE_MAX; eye++) {
+                assert(xrFrameBuilder_IsValidSwapChainIndex(
+                    layer->Equirect.Textures[eye].ColorSwapChain,
+                    layer->Equirect.Textures[eye].SwapChainIndex));
+            }
+            break;
+        case XRAPI_LAYER_TYPE_LOADING_ICON2:
+            assert(xrFrameBuilder_IsValidSwapChainIndex(
+                layer->LoadingIcon.ColorSwapChain, layer->LoadingIcon.SwapChainIndex));
+            break;
+        case XRAPI_LAYER_TYPE_FISHEYE2:
+            for (int eye = 0; eye < XRAPI_FRAME_LAYER_EYE_MAX; eye++) {
+                assert(xrFrameBuilder_IsValidSwapChainIndex(
+                    layer->FishEye.Textures[eye].ColorSwapChain,
+                    layer->FishEye.Textures[eye].SwapChainIndex));
+            }
+            break;
+        default:
+            assert(!"unknown layer type");
+            break;
+    }
+}
+#endif
+
+/// Finishes the frame and returns the description to pass to xrapiSubmitFrame2(). It stays
+/// valid until the next xrFrameBuilder_Begin().
+static inline const xrSubmitFrameDescription2* xrFrameBuilder_End(xrFrameBuilder* builder) {
+#if XRAPI_FRAME_BUILDER_VALIDATE
+    // A copied builder would still point at the layers of the original.
+    assert(builder->Description.Layers == builder->LayerList);
+    for (uint32_t i = 0; i < builder->Description.LayerCount; i++) {
+        assert(builder->LayerList[i] == &builder->Layers[i].Header);
+        xrFrameBuilder_ValidateLayer(&builder->Layers[i]);
+    }
+#endif
+    return &builder->Description;
+}
+
+#endif // XR_XrApiFrameBuilder_h
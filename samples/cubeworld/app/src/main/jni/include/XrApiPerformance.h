@@ -0,0 +1,987 @@
+
+#ifndef XR_XrApiPerformance_h
+#define XR_XrApiPerformance_h
+
+#include "math.h" // for sqrtf(), floorf(), fabsf()
+#include "string.h" // for memset()
+#include "XrApiConfig.h"
+#include "XrApiTypes.h"
+
+/*
+Performance policies driven by per-frame timing.
+
+The application measures an xrFrameTiming every frame and feeds it to the governors below.
+Each governor only computes a decision. Applying it (setting a property, calling into the
+runtime) is left to the caller, so the policies can be driven from recorded or synthetic
+timing as easily as from a live frame loop.
+*/
+
+/// Timing of one frame as measured by the application. All times are in seconds.
+typedef struct xrFrameTiming_ {
+    // Time available for one frame: SwapInterval / display refresh rate.
+    float FrameBudget;
+    // CPU time spent producing the frame, not counting time blocked in xrapiSubmitFrame2.
+    float CpuTime;
+    // GPU time spent rendering the frame, or 0 if the GPU time is unknown.
+    float GpuTime;
+    // Time blocked in xrapiSubmitFrame2.
+    float SubmitWaitTime;
+    // Time between the start of this frame and the start of the previous frame.
+    float FrameInterval;
+    // Time from sampling the tracking state to the predicted display time, or 0 if unknown.
+    float Latency;
+} xrFrameTiming;
+
+/// Returned by xrFrameTiming_GpuLoad() for frames without a GPU time.
+#define XRAPI_GPU_LOAD_UNKNOWN (-1.0f)
+
+/// Fraction of the frame budget used by the GPU, or XRAPI_GPU_LOAD_UNKNOWN if the GPU time is
+/// unknown. The CPU time plus the submit wait is no substitute: the submit call blocks on the
+/// vsync, so it would read as a full budget on every frame.
+static inline float xrFrameTiming_GpuLoad(const xrFrameTiming* timing) {
+    if (timing->GpuTime <= 0.0f) {
+        return XRAPI_GPU_LOAD_UNKNOWN;
+    }
+    return (timing->FrameBudget > 0.0f) ? timing->GpuTime / timing->FrameBudget : 0.0f;
+}
+
+/// Fraction of the frame budget used by the CPU.
+static inline float xrFrameTiming_CpuLoad(const xrFrameTiming* timing) {
+    return (timing->FrameBudget > 0.0f) ? timing->CpuTime / timing->FrameBudget : 0.0f;
+}
+
+//-----------------------------------------------------------------
+// Foveation governor.
+//-----------------------------------------------------------------
+
+/// Foveation levels accepted by XRAPI_FOVEATION_LEVEL: 0 (off) to 4 (highest).
+#define XRAPI_FOVEATION_LEVEL_MAX 4
+
+typedef struct xrFoveationGovernorParms_ {
+    // Range of levels the governor may choose from.
+    int MinLevel;
+    int MaxLevel;
+    // GPU load (fraction of the frame budget) the governor steers towards.
+    float TargetLoad;
+    // PID gains. The error is the GPU load minus the target load, the output is a
+    // continuous foveation level.
+    float Kp;
+    float Ki;
+    float Kd;
+    // Stale frames per second that are tolerated. Every stale frame per second above this
+    // adds StaleFramesGain to the error.
+    float StaleFramesBudget;
+    float StaleFramesGain;
+    // The continuous level has to move this far past the midpoint between two levels before
+    // the level changes.
+    float Hysteresis;
+    // Minimum time in seconds between raising or lowering the level.
+    float RaiseDwellTime;
+    float LowerDwellTime;
+} xrFoveationGovernorParms;
+
+static inline xrFoveationGovernorParms xrapiDefaultFoveationGovernorParms() {
+    xrFoveationGovernorParms parms;
+    parms.MinLevel = 0;
+    parms.MaxLevel = XRAPI_FOVEATION_LEVEL_MAX;
+    parms.TargetLoad = 0.85f;
+    parms.Kp = 2.0f;
+    parms.Ki = 4.0f;
+    parms.Kd = 0.0f;
+    parms.StaleFramesBudget = 1.0f;
+    parms.StaleFramesGain = 0.05f;
+    parms.Hysteresis = 0.25f;
+    parms.RaiseDwellTime = 0.25f;
+    parms.LowerDwellTime = 2.0f;
+    return parms;
+}
+
+typedef struct xrFoveationGovernor_ {
+    xrFoveationGovernorParms Parms;
+    // Integral of the error, in seconds.
+    float Integral;
+    float PreviousError;
+    // Continuous level computed by the controller.
+    float Output;
+    // Current discrete level.
+    int Level;
+    double LastChangeTime;
+    // Number of level changes since initialization.
+    uint32_t Changes;
+} xrFoveationGovernor;
+
+static inline void xrFoveationGovernor_Init(
+    xrFoveationGovernor* governor,
+    const xrFoveationGovernorParms* parms,
+    const int initialLevel,
+    const double now) {
+    governor->Parms = *parms;
+    governor->Level = (initialLevel < parms->MinLevel)
+        ? parms->MinLevel
+        : ((initialLevel > parms->MaxLevel) ? parms->MaxLevel : initialLevel);
+    governor->Output = (float)governor->Level;
+    governor->Integral = (parms->Ki > 0.0f) ? governor->Output / parms->Ki : 0.0f;
+    governor->PreviousError = 0.0f;
+    governor->LastChangeTime = now;
+    governor->Changes = 0;
+}
+
+/// Updates the governor with the timing of the last frame and the current
+/// XRAPI_SYS_STATUS_STALE_FRAMES_PER_SECOND. Returns the foveation level to use. Frames without
+/// a GPU time leave the governor unchanged.
+static inline int xrFoveationGovernor_Update(
+    xrFoveationGovernor* governor,
+    const xrFrameTiming* timing,
+    const float staleFramesPerSecond,
+    const double now) {
+    const xrFoveationGovernorParms* parms = &governor->Parms;
+    const float dt = (timing->FrameInterval > 0.0f) ? timing->FrameInterval : timing->FrameBudget;
+    const float gpuLoad = xrFrameTiming_GpuLoad(timing);
+    if (dt <= 0.0f || gpuLoad < 0.0f) {
+        return governor->Level;
+    }
+
+    float error = gpuLoad - parms->TargetLoad;
+    if (staleFramesPerSecond > parms->StaleFramesBudget) {
+        error += (staleFramesPerSecond - parms->StaleFramesBudget) * parms->StaleFramesGain;
+    }
+
+    // Clamp the integral so its contribution alone stays within the level range (anti-windup).
+    governor->Integral += error * dt;
+    if (parms->Ki > 0.0f) {
+        const float minIntegral = (float)parms->MinLevel / parms->Ki;
+        const float maxIntegral = (float)parms->MaxLevel / parms->Ki;
+        governor->Integral = (governor->Integral < minIntegral)
+            ? minIntegral
+            : ((governor->Integral > maxIntegral) ? maxIntegral : governor->Integral);
+    }
+    const float derivative = (error - governor->PreviousError) / dt;
+    governor->PreviousError = error;
+
+    float output = parms->Kp * error + parms->Ki * governor->Integral + parms->Kd * derivative;
+    output = (output < (float)parms->MinLevel)
+        ? (float)parms->MinLevel
+        : ((output > (float)parms->MaxLevel) ? (float)parms->MaxLevel : output);
+    governor->Output = output;
+
+    // Step at most one level at a time, and only after the dwell time in that direction.
+    const double sinceChange = now - governor->LastChangeTime;
+    const float threshold = 0.5f + parms->Hysteresis;
+    if (output > (float)governor->Level + threshold && governor->Level < parms->MaxLevel &&
+        sinceChange >= parms->RaiseDwellTime) {
+        governor->Level++;
+        governor->LastChangeTime = now;
+        governor->Changes++;
+    } else if (
+        output < (float)governor->Level - threshold && governor->Level > parms->MinLevel &&
+        sinceChange >= parms->LowerDwellTime) {
+        governor->Level--;
+        governor->LastChangeTime = now;
+        governor->Changes++;
+    }
+    return governor->Level;
+}
+
+//-----------------------------------------------------------------
+// Clock level governor.
+//-----------------------------------------------------------------
+
+/// Clock levels accepted by xrapiSetClockLevels range from 0 to this value, like the fixed
+/// levels of xrPerformanceParms.
+#define XRAPI_CLOCK_LEVEL_MAX 3
+
+typedef enum xrFrameBound_ {
+    xrFrameBound_None = 0, // the frame fit comfortably in the budget
+    xrFrameBound_Cpu = 1, // the CPU work came close to or exceeded the budget
+    xrFrameBound_Gpu = 2, // the GPU work came close to or exceeded the budget
+} xrFrameBound;
+
+/// Classifies which processor limited a frame. 'threshold' is the load (fraction of the frame
+/// budget) above which a processor is considered the bottleneck. Without a GPU time a frame
+/// is never GPU bound.
+static inline xrFrameBound xrFrameTiming_Classify(
+    const xrFrameTiming* timing,
+    const float threshold) {
+    const float cpuLoad = xrFrameTiming_CpuLoad(timing);
+    const float gpuLoad = xrFrameTiming_GpuLoad(timing);
+    if (gpuLoad < 0.0f) {
+        return (cpuLoad < threshold) ? xrFrameBound_None : xrFrameBound_Cpu;
+    }
+    if (cpuLoad < threshold && gpuLoad < threshold) {
+        return xrFrameBound_None;
+    }
+    return (cpuLoad >= gpuLoad) ? xrFrameBound_Cpu : xrFrameBound_Gpu;
+}
+
+typedef struct xrClockGovernorParms_ {
+    int MinCpuLevel;
+    int MaxCpuLevel;
+    int MinGpuLevel;
+    int MaxGpuLevel;
+    // Relative clock frequency of each level, used to predict the load after a level change
+    // and as the basis of the energy estimate.
+    float LevelPerformance[XRAPI_CLOCK_LEVEL_MAX + 1];
+    // Average load above which the level of a processor is raised.
+    float RaiseLoad;
+    // A level is only lowered when the predicted load at the lower level stays below this.
+    float LowerLoad;
+    // Fraction of frames in a window bound by a processor that raises its level.
+    float BoundFraction;
+    // Length in seconds of the window over which loads are averaged.
+    float WindowTime;
+    // Time in seconds the load has to allow a lower level before the level is lowered.
+    float LowerDwellTime;
+    // Time in seconds the level caps stay in place after throttling is no longer reported.
+    float ThrottleRecoveryTime;
+} xrClockGovernorParms;
+
+static inline xrClockGovernorParms xrapiDefaultClockGovernorParms() {
+    xrClockGovernorParms parms;
+    parms.MinCpuLevel = 0;
+    parms.MaxCpuLevel = XRAPI_CLOCK_LEVEL_MAX;
+    parms.MinGpuLevel = 0;
+    parms.MaxGpuLevel = XRAPI_CLOCK_LEVEL_MAX;
+    parms.LevelPerformance[0] = 0.6f;
+    parms.LevelPerformance[1] = 0.73f;
+    parms.LevelPerformance[2] = 0.86f;
+    parms.LevelPerformance[3] = 1.0f;
+    parms.RaiseLoad = 0.9f;
+    parms.LowerLoad = 0.75f;
+    parms.BoundFraction = 0.1f;
+    parms.WindowTime = 0.5f;
+    parms.LowerDwellTime = 3.0f;
+    parms.ThrottleRecoveryTime = 30.0f;
+    return parms;
+}
+
+typedef struct xrClockGovernor_ {
+    xrClockGovernorParms Parms;
+    int CpuLevel;
+    int GpuLevel;
+
+    // Current window.
+    float WindowElapsed;
+    float CpuLoadSum;
+    float GpuLoadSum;
+    int WindowFrames;
+    // Frames of the window with a GPU time. The GPU level holds when there were none.
+    int GpuLoadFrames;
+    int CpuBoundFrames;
+    int GpuBoundFrames;
+
+    // Time since which the load would have allowed a lower level, or a negative value.
+    double CpuLowerSince;
+    double GpuLowerSince;
+
+    // Level caps applied while the device reports throttling.
+    bool Throttled;
+    double ThrottleEndTime;
+    int CpuLevelCap;
+    int GpuLevelCap;
+
+    // Frames delivered within budget and frames that missed it.
+    uint32_t FramesDelivered;
+    uint32_t FramesMissed;
+    // Energy proxy: sum over frames of (cpu performance^3 + gpu performance^3) * time, taking
+    // dynamic power as roughly cubic in clock frequency.
+    double Energy;
+} xrClockGovernor;
+
+static inline int xrClockGovernor_Clamp(const int level, const int minLevel, const int maxLevel) {
+    return (level < minLevel) ? minLevel : ((level > maxLevel) ? maxLevel : level);
+}
+
+static inline void xrClockGovernor_Init(
+    xrClockGovernor* governor,
+    const xrClockGovernorParms* parms,
+    const int cpuLevel,
+    const int gpuLevel) {
+    memset(governor, 0, sizeof(xrClockGovernor));
+    governor->Parms = *parms;
+    governor->CpuLevel = xrClockGovernor_Clamp(cpuLevel, parms->MinCpuLevel, parms->MaxCpuLevel);
+    governor->GpuLevel = xrClockGovernor_Clamp(gpuLevel, parms->MinGpuLevel, parms->MaxGpuLevel);
+    governor->CpuLowerSince = -1.0;
+    governor->GpuLowerSince = -1.0;
+    governor->CpuLevelCap = parms->MaxCpuLevel;
+    governor->GpuLevelCap = parms->MaxGpuLevel;
+}
+
+/// Frames delivered per unit of the energy proxy. Only meaningful for comparing policies on
+/// the same device and workload.
+static inline double xrClockGovernor_FramesPerEnergy(const xrClockGovernor* governor) {
+    return (governor->Energy > 0.0) ? governor->FramesDelivered / governor->Energy : 0.0;
+}
+
+// Steps one processor's level for the window that just ended.
+static inline int xrClockGovernor_StepLevel(
+    const xrClockGovernorParms* parms,
+    const int level,
+    const int minLevel,
+    const int maxLevel,
+    const float load,
+    const float boundFraction,
+    double* lowerSince,
+    const double now) {
+    if ((load > parms->RaiseLoad || boundFraction > parms->BoundFraction) && level < maxLevel) {
+        *lowerSince = -1.0;
+        return level + 1;
+    }
+    if (level > minLevel) {
+        const float predicted =
+            load * parms->LevelPerformance[level] / parms->LevelPerformance[level - 1];
+        if (predicted < parms->LowerLoad && boundFraction == 0.0f) {
+            if (*lowerSince < 0.0) {
+                *lowerSince = now;
+            } else if (now - *lowerSince >= parms->LowerDwellTime) {
+                *lowerSince = -1.0;
+                return level - 1;
+            }
+            return level;
+        }
+    }
+    *lowerSince = -1.0;
+    return level;
+}
+
+/// Updates the governor with the timing of the last frame and the current
+/// XRAPI_SYS_STATUS_THROTTLED state. Returns true if the clock levels changed, in which case
+/// CpuLevel and GpuLevel should be passed to xrapiSetClockLevels().
+static inline bool xrClockGovernor_Update(
+    xrClockGovernor* governor,
+    const xrFrameTiming* timing,
+    const bool throttled,
+    const double now) {
+    const xrClockGovernorParms* parms = &governor->Parms;
+    const float dt = (timing->FrameInterval > 0.0f) ? timing->FrameInterval : timing->FrameBudget;
+
+    // Account for delivered frames and the energy spent on them.
+    if (timing->FrameInterval <= timing->FrameBudget * 1.5f) {
+        governor->FramesDelivered++;
+    } else {
+        governor->FramesMissed++;
+    }
+    const float cpuPerf = parms->LevelPerformance[governor->CpuLevel];
+    const float gpuPerf = parms->LevelPerformance[governor->GpuLevel];
+    governor->Energy += (cpuPerf * cpuPerf * cpuPerf + gpuPerf * gpuPerf * gpuPerf) * dt;
+
+    const int oldCpuLevel = governor->CpuLevel;
+    const int oldGpuLevel = governor->GpuLevel;
+
+    // Back off one level on both processors as soon as throttling is reported and keep the
+    // caps until the device has been unthrottled for a while.
+    if (throttled && !governor->Throttled) {
+        governor->CpuLevelCap =
+            xrClockGovernor_Clamp(governor->CpuLevel - 1, parms->MinCpuLevel, parms->MaxCpuLevel);
+        governor->GpuLevelCap =
+            xrClockGovernor_Clamp(governor->GpuLevel - 1, parms->MinGpuLevel, parms->MaxGpuLevel);
+        governor->CpuLevel = governor->CpuLevelCap;
+        governor->GpuLevel = governor->GpuLevelCap;
+    }
+    if (throttled) {
+        governor->ThrottleEndTime = now + parms->ThrottleRecoveryTime;
+    } else if (now >= governor->ThrottleEndTime) {
+        governor->CpuLevelCap = parms->MaxCpuLevel;
+        governor->GpuLevelCap = parms->MaxGpuLevel;
+    }
+    governor->Throttled = throttled;
+
+    governor->WindowElapsed += dt;
+    governor->CpuLoadSum += xrFrameTiming_CpuLoad(timing);
+    const float gpuLoad = xrFrameTiming_GpuLoad(timing);
+    if (gpuLoad >= 0.0f) {
+        governor->GpuLoadSum += gpuLoad;
+        governor->GpuLoadFrames++;
+    }
+    governor->WindowFrames++;
+    const xrFrameBound bound = xrFrameTiming_Classify(timing, 1.0f);
+    governor->CpuBoundFrames += (bound == xrFrameBound_Cpu);
+    governor->GpuBoundFrames += (bound == xrFrameBound_Gpu);
+
+    if (governor->WindowElapsed >= parms->WindowTime) {
+        const float invFrames = 1.0f / governor->WindowFrames;
+        governor->CpuLevel = xrClockGovernor_StepLevel(
+            parms,
+            governor->CpuLevel,
+            parms->MinCpuLevel,
+            governor->CpuLevelCap,
+            governor->CpuLoadSum * invFrames,
+            governor->CpuBoundFrames * invFrames,
+            &governor->CpuLowerSince,
+            now);
+        if (governor->GpuLoadFrames > 0) {
+            governor->GpuLevel = xrClockGovernor_StepLevel(
+                parms,
+                governor->GpuLevel,
+                parms->MinGpuLevel,
+                governor->GpuLevelCap,
+                governor->GpuLoadSum / governor->GpuLoadFrames,
+                governor->GpuBoundFrames * invFrames,
+                &governor->GpuLowerSince,
+                now);
+        } else {
+            // Keep the level, but at most at the throttling cap.
+            governor->GpuLevel = (governor->GpuLevel < governor->GpuLevelCap)
+                ? governor->GpuLevel
+                : governor->GpuLevelCap;
+        }
+
+        governor->WindowElapsed = 0.0f;
+        governor->CpuLoadSum = 0.0f;
+        governor->GpuLoadSum = 0.0f;
+        governor->GpuLoadFrames = 0;
+        governor->WindowFrames = 0;
+        governor->CpuBoundFrames = 0;
+        governor->GpuBoundFrames = 0;
+    }
+
+    return governor->CpuLevel != oldCpuLevel || governor->GpuLevel != oldGpuLevel;
+}
+
+//-----------------------------------------------------------------
+// Dynamic resolution.
+//-----------------------------------------------------------------
+
+/*
+The eye swapchains are allocated once at full size. Each frame the application renders into
+the lower left sub-rectangle selected by the resolution scale, and the projection layer is
+told to only sample that sub-rectangle, so scale changes never reallocate a swapchain.
+
+GPU time is roughly proportional to the number of pixels rendered, so the controller
+predicts the scale that hits the target load as scale * sqrt( target / load ). It moves
+quickly towards lower scales to avoid dropped frames and slowly towards higher scales to
+avoid oscillating, and it quantizes the scale so the viewport does not change size every
+frame.
+*/
+
+typedef struct xrResolutionScaleParms_ {
+    // Range of the scale applied to both dimensions of the eye textures.
+    float MinScale;
+    float MaxScale;
+    // GPU load (fraction of the frame budget) the controller steers towards.
+    float TargetLoad;
+    // Fraction of the distance to the predicted scale covered per frame when the scale
+    // goes down and when it goes up.
+    float LowerRate;
+    float RaiseRate;
+    // The applied scale is a multiple of this step.
+    float Step;
+} xrResolutionScaleParms;
+
+static inline xrResolutionScaleParms xrapiDefaultResolutionScaleParms() {
+    xrResolutionScaleParms parms;
+    parms.MinScale = 0.6f;
+    parms.MaxScale = 1.0f;
+    parms.TargetLoad = 0.8f;
+    parms.LowerRate = 0.5f;
+    parms.RaiseRate = 0.05f;
+    parms.Step = 0.05f;
+    return parms;
+}
+
+typedef struct xrResolutionScaleController_ {
+    xrResolutionScaleParms Parms;
+    // Continuous scale computed by the controller.
+    float Output;
+    // Quantized scale to render with.
+    float Scale;
+    // Number of scale changes since initialization.
+    uint32_t Changes;
+} xrResolutionScaleController;
+
+static inline float
+xrResolutionScale_Clamp(const xrResolutionScaleParms* parms, const float scale) {
+    return (scale < parms->MinScale) ? parms->MinScale
+                                     : ((scale > parms->MaxScale) ? parms->MaxScale : scale);
+}
+
+static inline void xrResolutionScaleController_Init(
+    xrResolutionScaleController* controller,
+    const xrResolutionScaleParms* parms,
+    const float initialScale) {
+    controller->Parms = *parms;
+    controller->Output = xrResolutionScale_Clamp(parms, initialScale);
+    controller->Scale = controller->Output;
+    controller->Changes = 0;
+}
+
+/// Updates the controller with the timing of the last frame, which was rendered at the
+/// current Scale. Returns the scale to render the next frame with.
+static inline float xrResolutionScaleController_Update(
+    xrResolutionScaleController* controller,
+    const xrFrameTiming* timing) {
+    const xrResolutionScaleParms* parms = &controller->Parms;
+    // Frames without a GPU time keep the current scale.
+    const float load = xrFrameTiming_GpuLoad(timing);
+    if (load <= 0.0f) {
+        return controller->Scale;
+    }
+
+    const float predicted =
+        xrResolutionScale_Clamp(parms, controller->Scale * sqrtf(parms->TargetLoad / load));
+    const float rate = (predicted < controller->Output) ? parms->LowerRate : parms->RaiseRate;
+    controller->Output += (predicted - controller->Output) * rate;
+
+    // Only switch to another step once the output is well past the midpoint between steps.
+    const float difference = controller->Output - controller->Scale;
+    if (difference > 0.75f * parms->Step || difference < -0.75f * parms->Step) {
+        const float scale = parms->Step * floorf(controller->Output / parms->Step + 0.5f);
+        controller->Scale = xrResolutionScale_Clamp(parms, scale);
+        controller->Changes++;
+    }
+    return controller->Scale;
+}
+
+/// Size in pixels of the region rendered at 'scale' in a texture of the given size.
+static inline void xrResolutionScale_GetViewport(
+    const float scale,
+    const int textureWidth,
+    const int textureHeight,
+    int* viewportWidth,
+    int* viewportHeight) {
+    const int width = (int)(textureWidth * scale + 0.5f);
+    const int height = (int)(textureHeight * scale + 0.5f);
+    *viewportWidth = (width < 1) ? 1 : ((width > textureWidth) ? textureWidth : width);
+    *viewportHeight = (height < 1) ? 1 : ((height > textureHeight) ? textureHeight : height);
+}
+
+/// TextureRect that restricts sampling to a viewport at the lower left of a texture. The
+/// rectangle is inset by half a texel on the sides that border unrendered texels, so bilinear
+/// filtering along the edge does not pick up stale contents.
+static inline xrRectf xrResolutionScale_GetTextureRect(
+    const int viewportWidth,
+    const int viewportHeight,
+    const int textureWidth,
+    const int textureHeight) {
+    xrRectf rect;
+    rect.x = 0.0f;
+    rect.y = 0.0f;
+    rect.width = (viewportWidth < textureWidth)
+        ? (viewportWidth - 0.5f) / textureWidth
+        : 1.0f;
+    rect.height = (viewportHeight < textureHeight)
+        ? (viewportHeight - 0.5f) / textureHeight
+        : 1.0f;
+    return rect;
+}
+
+/// Remaps a TexCoordsFromTanAngles matrix for a full texture to a viewport at the lower left
+/// of the texture.
+static inline xrMatrix4f xrResolutionScale_GetTexCoordsFromTanAngles(
+    const xrMatrix4f* texCoordsFromTanAngles,
+    const int viewportWidth,
+    const int viewportHeight,
+    const int textureWidth,
+    const int textureHeight) {
+    const float scaleX = (float)viewportWidth / textureWidth;
+    const float scaleY = (float)viewportHeight / textureHeight;
+    xrMatrix4f m = *texCoordsFromTanAngles;
+    for (int i = 0; i < 4; i++) {
+        m.M[0][i] *= scaleX;
+        m.M[1][i] *= scaleY;
+    }
+    return m;
+}
+
+//-----------------------------------------------------------------
+// Display refresh rate manager.
+//-----------------------------------------------------------------
+
+/*
+Chooses the display refresh rate and swap interval from the sustained cost of a frame.
+
+The supported refresh rates, combined with swap intervals up to MaxSwapInterval, form a
+ladder of configurations ordered by the rate at which the application produces frames. The
+cost of a frame (the larger of CPU and GPU time) does not depend on the configuration, so the
+load at any configuration can be predicted from the cost measured at the current one.
+
+The manager steps down the ladder as soon as a window of frames is too expensive for the
+current configuration, and steps up only after the next configuration has been affordable
+for RaiseDwellTime. Changing the refresh rate can cause a visible hitch, so changes are at
+least MinChangeInterval apart.
+*/
+
+/// Maximum number of refresh rate and swap interval configurations.
+#define XRAPI_REFRESH_RATE_MAX_CONFIGS 16
+
+typedef struct xrRefreshRateConfig_ {
+    float RefreshRate;
+    int SwapInterval;
+} xrRefreshRateConfig;
+
+typedef struct xrRefreshRateManagerParms_ {
+    // Largest swap interval to consider, 1 to only change the refresh rate.
+    int MaxSwapInterval;
+    // Length in seconds of the window over which the frame cost is averaged.
+    float WindowTime;
+    // Load (frame cost over frame period) above which the manager steps down.
+    float LowerLoad;
+    // Fraction of frames in a window over the frame period that also steps down.
+    float LowerMissFraction;
+    // The manager steps up when the predicted load at the next configuration stays below this.
+    float RaiseLoad;
+    // Time in seconds the next configuration has to be affordable before stepping up.
+    float RaiseDwellTime;
+    // Minimum time in seconds between two changes.
+    float MinChangeInterval;
+} xrRefreshRateManagerParms;
+
+static inline xrRefreshRateManagerParms xrapiDefaultRefreshRateManagerParms() {
+    xrRefreshRateManagerParms parms;
+    parms.MaxSwapInterval = 2;
+    parms.WindowTime = 1.0f;
+    parms.LowerLoad = 0.95f;
+    parms.LowerMissFraction = 0.05f;
+    parms.RaiseLoad = 0.75f;
+    parms.RaiseDwellTime = 10.0f;
+    parms.MinChangeInterval = 5.0f;
+    return parms;
+}
+
+typedef struct xrRefreshRateManager_ {
+    xrRefreshRateManagerParms Parms;
+    // Configurations ordered from the highest to the lowest frame rate.
+    xrRefreshRateConfig Configs[XRAPI_REFRESH_RATE_MAX_CONFIGS];
+    int NumConfigs;
+    int Current;
+    // Current configuration.
+    float RefreshRate;
+    int SwapInterval;
+
+    // Current window.
+    float WindowElapsed;
+    float CostSum;
+    int WindowFrames;
+    int MissedFrames;
+
+    // Time since which the next configuration has been affordable, or a negative value.
+    double RaiseSince;
+    double LastChangeTime;
+    // Number of changes since initialization.
+    uint32_t Changes;
+} xrRefreshRateManager;
+
+/// Frames per second produced in a configuration.
+static inline float xrRefreshRateConfig_FrameRate(const xrRefreshRateConfig* config) {
+    return config->RefreshRate / config->SwapInterval;
+}
+
+/// Time in seconds between two frames of a configuration.
+static inline float xrRefreshRateConfig_FramePeriod(const xrRefreshRateConfig* config) {
+    return config->SwapInterval / config->RefreshRate;
+}
+
+/// Time in seconds the slower of the two processors spent on a frame.
+static inline float xrFrameTiming_Cost(const xrFrameTiming* timing) {
+    return (timing->GpuTime > timing->CpuTime) ? timing->GpuTime : timing->CpuTime;
+}
+
+/// Makes 'refreshRate' and 'swapInterval', or the closest configuration, the current one and
+/// restarts the measurements. Use this when the configuration was changed from elsewhere.
+static inline void xrRefreshRateManager_SetCurrent(
+    xrRefreshRateManager* manager,
+    const float refreshRate,
+    const int swapInterval,
+    const double now) {
+    const float frameRate = refreshRate / swapInterval;
+    int best = 0;
+    float bestError = -1.0f;
+    for (int i = 0; i < manager->NumConfigs; i++) {
+        const xrRefreshRateConfig* config = &manager->Configs[i];
+        const float error = fabsf(xrRefreshRateConfig_FrameRate(config) - frameRate) +
+            fabsf(config->RefreshRate - refreshRate);
+        if (bestError < 0.0f || error < bestError) {
+            best = i;
+            bestError = error;
+        }
+    }
+    manager->Current = best;
+    if (manager->NumConfigs > 0) {
+        manager->RefreshRate = manager->Configs[best].RefreshRate;
+        manager->SwapInterval = manager->Configs[best].SwapInterval;
+    } else {
+        manager->RefreshRate = refreshRate;
+        manager->SwapInterval = swapInterval;
+    }
+    manager->WindowElapsed = 0.0f;
+    manager->CostSum = 0.0f;
+    manager->WindowFrames = 0;
+    manager->MissedFrames = 0;
+    manager->RaiseSince = -1.0;
+    manager->LastChangeTime = now;
+}
+
+/// Builds the configuration ladder from the XRAPI_SYS_PROP_SUPPORTED_DISPLAY_REFRESH_RATES.
+/// Configurations with the same frame rate keep the lowest swap interval.
+static inline void xrRefreshRateManager_Init(
+    xrRefreshRateManager* manager,
+    const xrRefreshRateManagerParms* parms,
+    const float* supportedRates,
+    const int numSupportedRates,
+    const float refreshRate,
+    const int swapInterval,
+    const double now) {
+    memset(manager, 0, sizeof(xrRefreshRateManager));
+    manager->Parms = *parms;
+
+    for (int swap = 1; swap <= parms->MaxSwapInterval; swap++) {
+        for (int i = 0; i < numSupportedRates; i++) {
+            if (supportedRates[i] <= 0.0f) {
+                continue;
+            }
+            const float frameRate = supportedRates[i] / swap;
+            bool duplicate = false;
+            for (int j = 0; j < manager->NumConfigs; j++) {
+                const xrRefreshRateConfig* other = &manager->Configs[j];
+                if (fabsf(xrRefreshRateConfig_FrameRate(other) - frameRate) < 0.5f) {
+                    duplicate = true;
+                    break;
+                }
+            }
+            if (duplicate || manager->NumConfigs >= XRAPI_REFRESH_RATE_MAX_CONFIGS) {
+                continue;
+            }
+            // Insert sorted from the highest to the lowest frame rate.
+            int index = manager->NumConfigs++;
+            while (index > 0 &&
+                   xrRefreshRateConfig_FrameRate(&manager->Configs[index - 1]) < frameRate) {
+                manager->Configs[index] = manager->Configs[index - 1];
+                index--;
+            }
+            manager->Configs[index].RefreshRate = supportedRates[i];
+            manager->Configs[index].SwapInterval = swap;
+        }
+    }
+
+    xrRefreshRateManager_SetCurrent(manager, refreshRate, swapInterval, now);
+    // Allow the first change right away.
+    manager->LastChangeTime = now - parms->MinChangeInterval;
+}
+
+/// Updates the manager with the timing of the last frame. Returns true if the configuration
+/// changed, in which case RefreshRate should be passed to xrapiSetDisplayRefreshRate() and
+/// SwapInterval used for the following frames.
+static inline bool xrRefreshRateManager_Update(
+    xrRefreshRateManager* manager,
+    const xrFrameTiming* timing,
+    const double now) {
+    const xrRefreshRateManagerParms* parms = &manager->Parms;
+    if (manager->NumConfigs <= 1) {
+        return false;
+    }
+    const xrRefreshRateConfig* current = &manager->Configs[manager->Current];
+    const float period = xrRefreshRateConfig_FramePeriod(current);
+    const float cost = xrFrameTiming_Cost(timing);
+
+    manager->WindowElapsed += (timing->FrameInterval > 0.0f) ? timing->FrameInterval : period;
+    manager->CostSum += cost;
+    manager->WindowFrames++;
+    manager->MissedFrames += (cost > period);
+    if (manager->WindowElapsed < parms->WindowTime) {
+        return false;
+    }
+
+    const float averageCost = manager->CostSum / manager->WindowFrames;
+    const float missFraction = (float)manager->MissedFrames / manager->WindowFrames;
+    manager->WindowElapsed = 0.0f;
+    manager->CostSum = 0.0f;
+    manager->WindowFrames = 0;
+    manager->MissedFrames = 0;
+
+    int next = manager->Current;
+    if (averageCost > parms->LowerLoad * period || missFraction > parms->LowerMissFraction) {
+        // Step down to the fastest configuration that fits the measured cost.
+        manager->RaiseSince = -1.0;
+        while (next < manager->NumConfigs - 1 &&
+               averageCost >
+                   parms->LowerLoad * xrRefreshRateConfig_FramePeriod(&manager->Configs[next])) {
+            next++;
+        }
+        if (next == manager->Current && manager->Current < manager->NumConfigs - 1) {
+            next++;
+        }
+    } else if (manager->Current > 0) {
+        const float higherPeriod =
+            xrRefreshRateConfig_FramePeriod(&manager->Configs[manager->Current - 1]);
+        if (averageCost < parms->RaiseLoad * higherPeriod) {
+            if (manager->RaiseSince < 0.0) {
+                manager->RaiseSince = now;
+            } else if (now - manager->RaiseSince >= parms->RaiseDwellTime) {
+                next = manager->Current - 1;
+            }
+        } else {
+            manager->RaiseSince = -1.0;
+        }
+    }
+
+    if (next == manager->Current || now - manager->LastChangeTime < parms->MinChangeInterval) {
+        return false;
+    }
+    xrRefreshRateManager_SetCurrent(
+        manager, manager->Configs[next].RefreshRate, manager->Configs[next].SwapInterval, now);
+    manager->Changes++;
+    return true;
+}
+
+//-----------------------------------------------------------------
+// Extra latency governor.
+//-----------------------------------------------------------------
+
+/*
+XRAPI_EXTRA_LATENCY_MODE_ON gives the GPU a full extra frame period to finish a frame, at the
+cost of one frame period of latency. Without it the CPU and GPU work of a frame have to fit in
+one frame period together. The extra frame only pays off when that combined work does not fit
+and the GPU has the larger share, so the governor enables it when a window contains enough
+such GPU bound frames, and disables it again once the combined load has stayed low for
+DisableDwellTime.
+
+The runtime applies a new mode on the next frame submission, and the display time predicted
+for a frame depends on the mode. The caller therefore has to apply a change between
+submitting one frame and predicting the display time of the next one. With a pipelined frame
+loop that means waiting for the frame in flight to be submitted first.
+
+The governor also accumulates the throughput and latency measured in each mode.
+*/
+
+typedef struct xrExtraLatencyGovernorParms_ {
+    // Length in seconds of the window over which frames are classified.
+    float WindowTime;
+    // Combined CPU and GPU load above which a frame with more GPU than CPU time counts as GPU
+    // bound.
+    float BoundLoad;
+    // Fraction of GPU bound frames in a window that enables the extra frame of latency.
+    float EnableFraction;
+    // Average combined load below which the extra frame of latency is no longer needed.
+    float DisableLoad;
+    // Time in seconds the combined load has to stay low before the extra frame is disabled.
+    float DisableDwellTime;
+} xrExtraLatencyGovernorParms;
+
+static inline xrExtraLatencyGovernorParms xrapiDefaultExtraLatencyGovernorParms() {
+    xrExtraLatencyGovernorParms parms;
+    parms.WindowTime = 1.0f;
+    parms.BoundLoad = 0.95f;
+    parms.EnableFraction = 0.1f;
+    parms.DisableLoad = 0.75f;
+    parms.DisableDwellTime = 5.0f;
+    return parms;
+}
+
+/// Throughput and latency accumulated while a mode was active.
+typedef struct xrExtraLatencyModeStats_ {
+    uint32_t Frames;
+    // Sum of the frame intervals in seconds.
+    double Time;
+    // Sum of the latencies in seconds, over the frames with a known latency.
+    double LatencySum;
+    uint32_t LatencyFrames;
+} xrExtraLatencyModeStats;
+
+typedef struct xrExtraLatencyGovernor_ {
+    xrExtraLatencyGovernorParms Parms;
+    xrExtraLatencyMode Mode;
+
+    // Current window.
+    float WindowElapsed;
+    float LoadSum;
+    int WindowFrames;
+    int GpuBoundFrames;
+
+    // Time since which the combined load has been low, or a negative value.
+    double DisableSince;
+    // Number of mode changes since initialization.
+    uint32_t Changes;
+
+    // Indexed by XRAPI_EXTRA_LATENCY_MODE_OFF and XRAPI_EXTRA_LATENCY_MODE_ON.
+    xrExtraLatencyModeStats Stats[2];
+} xrExtraLatencyGovernor;
+
+static inline void xrExtraLatencyGovernor_Init(
+    xrExtraLatencyGovernor* governor,
+    const xrExtraLatencyGovernorParms* parms,
+    const xrExtraLatencyMode mode) {
+    memset(governor, 0, sizeof(xrExtraLatencyGovernor));
+    governor->Parms = *parms;
+    governor->Mode = (mode == XRAPI_EXTRA_LATENCY_MODE_ON) ? XRAPI_EXTRA_LATENCY_MODE_ON
+                                                           : XRAPI_EXTRA_LATENCY_MODE_OFF;
+    governor->DisableSince = -1.0;
+}
+
+/// Frames per second delivered while 'mode' was active.
+static inline float xrExtraLatencyGovernor_Throughput(
+    const xrExtraLatencyGovernor* governor,
+    const xrExtraLatencyMode mode) {
+    const xrExtraLatencyModeStats* stats = &governor->Stats[mode == XRAPI_EXTRA_LATENCY_MODE_ON];
+    return (stats->Time > 0.0) ? (float)(stats->Frames / stats->Time) : 0.0f;
+}
+
+/// Average latency in seconds while 'mode' was active.
+static inline float xrExtraLatencyGovernor_Latency(
+    const xrExtraLatencyGovernor* governor,
+    const xrExtraLatencyMode mode) {
+    const xrExtraLatencyModeStats* stats = &governor->Stats[mode == XRAPI_EXTRA_LATENCY_MODE_ON];
+    return (stats->LatencyFrames > 0) ? (float)(stats->LatencySum / stats->LatencyFrames) : 0.0f;
+}
+
+/// Updates the governor with the timing of the last frame. Returns true if the mode changed, in
+/// which case Mode should be passed to xrapiSetExtraLatencyMode() before the display time of
+/// the next frame is predicted.
+static inline bool xrExtraLatencyGovernor_Update(
+    xrExtraLatencyGovernor* governor,
+    const xrFrameTiming* timing,
+    const double now) {
+    const xrExtraLatencyGovernorParms* parms = &governor->Parms;
+    const float dt = (timing->FrameInterval > 0.0f) ? timing->FrameInterval : timing->FrameBudget;
+
+    xrExtraLatencyModeStats* stats =
+        &governor->Stats[governor->Mode == XRAPI_EXTRA_LATENCY_MODE_ON];
+    stats->Frames++;
+    stats->Time += dt;
+    if (timing->Latency > 0.0f) {
+        stats->LatencySum += timing->Latency;
+        stats->LatencyFrames++;
+    }
+
+    const float cpuLoad = xrFrameTiming_CpuLoad(timing);
+    // Without a measured GPU time a frame never counts as GPU bound.
+    const float measuredGpuLoad = xrFrameTiming_GpuLoad(timing);
+    const float gpuLoad = (measuredGpuLoad > 0.0f) ? measuredGpuLoad : 0.0f;
+    governor->WindowElapsed += dt;
+    governor->LoadSum += cpuLoad + gpuLoad;
+    governor->WindowFrames++;
+    governor->GpuBoundFrames += (cpuLoad + gpuLoad > parms->BoundLoad && gpuLoad > cpuLoad);
+    if (governor->WindowElapsed < parms->WindowTime) {
+        return false;
+    }
+
+    const float averageLoad = governor->LoadSum / governor->WindowFrames;
+    const float boundFraction = (float)governor->GpuBoundFrames / governor->WindowFrames;
+    governor->WindowElapsed = 0.0f;
+    governor->LoadSum = 0.0f;
+    governor->WindowFrames = 0;
+    governor->GpuBoundFrames = 0;
+
+    xrExtraLatencyMode mode = governor->Mode;
+    if (governor->Mode == XRAPI_EXTRA_LATENCY_MODE_OFF) {
+        if (boundFraction > parms->EnableFraction) {
+            mode = XRAPI_EXTRA_LATENCY_MODE_ON;
+        }
+    } else if (averageLoad < parms->DisableLoad && boundFraction == 0.0f) {
+        if (governor->DisableSince < 0.0) {
+            governor->DisableSince = now;
+        } else if (now - governor->DisableSince >= parms->DisableDwellTime) {
+            mode = XRAPI_EXTRA_LATENCY_MODE_OFF;
+        }
+    } else {
+        governor->DisableSince = -1.0;
+    }
+
+    if (mode == governor->Mode) {
+        return false;
+    }
+    governor->Mode = mode;
+    governor->DisableSince = -1.0;
+    governor->Changes++;
+    return true;
+}
+
+#endif // XR_XrApiPerformance_h
@@ -0,0 +1,246 @@
+
+#ifndef XR_XrApiProgramCache_h
+#define XR_XrApiProgramCache_h
+
+#include "stdio.h" // for fopen(), snprintf()
+#include "stdlib.h" // for malloc(), free()
+#include "string.h" // for memset(), strlen()
+#include <errno.h> // for errno
+#include <sys/stat.h> // for mkdir()
+#include <unistd.h> // for unlink()
+#include "XrApiConfig.h"
+#include "XrApiTypes.h"
+
+/*
+Persistent cache of linked GPU program binaries.
+
+Programs are keyed by a 64-bit FNV-1a hash of every source string passed to the shader
+compiler, including the version and define strings, and of a driver identification string.
+A driver update changes the key, so stale binaries are never loaded; they are simply no
+longer referenced.
+
+Each binary is stored in its own file in an application-private directory, with a header
+that repeats the key and holds a checksum of the payload. A file that fails validation,
+or that the driver rejects, is deleted so the program is compiled and stored again. Files
+are written to a temporary name and renamed into place, so a reader never sees a partially
+written binary, and several threads can share a cache directory.
+
+The cache does not call the graphics API itself. It goes through an xrProgramCacheBackend,
+which the application implements on top of glGetProgramBinary() and glProgramBinary().
+This keeps the cache logic independent of a graphics context.
+*/
+
+#define XRAPI_PROGRAM_CACHE_MAGIC 0x43505258 // 'XRPC'
+/// Increment when the file layout or the way programs are built changes.
+#define XRAPI_PROGRAM_CACHE_VERSION 1
+/// Binaries larger than this are not cached.
+#define XRAPI_PROGRAM_CACHE_MAX_BINARY_SIZE (16 * 1024 * 1024)
+
+typedef struct xrProgramCacheBackend_ {
+    void* UserData;
+    // Returns the size of the binary of a linked program, or 0 if it is not available.
+    int (*GetBinarySize)(void* userData, unsigned int program);
+    // Retrieves the binary of a linked program.
+    bool (*GetBinary)(
+        void* userData,
+        unsigned int program,
+        void* binary,
+        int size,
+        unsigned int* format);
+    // Loads a binary into a program object. Returns true if the program is linked.
+    bool (*LoadBinary)(
+        void* userData,
+        unsigned int program,
+        unsigned int format,
+        const void* binary,
+        int size);
+} xrProgramCacheBackend;
+
+/// Header of a cache file.
+typedef struct xrProgramCacheFileHeader_ {
+    uint32_t Magic;
+    uint32_t Version;
+    uint64_t Key;
+    uint32_t Format;
+    uint32_t Size;
+    // FNV-1a hash of the binary.
+    uint64_t Checksum;
+} xrProgramCacheFileHeader;
+
+typedef struct xrProgramCacheStats_ {
+    // Number of programs loaded from the cache.
+    uint32_t Hits;
+    // Number of programs without a cache file.
+    uint32_t Misses;
+    // Number of cache files that were corrupt or rejected by the driver.
+    uint32_t Rejected;
+    // Number of binaries written to the cache.
+    uint32_t Stored;
+} xrProgramCacheStats;
+
+typedef struct xrProgramCache_ {
+    char Directory[512];
+    // Hash of the driver identification, seeds every key.
+    uint64_t DriverHash;
+    xrProgramCacheBackend Backend;
+    xrProgramCacheStats Stats;
+} xrProgramCache;
+
+static inline uint64_t xrProgramCache_Hash(uint64_t hash, const void* data, const size_t size) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+static inline uint64_t xrProgramCache_HashString(const uint64_t hash, const char* string) {
+    // Include the terminator so { "ab", "c" } and { "a", "bc" } hash differently.
+    return xrProgramCache_Hash(hash, string, strlen(string) + 1);
+}
+
+/// Returns true if the cache was initialized with a directory.
+static inline bool xrProgramCache_IsEnabled(const xrProgramCache* cache) {
+    return cache->Directory[0] != '\0';
+}
+
+/// Sets up a cache in 'directory', which is created if needed. 'driverVersion' should identify
+/// the driver build, for instance the GL_VENDOR, GL_RENDERER and GL_VERSION strings.
+/// Returns false and leaves the cache disabled if the directory cannot be used.
+static inline bool xrProgramCache_Init(
+    xrProgramCache* cache,
+    const char* directory,
+    const char* driverVersion,
+    const xrProgramCacheBackend* backend) {
+    memset(cache, 0, sizeof(xrProgramCache));
+    if (mkdir(directory, 0700) != 0 && errno != EEXIST) {
+        return false;
+    }
+    const int length = snprintf(cache->Directory, sizeof(cache->Directory), "%s", directory);
+    if (length <= 0 || length >= (int)sizeof(cache->Directory)) {
+        cache->Directory[0] = '\0';
+        return false;
+    }
+    const uint32_t version = XRAPI_PROGRAM_CACHE_VERSION;
+    cache->DriverHash = xrProgramCache_Hash(0xCBF29CE484222325ULL, &version, sizeof(version));
+    cache->DriverHash = xrProgramCache_HashString(cache->DriverHash, driverVersion);
+    cache->Backend = *backend;
+    return true;
+}
+
+/// Computes the key of a program from all the source strings of all its shader stages.
+static inline uint64_t xrProgramCache_ComputeKey(
+    const xrProgramCache* cache,
+    const char* const* sources,
+    const int count) {
+    uint64_t key = cache->DriverHash;
+    for (int i = 0; i < count; i++) {
+        key = xrProgramCache_HashString(key, sources[i]);
+    }
+    return key;
+}
+
+static inline void xrProgramCache_GetPath(
+    const xrProgramCache* cache,
+    const uint64_t key,
+    char* path,
+    const size_t pathSize) {
+    snprintf(path, pathSize, "%s/%016llx.bin", cache->Directory, (unsigned long long)key);
+}
+
+/// Loads the binary with 'key' into 'program', which must be a newly created program object.
+/// Returns false if there is no valid binary, in which case the program must be built from
+/// source and passed to xrProgramCache_Store().
+static inline bool
+xrProgramCache_Load(xrProgramCache* cache, const uint64_t key, const unsigned int program) {
+    if (!xrProgramCache_IsEnabled(cache)) {
+        return false;
+    }
+
+    char path[640];
+    xrProgramCache_GetPath(cache, key, path, sizeof(path));
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        cache->Stats.Misses++;
+        return false;
+    }
+
+    bool loaded = false;
+    xrProgramCacheFileHeader header;
+    if (fread(&header, sizeof(header), 1, file) == 1 && header.Magic == XRAPI_PROGRAM_CACHE_MAGIC &&
+        header.Version == XRAPI_PROGRAM_CACHE_VERSION && header.Key == key && header.Size > 0 &&
+        header.Size <= XRAPI_PROGRAM_CACHE_MAX_BINARY_SIZE) {
+        void* binary = malloc(header.Size);
+        if (binary != NULL && fread(binary, header.Size, 1, file) == 1 &&
+            xrProgramCache_Hash(0xCBF29CE484222325ULL, binary, header.Size) == header.Checksum) {
+            loaded = cache->Backend.LoadBinary(
+                cache->Backend.UserData, program, header.Format, binary, (int)header.Size);
+        }
+        free(binary);
+    }
+    fclose(file);
+
+    if (loaded) {
+        cache->Stats.Hits++;
+    } else {
+        // Corrupt, truncated or rejected by the driver; rebuild it.
+        cache->Stats.Rejected++;
+        unlink(path);
+    }
+    return loaded;
+}
+
+/// Stores the binary of a linked program under 'key'.
+static inline bool
+xrProgramCache_Store(xrProgramCache* cache, const uint64_t key, const unsigned int program) {
+    if (!xrProgramCache_IsEnabled(cache)) {
+        return false;
+    }
+
+    const int size = cache->Backend.GetBinarySize(cache->Backend.UserData, program);
+    if (size <= 0 || size > XRAPI_PROGRAM_CACHE_MAX_BINARY_SIZE) {
+        return false;
+    }
+    void* binary = malloc(size);
+    if (binary == NULL) {
+        return false;
+    }
+
+    xrProgramCacheFileHeader header;
+    memset(&header, 0, sizeof(header));
+    header.Magic = XRAPI_PROGRAM_CACHE_MAGIC;
+    header.Version = XRAPI_PROGRAM_CACHE_VERSION;
+    header.Key = key;
+    header.Size = (uint32_t)size;
+
+    bool stored = false;
+    unsigned int format = 0;
+    if (cache->Backend.GetBinary(cache->Backend.UserData, program, binary, size, &format)) {
+        header.Format = format;
+        header.Checksum = xrProgramCache_Hash(0xCBF29CE484222325ULL, binary, size);
+
+        char path[640];
+        char tempPath[680];
+        xrProgramCache_GetPath(cache, key, path, sizeof(path));
+        // Unique per cache instance, so threads with their own cache never share a temp file.
+        snprintf(tempPath, sizeof(tempPath), "%s.%p.tmp", path, (void*)cache);
+        FILE* file = fopen(tempPath, "wb");
+        if (file != NULL) {
+            const bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                fwrite(binary, size, 1, file) == 1;
+            stored = (fclose(file) == 0) && written && rename(tempPath, path) == 0;
+            if (!stored) {
+                unlink(tempPath);
+            }
+        }
+    }
+    free(binary);
+
+    if (stored) {
+        cache->Stats.Stored++;
+    }
+    return stored;
+}
+
+#endif // XR_XrApiProgramCache_h
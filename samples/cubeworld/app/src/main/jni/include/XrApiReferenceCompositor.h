@@ -0,0 +1,900 @@
+
+#ifndef XR_XrApiReferenceCompositor_h
+#define XR_XrApiReferenceCompositor_h
+
+// clock_gettime() and CLOCK_MONOTONIC are POSIX, so strict C modes like -std=c99 only declare
+// them with _POSIX_C_SOURCE. This only takes effect if no system header was included before
+// this one.
+#if !defined(_POSIX_C_SOURCE) && !defined(_GNU_SOURCE)
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "math.h" // for atan2f(), asinf(), acosf(), sqrtf()
+#include "stdlib.h" // for malloc(), free()
+#include "string.h" // for memset()
+#include <pthread.h> // for pthread_create()
+#include <time.h> // for clock_gettime()
+#include "XrApiConfig.h"
+#include "XrApiTypes.h"
+#include "XrApiExtension.h"
+#include "XrApiHelpers.h"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/*
+CPU reference compositor for the xrapiSubmitFrame2() layer types.
+
+Composites an xrSubmitFrameDescription2 into one floating point RGBA image per eye, so
+TexCoordsFromTanAngles, TextureRect, flags and blend settings can be validated off-device,
+for instance against golden images, and so the cost of each layer can be measured.
+
+The runtime compositor is closed, so this is a model of it rather than a bit-exact copy:
+
+    - Every output pixel is a ray (tanX, tanY, -1) through the display eye, derived from the
+      eye projection matrix. Output and texture rows go from bottom to top, like eye buffers.
+    - Layers are reprojected by rotation only, from the layer HeadPose to the display
+      orientation passed to xrReferenceCompositor_Compose(), unless FIXED_TO_VIEW is set.
+    - The ray is transformed by the layer matrix and mapped to texture coordinates by the
+      layer type: a projective divide for PROJECTION2, a 180 by 60 degree hemicylinder for
+      CYLINDER2, a GL cube map lookup of normalize( direction ) + Offset for CUBE2, an
+      equirectangular mapping for EQUIRECT2, and an equiangular 180 degree fisheye for
+      FISHEYE2. TextureMatrix is applied as a 2D affine transform. Except for PROJECTION2,
+      the layer matrix is expected to rotate the ray, with identity looking down -Z.
+    - Texture coordinates are clamped to TextureRect, or the pixel is left untouched when
+      CLIP_TO_TEXTURE_RECT is set and they are outside of it.
+    - LOADING_ICON2 is a view-fixed square of 2 / SpinScale tangent units, rotated by
+      SpinSpeed radians per second of the frame DisplayTime. The default icon is drawn as an
+      open ring.
+    - Images are RGBA8, sampled bilinearly with clamp to edge, and not linearized. The
+      default swap chain is opaque white and the black swap chain is opaque black.
+    - The sampled color is multiplied by ColorScale and blended with SrcBlend and DstBlend.
+
+Rows are distributed in bands over the calling thread and worker threads. The workers are
+started by xrReferenceCompositor_Init() and wait between frames, so composing a frame does
+not create threads. Within a row the rays of a layer are transformed as separate x, y and z
+arrays so the compiler can vectorize the loops, and the blend uses NEON when available.
+
+Uses POSIX threads, so it is only available on Android and Linux. When compiling with a
+strict C mode like -std=c99, define _POSIX_C_SOURCE as 200112L or higher before including any
+system header, or include this header first.
+*/
+
+#define XRAPI_COMPOSITOR_MAX_THREADS 16
+/// Number of rows a thread composites at a time.
+#define XRAPI_COMPOSITOR_BAND_ROWS 8
+
+/// CPU copy of a swap chain image.
+typedef struct xrCompositorImage_ {
+    int Width;
+    int Height;
+    // Number of array layers. Cube maps have 6 layers in the order +X, -X, +Y, -Y, +Z, -Z.
+    int Layers;
+    // RGBA8 texels, layer after layer, with rows from bottom to top.
+    const uint8_t* Texels;
+} xrCompositorImage;
+
+/// Returns the CPU image of a swap chain image, or NULL if there is none.
+typedef const xrCompositorImage* (
+    *xrCompositorGetImageFunc)(void* userData, const xrTextureSwapChain* swapChain, int index);
+
+typedef struct xrReferenceCompositorParms_ {
+    // Size of the output image of each eye.
+    int Width;
+    int Height;
+    // Projection of each display eye, which determines the field of view of the output.
+    xrMatrix4f Projection[XRAPI_FRAME_LAYER_EYE_MAX];
+    // Number of threads including the calling thread.
+    int ThreadCount;
+    xrCompositorGetImageFunc GetImage;
+    void* UserData;
+} xrReferenceCompositorParms;
+
+static inline xrReferenceCompositorParms xrReferenceCompositor_DefaultParms() {
+    xrReferenceCompositorParms parms;
+    memset(&parms, 0, sizeof(parms));
+    parms.Width = 1024;
+    parms.Height = 1024;
+    for (int eye = 0; eye < XRAPI_FRAME_LAYER_EYE_MAX; eye++) {
+        parms.Projection[eye] =
+            xrMatrix4f_CreateProjectionFov(90.0f, 90.0f, 0.0f, 0.0f, 0.1f, 0.0f);
+    }
+    parms.ThreadCount = 4;
+    return parms;
+}
+
+/// Cost of the last xrReferenceCompositor_Compose().
+typedef struct xrReferenceCompositorStats_ {
+    int LayerCount;
+    // Time spent on each layer, summed over all threads and both eyes.
+    double LayerTime[xrMaxLayerCount];
+    // Number of output pixels each layer was blended into, over both eyes.
+    uint64_t LayerPixels[xrMaxLayerCount];
+    double WallTime;
+} xrReferenceCompositorStats;
+
+typedef enum xrCompositorSource_ {
+    xrCompositorSource_None,
+    xrCompositorSource_Image,
+    xrCompositorSource_White,
+    xrCompositorSource_Black,
+    xrCompositorSource_LoadingIcon,
+} xrCompositorSource;
+
+/// Per layer and eye values derived once per frame.
+typedef struct xrCompositorLayerSetup_ {
+    xrLayerType2 Type;
+    xrCompositorSource Source;
+    const xrCompositorImage* Image;
+    int ImageLayer;
+    // Transforms a display eye ray to the space the layer type maps to texture coordinates.
+    float Ray[3][3];
+    float TextureMatrix[2][3];
+    xrRectf TextureRect;
+    bool Clip;
+    xrVector3f Offset;
+    float SpinCos;
+    float SpinSin;
+    float SpinExtent;
+    float ColorScale[4];
+    xrFrameLayerBlend SrcBlend;
+    xrFrameLayerBlend DstBlend;
+} xrCompositorLayerSetup;
+
+typedef struct xrReferenceCompositor_ xrReferenceCompositor;
+
+typedef struct xrCompositorThread_ {
+    xrReferenceCompositor* Compositor;
+    int Index;
+    pthread_t Thread;
+    // Row scratch: ray x, y, z, texture u, v, and cube face or coverage.
+    float* Scratch;
+    double LayerTime[xrMaxLayerCount];
+    uint64_t LayerPixels[xrMaxLayerCount];
+} xrCompositorThread;
+
+struct xrReferenceCompositor_ {
+    xrReferenceCompositorParms Parms;
+    // Output RGBA of each eye, Width * Height * 4 floats with rows from bottom to top.
+    float* Output[XRAPI_FRAME_LAYER_EYE_MAX];
+    // Tangent of the ray through each column and row of each eye.
+    float* TanX[XRAPI_FRAME_LAYER_EYE_MAX];
+    float* TanY[XRAPI_FRAME_LAYER_EYE_MAX];
+    xrCompositorThread Threads[XRAPI_COMPOSITOR_MAX_THREADS];
+    xrReferenceCompositorStats Stats;
+
+    // Frame state shared with the worker threads.
+    int LayerCount;
+    xrCompositorLayerSetup Setup[xrMaxLayerCount][XRAPI_FRAME_LAYER_EYE_MAX];
+    int BandCount;
+    int NextBand;
+
+    // Worker threads 1 to WorkerCount wait on WorkCondition until Frame changes, and the last
+    // one to finish the frame signals DoneCondition.
+    bool Initialized;
+    int WorkerCount;
+    pthread_mutex_t Mutex;
+    pthread_cond_t WorkCondition;
+    pthread_cond_t DoneCondition;
+    int Frame;
+    int WorkersBusy;
+    bool Exit;
+};
+
+static inline void* xrReferenceCompositor_WorkerFunction(void* parm);
+
+static inline double xrReferenceCompositor_GetTime() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/// Allocates the output images and starts the worker threads. Returns false if out of memory.
+/// Call xrReferenceCompositor_Destroy() in either case.
+static inline bool xrReferenceCompositor_Init(
+    xrReferenceCompositor* compositor,
+    const xrReferenceCompositorParms* parms) {
+    memset(compositor, 0, sizeof(xrReferenceCompositor));
+    compositor->Parms = *parms;
+    if (compositor->Parms.ThreadCount < 1) {
+        compositor->Parms.ThreadCount = 1;
+    }
+    if (compositor->Parms.ThreadCount > XRAPI_COMPOSITOR_MAX_THREADS) {
+        compositor->Parms.ThreadCount = XRAPI_COMPOSITOR_MAX_THREADS;
+    }
+
+    const int width = parms->Width;
+    const int height = parms->Height;
+    bool allocated = true;
+    for (int eye = 0; eye < XRAPI_FRAME_LAYER_EYE_MAX; eye++) {
+        compositor->Output[eye] = (float*)malloc((size_t)width * height * 4 * sizeof(float));
+        compositor->TanX[eye] = (float*)malloc(width * sizeof(float));
+        compositor->TanY[eye] = (float*)malloc(height * sizeof(float));
+        if (compositor->Output[eye] == NULL || compositor->TanX[eye] == NULL ||
+            compositor->TanY[eye] == NULL) {
+            allocated = false;
+            continue;
+        }
+
+        // The ray ( tanX, tanY, -1 ) projects to ndc = ( M00 * tanX - M02, M11 * tanY - M12 ).
+        const xrMatrix4f* projection = &parms->Projection[eye];
+        for (int x = 0; x < width; x++) {
+            const float ndcX = 2.0f * (x + 0.5f) / width - 1.0f;
+            compositor->TanX[eye][x] = (ndcX + projection->M[0][2]) / projection->M[0][0];
+        }
+        for (int y = 0; y < height; y++) {
+            const float ndcY = 2.0f * (y + 0.5f) / height - 1.0f;
+            compositor->TanY[eye][y] = (ndcY + projection->M[1][2]) / projection->M[1][1];
+        }
+    }
+    for (int t = 0; t < compositor->Parms.ThreadCount; t++) {
+        compositor->Threads[t].Compositor = compositor;
+        compositor->Threads[t].Index = t;
+        compositor->Threads[t].Scratch = (float*)malloc((size_t)width * 6 * sizeof(float));
+        allocated &= (compositor->Threads[t].Scratch != NULL);
+    }
+
+    pthread_mutex_init(&compositor->Mutex, NULL);
+    pthread_cond_init(&compositor->WorkCondition, NULL);
+    pthread_cond_init(&compositor->DoneCondition, NULL);
+    compositor->Initialized = true;
+    if (!allocated) {
+        return false;
+    }
+    // Compose() uses as many threads as could be started.
+    for (int t = 1; t < compositor->Parms.ThreadCount; t++) {
+        xrCompositorThread* thread = &compositor->Threads[t];
+        if (pthread_create(&thread->Thread, NULL, xrReferenceCompositor_WorkerFunction, thread) !=
+            0) {
+            break;
+        }
+        compositor->WorkerCount++;
+    }
+    return true;
+}
+
+static inline void xrReferenceCompositor_Destroy(xrReferenceCompositor* compositor) {
+    if (compositor->Initialized) {
+        pthread_mutex_lock(&compositor->Mutex);
+        compositor->Exit = true;
+        pthread_cond_broadcast(&compositor->WorkCondition);
+        pthread_mutex_unlock(&compositor->Mutex);
+        for (int t = 1; t <= compositor->WorkerCount; t++) {
+            pthread_join(compositor->Threads[t].Thread, NULL);
+        }
+        pthread_cond_destroy(&compositor->WorkCondition);
+        pthread_cond_destroy(&compositor->DoneCondition);
+        pthread_mutex_destroy(&compositor->Mutex);
+    }
+    for (int eye = 0; eye < XRAPI_FRAME_LAYER_EYE_MAX; eye++) {
+        free(compositor->Output[eye]);
+        free(compositor->TanX[eye]);
+        free(compositor->TanY[eye]);
+    }
+    for (int t = 0; t < XRAPI_COMPOSITOR_MAX_THREADS; t++) {
+        free(compositor->Threads[t].Scratch);
+    }
+    memset(compositor, 0, sizeof(xrReferenceCompositor));
+}
+
+//-----------------------------------------------------------------
+// Layer setup.
+//-----------------------------------------------------------------
+
+static inline void xrCompositorLayerSetup_SetRay(
+    xrCompositorLayerSetup* setup,
+    const xrMatrix4f* layerMatrix,
+    const xrQuatf* layerOrientation,
+    const xrQuatf* displayOrientation) {
+    // Layer space from display eye space: rotate the ray to world space with the display
+    // orientation and back with the orientation the layer was rendered with.
+    const xrMatrix4f display = xrMatrix4f_CreateFromQuaternion(displayOrientation);
+    const xrMatrix4f layer = xrMatrix4f_CreateFromQuaternion(layerOrientation);
+    const xrMatrix4f layerInverse = xrMatrix4f_Transpose(&layer);
+    const xrMatrix4f layerFromDisplay = xrMatrix4f_Multiply(&layerInverse, &display);
+    const xrMatrix4f ray = xrMatrix4f_Multiply(layerMatrix, &layerFromDisplay);
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            setup->Ray[i][j] = ray.M[i][j];
+        }
+    }
+}
+
+static inline void xrCompositorLayerSetup_SetTextureMatrix(
+    xrCompositorLayerSetup* setup,
+    const xrMatrix4f* textureMatrix) {
+    for (int i = 0; i < 2; i++) {
+        for (int j = 0; j < 3; j++) {
+            setup->TextureMatrix[i][j] = textureMatrix->M[i][j];
+        }
+    }
+}
+
+static inline void xrReferenceCompositor_SetSource(
+    const xrReferenceCompositor* compositor,
+    xrCompositorLayerSetup* setup,
+    const xrTextureSwapChain* swapChain,
+    const int swapChainIndex,
+    const int imageLayer) {
+    const uintptr_t id = (uintptr_t)swapChain;
+    setup->Image = NULL;
+    setup->ImageLayer = 0;
+    if (id == XRAPI_DEFAULT_TEXTURE_SWAPCHAIN) {
+        setup->Source = xrCompositorSource_White;
+    } else if (id == XRAPI_DEFAULT_TEXTURE_SWAPCHAIN_BLACK) {
+        setup->Source = xrCompositorSource_Black;
+    } else if (id == XRAPI_DEFAULT_TEXTURE_SWAPCHAIN_LOADING_ICON) {
+        setup->Source = xrCompositorSource_LoadingIcon;
+    } else {
+        const xrReferenceCompositorParms* parms = &compositor->Parms;
+        setup->Image = (swapChain != NULL && parms->GetImage != NULL)
+            ? parms->GetImage(parms->UserData, swapChain, swapChainIndex)
+            : NULL;
+        setup->Source = (setup->Image != NULL && setup->Image->Texels != NULL)
+            ? xrCompositorSource_Image
+            : xrCompositorSource_None;
+        if (setup->Image != NULL) {
+            setup->ImageLayer =
+                (imageLayer < setup->Image->Layers) ? imageLayer : setup->Image->Layers - 1;
+        }
+    }
+}
+
+static inline void xrReferenceCompositor_SetupLayer(
+    xrReferenceCompositor* compositor,
+    const xrLayerHeader2* header,
+    const int eye,
+    const xrQuatf* displayOrientation,
+    const double displayTime,
+    xrCompositorLayerSetup* setup) {
+    memset(setup, 0, sizeof(xrCompositorLayerSetup));
+    setup->Type = header->Type;
+    setup->Clip = (header->Flags & XRAPI_FRAME_LAYER_FLAG_CLIP_TO_TEXTURE_RECT) != 0;
+    setup->ColorScale[0] = header->ColorScale.x;
+    setup->ColorScale[1] = header->ColorScale.y;
+    setup->ColorScale[2] = header->ColorScale.z;
+    setup->ColorScale[3] = header->ColorScale.w;
+    setup->SrcBlend = header->SrcBlend;
+    setup->DstBlend = header->DstBlend;
+    setup->TextureRect.width = 1.0f;
+    setup->TextureRect.height = 1.0f;
+    setup->TextureMatrix[0][0] = 1.0f;
+    setup->TextureMatrix[1][1] = 1.0f;
+
+    const bool fixedToView = (header->Flags & XRAPI_FRAME_LAYER_FLAG_FIXED_TO_VIEW) != 0;
+    const xrQuatf* display = displayOrientation;
+    const xrMatrix4f identity = xrMatrix4f_CreateIdentity();
+
+    switch (header->Type) {
+        case XRAPI_LAYER_TYPE_PROJECTION2: {
+            const xrLayerProjection2* layer = (const xrLayerProjection2*)header;
+            xrReferenceCompositor_SetSource(
+                compositor,
+                setup,
+                layer->Textures[eye].ColorSwapChain,
+                layer->Textures[eye].SwapChainIndex,
+                eye);
+            xrCompositorLayerSetup_SetRay(
+                setup,
+                &layer->Textures[eye].TexCoordsFromTanAngles,
+                fixedToView ? display : &layer->HeadPose.Pose.Orientation,
+                display);
+            setup->TextureRect = layer->Textures[eye].TextureRect;
+            break;
+        }
+        case XRAPI_LAYER_TYPE_CYLINDER2: {
+            const xrLayerCylinder2* layer = (const xrLayerCylinder2*)header;
+            xrReferenceCompositor_SetSource(
+                compositor,
+                setup,
+                layer->Textures[eye].ColorSwapChain,
+                layer->Textures[eye].SwapChainIndex,
+                eye);
+            xrCompositorLayerSetup_SetRay(
+                setup,
+                &layer->Textures[eye].TexCoordsFromTanAngles,
+                fixedToView ? display : &layer->HeadPose.Pose.Orientation,
+                display);
+            xrCompositorLayerSetup_SetTextureMatrix(setup, &layer->Textures[eye].TextureMatrix);
+            setup->TextureRect = layer->Textures[eye].TextureRect;
+            break;
+        }
+        case XRAPI_LAYER_TYPE_CUBE2: {
+            const xrLayerCube2* layer = (const xrLayerCube2*)header;
+            xrReferenceCompositor_SetSource(
+                compositor,
+                setup,
+                layer->Textures[eye].ColorSwapChain,
+                layer->Textures[eye].SwapChainIndex,
+                0);
+            xrCompositorLayerSetup_SetRay(
+                setup,
+                &layer->TexCoordsFromTanAngles,
+                fixedToView ? display : &layer->HeadPose.Pose.Orientation,
+                display);
+            setup->Offset = layer->Offset;
+            break;
+        }
+        case XRAPI_LAYER_TYPE_EQUIRECT2: {
+            const xrLayerEquirect2* layer = (const xrLayerEquirect2*)header;
+            xrReferenceCompositor_SetSource(
+                compositor,
+                setup,
+                layer->Textures[eye].ColorSwapChain,
+                layer->Textures[eye].SwapChainIndex,
+                eye);
+            xrCompositorLayerSetup_SetRay(
+                setup,
+                &layer->TexCoordsFromTanAngles,
+                fixedToView ? display : &layer->HeadPose.Pose.Orientation,
+                display);
+            xrCompositorLayerSetup_SetTextureMatrix(setup, &layer->Textures[eye].TextureMatrix);
+            setup->TextureRect = layer->Textures[eye].TextureRect;
+            break;
+        }
+        case XRAPI_LAYER_TYPE_FISHEYE2: {
+            const xrLayerFishEye2* layer = (const xrLayerFishEye2*)header;
+            xrReferenceCompositor_SetSource(
+                compositor,
+                setup,
+                layer->Textures[eye].ColorSwapChain,
+                layer->Textures[eye].SwapChainIndex,
+                eye);
+            xrCompositorLayerSetup_SetRay(
+                setup,
+                &layer->Textures[eye].LensFromTanAngles,
+                fixedToView ? display : &layer->HeadPose.Pose.Orientation,
+                display);
+            xrCompositorLayerSetup_SetTextureMatrix(setup, &layer->Textures[eye].TextureMatrix);
+            setup->TextureRect = layer->Textures[eye].TextureRect;
+            break;
+        }
+        case XRAPI_LAYER_TYPE_LOADING_ICON2: {
+            const xrLayerLoadingIcon2* layer = (const xrLayerLoadingIcon2*)header;
+            xrReferenceCompositor_SetSource(
+                compositor, setup, layer->ColorSwapChain, layer->SwapChainIndex, 0);
+            xrCompositorLayerSetup_SetRay(setup, &identity, display, display);
+            const float angle = (float)(layer->SpinSpeed * displayTime);
+            setup->SpinCos = cosf(angle);
+            setup->SpinSin = sinf(angle);
+            setup->SpinExtent = (layer->SpinScale > 0.0f) ? 1.0f / layer->SpinScale : 0.0f;
+            break;
+        }
+        default:
+            setup->Source = xrCompositorSource_None;
+            break;
+    }
+}
+
+//-----------------------------------------------------------------
+// Sampling.
+//-----------------------------------------------------------------
+
+static inline void xrCompositorImage_Sample(
+    const xrCompositorImage* image,
+    const int layer,
+    const float u,
+    const float v,
+    float* rgba) {
+    const int width = image->Width;
+    const int height = image->Height;
+    float x = u * width - 0.5f;
+    float y = v * height - 0.5f;
+    x = (x < 0.0f) ? 0.0f : ((x > width - 1) ? (float)(width - 1) : x);
+    y = (y < 0.0f) ? 0.0f : ((y > height - 1) ? (float)(height - 1) : y);
+    const int x0 = (int)x;
+    const int y0 = (int)y;
+    const int x1 = (x0 + 1 < width) ? x0 + 1 : x0;
+    const int y1 = (y0 + 1 < height) ? y0 + 1 : y0;
+    const float fx = x - x0;
+    const float fy = y - y0;
+
+    const uint8_t* texels = image->Texels + (size_t)layer * width * height * 4;
+    const uint8_t* t00 = texels + ((size_t)y0 * width + x0) * 4;
+    const uint8_t* t01 = texels + ((size_t)y0 * width + x1) * 4;
+    const uint8_t* t10 = texels + ((size_t)y1 * width + x0) * 4;
+    const uint8_t* t11 = texels + ((size_t)y1 * width + x1) * 4;
+    for (int c = 0; c < 4; c++) {
+        const float top = t00[c] + (t01[c] - t00[c]) * fx;
+        const float bottom = t10[c] + (t11[c] - t10[c]) * fx;
+        rgba[c] = (top + (bottom - top) * fy) * (1.0f / 255.0f);
+    }
+}
+
+/// Maps a direction to a GL cube map face and face coordinates.
+static inline int xrCompositor_CubeFace(const float x, const float y, const float z, float* uv) {
+    const float ax = fabsf(x);
+    const float ay = fabsf(y);
+    const float az = fabsf(z);
+    int face;
+    float sc;
+    float tc;
+    float ma;
+    if (ax >= ay && ax >= az) {
+        face = (x >= 0.0f) ? 0 : 1;
+        sc = (x >= 0.0f) ? -z : z;
+        tc = -y;
+        ma = ax;
+    } else if (ay >= az) {
+        face = (y >= 0.0f) ? 2 : 3;
+        sc = x;
+        tc = (y >= 0.0f) ? z : -z;
+        ma = ay;
+    } else {
+        face = (z >= 0.0f) ? 4 : 5;
+        sc = (z >= 0.0f) ? x : -x;
+        tc = -y;
+        ma = az;
+    }
+    uv[0] = 0.5f * (sc / ma + 1.0f);
+    uv[1] = 0.5f * (tc / ma + 1.0f);
+    return face;
+}
+
+/// Alpha of the default loading icon at icon coordinates in [0, 1]: an open ring.
+static inline float xrCompositor_LoadingIconAlpha(const float u, const float v) {
+    const float x = u - 0.5f;
+    const float y = v - 0.5f;
+    const float r = sqrtf(x * x + y * y);
+    if (r < 0.3f || r > 0.45f) {
+        return 0.0f;
+    }
+    // Leave a quarter of the ring open so the spin is visible.
+    return (x > 0.0f && y > 0.0f) ? 0.0f : 1.0f;
+}
+
+static inline float xrCompositor_BlendFactor(const xrFrameLayerBlend blend, const float srcAlpha) {
+    switch (blend) {
+        case XRAPI_FRAME_LAYER_BLEND_ONE:
+            return 1.0f;
+        case XRAPI_FRAME_LAYER_BLEND_SRC_ALPHA:
+            return srcAlpha;
+        case XRAPI_FRAME_LAYER_BLEND_ONE_MINUS_SRC_ALPHA:
+            return 1.0f - srcAlpha;
+        default:
+            return 0.0f;
+    }
+}
+
+//-----------------------------------------------------------------
+// Composition.
+//-----------------------------------------------------------------
+
+/// Composites one layer into one row. Returns the number of pixels blended.
+static inline int xrReferenceCompositor_ComposeLayerRow(
+    const xrReferenceCompositor* compositor,
+    const xrCompositorLayerSetup* setup,
+    const int eye,
+    const int row,
+    float* scratch) {
+    if (setup->Source == xrCompositorSource_None) {
+        return 0;
+    }
+
+    const int width = compositor->Parms.Width;
+    const float* tanX = compositor->TanX[eye];
+    const float tanY = compositor->TanY[eye][row];
+    float* rx = scratch;
+    float* ry = scratch + width;
+    float* rz = scratch + 2 * width;
+    float* tu = scratch + 3 * width;
+    float* tv = scratch + 4 * width;
+    // Coverage, or the cube face plus one.
+    float* coverage = scratch + 5 * width;
+
+    // Transform the rays ( tanX, tanY, -1 ) to layer space.
+    const float(*m)[3] = setup->Ray;
+    const float bx = m[0][1] * tanY - m[0][2];
+    const float by = m[1][1] * tanY - m[1][2];
+    const float bz = m[2][1] * tanY - m[2][2];
+    for (int i = 0; i < width; i++) {
+        rx[i] = m[0][0] * tanX[i] + bx;
+        ry[i] = m[1][0] * tanX[i] + by;
+        rz[i] = m[2][0] * tanX[i] + bz;
+    }
+
+    // Map the rays to texture coordinates.
+    const float halfPi = 1.57079632679f;
+    const float pi = 3.14159265359f;
+    const float tanHalfCylinderHeight = 0.57735026919f; // tan( 30 degrees )
+    bool textureMatrix = false;
+    switch (setup->Type) {
+        case XRAPI_LAYER_TYPE_PROJECTION2:
+            for (int i = 0; i < width; i++) {
+                coverage[i] = (rz[i] > 0.0f) ? 1.0f : 0.0f;
+                const float rcp = (rz[i] > 0.0f) ? 1.0f / rz[i] : 0.0f;
+                tu[i] = rx[i] * rcp;
+                tv[i] = ry[i] * rcp;
+            }
+            break;
+        case XRAPI_LAYER_TYPE_CYLINDER2:
+            for (int i = 0; i < width; i++) {
+                const float angle = atan2f(rx[i], -rz[i]);
+                const float radius = sqrtf(rx[i] * rx[i] + rz[i] * rz[i]);
+                const float height = (radius > 0.0f) ? ry[i] / radius : 2.0f;
+                coverage[i] = (fabsf(angle) <= halfPi && fabsf(height) <= tanHalfCylinderHeight)
+                    ? 1.0f
+                    : 0.0f;
+                tu[i] = 0.5f + angle / pi;
+                tv[i] = 0.5f + 0.5f * height / tanHalfCylinderHeight;
+            }
+            textureMatrix = true;
+            break;
+        case XRAPI_LAYER_TYPE_CUBE2:
+            for (int i = 0; i < width; i++) {
+                const float length = sqrtf(rx[i] * rx[i] + ry[i] * ry[i] + rz[i] * rz[i]);
+                const float x = rx[i] / length + setup->Offset.x;
+                const float y = ry[i] / length + setup->Offset.y;
+                const float z = rz[i] / length + setup->Offset.z;
+                float uv[2];
+                coverage[i] = 1.0f + xrCompositor_CubeFace(x, y, z, uv);
+                tu[i] = uv[0];
+                tv[i] = uv[1];
+            }
+            break;
+        case XRAPI_LAYER_TYPE_EQUIRECT2:
+            for (int i = 0; i < width; i++) {
+                const float length = sqrtf(rx[i] * rx[i] + ry[i] * ry[i] + rz[i] * rz[i]);
+                coverage[i] = 1.0f;
+                tu[i] = 0.5f + atan2f(rx[i], -rz[i]) * (0.5f / pi);
+                tv[i] = 0.5f + asinf(ry[i] / length) / pi;
+            }
+            textureMatrix = true;
+            break;
+        case XRAPI_LAYER_TYPE_FISHEYE2:
+            for (int i = 0; i < width; i++) {
+                const float length = sqrtf(rx[i] * rx[i] + ry[i] * ry[i] + rz[i] * rz[i]);
+                const float theta = acosf(-rz[i] / length);
+                const float radius = theta / halfPi;
+                const float planar = sqrtf(rx[i] * rx[i] + ry[i] * ry[i]);
+                const float scale = (planar > 0.0f) ? radius / planar : 0.0f;
+                coverage[i] = (theta <= halfPi) ? 1.0f : 0.0f;
+                tu[i] = rx[i] * scale;
+                tv[i] = ry[i] * scale;
+            }
+            textureMatrix = true;
+            break;
+        case XRAPI_LAYER_TYPE_LOADING_ICON2:
+            for (int i = 0; i < width; i++) {
+                const float x = (rz[i] < 0.0f) ? rx[i] / -rz[i] : 2.0f * setup->SpinExtent;
+                const float y = (rz[i] < 0.0f) ? ry[i] / -rz[i] : 2.0f * setup->SpinExtent;
+                const float sx = setup->SpinCos * x + setup->SpinSin * y;
+                const float sy = -setup->SpinSin * x + setup->SpinCos * y;
+                tu[i] = 0.5f + 0.5f * sx / setup->SpinExtent;
+                tv[i] = 0.5f + 0.5f * sy / setup->SpinExtent;
+                coverage[i] = (setup->SpinExtent > 0.0f && tu[i] >= 0.0f && tu[i] <= 1.0f &&
+                               tv[i] >= 0.0f && tv[i] <= 1.0f)
+                    ? 1.0f
+                    : 0.0f;
+            }
+            break;
+        default:
+            return 0;
+    }
+
+    if (textureMatrix) {
+        const float(*t)[3] = setup->TextureMatrix;
+        for (int i = 0; i < width; i++) {
+            const float u = tu[i];
+            const float v = tv[i];
+            tu[i] = t[0][0] * u + t[0][1] * v + t[0][2];
+            tv[i] = t[1][0] * u + t[1][1] * v + t[1][2];
+        }
+    }
+
+    // Clip or clamp to the texture rectangle.
+    if (setup->Type != XRAPI_LAYER_TYPE_CUBE2 && setup->Type != XRAPI_LAYER_TYPE_LOADING_ICON2) {
+        const float minU = setup->TextureRect.x;
+        const float minV = setup->TextureRect.y;
+        const float maxU = minU + setup->TextureRect.width;
+        const float maxV = minV + setup->TextureRect.height;
+        for (int i = 0; i < width; i++) {
+            if (setup->Clip && (tu[i] < minU || tu[i] > maxU || tv[i] < minV || tv[i] > maxV)) {
+                coverage[i] = 0.0f;
+            }
+            tu[i] = (tu[i] < minU) ? minU : ((tu[i] > maxU) ? maxU : tu[i]);
+            tv[i] = (tv[i] < minV) ? minV : ((tv[i] > maxV) ? maxV : tv[i]);
+        }
+    }
+
+    // Sample and blend.
+    float* dst = compositor->Output[eye] + (size_t)row * width * 4;
+    int blended = 0;
+    for (int i = 0; i < width; i++) {
+        if (coverage[i] == 0.0f) {
+            continue;
+        }
+        float src[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+        if (setup->Source == xrCompositorSource_Image) {
+            const int layer =
+                (setup->Type == XRAPI_LAYER_TYPE_CUBE2) ? (int)coverage[i] - 1 : setup->ImageLayer;
+            xrCompositorImage_Sample(
+                setup->Image, (layer < setup->Image->Layers) ? layer : 0, tu[i], tv[i], src);
+        } else if (setup->Source == xrCompositorSource_Black) {
+            src[0] = src[1] = src[2] = 0.0f;
+        } else if (setup->Source == xrCompositorSource_LoadingIcon) {
+            src[3] = xrCompositor_LoadingIconAlpha(tu[i], tv[i]);
+        }
+
+        float* d = dst + i * 4;
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+        const float32x4_t s = vmulq_f32(vld1q_f32(src), vld1q_f32(setup->ColorScale));
+        const float srcAlpha = vgetq_lane_f32(s, 3);
+        const float srcFactor = xrCompositor_BlendFactor(setup->SrcBlend, srcAlpha);
+        const float dstFactor = xrCompositor_BlendFactor(setup->DstBlend, srcAlpha);
+        vst1q_f32(d, vmlaq_n_f32(vmulq_n_f32(s, srcFactor), vld1q_f32(d), dstFactor));
+#else
+        float s[4];
+        for (int c = 0; c < 4; c++) {
+            s[c] = src[c] * setup->ColorScale[c];
+        }
+        const float srcFactor = xrCompositor_BlendFactor(setup->SrcBlend, s[3]);
+        const float dstFactor = xrCompositor_BlendFactor(setup->DstBlend, s[3]);
+        for (int c = 0; c < 4; c++) {
+            d[c] = s[c] * srcFactor + d[c] * dstFactor;
+        }
+#endif
+        blended++;
+    }
+    return blended;
+}
+
+// Composites bands until all bands of the frame are taken.
+static inline void xrReferenceCompositor_ComposeBands(xrCompositorThread* thread) {
+    xrReferenceCompositor* compositor = thread->Compositor;
+    const int height = compositor->Parms.Height;
+    const int bandsPerEye = (height + XRAPI_COMPOSITOR_BAND_ROWS - 1) / XRAPI_COMPOSITOR_BAND_ROWS;
+
+    for (;;) {
+        const int band = __atomic_fetch_add(&compositor->NextBand, 1, __ATOMIC_RELAXED);
+        if (band >= compositor->BandCount) {
+            break;
+        }
+        const int eye = band / bandsPerEye;
+        const int firstRow = (band % bandsPerEye) * XRAPI_COMPOSITOR_BAND_ROWS;
+        const int endRow = (firstRow + XRAPI_COMPOSITOR_BAND_ROWS < height)
+            ? firstRow + XRAPI_COMPOSITOR_BAND_ROWS
+            : height;
+
+        // Layers are composited in order for the whole band, which keeps the band in cache.
+        for (int l = 0; l < compositor->LayerCount; l++) {
+            const double startTime = xrReferenceCompositor_GetTime();
+            for (int row = firstRow; row < endRow; row++) {
+                thread->LayerPixels[l] += xrReferenceCompositor_ComposeLayerRow(
+                    compositor, &compositor->Setup[l][eye], eye, row, thread->Scratch);
+            }
+            thread->LayerTime[l] += xrReferenceCompositor_GetTime() - startTime;
+        }
+    }
+}
+
+static inline void* xrReferenceCompositor_WorkerFunction(void* parm) {
+    xrCompositorThread* thread = (xrCompositorThread*)parm;
+    xrReferenceCompositor* compositor = thread->Compositor;
+    // Frame was 0 when Init() started the thread. Reading it here instead could miss a frame
+    // that was started before this thread first ran.
+    int frame = 0;
+    pthread_mutex_lock(&compositor->Mutex);
+    for (;;) {
+        while (!compositor->Exit && compositor->Frame == frame) {
+            pthread_cond_wait(&compositor->WorkCondition, &compositor->Mutex);
+        }
+        if (compositor->Exit) {
+            break;
+        }
+        frame = compositor->Frame;
+        pthread_mutex_unlock(&compositor->Mutex);
+
+        xrReferenceCompositor_ComposeBands(thread);
+
+        pthread_mutex_lock(&compositor->Mutex);
+        if (--compositor->WorkersBusy == 0) {
+            pthread_cond_signal(&compositor->DoneCondition);
+        }
+    }
+    pthread_mutex_unlock(&compositor->Mutex);
+    return NULL;
+}
+
+/// Composites the frame into Output[]. 'displayOrientation' is the head orientation the
+/// frame is displayed with. The swap chain images must stay valid during the call.
+static inline void xrReferenceCompositor_Compose(
+    xrReferenceCompositor* compositor,
+    const xrSubmitFrameDescription2* frame,
+    const xrQuatf* displayOrientation) {
+    const double startTime = xrReferenceCompositor_GetTime();
+    const xrReferenceCompositorParms* parms = &compositor->Parms;
+
+    compositor->LayerCount = (frame->LayerCount < (uint32_t)xrMaxLayerCount)
+        ? (int)frame->LayerCount
+        : (int)xrMaxLayerCount;
+    for (int l = 0; l < compositor->LayerCount; l++) {
+        for (int eye = 0; eye < XRAPI_FRAME_LAYER_EYE_MAX; eye++) {
+            xrCompositorLayerSetup* setup = &compositor->Setup[l][eye];
+            if (frame->Layers[l] == NULL) {
+                memset(setup, 0, sizeof(xrCompositorLayerSetup));
+                continue;
+            }
+            xrReferenceCompositor_SetupLayer(
+                compositor, frame->Layers[l], eye, displayOrientation, frame->DisplayTime, setup);
+        }
+    }
+
+    for (int eye = 0; eye < XRAPI_FRAME_LAYER_EYE_MAX; eye++) {
+        memset(
+            compositor->Output[eye], 0, (size_t)parms->Width * parms->Height * 4 * sizeof(float));
+    }
+    const int bandsPerEye =
+        (parms->Height + XRAPI_COMPOSITOR_BAND_ROWS - 1) / XRAPI_COMPOSITOR_BAND_ROWS;
+    compositor->BandCount = bandsPerEye * XRAPI_FRAME_LAYER_EYE_MAX;
+    compositor->NextBand = 0;
+
+    const int threadCount = 1 + compositor->WorkerCount;
+    for (int t = 0; t < threadCount; t++) {
+        memset(compositor->Threads[t].LayerTime, 0, sizeof(compositor->Threads[t].LayerTime));
+        memset(compositor->Threads[t].LayerPixels, 0, sizeof(compositor->Threads[t].LayerPixels));
+    }
+
+    // Wake the workers, help with the bands and wait for the workers to finish theirs. The
+    // mutex publishes the frame state to the workers and their statistics back.
+    pthread_mutex_lock(&compositor->Mutex);
+    compositor->WorkersBusy = compositor->WorkerCount;
+    compositor->Frame++;
+    pthread_cond_broadcast(&compositor->WorkCondition);
+    pthread_mutex_unlock(&compositor->Mutex);
+    xrReferenceCompositor_ComposeBands(&compositor->Threads[0]);
+    pthread_mutex_lock(&compositor->Mutex);
+    while (compositor->WorkersBusy > 0) {
+        pthread_cond_wait(&compositor->DoneCondition, &compositor->Mutex);
+    }
+    pthread_mutex_unlock(&compositor->Mutex);
+
+    xrReferenceCompositorStats* stats = &compositor->Stats;
+    memset(stats, 0, sizeof(xrReferenceCompositorStats));
+    stats->LayerCount = compositor->LayerCount;
+    for (int t = 0; t < threadCount; t++) {
+        for (int l = 0; l < compositor->LayerCount; l++) {
+            stats->LayerTime[l] += compositor->Threads[t].LayerTime[l];
+            stats->LayerPixels[l] += compositor->Threads[t].LayerPixels[l];
+        }
+    }
+    stats->WallTime = xrReferenceCompositor_GetTime() - startTime;
+}
+
+/// Converts the output of an eye to RGBA8 with rows from bottom to top.
+static inline void xrReferenceCompositor_GetImage(
+    const xrReferenceCompositor* compositor,
+    const int eye,
+    uint8_t* rgba) {
+    const size_t count = (size_t)compositor->Parms.Width * compositor->Parms.Height * 4;
+    const float* src = compositor->Output[eye];
+    for (size_t i = 0; i < count; i++) {
+        const float value = src[i] * 255.0f + 0.5f;
+        rgba[i] = (uint8_t)((value < 0.0f) ? 0.0f : ((value > 255.0f) ? 255.0f : value));
+    }
+}
+
+/// Compares two RGBA8 images, for instance an output against a golden image. Returns the
+/// largest difference of any channel, and optionally the number of differing channels.
+static inline int xrCompositorImage_Compare(
+    const uint8_t* a,
+    const uint8_t* b,
+    const int width,
+    const int height,
+    size_t* differences) {
+    int maxDifference = 0;
+    size_t count = 0;
+    const size_t size = (size_t)width * height * 4;
+    for (size_t i = 0; i < size; i++) {
+        const int difference = (a[i] > b[i]) ? a[i] - b[i] : b[i] - a[i];
+        maxDifference = (difference > maxDifference) ? difference : maxDifference;
+        count += (difference != 0);
+    }
+    if (differences != NULL) {
+        *differences = count;
+    }
+    return maxDifference;
+}
+
+#endif // XR_XrApiReferenceCompositor_h
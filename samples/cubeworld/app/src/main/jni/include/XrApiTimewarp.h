@@ -0,0 +1,375 @@
+
+#ifndef XR_XrApiTimewarp_h
+#define XR_XrApiTimewarp_h
+
+// For clock_gettime() in XrApiReferenceCompositor.h, which needs it before the first system
+// header.
+#if !defined(_POSIX_C_SOURCE) && !defined(_GNU_SOURCE)
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "string.h" // for memcpy()
+#include <pthread.h> // for pthread_create()
+#include "XrApiConfig.h"
+#include "XrApiTypes.h"
+#include "XrApiHelpers.h"
+#include "XrApiReferenceCompositor.h"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define XRAPI_TIMEWARP_SSE2 1
+#endif
+
+/*
+CPU timewarp of a single eye image.
+
+Reprojects an eye image rendered with one head orientation to a newer head orientation,
+the way the compositor reprojects a projection layer. This shows the effect of a late pose,
+or of a change to xrMatrix4f_TanAngleMatrixFromProjection() or
+xrMatrix4f_TanAngleMatrixFromUnitSquare(), on the host at interactive rates.
+
+Timewarp only corrects for rotation. For an output pixel ( x, y ) the source texture
+coordinate is
+
+    h = TexCoordsFromTanAngles * transpose( Render ) * Display * K * ( x, y, 1 )
+    uv = h.xy / h.z
+
+where Render and Display are the rotations of the two head orientations, and K maps a pixel
+to its tangent ray ( tanX, tanY, -1 ) through the display projection. The product is a
+single 3x3 homography, so along a row h changes by a constant step and each pixel costs
+three multiply-adds and a reciprocal. The coordinates are exact, not interpolated from a
+coarse warp mesh.
+
+The output is split into square tiles, which the calling thread and the worker threads take
+from a shared counter. Tiles keep the source reads of neighboring rows in cache. The workers
+are started by xrTimewarp_Init() and wait between warps, so a warp does not create threads.
+Within a tile row the coordinates are computed four at a time with NEON or SSE2, and the
+texels are filtered bilinearly in 8-bit fixed point, two channels per 32-bit operation.
+
+Pixels with a texture coordinate outside [0, 1], or behind the source view, are written as
+transparent black, like a clamp to border sampler. Where a projection layer with
+CLIP_TO_TEXTURE_RECT covers the same pixels, the output of xrReferenceCompositor differs by
+at most 3/255 because of the fixed point filter.
+*/
+
+/// Width and height of the tiles the output is split into.
+#define XRAPI_TIMEWARP_TILE_SIZE 32
+
+typedef struct xrTimewarpParms_ {
+    // Eye image, and the matrix and head orientation it was rendered with.
+    const xrCompositorImage* Source;
+    int SourceLayer;
+    xrMatrix4f TexCoordsFromTanAngles;
+    xrQuatf RenderOrientation;
+    // Head orientation to reproject to.
+    xrQuatf DisplayOrientation;
+    // RGBA8 output of Width * Height pixels with rows from bottom to top.
+    uint8_t* Output;
+    int Width;
+    int Height;
+    xrMatrix4f DisplayProjection;
+} xrTimewarpParms;
+
+typedef struct xrTimewarpStats_ {
+    // Number of output pixels without source texels.
+    int OutsidePixels;
+    double WallTime;
+} xrTimewarpStats;
+
+typedef struct xrTimewarp_ xrTimewarp;
+
+typedef struct xrTimewarpThread_ {
+    xrTimewarp* Timewarp;
+    pthread_t Thread;
+    int OutsidePixels;
+} xrTimewarpThread;
+
+struct xrTimewarp_ {
+    xrTimewarpThread Threads[XRAPI_COMPOSITOR_MAX_THREADS];
+
+    // Warp state shared with the worker threads.
+    const xrTimewarpParms* Parms;
+    float Warp[9];
+    int TileCount;
+    int NextTile;
+
+    // Worker threads 1 to WorkerCount wait on WorkCondition until Frame changes, and the last
+    // one to finish the warp signals DoneCondition.
+    bool Initialized;
+    int WorkerCount;
+    pthread_mutex_t Mutex;
+    pthread_cond_t WorkCondition;
+    pthread_cond_t DoneCondition;
+    int Frame;
+    int WorkersBusy;
+    bool Exit;
+};
+
+static inline void* xrTimewarp_WorkerFunction(void* parm);
+
+/// Starts the worker threads, so that warps use 'threadCount' threads including the calling
+/// thread. Fewer are used if threads cannot be created. Call xrTimewarp_Destroy() when done.
+static inline void xrTimewarp_Init(xrTimewarp* timewarp, const int threadCount) {
+    memset(timewarp, 0, sizeof(xrTimewarp));
+    pthread_mutex_init(&timewarp->Mutex, NULL);
+    pthread_cond_init(&timewarp->WorkCondition, NULL);
+    pthread_cond_init(&timewarp->DoneCondition, NULL);
+    timewarp->Initialized = true;
+    for (int t = 0; t < XRAPI_COMPOSITOR_MAX_THREADS; t++) {
+        timewarp->Threads[t].Timewarp = timewarp;
+    }
+    for (int t = 1; t < threadCount && t < XRAPI_COMPOSITOR_MAX_THREADS; t++) {
+        xrTimewarpThread* thread = &timewarp->Threads[t];
+        if (pthread_create(&thread->Thread, NULL, xrTimewarp_WorkerFunction, thread) != 0) {
+            break;
+        }
+        timewarp->WorkerCount++;
+    }
+}
+
+static inline void xrTimewarp_Destroy(xrTimewarp* timewarp) {
+    if (timewarp->Initialized) {
+        pthread_mutex_lock(&timewarp->Mutex);
+        timewarp->Exit = true;
+        pthread_cond_broadcast(&timewarp->WorkCondition);
+        pthread_mutex_unlock(&timewarp->Mutex);
+        for (int t = 1; t <= timewarp->WorkerCount; t++) {
+            pthread_join(timewarp->Threads[t].Thread, NULL);
+        }
+        pthread_cond_destroy(&timewarp->WorkCondition);
+        pthread_cond_destroy(&timewarp->DoneCondition);
+        pthread_mutex_destroy(&timewarp->Mutex);
+    }
+    memset(timewarp, 0, sizeof(xrTimewarp));
+}
+
+/// Returns the homography from output pixel ( x, y, 1 ) to homogeneous source texture
+/// coordinates, in the upper 3x3 of the matrix.
+static inline xrMatrix4f xrTimewarp_GetWarpMatrix(const xrTimewarpParms* parms) {
+    // Pixel to tangent ray, with the pixel center at + 0.5.
+    const xrMatrix4f* p = &parms->DisplayProjection;
+    xrMatrix4f rayFromPixel = xrMatrix4f_CreateIdentity();
+    rayFromPixel.M[0][0] = 2.0f / (parms->Width * p->M[0][0]);
+    rayFromPixel.M[0][2] = (1.0f / parms->Width - 1.0f + p->M[0][2]) / p->M[0][0];
+    rayFromPixel.M[1][1] = 2.0f / (parms->Height * p->M[1][1]);
+    rayFromPixel.M[1][2] = (1.0f / parms->Height - 1.0f + p->M[1][2]) / p->M[1][1];
+    rayFromPixel.M[2][2] = -1.0f;
+
+    const xrMatrix4f display = xrMatrix4f_CreateFromQuaternion(&parms->DisplayOrientation);
+    const xrMatrix4f render = xrMatrix4f_CreateFromQuaternion(&parms->RenderOrientation);
+    const xrMatrix4f renderInverse = xrMatrix4f_Transpose(&render);
+    const xrMatrix4f renderFromDisplay = xrMatrix4f_Multiply(&renderInverse, &display);
+
+    // Only the upper 3x3 of each matrix takes part.
+    xrMatrix4f texCoords = parms->TexCoordsFromTanAngles;
+    texCoords.M[0][3] = texCoords.M[1][3] = texCoords.M[2][3] = 0.0f;
+    texCoords.M[3][0] = texCoords.M[3][1] = texCoords.M[3][2] = 0.0f;
+    texCoords.M[3][3] = 1.0f;
+    const xrMatrix4f rotated = xrMatrix4f_Multiply(&renderFromDisplay, &rayFromPixel);
+    return xrMatrix4f_Multiply(&texCoords, &rotated);
+}
+
+/// Blends two RGBA8 texels with a weight of 0 to 256 for 'b'.
+static inline uint32_t xrTimewarp_Lerp(const uint32_t a, const uint32_t b, const uint32_t weight) {
+    const uint32_t inverse = 256 - weight;
+    const uint32_t rb = ((((a & 0x00FF00FF) * inverse) + ((b & 0x00FF00FF) * weight)) >> 8);
+    const uint32_t ag =
+        ((((a >> 8) & 0x00FF00FF) * inverse) + (((b >> 8) & 0x00FF00FF) * weight));
+    return (rb & 0x00FF00FF) | (ag & 0xFF00FF00);
+}
+
+/// Warps one tile. Returns the number of pixels without source texels.
+static inline int
+xrTimewarp_WarpTile(const xrTimewarpParms* parms, const float* warp, const int tile) {
+    const int tilesX = (parms->Width + XRAPI_TIMEWARP_TILE_SIZE - 1) / XRAPI_TIMEWARP_TILE_SIZE;
+    const int firstX = (tile % tilesX) * XRAPI_TIMEWARP_TILE_SIZE;
+    const int firstY = (tile / tilesX) * XRAPI_TIMEWARP_TILE_SIZE;
+    const int countX = (firstX + XRAPI_TIMEWARP_TILE_SIZE < parms->Width)
+        ? XRAPI_TIMEWARP_TILE_SIZE
+        : parms->Width - firstX;
+    const int endY = (firstY + XRAPI_TIMEWARP_TILE_SIZE < parms->Height)
+        ? firstY + XRAPI_TIMEWARP_TILE_SIZE
+        : parms->Height;
+
+    const xrCompositorImage* source = parms->Source;
+    const int sourceWidth = source->Width;
+    const int sourceHeight = source->Height;
+    const uint8_t* texels =
+        source->Texels + (size_t)parms->SourceLayer * sourceWidth * sourceHeight * 4;
+
+    float x[XRAPI_TIMEWARP_TILE_SIZE];
+    float y[XRAPI_TIMEWARP_TILE_SIZE];
+    int outside = 0;
+    for (int row = firstY; row < endY; row++) {
+        // Texel coordinates of the row, with texel centers at integers.
+        const float hx = warp[0] * firstX + warp[1] * row + warp[2];
+        const float hy = warp[3] * firstX + warp[4] * row + warp[5];
+        const float hz = warp[6] * firstX + warp[7] * row + warp[8];
+        int i = 0;
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+        static const float lanes[4] = {0.0f, 1.0f, 2.0f, 3.0f};
+        const float32x4_t width = vdupq_n_f32((float)sourceWidth);
+        const float32x4_t height = vdupq_n_f32((float)sourceHeight);
+        const float32x4_t half = vdupq_n_f32(0.5f);
+        const float32x4_t zero = vdupq_n_f32(0.0f);
+        const float32x4_t behind = vdupq_n_f32(-1.0f);
+        for (; i + 4 <= countX; i += 4) {
+            const float32x4_t step = vaddq_f32(vdupq_n_f32((float)i), vld1q_f32(lanes));
+            const float32x4_t z = vmlaq_n_f32(vdupq_n_f32(hz), step, warp[6]);
+            // Reciprocal estimate refined by two Newton-Raphson steps.
+            float32x4_t scale = vrecpeq_f32(z);
+            scale = vmulq_f32(vrecpsq_f32(z, scale), scale);
+            scale = vmulq_f32(vrecpsq_f32(z, scale), scale);
+            const float32x4_t u = vmulq_f32(vmlaq_n_f32(vdupq_n_f32(hx), step, warp[0]), scale);
+            const float32x4_t v = vmulq_f32(vmlaq_n_f32(vdupq_n_f32(hy), step, warp[3]), scale);
+            vst1q_f32(x + i, vsubq_f32(vmulq_f32(u, width), half));
+            const float32x4_t texelY = vsubq_f32(vmulq_f32(v, height), half);
+            vst1q_f32(y + i, vbslq_f32(vcgtq_f32(z, zero), texelY, behind));
+        }
+#elif defined(XRAPI_TIMEWARP_SSE2)
+        const __m128 lanes = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+        const __m128 width = _mm_set1_ps((float)sourceWidth);
+        const __m128 height = _mm_set1_ps((float)sourceHeight);
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 behind = _mm_set1_ps(-1.0f);
+        for (; i + 4 <= countX; i += 4) {
+            const __m128 step = _mm_add_ps(_mm_set1_ps((float)i), lanes);
+            const __m128 z = _mm_add_ps(_mm_set1_ps(hz), _mm_mul_ps(step, _mm_set1_ps(warp[6])));
+            // A full division, so the coordinates match the scalar loop.
+            const __m128 scale = _mm_div_ps(_mm_set1_ps(1.0f), z);
+            const __m128 hu = _mm_add_ps(_mm_set1_ps(hx), _mm_mul_ps(step, _mm_set1_ps(warp[0])));
+            const __m128 hv = _mm_add_ps(_mm_set1_ps(hy), _mm_mul_ps(step, _mm_set1_ps(warp[3])));
+            const __m128 u = _mm_mul_ps(hu, scale);
+            const __m128 v = _mm_mul_ps(hv, scale);
+            _mm_storeu_ps(x + i, _mm_sub_ps(_mm_mul_ps(u, width), half));
+            const __m128 texelY = _mm_sub_ps(_mm_mul_ps(v, height), half);
+            const __m128 inFront = _mm_cmpgt_ps(z, zero);
+            _mm_storeu_ps(
+                y + i, _mm_or_ps(_mm_and_ps(inFront, texelY), _mm_andnot_ps(inFront, behind)));
+        }
+#endif
+        for (; i < countX; i++) {
+            const float z = hz + warp[6] * i;
+            const float scale = 1.0f / z;
+            x[i] = (hx + warp[0] * i) * scale * sourceWidth - 0.5f;
+            y[i] = (z > 0.0f) ? (hy + warp[3] * i) * scale * sourceHeight - 0.5f : -1.0f;
+        }
+
+        uint8_t* dst = parms->Output + ((size_t)row * parms->Width + firstX) * 4;
+        for (int column = 0; column < countX; column++) {
+            uint32_t color = 0;
+            if (x[column] >= -0.5f && x[column] <= sourceWidth - 0.5f && y[column] >= -0.5f &&
+                y[column] <= sourceHeight - 0.5f) {
+                // 8 bits of sub-texel position, clamped to the edge texels.
+                const int fx = (int)((x[column] + 1.0f) * 256.0f) - 256;
+                const int fy = (int)((y[column] + 1.0f) * 256.0f) - 256;
+                const int tx = fx >> 8;
+                const int ty = fy >> 8;
+                const int x0 = (tx < 0) ? 0 : tx;
+                const int y0 = (ty < 0) ? 0 : ty;
+                const int x1 = (tx + 1 < sourceWidth) ? tx + 1 : sourceWidth - 1;
+                const int y1 = (ty + 1 < sourceHeight) ? ty + 1 : sourceHeight - 1;
+                uint32_t t00, t01, t10, t11;
+                memcpy(&t00, texels + ((size_t)y0 * sourceWidth + x0) * 4, 4);
+                memcpy(&t01, texels + ((size_t)y0 * sourceWidth + x1) * 4, 4);
+                memcpy(&t10, texels + ((size_t)y1 * sourceWidth + x0) * 4, 4);
+                memcpy(&t11, texels + ((size_t)y1 * sourceWidth + x1) * 4, 4);
+                const uint32_t weightX = fx & 255;
+                const uint32_t weightY = fy & 255;
+                const uint32_t bottom = xrTimewarp_Lerp(t00, t01, weightX);
+                const uint32_t top = xrTimewarp_Lerp(t10, t11, weightX);
+                color = xrTimewarp_Lerp(bottom, top, weightY);
+            } else {
+                outside++;
+            }
+            memcpy(dst + column * 4, &color, 4);
+        }
+    }
+    return outside;
+}
+
+// Warps tiles until all tiles of the output are taken.
+static inline void xrTimewarp_WarpTiles(xrTimewarpThread* thread) {
+    xrTimewarp* timewarp = thread->Timewarp;
+    for (;;) {
+        const int tile = __atomic_fetch_add(&timewarp->NextTile, 1, __ATOMIC_RELAXED);
+        if (tile >= timewarp->TileCount) {
+            break;
+        }
+        thread->OutsidePixels += xrTimewarp_WarpTile(timewarp->Parms, timewarp->Warp, tile);
+    }
+}
+
+static inline void* xrTimewarp_WorkerFunction(void* parm) {
+    xrTimewarpThread* thread = (xrTimewarpThread*)parm;
+    xrTimewarp* timewarp = thread->Timewarp;
+    // Frame was 0 when Init() started the thread, see xrReferenceCompositor_WorkerFunction().
+    int frame = 0;
+    pthread_mutex_lock(&timewarp->Mutex);
+    for (;;) {
+        while (!timewarp->Exit && timewarp->Frame == frame) {
+            pthread_cond_wait(&timewarp->WorkCondition, &timewarp->Mutex);
+        }
+        if (timewarp->Exit) {
+            break;
+        }
+        frame = timewarp->Frame;
+        pthread_mutex_unlock(&timewarp->Mutex);
+
+        xrTimewarp_WarpTiles(thread);
+
+        pthread_mutex_lock(&timewarp->Mutex);
+        if (--timewarp->WorkersBusy == 0) {
+            pthread_cond_signal(&timewarp->DoneCondition);
+        }
+    }
+    pthread_mutex_unlock(&timewarp->Mutex);
+    return NULL;
+}
+
+/// Reprojects parms->Source to parms->Output.
+static inline xrTimewarpStats xrTimewarp_Warp(xrTimewarp* timewarp, const xrTimewarpParms* parms) {
+    const double startTime = xrReferenceCompositor_GetTime();
+
+    const xrMatrix4f warpMatrix = xrTimewarp_GetWarpMatrix(parms);
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            timewarp->Warp[i * 3 + j] = warpMatrix.M[i][j];
+        }
+    }
+    const int tilesX = (parms->Width + XRAPI_TIMEWARP_TILE_SIZE - 1) / XRAPI_TIMEWARP_TILE_SIZE;
+    const int tilesY = (parms->Height + XRAPI_TIMEWARP_TILE_SIZE - 1) / XRAPI_TIMEWARP_TILE_SIZE;
+    timewarp->Parms = parms;
+    timewarp->TileCount = tilesX * tilesY;
+    timewarp->NextTile = 0;
+    for (int t = 0; t <= timewarp->WorkerCount; t++) {
+        timewarp->Threads[t].OutsidePixels = 0;
+    }
+
+    // Wake the workers, help with the tiles and wait for the workers to finish theirs. The
+    // mutex publishes the warp state to the workers and their statistics back.
+    pthread_mutex_lock(&timewarp->Mutex);
+    timewarp->WorkersBusy = timewarp->WorkerCount;
+    timewarp->Frame++;
+    pthread_cond_broadcast(&timewarp->WorkCondition);
+    pthread_mutex_unlock(&timewarp->Mutex);
+    xrTimewarp_WarpTiles(&timewarp->Threads[0]);
+    pthread_mutex_lock(&timewarp->Mutex);
+    while (timewarp->WorkersBusy > 0) {
+        pthread_cond_wait(&timewarp->DoneCondition, &timewarp->Mutex);
+    }
+    pthread_mutex_unlock(&timewarp->Mutex);
+
+    xrTimewarpStats stats;
+    stats.OutsidePixels = 0;
+    for (int t = 0; t <= timewarp->WorkerCount; t++) {
+        stats.OutsidePixels += timewarp->Threads[t].OutsidePixels;
+    }
+    stats.WallTime = xrReferenceCompositor_GetTime() - startTime;
+    return stats;
+}
+
+#endif // XR_XrApiTimewarp_h
@@ -0,0 +1,184 @@
+/*
+Frame pacing test of XrApiHaptics.h.
+
+A mock xrapiSetHapticVibrationBuffer() records every buffer the mixer submits. At steady
+60, 72, 90 and 120 Hz with overlapping clicks, rumbles and clips, every frame must submit at
+most one buffer, every buffer must start where the previous one still covers, and the mixer
+must count no gaps and no overruns. Dropping two frames in a row must be counted as a gap.
+Buffers mixed incrementally must match a full remix of the same samples.
+
+Returns 0 if all checks pass.
+*/
+
+#include <stdio.h>
+#include "XrApiHaptics.h"
+
+// Oculus Touch reports 2 ms samples and at most 64 samples per buffer.
+#define SAMPLE_DURATION_MS 2
+#define MAX_SAMPLES 64
+
+static int Failures = 0;
+
+static void Check(const bool condition, const char* what, const double rate, const int frame) {
+    if (!condition) {
+        if (Failures < 16) {
+            printf("%.0f Hz frame %d: %s\n", rate, frame, what);
+        }
+        Failures++;
+    }
+}
+
+// Mock runtime.
+static int SubmitCalls = 0;
+static xrHapticBuffer LastBuffer;
+
+xrResult xrapiSetHapticVibrationBuffer(
+    xrMobile* xr,
+    const xrDeviceID deviceID,
+    const xrHapticBuffer* hapticBuffer) {
+    (void)xr;
+    (void)deviceID;
+    SubmitCalls++;
+    LastBuffer = *hapticBuffer;
+    return xrSuccess;
+}
+
+static void InitMixer(xrHapticMixer* mixer) {
+    xrInputTrackedRemoteCapabilities caps;
+    memset(&caps, 0, sizeof(caps));
+    caps.HapticSampleDurationMS = SAMPLE_DURATION_MS;
+    caps.HapticSamplesMax = MAX_SAMPLES;
+    xrHapticMixer_Init(mixer, &caps);
+}
+
+static void TestSteadyRate(const double rate) {
+    static uint8_t clip[100];
+    for (int i = 0; i < 100; i++) {
+        clip[i] = (uint8_t)(i * 2);
+    }
+
+    xrHapticMixer mixer;
+    InitMixer(&mixer);
+    const double period = 1.0 / rate;
+    bool playing = false;
+    double coveredEnd = 0.0;
+    for (int frame = 0; frame < 2000; frame++) {
+        const double displayTime = 1000.0 + frame * period;
+        if (frame % 50 == 0) {
+            xrHapticMixer_PlayClick(&mixer, displayTime, 1.0f, 0.02f);
+        }
+        if (frame % 300 == 10) {
+            xrHapticMixer_PlayRumble(&mixer, displayTime, 0.5f, 1.0f, 0.1f, 0.1f);
+        }
+        if (frame % 200 == 5) {
+            xrHapticMixer_PlayClip(&mixer, displayTime, clip, 100, 1.0f);
+        }
+
+        const int calls = SubmitCalls;
+        xrHapticMixer_Submit(&mixer, NULL, 0, displayTime, period);
+        Check(SubmitCalls - calls <= 1, "more than one buffer", rate, frame);
+        if (SubmitCalls == calls) {
+            continue;
+        }
+        // The buffer starts with the first sample at or after the display time, and while an
+        // effect plays the previous buffer still covers that sample.
+        const double sample = SAMPLE_DURATION_MS * 0.001;
+        Check(
+            LastBuffer.BufferTime >= displayTime - 1e-6 &&
+                LastBuffer.BufferTime < displayTime + sample,
+            "buffer does not start at the display time",
+            rate,
+            frame);
+        Check(
+            !playing || LastBuffer.BufferTime <= coveredEnd + 1e-6,
+            "buffer starts after the end of the previous one",
+            rate,
+            frame);
+        Check(LastBuffer.NumSamples <= MAX_SAMPLES, "buffer exceeds the maximum", rate, frame);
+        playing = !LastBuffer.Terminated;
+        coveredEnd = LastBuffer.BufferTime + LastBuffer.NumSamples * sample;
+    }
+
+    Check(mixer.Stats.Buffers > 0, "no buffers", rate, -1);
+    Check(mixer.Stats.Gaps == 0 && mixer.Stats.GapSamples == 0, "gaps", rate, -1);
+    Check(mixer.Stats.Overruns == 0 && mixer.Stats.OverrunSamples == 0, "overruns", rate, -1);
+    printf(
+        "%.0f Hz: %u frames, %u buffers, %u gaps, %u overruns\n",
+        rate,
+        mixer.Stats.Frames,
+        mixer.Stats.Buffers,
+        mixer.Stats.Gaps,
+        mixer.Stats.Overruns);
+}
+
+static void TestDroppedFrames(void) {
+    const double rate = 72.0;
+    const double period = 1.0 / rate;
+    xrHapticMixer mixer;
+    InitMixer(&mixer);
+    xrHapticMixer_PlayRumble(&mixer, 10.0, 0.5f, 1.0f, 0.0f, 0.0f);
+    xrHapticBuffer buffer;
+    for (int frame = 0; frame < 20; frame++) {
+        // One dropped frame is covered by the margin, two in a row are not.
+        if (frame == 5 || frame == 10 || frame == 11) {
+            continue;
+        }
+        xrHapticMixer_BuildFrame(&mixer, 10.0 + frame * period, period, &buffer);
+        Check(
+            mixer.Stats.Gaps == ((frame < 12) ? 0u : 1u),
+            "unexpected gap count",
+            rate,
+            frame);
+    }
+}
+
+static void TestIncrementalMix(void) {
+    const double rate = 72.0;
+    const double period = 1.0 / rate;
+    xrHapticMixer mixer;
+    InitMixer(&mixer);
+    uint32_t seed = 1;
+    int compared = 0;
+    for (int frame = 0; frame < 5000; frame++) {
+        const double displayTime = 50.0 + frame * period;
+        seed = seed * 1103515245u + 12345u;
+        const uint32_t random = seed >> 16;
+        if (random % 7 == 0) {
+            xrHapticMixer_PlayClick(&mixer, displayTime + ((seed >> 8) % 3) * period, 0.7f, 0.03f);
+        }
+        if (random % 97 == 0) {
+            xrHapticMixer_PlayRumble(&mixer, displayTime, 0.4f, 0.5f, 0.05f, 0.05f);
+        }
+        if (random % 13 == 0) {
+            continue; // dropped frame
+        }
+        xrHapticBuffer buffer;
+        if (!xrHapticMixer_BuildFrame(&mixer, displayTime, period, &buffer)) {
+            continue;
+        }
+        xrHapticMixer remix = mixer;
+        const int64_t first = xrHapticMixer_SampleIndex(&mixer, displayTime);
+        xrHapticMixer_Mix(&remix, first, first + buffer.NumSamples);
+        for (uint32_t i = 0; i < buffer.NumSamples; i++) {
+            const uint8_t want = remix.Ring[(first + i) & (XRAPI_HAPTICS_RING_SAMPLES - 1)];
+            Check(buffer.HapticBuffer[i] == want, "incremental mix differs", rate, frame);
+        }
+        compared++;
+    }
+    Check(compared > 1000, "too few buffers compared", rate, -1);
+}
+
+int main(void) {
+    const double rates[] = {60.0, 72.0, 90.0, 120.0};
+    for (int i = 0; i < 4; i++) {
+        TestSteadyRate(rates[i]);
+    }
+    TestDroppedFrames();
+    TestIncrementalMix();
+    if (Failures > 0) {
+        printf("%d failures\n", Failures);
+        return 1;
+    }
+    printf("All haptics checks pass\n");
+    return 0;
+}
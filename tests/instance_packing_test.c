@@ -0,0 +1,265 @@
+/*
+Bit-exactness test of the packers and unpackers in XrApiInstancePacking.h.
+
+The scalar conversions are compared against reference conversions computed in double
+precision: the half float conversion for every float whose exponent is in the range where the
+result is neither zero nor infinity, the half float decoder for every half, and the signed
+normalized conversion for every float in [-2^-17, 1] in magnitude plus the values around the
+clamp limits. Floats outside those ranges are sampled. The batch packers, which use NEON on
+64-bit ARM, are compared against the scalar conversions element by element.
+
+Returns 0 if all conversions match.
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "XrApiInstancePacking.h"
+
+static int Failures = 0;
+
+static void Fail(const char* what, const uint32_t input, const uint32_t got, const uint32_t want) {
+    if (Failures < 16) {
+        printf("%s: input 0x%08x got 0x%08x expected 0x%08x\n", what, input, got, want);
+    }
+    Failures++;
+}
+
+static float FloatFromBits(const uint32_t bits) {
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static uint32_t BitsFromFloat(const float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+// Rounds to the nearest half float with ties to even, using the default rounding mode of
+// nearbyint(). Every step is exact in double precision.
+static uint16_t ReferenceFloatToHalf(const float value) {
+    const uint16_t sign = (BitsFromFloat(value) & 0x80000000u) ? 0x8000 : 0;
+    if (isnan(value)) {
+        return sign | 0x7E00;
+    }
+    const double magnitude = fabs((double)value);
+    if (magnitude == 0.0) {
+        return sign;
+    }
+    int exponent;
+    frexp(magnitude, &exponent);
+    exponent -= 1; // magnitude is in [2^exponent, 2^(exponent + 1))
+    if (exponent < -14) {
+        exponent = -14; // denormals share the quantum of the smallest normal
+    }
+    const double quantum = ldexp(1.0, exponent - 10);
+    const double steps = nearbyint(magnitude / quantum);
+    if (exponent == -14 && steps < 1024.0) {
+        return sign | (uint16_t)steps;
+    }
+    // A mantissa that rounds up to 2048 carries into the exponent, and an exponent of 16
+    // encodes infinity.
+    const double bits = (double)((exponent + 15) << 10) + steps - 1024.0;
+    return sign | (uint16_t)((bits < 0x7C00) ? bits : 0x7C00);
+}
+
+static float ReferenceHalfToFloat(const uint16_t half) {
+    const int exponent = (half >> 10) & 0x1F;
+    const int mantissa = half & 0x3FF;
+    double value;
+    if (exponent == 0x1F) {
+        value = (mantissa != 0) ? NAN : INFINITY;
+    } else if (exponent == 0) {
+        value = ldexp((double)mantissa, -24);
+    } else {
+        value = ldexp((double)(1024 + mantissa), exponent - 25);
+    }
+    return (float)((half & 0x8000) ? -value : value);
+}
+
+// The product with 32767 is rounded to single precision before it is rounded to an integer,
+// so a product within half a float ulp of a tie rounds like the tie.
+static int16_t ReferenceFloatToSnorm16(const float value) {
+    const float clamped = (value > 1.0f) ? 1.0f : ((value < -1.0f) ? -1.0f : value);
+    const float product = clamped * 32767.0f;
+    const double exact = (double)clamped * 32767.0;
+    const double rounded = nearbyint((double)product);
+    // The float product is off by at most half an ulp, 2^-10 at 32767.
+    if (fabs(rounded - exact) > 0.5 + 1.0 / 1024.0) {
+        return INT16_MIN; // never produced by the packer
+    }
+    return (int16_t)rounded;
+}
+
+// Visits every float with a biased exponent in [minExponent, maxExponent], both signs, and a
+// sample of every 4099th bit pattern elsewhere.
+static void ForEachFloat(
+    const uint32_t minExponent,
+    const uint32_t maxExponent,
+    void (*test)(uint32_t bits)) {
+    for (uint64_t bits = 0; bits <= 0xFFFFFFFFu;) {
+        test((uint32_t)bits);
+        const uint32_t exponent = (uint32_t)(bits >> 23) & 0xFF;
+        bits += (exponent >= minExponent && exponent <= maxExponent) ? 1 : 4099;
+    }
+}
+
+static void TestFloatToHalfBits(const uint32_t bits) {
+    const float value = FloatFromBits(bits);
+    const uint16_t got = xrPackedInstance_FloatToHalf(value);
+    const uint16_t want = ReferenceFloatToHalf(value);
+    if (got != want) {
+        Fail("FloatToHalf", bits, got, want);
+    }
+}
+
+static void TestFloatToHalf(void) {
+    // Below 2^-26 everything rounds to zero, and from 2^16 up everything is infinity or NaN.
+    ForEachFloat(127 - 26, 127 + 16, TestFloatToHalfBits);
+    // Both sides of every boundary of the range checks.
+    const uint32_t edges[] = {
+        0x00000000, 0x00000001, 0x337FFFFF, 0x33800000, 0x33800001, 0x387FC000, 0x387FE000,
+        0x387FFFFF, 0x38800000, 0x477FE000, 0x477FEFFF, 0x477FF000, 0x477FFFFF, 0x47800000,
+        0x7F7FFFFF, 0x7F800000, 0x7F800001, 0x7FC00000, 0x7FFFFFFF};
+    for (size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); i++) {
+        TestFloatToHalfBits(edges[i]);
+        TestFloatToHalfBits(edges[i] | 0x80000000u);
+    }
+}
+
+static void TestHalfToFloat(void) {
+    for (uint32_t half = 0; half < 0x10000; half++) {
+        const float got = xrPackedInstance_HalfToFloat((uint16_t)half);
+        const float want = ReferenceHalfToFloat((uint16_t)half);
+        if (isnan(want) ? !isnan(got) : BitsFromFloat(got) != BitsFromFloat(want)) {
+            Fail("HalfToFloat", half, BitsFromFloat(got), BitsFromFloat(want));
+        }
+        // Every half that is not a NaN converts back to itself.
+        if (!isnan(want) && xrPackedInstance_FloatToHalf(got) != half) {
+            Fail("HalfToFloat round trip", half, xrPackedInstance_FloatToHalf(got), half);
+        }
+    }
+}
+
+static void TestFloatToSnorm16Bits(const uint32_t bits) {
+    const float value = FloatFromBits(bits);
+    if (isnan(value)) {
+        return;
+    }
+    const int16_t got = xrPackedInstance_FloatToSnorm16(value);
+    const int16_t want = ReferenceFloatToSnorm16(value);
+    if (got != want) {
+        Fail("FloatToSnorm16", bits, (uint16_t)got, (uint16_t)want);
+    }
+}
+
+static void TestFloatToSnorm16(void) {
+    // Below 2^-17 everything rounds to zero, and from 2.0 up everything clamps.
+    ForEachFloat(127 - 17, 127, TestFloatToSnorm16Bits);
+    // Clamping.
+    const float outside[] = {1.0000001f, -1.0000001f, 2.0f, -2.0f, 1e30f, -1e30f, INFINITY,
+                             -INFINITY};
+    for (size_t i = 0; i < sizeof(outside) / sizeof(outside[0]); i++) {
+        const int16_t got = xrPackedInstance_FloatToSnorm16(outside[i]);
+        const int16_t want = (outside[i] > 0.0f) ? 32767 : -32767;
+        if (got != want) {
+            Fail("FloatToSnorm16 clamp", BitsFromFloat(outside[i]), (uint16_t)got, (uint16_t)want);
+        }
+    }
+    // Decoding follows the OpenGL ES 3.0 rule max(c / 32767, -1).
+    for (int value = -32768; value <= 32767; value++) {
+        const float got = xrPackedInstance_Snorm16ToFloat((int16_t)value);
+        const float want = (value == -32768) ? -1.0f : (float)value / 32767.0f;
+        if (BitsFromFloat(got) != BitsFromFloat(want)) {
+            Fail("Snorm16ToFloat", (uint32_t)value, BitsFromFloat(got), BitsFromFloat(want));
+        }
+    }
+}
+
+static uint32_t RandomBits(uint32_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+// Mostly values between 2^-32 and 2^16 in magnitude, sometimes any float bit pattern. No
+// NaNs, whose payloads the NEON path does not preserve.
+static float RandomFloat(uint32_t* state) {
+    for (;;) {
+        const uint32_t bits = RandomBits(state);
+        const float value = ((bits & 7) != 0)
+            ? ldexpf((float)(int32_t)bits, (int)(RandomBits(state) % 48) - 63)
+            : FloatFromBits(bits);
+        if (!isnan(value)) {
+            return value;
+        }
+    }
+}
+
+static void TestBatchPacking(void) {
+    enum { COUNT = 4099 }; // not a multiple of the vector width, to cover the scalar tail
+    xrQuatf* quats = (xrQuatf*)malloc(COUNT * sizeof(xrQuatf));
+    xrVector3f* positions = (xrVector3f*)malloc(COUNT * sizeof(xrVector3f));
+    int16_t* packedQuats = (int16_t*)malloc(COUNT * 4 * sizeof(int16_t));
+    uint16_t* packedPositions = (uint16_t*)malloc(COUNT * 4 * sizeof(uint16_t));
+
+    uint32_t state = 12345;
+    for (int round = 0; round < 256; round++) {
+        for (int i = 0; i < COUNT; i++) {
+            quats[i].x = RandomFloat(&state);
+            quats[i].y = RandomFloat(&state);
+            quats[i].z = RandomFloat(&state);
+            quats[i].w = RandomFloat(&state);
+            positions[i].x = RandomFloat(&state);
+            positions[i].y = RandomFloat(&state);
+            positions[i].z = RandomFloat(&state);
+        }
+        xrPackedInstance_PackOrientations(packedQuats, quats, COUNT);
+        xrPackedInstance_PackPositions(packedPositions, positions, COUNT);
+        for (int i = 0; i < COUNT; i++) {
+            const float* q = &quats[i].x;
+            const float* p = &positions[i].x;
+            for (int c = 0; c < 4; c++) {
+                const int16_t wantQuat = xrPackedInstance_FloatToSnorm16(q[c]);
+                if (packedQuats[i * 4 + c] != wantQuat) {
+                    Fail(
+                        "PackOrientations",
+                        BitsFromFloat(q[c]),
+                        (uint16_t)packedQuats[i * 4 + c],
+                        (uint16_t)wantQuat);
+                }
+                const uint16_t wantPosition =
+                    (c < 3) ? xrPackedInstance_FloatToHalf(p[c]) : 0x3C00;
+                if (packedPositions[i * 4 + c] != wantPosition) {
+                    Fail(
+                        "PackPositions",
+                        (c < 3) ? BitsFromFloat(p[c]) : 0,
+                        packedPositions[i * 4 + c],
+                        wantPosition);
+                }
+            }
+        }
+    }
+
+    free(quats);
+    free(positions);
+    free(packedQuats);
+    free(packedPositions);
+}
+
+int main(void) {
+    TestFloatToHalf();
+    TestHalfToFloat();
+    TestFloatToSnorm16();
+    TestBatchPacking();
+    if (Failures > 0) {
+        printf("%d mismatches\n", Failures);
+        return 1;
+    }
+    printf("All instance packing conversions are bit-exact\n");
+    return 0;
+}
@@ -0,0 +1,344 @@
+/*
+Scripted load tests of the governors in XrApiPerformance.h.
+
+Every test feeds a deterministic xrFrameTiming sequence, computed from a simple model of how
+the frame cost responds to the governor's decisions, and checks the decisions frame by frame.
+
+Returns 0 if all checks pass.
+*/
+
+#include <stdio.h>
+#include "XrApiPerformance.h"
+
+#define REFRESH_RATE 72.0f
+
+static int Failures = 0;
+
+static void Check(const bool condition, const char* what, const double time) {
+    if (!condition) {
+        if (Failures < 16) {
+            printf("t = %.3f: %s\n", time, what);
+        }
+        Failures++;
+    }
+}
+
+static xrFrameTiming CreateTiming(const float budget, const float cpuTime, const float gpuTime) {
+    xrFrameTiming timing;
+    memset(&timing, 0, sizeof(timing));
+    timing.FrameBudget = budget;
+    timing.CpuTime = cpuTime;
+    timing.GpuTime = gpuTime;
+    timing.FrameInterval = budget;
+    return timing;
+}
+
+//-----------------------------------------------------------------
+// Foveation governor.
+//-----------------------------------------------------------------
+
+// GPU time in seconds of the scripted trace at level 0, with spikes to 115-130% of the budget.
+static float FoveationTraceGpuTime(const double time) {
+    if (time >= 10.0 && time < 20.0) {
+        return 0.016f;
+    }
+    if (time >= 30.0 && time < 32.0) {
+        return 0.018f;
+    }
+    if (time >= 40.0 && time < 50.0) {
+        return 0.0135f;
+    }
+    return 0.011f;
+}
+
+static void TestFoveationSpikes(void) {
+    const xrFoveationGovernorParms parms = xrapiDefaultFoveationGovernorParms();
+    const float budget = 1.0f / REFRESH_RATE;
+    // Load steps of the trace, and how long the governor may take to react to one.
+    const double loadSteps[] = {10.0, 20.0, 30.0, 32.0, 40.0, 50.0};
+    const double settleTime = 1.5;
+
+    xrFoveationGovernor governor;
+    xrFoveationGovernor_Init(&governor, &parms, 0, 0.0);
+    // Times of the stale frames within the last second.
+    double staleTimes[(int)REFRESH_RATE];
+    int staleCount = 0;
+    int totalStale = 0;
+    double lastChange = 0.0;
+    for (int frame = 0; frame < 60 * (int)REFRESH_RATE; frame++) {
+        const double time = (frame + 1) * (double)budget;
+        // Every level saves 8% of the GPU time. Frames over budget miss the display time.
+        const float gpuTime = FoveationTraceGpuTime(time) * (1.0f - 0.08f * governor.Level);
+        int kept = 0;
+        for (int i = 0; i < staleCount; i++) {
+            if (staleTimes[i] > time - 1.0) {
+                staleTimes[kept++] = staleTimes[i];
+            }
+        }
+        staleCount = kept;
+        if (gpuTime > budget) {
+            staleTimes[staleCount++] = time;
+            totalStale++;
+        }
+
+        bool settling = false;
+        for (int i = 0; i < 6; i++) {
+            settling |= time >= loadSteps[i] && time < loadSteps[i] + settleTime;
+        }
+        Check(
+            settling || staleCount <= parms.StaleFramesBudget,
+            "stale frames over budget after settling",
+            time);
+
+        const xrFrameTiming timing = CreateTiming(budget, 0.004f, gpuTime);
+        const int level = governor.Level;
+        xrFoveationGovernor_Update(&governor, &timing, (float)staleCount, time);
+        Check(
+            governor.Level >= level - 1 && governor.Level <= level + 1,
+            "level stepped by more than one",
+            time);
+        if (governor.Level > level) {
+            Check(time - lastChange >= parms.RaiseDwellTime, "raised within the dwell", time);
+            lastChange = time;
+        } else if (governor.Level < level) {
+            Check(time - lastChange >= parms.LowerDwellTime, "lowered within the dwell", time);
+            lastChange = time;
+        }
+
+        // The level is back at the minimum before the next spike and at the end.
+        if (frame == (int)(29.9 * REFRESH_RATE) || frame == (int)(59.9 * REFRESH_RATE)) {
+            Check(governor.Level == parms.MinLevel, "level did not return to the minimum", time);
+        }
+        // The level is raised during each long spike.
+        if (frame == (int)(19.9 * REFRESH_RATE) || frame == (int)(49.9 * REFRESH_RATE)) {
+            Check(governor.Level > parms.MinLevel, "level not raised during a spike", time);
+        }
+    }
+    printf("foveation: %u level changes, %d stale frames\n", governor.Changes, totalStale);
+}
+
+static void TestFoveationHysteresis(void) {
+    // Without the integral term the continuous level is 2 * ( load - target ), so the load
+    // sets it directly.
+    xrFoveationGovernorParms parms = xrapiDefaultFoveationGovernorParms();
+    parms.Ki = 0.0f;
+    const float budget = 1.0f / REFRESH_RATE;
+
+    xrFoveationGovernor governor;
+    xrFoveationGovernor_Init(&governor, &parms, 0, 0.0);
+    double time = 0.0;
+    // Load for a continuous level, and the level expected after 10 seconds of it.
+    const float outputs[] = {0.6f, 0.8f, 0.6f, 0.3f, 0.2f, 1.6f, 1.9f, 1.4f, 1.2f};
+    const int levels[] = {0, 1, 1, 1, 0, 1, 2, 2, 1};
+    for (int step = 0; step < 9; step++) {
+        const float load = parms.TargetLoad + outputs[step] / parms.Kp;
+        const xrFrameTiming timing = CreateTiming(budget, 0.004f, load * budget);
+        for (int frame = 0; frame < 10 * (int)REFRESH_RATE; frame++) {
+            time += budget;
+            xrFoveationGovernor_Update(&governor, &timing, 0.0f, time);
+        }
+        Check(governor.Level == levels[step], "hysteresis did not hold", time);
+    }
+    Check(governor.Changes == 5, "unexpected number of level changes", time);
+}
+
+static void TestFoveationWithoutGpuTime(void) {
+    const xrFoveationGovernorParms parms = xrapiDefaultFoveationGovernorParms();
+    const float budget = 1.0f / REFRESH_RATE;
+    xrFoveationGovernor governor;
+    xrFoveationGovernor_Init(&governor, &parms, 2, 0.0);
+    const xrFoveationGovernor before = governor;
+    // The submit wait fills the budget, which must not read as GPU load.
+    xrFrameTiming timing = CreateTiming(budget, 0.004f, 0.0f);
+    timing.SubmitWaitTime = budget - timing.CpuTime;
+    double time = 0.0;
+    for (int frame = 0; frame < 60 * (int)REFRESH_RATE; frame++) {
+        time += budget;
+        xrFoveationGovernor_Update(&governor, &timing, 0.0f, time);
+    }
+    Check(
+        governor.Level == before.Level && governor.Integral == before.Integral &&
+            governor.Changes == 0,
+        "frames without a GPU time changed the governor",
+        time);
+}
+
+//-----------------------------------------------------------------
+// Clock level governor.
+//-----------------------------------------------------------------
+
+static void TestClockLevels(void) {
+    const xrClockGovernorParms parms = xrapiDefaultClockGovernorParms();
+    const float budget = 1.0f / REFRESH_RATE;
+    xrClockGovernor governor;
+    xrClockGovernor_Init(&governor, &parms, 2, 2);
+    // 0-20 s light, 20-40 s more CPU work than the top level can do, 40-60 s heavy GPU work,
+    // throttled from 50 s on, 60-120 s light again. Work is in seconds at the top level.
+    int throttleCpuCap = -1;
+    int throttleGpuCap = -1;
+    for (int frame = 0; frame < 120 * (int)REFRESH_RATE; frame++) {
+        const double time = (frame + 1) * (double)budget;
+        const float cpuWork = (time >= 20.0 && time < 40.0) ? 0.016f : 0.004f;
+        const float gpuWork = (time >= 40.0 && time < 60.0) ? 0.0125f : 0.005f;
+        const bool throttled = time >= 50.0 && time < 55.0;
+        if (throttled && throttleCpuCap < 0) {
+            throttleCpuCap = governor.CpuLevel - 1;
+            throttleGpuCap = governor.GpuLevel - 1;
+        }
+        const float cpuTime = cpuWork / parms.LevelPerformance[governor.CpuLevel];
+        const float gpuTime = gpuWork / parms.LevelPerformance[governor.GpuLevel];
+        xrFrameTiming timing = CreateTiming(budget, cpuTime, gpuTime);
+        timing.FrameInterval = (cpuTime > budget || gpuTime > budget) ? 2.0f * budget : budget;
+        xrClockGovernor_Update(&governor, &timing, throttled, time);
+
+        Check(
+            governor.CpuLevel >= 0 && governor.CpuLevel <= XRAPI_CLOCK_LEVEL_MAX &&
+                governor.GpuLevel >= 0 && governor.GpuLevel <= XRAPI_CLOCK_LEVEL_MAX,
+            "clock level out of range",
+            time);
+        if (frame == (int)(39.9 * REFRESH_RATE)) {
+            Check(governor.CpuLevel == XRAPI_CLOCK_LEVEL_MAX, "CPU level not at the top", time);
+        }
+        if (frame == (int)(49.9 * REFRESH_RATE)) {
+            Check(governor.GpuLevel == XRAPI_CLOCK_LEVEL_MAX, "GPU level not at the top", time);
+        }
+        if (throttled) {
+            Check(
+                governor.CpuLevel <= throttleCpuCap && governor.GpuLevel <= throttleGpuCap,
+                "levels above the throttling cap",
+                time);
+        }
+        if (frame == (int)(119.9 * REFRESH_RATE)) {
+            Check(
+                governor.CpuLevel == 0 && governor.GpuLevel == 0,
+                "levels not lowered for the light load",
+                time);
+        }
+    }
+    printf(
+        "clock levels: %u frames delivered, %u missed, %.1f frames per energy\n",
+        governor.FramesDelivered,
+        governor.FramesMissed,
+        xrClockGovernor_FramesPerEnergy(&governor));
+}
+
+//-----------------------------------------------------------------
+// Display refresh rate manager.
+//-----------------------------------------------------------------
+
+// Frame cost in seconds of the scripted workload trace: light, heavy, very heavy, then light
+// with a spike every 13th frame.
+static float RefreshRateTraceCost(const double time, const int frame) {
+    if (time < 30.0) {
+        return 0.0065f;
+    }
+    if (time < 60.0) {
+        return 0.0155f;
+    }
+    if (time < 90.0) {
+        return 0.020f;
+    }
+    return (frame % 13 == 0) ? 0.011f : 0.0067f;
+}
+
+static void TestRefreshRates(void) {
+    const xrRefreshRateManagerParms parms = xrapiDefaultRefreshRateManagerParms();
+    const float supportedRates[] = {72.0f, 90.0f, 60.0f, 120.0f};
+    xrRefreshRateManager manager;
+    xrRefreshRateManager_Init(&manager, &parms, supportedRates, 4, 72.0f, 1, 0.0);
+
+    // Fastest to slowest, with a swap interval of 2 only where no refresh rate gives the rate.
+    const float ladderRates[] = {120.0f, 90.0f, 72.0f, 60.0f, 90.0f, 72.0f, 60.0f};
+    const int ladderSwaps[] = {1, 1, 1, 1, 2, 2, 2};
+    Check(manager.NumConfigs == 7, "unexpected number of configurations", 0.0);
+    for (int i = 0; i < manager.NumConfigs && i < 7; i++) {
+        Check(
+            manager.Configs[i].RefreshRate == ladderRates[i] &&
+                manager.Configs[i].SwapInterval == ladderSwaps[i],
+            "unexpected configuration ladder",
+            0.0);
+    }
+
+    // Every change, with the earliest and latest time it may happen after the load step or,
+    // for a negative step, after the previous change. A step down happens within one window
+    // of the load step. A step up needs an affordable window and then RaiseDwellTime.
+    typedef struct {
+        float RefreshRate;
+        int SwapInterval;
+        double Step;
+        double Earliest;
+        double Latest;
+    } ExpectedChange;
+    const double window = parms.WindowTime + 1.0 / 30.0;
+    const double raise = parms.RaiseDwellTime;
+    const ExpectedChange expected[] = {
+        {90.0f, 1, 0.0, raise, raise + 2.0 * window},
+        {60.0f, 1, 30.0, 0.0, window},
+        {90.0f, 2, 60.0, 0.0, window},
+        {60.0f, 1, 90.0, raise, raise + 2.0 * window},
+        {72.0f, 1, -1.0, raise, raise + 2.0 * window},
+        {90.0f, 1, -1.0, raise, raise + 2.0 * window},
+    };
+    const int expectedCount = sizeof(expected) / sizeof(expected[0]);
+    // Load increases, after which frames may be missed for one window.
+    const double loadSteps[] = {30.0, 60.0};
+
+    double time = 0.0;
+    double lastChange = 0.0;
+    int frames = 0;
+    int missed = 0;
+    while (time < 150.0) {
+        const float period = manager.SwapInterval / manager.RefreshRate;
+        const float cost = RefreshRateTraceCost(time, frames);
+        if (cost > period) {
+            missed++;
+            bool afterStep = false;
+            for (int i = 0; i < 2; i++) {
+                afterStep |= time >= loadSteps[i] && time < loadSteps[i] + window;
+            }
+            Check(afterStep, "frame missed outside the window after a load step", time);
+        }
+        xrFrameTiming timing = CreateTiming(period, 0.8f * cost, cost);
+        if (xrRefreshRateManager_Update(&manager, &timing, time)) {
+            const int change = (int)manager.Changes - 1;
+            if (change < expectedCount) {
+                const ExpectedChange* e = &expected[change];
+                Check(
+                    manager.RefreshRate == e->RefreshRate &&
+                        manager.SwapInterval == e->SwapInterval,
+                    "unexpected configuration",
+                    time);
+                const double start = (e->Step < 0.0) ? lastChange : e->Step;
+                Check(
+                    time >= start + e->Earliest && time <= start + e->Latest,
+                    "change at the wrong time",
+                    time);
+            }
+            lastChange = time;
+            printf(
+                "refresh rate: frame %d, t = %.2f: %.0f Hz, swap interval %d\n",
+                frames,
+                time,
+                manager.RefreshRate,
+                manager.SwapInterval);
+        }
+        frames++;
+        time += period;
+    }
+    Check(manager.Changes == (uint32_t)expectedCount, "unexpected number of changes", time);
+    printf("refresh rate: %d frames, %d missed\n", frames, missed);
+}
+
+int main(void) {
+    TestFoveationSpikes();
+    TestFoveationHysteresis();
+    TestFoveationWithoutGpuTime();
+    TestClockLevels();
+    TestRefreshRates();
+    if (Failures > 0) {
+        printf("%d failures\n", Failures);
+        return 1;
+    }
+    printf("All performance governor checks pass\n");
+    return 0;
+}
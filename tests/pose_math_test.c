@@ -0,0 +1,231 @@
+/*
+Batch kernel test of XrApiMath.h.
+
+Every batch function on structure of arrays poses is compared with the same operation on
+4x4 matrices from xrapiGetTransformFromPose(), or for the interpolations with the scalar
+xrQuatf function, over random poses. The count is not a multiple of four, so both the four
+wide loop and the scalar tail run. The stated tolerances are the largest absolute
+difference of any matrix element or component:
+
+    xrPosefSoA_Multiply, xrPosefSoA_Inverse     2e-6 for the rotation, 1e-5 for positions
+    xrPosef_TransformPoints                     1e-5
+    xrQuatfSoA_Nlerp                            1e-6
+    xrQuatfSoA_Slerp                            3e-5, as documented for the NEON path
+
+Positions are within 4 meters of the origin, so the position tolerances are a few float
+steps. Running the batches in place must give the same result as into separate arrays.
+
+Returns 0 if all checks pass.
+*/
+
+#include "XrApiMath.h"
+#include "XrApiHelpers.h"
+#include <stdio.h>
+
+#define COUNT 1001
+#define ROTATION_TOLERANCE 2e-6f
+#define POSITION_TOLERANCE 1e-5f
+#define NLERP_TOLERANCE 1e-6f
+#define SLERP_TOLERANCE 3e-5f
+
+static int Failures = 0;
+
+static void Check(const bool condition, const char* what, const int i) {
+    if (!condition) {
+        if (Failures < 16) {
+            printf("%d: %s\n", i, what);
+        }
+        Failures++;
+    }
+}
+
+static uint32_t Seed = 1;
+
+// Uniform in [-1, 1].
+static float Random(void) {
+    Seed = Seed * 1103515245u + 12345u;
+    return (float)(Seed >> 8) / (float)(1 << 23) - 1.0f;
+}
+
+static xrQuatf RandomQuat(void) {
+    for (;;) {
+        const xrQuatf q = {Random(), Random(), Random(), Random()};
+        if (xrQuatf_Dot(&q, &q) > 0.01f) {
+            return xrQuatf_Normalize(&q);
+        }
+    }
+}
+
+static xrPosef RandomPose(void) {
+    xrPosef pose;
+    pose.Orientation = RandomQuat();
+    pose.Position.x = 2.0f * Random();
+    pose.Position.y = 2.0f * Random();
+    pose.Position.z = 2.0f * Random();
+    return pose;
+}
+
+// Component arrays of one batch.
+typedef struct Batch_ {
+    float Values[7][COUNT];
+    xrPosefSoA Soa;
+} Batch;
+
+static void Batch_Init(Batch* batch) {
+    batch->Soa.Orientation.x = batch->Values[0];
+    batch->Soa.Orientation.y = batch->Values[1];
+    batch->Soa.Orientation.z = batch->Values[2];
+    batch->Soa.Orientation.w = batch->Values[3];
+    batch->Soa.Position.x = batch->Values[4];
+    batch->Soa.Position.y = batch->Values[5];
+    batch->Soa.Position.z = batch->Values[6];
+}
+
+static float MaxDifference(const float* a, const float* b, const int count) {
+    float difference = 0.0f;
+    for (int i = 0; i < count; i++) {
+        const float d = fabsf(a[i] - b[i]);
+        difference = (d > difference) ? d : difference;
+    }
+    return difference;
+}
+
+// Compares the upper 3x4 of two transforms.
+static void
+CheckTransform(const xrMatrix4f* got, const xrMatrix4f* want, const char* what, const int i) {
+    bool match = true;
+    for (int row = 0; row < 3; row++) {
+        match &= MaxDifference(got->M[row], want->M[row], 3) <= ROTATION_TOLERANCE;
+        match &= fabsf(got->M[row][3] - want->M[row][3]) <= POSITION_TOLERANCE;
+    }
+    Check(match, what, i);
+}
+
+static Batch A;
+static Batch B;
+static Batch Out;
+static xrPosef PosesA[COUNT];
+static xrPosef PosesB[COUNT];
+
+static void TestMultiply(void) {
+    xrPosefSoA_Multiply(&Out.Soa, &A.Soa, &B.Soa, COUNT);
+    for (int i = 0; i < COUNT; i++) {
+        const xrMatrix4f a = xrapiGetTransformFromPose(&PosesA[i]);
+        const xrMatrix4f b = xrapiGetTransformFromPose(&PosesB[i]);
+        const xrMatrix4f want = xrMatrix4f_Multiply(&a, &b);
+        const xrPosef pose = xrPosefSoA_Get(&Out.Soa, i);
+        const xrMatrix4f got = xrapiGetTransformFromPose(&pose);
+        CheckTransform(&got, &want, "xrPosefSoA_Multiply differs from xrMatrix4f_Multiply", i);
+    }
+
+    // In place into the first input.
+    Batch inPlace = A;
+    Batch_Init(&inPlace);
+    xrPosefSoA_Multiply(&inPlace.Soa, &inPlace.Soa, &B.Soa, COUNT);
+    Check(
+        memcmp(inPlace.Values, Out.Values, sizeof(Out.Values)) == 0,
+        "xrPosefSoA_Multiply in place differs",
+        -1);
+}
+
+static void TestInverse(void) {
+    xrPosefSoA_Inverse(&Out.Soa, &A.Soa, COUNT);
+    for (int i = 0; i < COUNT; i++) {
+        const xrMatrix4f a = xrapiGetTransformFromPose(&PosesA[i]);
+        const xrMatrix4f want = xrMatrix4f_Inverse(&a);
+        const xrPosef pose = xrPosefSoA_Get(&Out.Soa, i);
+        const xrMatrix4f got = xrapiGetTransformFromPose(&pose);
+        CheckTransform(&got, &want, "xrPosefSoA_Inverse differs from xrMatrix4f_Inverse", i);
+    }
+
+    Batch inPlace = A;
+    Batch_Init(&inPlace);
+    xrPosefSoA_Inverse(&inPlace.Soa, &inPlace.Soa, COUNT);
+    Check(
+        memcmp(inPlace.Values, Out.Values, sizeof(Out.Values)) == 0,
+        "xrPosefSoA_Inverse in place differs",
+        -1);
+}
+
+static void TestTransformPoints(void) {
+    // The positions of B are the points.
+    const xrVector3fSoA* points = &B.Soa.Position;
+    xrPosef_TransformPoints(&Out.Soa.Position, &PosesA[0], points, COUNT);
+    const xrMatrix4f transform = xrapiGetTransformFromPose(&PosesA[0]);
+    for (int i = 0; i < COUNT; i++) {
+        const xrVector4f p = {points->x[i], points->y[i], points->z[i], 1.0f};
+        const xrVector4f want = xrVector4f_MultiplyMatrix4f(&transform, &p);
+        const xrVector3f got = xrVector3fSoA_Get(&Out.Soa.Position, i);
+        Check(
+            fabsf(got.x - want.x) <= POSITION_TOLERANCE &&
+                fabsf(got.y - want.y) <= POSITION_TOLERANCE &&
+                fabsf(got.z - want.z) <= POSITION_TOLERANCE,
+            "xrPosef_TransformPoints differs from the matrix",
+            i);
+    }
+
+    Batch inPlace = B;
+    Batch_Init(&inPlace);
+    xrPosef_TransformPoints(&inPlace.Soa.Position, &PosesA[0], &inPlace.Soa.Position, COUNT);
+    Check(
+        memcmp(inPlace.Values[4], Out.Values[4], 3 * sizeof(Out.Values[4])) == 0,
+        "xrPosef_TransformPoints in place differs",
+        -1);
+}
+
+static void TestInterpolation(void) {
+    const float ts[4] = {0.0f, 0.25f, 0.5f, 0.9f};
+    for (int j = 0; j < 4; j++) {
+        const float t = ts[j];
+        xrQuatfSoA_Nlerp(&Out.Soa.Orientation, &A.Soa.Orientation, &B.Soa.Orientation, t, COUNT);
+        for (int i = 0; i < COUNT; i++) {
+            const xrQuatf want = xrQuatf_Nlerp(&PosesA[i].Orientation, &PosesB[i].Orientation, t);
+            const xrQuatf got = xrQuatfSoA_Get(&Out.Soa.Orientation, i);
+            Check(
+                MaxDifference(&got.x, &want.x, 4) <= NLERP_TOLERANCE,
+                "xrQuatfSoA_Nlerp differs from xrQuatf_Nlerp",
+                i);
+        }
+
+        xrQuatfSoA_Slerp(&Out.Soa.Orientation, &A.Soa.Orientation, &B.Soa.Orientation, t, COUNT);
+        for (int i = 0; i < COUNT; i++) {
+            const xrQuatf want = xrQuatf_Slerp(&PosesA[i].Orientation, &PosesB[i].Orientation, t);
+            const xrQuatf got = xrQuatfSoA_Get(&Out.Soa.Orientation, i);
+            Check(
+                MaxDifference(&got.x, &want.x, 4) <= SLERP_TOLERANCE,
+                "xrQuatfSoA_Slerp differs from xrQuatf_Slerp",
+                i);
+        }
+    }
+}
+
+int main(void) {
+    Batch_Init(&A);
+    Batch_Init(&B);
+    Batch_Init(&Out);
+    for (int i = 0; i < COUNT; i++) {
+        PosesA[i] = RandomPose();
+        PosesB[i] = RandomPose();
+        // Every fourth pair is close together, like consecutive animation samples.
+        if (i % 4 == 1) {
+            const xrVector3f rotation = {0.01f * Random(), 0.01f * Random(), 0.01f * Random()};
+            PosesB[i].Orientation = xrQuatf_Integrate(&PosesA[i].Orientation, &rotation);
+        }
+    }
+    xrPosefSoA_Load(&A.Soa, PosesA, COUNT);
+    xrPosefSoA_Load(&B.Soa, PosesB, COUNT);
+    xrPosef stored[COUNT];
+    xrPosefSoA_Store(stored, &A.Soa, COUNT);
+    Check(memcmp(stored, PosesA, sizeof(stored)) == 0, "Load and Store do not round-trip", -1);
+
+    TestMultiply();
+    TestInverse();
+    TestTransformPoints();
+    TestInterpolation();
+    if (Failures > 0) {
+        printf("%d failures\n", Failures);
+        return 1;
+    }
+    printf("All batch kernels match\n");
+    return 0;
+}
@@ -0,0 +1,270 @@
+/*
+Cache file test of XrApiProgramCache.h.
+
+A fake xrProgramCacheBackend stands in for glGetProgramBinary() and glProgramBinary(). Each
+check goes through the Stats counters and the file in the cache directory: a miss followed by
+a store and a hit, a truncated file and a file with a bad checksum being rejected and deleted,
+a binary the driver rejects being deleted, and a different driver string changing the key.
+
+Returns 0 if all checks pass.
+*/
+
+// First, to check that it includes everything it uses.
+#include "XrApiProgramCache.h"
+#include <stdio.h>
+
+#define CACHE_DIRECTORY "program_cache_test.dir"
+#define BINARY_SIZE 3000
+#define BINARY_FORMAT 0x8741
+
+static int Failures = 0;
+
+static void Check(const bool condition, const char* what) {
+    if (!condition) {
+        if (Failures < 16) {
+            printf("%s\n", what);
+        }
+        Failures++;
+    }
+}
+
+//-----------------------------------------------------------------
+// Fake driver.
+//-----------------------------------------------------------------
+
+typedef struct FakeDriver_ {
+    // When set, LoadBinary() rejects every binary, like a driver after an update.
+    bool RejectBinaries;
+    int LoadCalls;
+    unsigned int LoadedProgram;
+} FakeDriver;
+
+// The binary of a linked program depends on the program only.
+static uint8_t FakeDriver_Byte(const unsigned int program, const int i) {
+    return (uint8_t)(program * 31 + i * 7 + (i >> 8));
+}
+
+static int FakeDriver_GetBinarySize(void* userData, unsigned int program) {
+    (void)userData;
+    (void)program;
+    return BINARY_SIZE;
+}
+
+static bool FakeDriver_GetBinary(
+    void* userData,
+    unsigned int program,
+    void* binary,
+    int size,
+    unsigned int* format) {
+    (void)userData;
+    uint8_t* bytes = (uint8_t*)binary;
+    for (int i = 0; i < size; i++) {
+        bytes[i] = FakeDriver_Byte(program, i);
+    }
+    *format = BINARY_FORMAT;
+    return true;
+}
+
+static bool FakeDriver_LoadBinary(
+    void* userData,
+    unsigned int program,
+    unsigned int format,
+    const void* binary,
+    int size) {
+    FakeDriver* driver = (FakeDriver*)userData;
+    driver->LoadCalls++;
+    if (driver->RejectBinaries || format != BINARY_FORMAT || size != BINARY_SIZE) {
+        return false;
+    }
+    // Binaries are only ever stored from program 1.
+    const uint8_t* bytes = (const uint8_t*)binary;
+    for (int i = 0; i < size; i++) {
+        if (bytes[i] != FakeDriver_Byte(1, i)) {
+            return false;
+        }
+    }
+    driver->LoadedProgram = program;
+    return true;
+}
+
+static FakeDriver Driver;
+
+static void InitCache(xrProgramCache* cache, const char* driverVersion) {
+    xrProgramCacheBackend backend;
+    backend.UserData = &Driver;
+    backend.GetBinarySize = FakeDriver_GetBinarySize;
+    backend.GetBinary = FakeDriver_GetBinary;
+    backend.LoadBinary = FakeDriver_LoadBinary;
+    const bool initialized = xrProgramCache_Init(cache, CACHE_DIRECTORY, driverVersion, &backend);
+    Check(initialized && xrProgramCache_IsEnabled(cache), "cache not initialized");
+}
+
+static const char* const Sources[] = {
+    "#version 300 es\n",
+    "#define NUM_VIEWS 2\n",
+    "void main() { gl_Position = vec4( 0.0 ); }\n",
+    "#version 300 es\n",
+    "out lowp vec4 outColor;\nvoid main() { outColor = vec4( 1.0 ); }\n",
+};
+
+// Returns the size of the cache file with 'key', or -1 if there is none.
+static long FileSize(const xrProgramCache* cache, const uint64_t key) {
+    char path[640];
+    xrProgramCache_GetPath(cache, key, path, sizeof(path));
+    struct stat st;
+    return (stat(path, &st) == 0) ? (long)st.st_size : -1;
+}
+
+static bool StatsEqual(
+    const xrProgramCache* cache,
+    const uint32_t hits,
+    const uint32_t misses,
+    const uint32_t rejected,
+    const uint32_t stored) {
+    return cache->Stats.Hits == hits && cache->Stats.Misses == misses &&
+        cache->Stats.Rejected == rejected && cache->Stats.Stored == stored;
+}
+
+// Overwrites the cache file with 'key' so it only holds its first 'size' bytes, with the byte
+// at 'flip' inverted unless it is negative.
+static void
+DamageFile(const xrProgramCache* cache, const uint64_t key, const long size, const long flip) {
+    char path[640];
+    xrProgramCache_GetPath(cache, key, path, sizeof(path));
+    static uint8_t contents[sizeof(xrProgramCacheFileHeader) + BINARY_SIZE];
+    FILE* file = fopen(path, "rb");
+    const size_t read = (file != NULL) ? fread(contents, 1, sizeof(contents), file) : 0;
+    if (file != NULL) {
+        fclose(file);
+    }
+    Check(read == sizeof(contents), "cache file cannot be read back");
+    if (flip >= 0) {
+        contents[flip] ^= 0xFF;
+    }
+    file = fopen(path, "wb");
+    Check(file != NULL && fwrite(contents, 1, size, file) == (size_t)size, "cannot damage file");
+    if (file != NULL) {
+        fclose(file);
+    }
+}
+
+static void TestMissStoreHit(xrProgramCache* cache, const uint64_t key) {
+    const long fileSize = (long)(sizeof(xrProgramCacheFileHeader) + BINARY_SIZE);
+    Check(FileSize(cache, key) == -1, "cache file before the first store");
+    Check(!xrProgramCache_Load(cache, key, 1), "load without a cache file");
+    Check(StatsEqual(cache, 0, 1, 0, 0), "miss not counted");
+    Check(Driver.LoadCalls == 0, "driver called without a cache file");
+
+    Check(xrProgramCache_Store(cache, key, 1), "store failed");
+    Check(StatsEqual(cache, 0, 1, 0, 1), "store not counted");
+    Check(FileSize(cache, key) == fileSize, "cache file has the wrong size");
+
+    Check(xrProgramCache_Load(cache, key, 2), "load of a stored binary failed");
+    Check(StatsEqual(cache, 1, 1, 0, 1), "hit not counted");
+    Check(Driver.LoadedProgram == 2, "binary not loaded into the program");
+    Check(FileSize(cache, key) == fileSize, "cache file changed by a hit");
+}
+
+static void TestCorruptFiles(xrProgramCache* cache, const uint64_t key) {
+    const long headerSize = (long)sizeof(xrProgramCacheFileHeader);
+    const long fileSize = headerSize + BINARY_SIZE;
+    const int loadCalls = Driver.LoadCalls;
+
+    // Cut off in the middle of the binary.
+    DamageFile(cache, key, fileSize - 1, -1);
+    Check(!xrProgramCache_Load(cache, key, 3), "truncated file loaded");
+    Check(StatsEqual(cache, 1, 1, 1, 1), "truncated file not counted as rejected");
+    Check(FileSize(cache, key) == -1, "truncated file not deleted");
+
+    // Cut off in the middle of the header.
+    Check(xrProgramCache_Store(cache, key, 1), "store after a truncated file failed");
+    DamageFile(cache, key, headerSize / 2, -1);
+    Check(!xrProgramCache_Load(cache, key, 3), "truncated header loaded");
+    Check(StatsEqual(cache, 1, 1, 2, 2), "truncated header not counted as rejected");
+    Check(FileSize(cache, key) == -1, "file with a truncated header not deleted");
+
+    // One byte of the binary changed.
+    Check(xrProgramCache_Store(cache, key, 1), "store after a truncated header failed");
+    DamageFile(cache, key, fileSize, headerSize + BINARY_SIZE / 2);
+    Check(!xrProgramCache_Load(cache, key, 3), "file with a bad checksum loaded");
+    Check(StatsEqual(cache, 1, 1, 3, 3), "bad checksum not counted as rejected");
+    Check(FileSize(cache, key) == -1, "file with a bad checksum not deleted");
+
+    // None of them may reach the driver.
+    Check(Driver.LoadCalls == loadCalls, "corrupt binary passed to the driver");
+
+    Check(xrProgramCache_Store(cache, key, 1), "store after a bad checksum failed");
+    Check(xrProgramCache_Load(cache, key, 4), "load after a bad checksum failed");
+    Check(StatsEqual(cache, 2, 1, 3, 4), "hit after a bad checksum not counted");
+}
+
+static void TestDriverRejection(xrProgramCache* cache, const uint64_t key) {
+    const int loadCalls = Driver.LoadCalls;
+    Driver.RejectBinaries = true;
+    Check(!xrProgramCache_Load(cache, key, 5), "binary rejected by the driver loaded");
+    Check(Driver.LoadCalls == loadCalls + 1, "driver not asked to load the binary");
+    Check(StatsEqual(cache, 2, 1, 4, 4), "driver rejection not counted");
+    Check(FileSize(cache, key) == -1, "file rejected by the driver not deleted");
+
+    // The program is then built from source and stored again.
+    Check(!xrProgramCache_Load(cache, key, 5), "load after a rejection");
+    Check(StatsEqual(cache, 2, 2, 4, 4), "miss after a rejection not counted");
+    Driver.RejectBinaries = false;
+    Check(xrProgramCache_Store(cache, key, 1), "store after a rejection failed");
+    Check(xrProgramCache_Load(cache, key, 6), "load after a rejection failed");
+    Check(StatsEqual(cache, 3, 2, 4, 5), "hit after a rejection not counted");
+}
+
+static void TestDriverVersion(const xrProgramCache* cache, const uint64_t key) {
+    xrProgramCache updated;
+    InitCache(&updated, "Qualcomm Adreno (TM) 650 OpenGL ES 3.2 V@0502.0");
+    const uint64_t updatedKey = xrProgramCache_ComputeKey(&updated, Sources, 5);
+    Check(updatedKey != key, "driver version does not change the key");
+
+    // The binary of the old driver is never looked at.
+    const int loadCalls = Driver.LoadCalls;
+    Check(!xrProgramCache_Load(&updated, updatedKey, 7), "binary of another driver loaded");
+    Check(StatsEqual(&updated, 0, 1, 0, 0), "miss after a driver update not counted");
+    Check(Driver.LoadCalls == loadCalls, "binary of another driver passed to the driver");
+    Check(FileSize(cache, key) > 0, "binary of another driver deleted");
+
+    // The same driver string gives the same key.
+    xrProgramCache same;
+    InitCache(&same, "Qualcomm Adreno (TM) 650 OpenGL ES 3.2 V@0490.0");
+    Check(xrProgramCache_ComputeKey(&same, Sources, 5) == key, "key is not stable");
+
+    // Moving text between source strings changes the key.
+    const char* const split[] = {"#version 300 es\n#define NUM_VIEWS 2", "\n"};
+    const char* const joined[] = {"#version 300 es\n", "#define NUM_VIEWS 2\n"};
+    Check(
+        xrProgramCache_ComputeKey(&same, split, 2) != xrProgramCache_ComputeKey(&same, joined, 2),
+        "source boundaries do not change the key");
+
+    char path[640];
+    xrProgramCache_GetPath(&updated, updatedKey, path, sizeof(path));
+    unlink(path);
+}
+
+int main(void) {
+    xrProgramCache cache;
+    InitCache(&cache, "Qualcomm Adreno (TM) 650 OpenGL ES 3.2 V@0490.0");
+    const uint64_t key = xrProgramCache_ComputeKey(&cache, Sources, 5);
+    // Start from an empty cache if a previous run was interrupted.
+    char path[640];
+    xrProgramCache_GetPath(&cache, key, path, sizeof(path));
+    unlink(path);
+
+    TestMissStoreHit(&cache, key);
+    TestCorruptFiles(&cache, key);
+    TestDriverRejection(&cache, key);
+    TestDriverVersion(&cache, key);
+
+    unlink(path);
+    rmdir(CACHE_DIRECTORY);
+    if (Failures > 0) {
+        printf("%d failures\n", Failures);
+        return 1;
+    }
+    printf("All program cache checks pass\n");
+    return 0;
+}
@@ -0,0 +1,266 @@
+/*
+Golden image test of XrApiReferenceCompositor.h.
+
+The golden images are generated here rather than stored: every case composites layers whose
+expected output follows directly from the source texture, so a change in the mapping,
+sampling, clipping or blending of the compositor shows up as a difference. The same frames
+are also composited repeatedly with one and with several threads, which must give identical
+output.
+
+Returns 0 if all images match.
+*/
+
+// First, so it can request the POSIX declarations it needs under -std=c99.
+#include "XrApiReferenceCompositor.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SIZE 256
+#define CUBE_SIZE 16
+
+// Swap chain handles known to GetImage().
+#define TEXTURE_SWAPCHAIN ((xrTextureSwapChain*)(uintptr_t)0x100)
+#define CUBE_SWAPCHAIN ((xrTextureSwapChain*)(uintptr_t)0x200)
+
+static uint8_t Texels[2 * SIZE * SIZE * 4];
+static uint8_t CubeTexels[6 * CUBE_SIZE * CUBE_SIZE * 4];
+static xrCompositorImage Texture = {SIZE, SIZE, 2, Texels};
+static xrCompositorImage Cube = {CUBE_SIZE, CUBE_SIZE, 6, CubeTexels};
+
+static int Failures = 0;
+
+static const xrCompositorImage*
+GetImage(void* userData, const xrTextureSwapChain* swapChain, int index) {
+    (void)userData;
+    (void)index;
+    return (swapChain == TEXTURE_SWAPCHAIN) ? &Texture
+                                            : ((swapChain == CUBE_SWAPCHAIN) ? &Cube : NULL);
+}
+
+static void CreateTextures(void) {
+    // Red and green ramps with a blue checkerboard, the same in both layers.
+    for (int y = 0; y < SIZE; y++) {
+        for (int x = 0; x < SIZE; x++) {
+            uint8_t* texel = &Texels[(y * SIZE + x) * 4];
+            texel[0] = (uint8_t)x;
+            texel[1] = (uint8_t)y;
+            texel[2] = (((x / 16) + (y / 16)) & 1) ? 255 : 0;
+            texel[3] = 255;
+        }
+    }
+    memcpy(&Texels[SIZE * SIZE * 4], Texels, SIZE * SIZE * 4);
+    // A different red level for every cube face.
+    for (int face = 0; face < 6; face++) {
+        for (int i = 0; i < CUBE_SIZE * CUBE_SIZE; i++) {
+            uint8_t* texel = &CubeTexels[(face * CUBE_SIZE * CUBE_SIZE + i) * 4];
+            texel[0] = (uint8_t)(face * 40);
+            texel[1] = 0;
+            texel[2] = 0;
+            texel[3] = 255;
+        }
+    }
+}
+
+static void CheckImage(
+    const char* name,
+    const xrReferenceCompositor* compositor,
+    const uint8_t* golden,
+    const int tolerance) {
+    static uint8_t output[SIZE * SIZE * 4];
+    for (int eye = 0; eye < XRAPI_FRAME_LAYER_EYE_MAX; eye++) {
+        xrReferenceCompositor_GetImage(compositor, eye, output);
+        size_t differences = 0;
+        const int maxDifference =
+            xrCompositorImage_Compare(output, golden, SIZE, SIZE, &differences);
+        if (maxDifference > tolerance) {
+            printf(
+                "%s eye %d: %zu channels differ, by up to %d\n",
+                name,
+                eye,
+                differences,
+                maxDifference);
+            Failures++;
+        }
+    }
+}
+
+static xrLayerProjection2 CreateProjectionLayer(const xrReferenceCompositorParms* parms) {
+    xrLayerProjection2 layer = xrapiDefaultLayerProjection2();
+    layer.HeadPose.Pose.Orientation.w = 1.0f;
+    for (int eye = 0; eye < XRAPI_FRAME_LAYER_EYE_MAX; eye++) {
+        layer.Textures[eye].ColorSwapChain = TEXTURE_SWAPCHAIN;
+        layer.Textures[eye].TexCoordsFromTanAngles =
+            xrMatrix4f_TanAngleMatrixFromProjection(&parms->Projection[eye]);
+    }
+    return layer;
+}
+
+static void Compose(
+    xrReferenceCompositor* compositor,
+    const xrLayerHeader2** layers,
+    const int layerCount) {
+    xrSubmitFrameDescription2 frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.DisplayTime = 1.0;
+    frame.LayerCount = (uint32_t)layerCount;
+    frame.Layers = layers;
+    const xrQuatf identity = {0.0f, 0.0f, 0.0f, 1.0f};
+    xrReferenceCompositor_Compose(compositor, &frame, &identity);
+}
+
+static void TestGoldenImages(const int threadCount) {
+    xrReferenceCompositorParms parms = xrReferenceCompositor_DefaultParms();
+    parms.Width = SIZE;
+    parms.Height = SIZE;
+    parms.ThreadCount = threadCount;
+    parms.GetImage = GetImage;
+    xrReferenceCompositor compositor;
+    if (!xrReferenceCompositor_Init(&compositor, &parms)) {
+        printf("xrReferenceCompositor_Init failed\n");
+        Failures++;
+        xrReferenceCompositor_Destroy(&compositor);
+        return;
+    }
+
+    static uint8_t golden[SIZE * SIZE * 4];
+
+    // A projection layer rendered with the display projection and pose maps every output
+    // pixel to the texel center with the same coordinates.
+    xrLayerProjection2 projection = CreateProjectionLayer(&parms);
+    const xrLayerHeader2* layers[2] = {&projection.Header, NULL};
+    Compose(&compositor, layers, 1);
+    CheckImage("projection", &compositor, Texels, 0);
+
+    // Black at half alpha blended over it halves the color and leaves 3/4 alpha.
+    xrLayerProjection2 black = projection;
+    black.Header.SrcBlend = XRAPI_FRAME_LAYER_BLEND_SRC_ALPHA;
+    black.Header.DstBlend = XRAPI_FRAME_LAYER_BLEND_ONE_MINUS_SRC_ALPHA;
+    black.Header.ColorScale.w = 0.5f;
+    for (int eye = 0; eye < XRAPI_FRAME_LAYER_EYE_MAX; eye++) {
+        black.Textures[eye].ColorSwapChain =
+            (xrTextureSwapChain*)(uintptr_t)XRAPI_DEFAULT_TEXTURE_SWAPCHAIN_BLACK;
+    }
+    layers[1] = &black.Header;
+    Compose(&compositor, layers, 2);
+    for (int i = 0; i < SIZE * SIZE * 4; i++) {
+        golden[i] = ((i & 3) == 3) ? 191 : (uint8_t)((Texels[i] + 1) / 2);
+    }
+    CheckImage("blend", &compositor, golden, 1);
+
+    // Clipping to the left half of the texture leaves the right half of the output empty.
+    xrLayerProjection2 clipped = projection;
+    clipped.Header.Flags |= XRAPI_FRAME_LAYER_FLAG_CLIP_TO_TEXTURE_RECT;
+    for (int eye = 0; eye < XRAPI_FRAME_LAYER_EYE_MAX; eye++) {
+        clipped.Textures[eye].TextureRect.x = 0.0f;
+        clipped.Textures[eye].TextureRect.y = 0.0f;
+        clipped.Textures[eye].TextureRect.width = 0.5f;
+        clipped.Textures[eye].TextureRect.height = 1.0f;
+    }
+    layers[0] = &clipped.Header;
+    Compose(&compositor, layers, 1);
+    for (int y = 0; y < SIZE; y++) {
+        for (int x = 0; x < SIZE; x++) {
+            const int i = (y * SIZE + x) * 4;
+            for (int c = 0; c < 4; c++) {
+                golden[i + c] = (x < SIZE / 2) ? Texels[i + c] : 0;
+            }
+        }
+    }
+    CheckImage("clip", &compositor, golden, 0);
+
+    // A cube map with the identity matrix looks down -Z, the last face, in every pixel of a
+    // 90 degree field of view.
+    xrLayerCube2 cube = xrapiDefaultLayerCube2();
+    cube.HeadPose.Pose.Orientation.w = 1.0f;
+    cube.TexCoordsFromTanAngles = xrMatrix4f_CreateIdentity();
+    for (int eye = 0; eye < XRAPI_FRAME_LAYER_EYE_MAX; eye++) {
+        cube.Textures[eye].ColorSwapChain = CUBE_SWAPCHAIN;
+    }
+    layers[0] = &cube.Header;
+    Compose(&compositor, layers, 1);
+    for (int i = 0; i < SIZE * SIZE; i++) {
+        golden[i * 4 + 0] = 5 * 40;
+        golden[i * 4 + 1] = 0;
+        golden[i * 4 + 2] = 0;
+        golden[i * 4 + 3] = 255;
+    }
+    CheckImage("cube", &compositor, golden, 0);
+
+    xrReferenceCompositor_Destroy(&compositor);
+}
+
+// Composites a frame with every layer type several times and returns the output of the
+// last frame, which must not depend on the number of threads.
+static float* ComposeAllLayerTypes(const int threadCount, const int frames) {
+    xrReferenceCompositorParms parms = xrReferenceCompositor_DefaultParms();
+    parms.Width = SIZE;
+    parms.Height = SIZE;
+    parms.ThreadCount = threadCount;
+    parms.GetImage = GetImage;
+    xrReferenceCompositor compositor;
+    if (!xrReferenceCompositor_Init(&compositor, &parms)) {
+        xrReferenceCompositor_Destroy(&compositor);
+        return NULL;
+    }
+
+    xrLayerCube2 cube = xrapiDefaultLayerCube2();
+    cube.HeadPose.Pose.Orientation.w = 1.0f;
+    cube.TexCoordsFromTanAngles = xrMatrix4f_CreateIdentity();
+    xrLayerEquirect2 equirect = xrapiDefaultLayerEquirect2();
+    equirect.HeadPose.Pose.Orientation.w = 1.0f;
+    equirect.TexCoordsFromTanAngles = xrMatrix4f_CreateIdentity();
+    xrLayerCylinder2 cylinder = xrapiDefaultLayerCylinder2();
+    cylinder.HeadPose.Pose.Orientation.w = 1.0f;
+    cylinder.Header.SrcBlend = XRAPI_FRAME_LAYER_BLEND_SRC_ALPHA;
+    cylinder.Header.DstBlend = XRAPI_FRAME_LAYER_BLEND_ONE_MINUS_SRC_ALPHA;
+    cylinder.Header.ColorScale.w = 0.5f;
+    for (int eye = 0; eye < XRAPI_FRAME_LAYER_EYE_MAX; eye++) {
+        cube.Textures[eye].ColorSwapChain = CUBE_SWAPCHAIN;
+        equirect.Textures[eye].ColorSwapChain = TEXTURE_SWAPCHAIN;
+        cylinder.Textures[eye].ColorSwapChain = TEXTURE_SWAPCHAIN;
+        cylinder.Textures[eye].TexCoordsFromTanAngles = xrMatrix4f_CreateIdentity();
+    }
+    xrLayerLoadingIcon2 icon = xrapiDefaultLayerLoadingIcon2();
+    const xrLayerHeader2* layers[4] = {
+        &cube.Header, &equirect.Header, &cylinder.Header, &icon.Header};
+    for (int frame = 0; frame < frames; frame++) {
+        Compose(&compositor, layers, 4);
+    }
+
+    const size_t size = (size_t)SIZE * SIZE * 4 * sizeof(float);
+    float* output = (float*)malloc(XRAPI_FRAME_LAYER_EYE_MAX * size);
+    for (int eye = 0; eye < XRAPI_FRAME_LAYER_EYE_MAX; eye++) {
+        memcpy((uint8_t*)output + eye * size, compositor.Output[eye], size);
+    }
+    xrReferenceCompositor_Destroy(&compositor);
+    return output;
+}
+
+static void TestThreads(void) {
+    const size_t size = (size_t)XRAPI_FRAME_LAYER_EYE_MAX * SIZE * SIZE * 4 * sizeof(float);
+    float* reference = ComposeAllLayerTypes(1, 1);
+    for (int threadCount = 2; threadCount <= 8; threadCount *= 2) {
+        float* output = ComposeAllLayerTypes(threadCount, 4);
+        if (reference == NULL || output == NULL || memcmp(reference, output, size) != 0) {
+            printf("%d threads: output differs from a single thread\n", threadCount);
+            Failures++;
+        }
+        free(output);
+    }
+    free(reference);
+}
+
+int main(void) {
+    CreateTextures();
+    TestGoldenImages(1);
+    TestGoldenImages(4);
+    TestThreads();
+    if (Failures > 0) {
+        printf("%d failures\n", Failures);
+        return 1;
+    }
+    printf("All reference compositor images match\n");
+    return 0;
+}
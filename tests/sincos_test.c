@@ -0,0 +1,204 @@
+/*
+Accuracy test of xrSinCos_Array() in XrApiMath.h.
+
+Sweeps every 97th float up to XRAPI_SINCOS_MAX_ARGUMENT with both signs, and every float
+around the first zeros of sine and cosine, and compares each accuracy setting with sin() and
+cos() in double precision rounded to float. The largest error in ulp and the largest
+absolute error must stay within the documented bounds. Arguments past the reduction range,
+infinities and NaNs must give exactly sinf() and cosf(). The rotations from
+xrMatrix4f_CreateRotations() must match xrMatrix4f_CreateRotation().
+
+Returns 0 if all checks pass.
+*/
+
+#include "XrApiMath.h"
+#include "XrApiHelpers.h"
+#include <stdio.h>
+
+// The documented bounds of each accuracy setting.
+#define FULL_MAX_ULP 2
+#define FAST_MAX_ULP 208
+#define FAST_MAX_ERROR 1.5e-5
+
+#define SWEEP_STRIDE 97
+#define BATCH 4096
+
+static int Failures = 0;
+
+static void Check(const bool condition, const char* what, const float x) {
+    if (!condition) {
+        if (Failures < 16) {
+            printf("%.9g: %s\n", x, what);
+        }
+        Failures++;
+    }
+}
+
+// Position of 'f' in the ordered sequence of floats, so that neighbors differ by 1.
+static int64_t OrderedBits(const float f) {
+    int32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return (bits < 0) ? -(int64_t)(bits & 0x7FFFFFFF) : (int64_t)bits;
+}
+
+static int64_t UlpDistance(const float a, const float b) {
+    const int64_t d = OrderedBits(a) - OrderedBits(b);
+    return (d < 0) ? -d : d;
+}
+
+typedef struct ErrorStats_ {
+    int64_t MaxUlp;
+    float MaxUlpArgument;
+    double MaxError;
+    int64_t Count;
+} ErrorStats;
+
+static float Radians[BATCH];
+static int RadianCount = 0;
+
+static void Flush(ErrorStats* stats) {
+    static float sines[BATCH];
+    static float cosines[BATCH];
+    for (int accuracy = 0; accuracy < 2; accuracy++) {
+        xrSinCos_Array(sines, cosines, Radians, RadianCount, (xrSinCosAccuracy)accuracy);
+        ErrorStats* s = &stats[accuracy];
+        for (int i = 0; i < RadianCount; i++) {
+            const double sine = sin((double)Radians[i]);
+            const double cosine = cos((double)Radians[i]);
+            const int64_t sinUlp = UlpDistance(sines[i], (float)sine);
+            const int64_t cosUlp = UlpDistance(cosines[i], (float)cosine);
+            const int64_t ulp = (sinUlp > cosUlp) ? sinUlp : cosUlp;
+            if (ulp > s->MaxUlp) {
+                s->MaxUlp = ulp;
+                s->MaxUlpArgument = Radians[i];
+            }
+            const double sinError = fabs(sines[i] - sine);
+            const double cosError = fabs(cosines[i] - cosine);
+            s->MaxError = (sinError > s->MaxError) ? sinError : s->MaxError;
+            s->MaxError = (cosError > s->MaxError) ? cosError : s->MaxError;
+        }
+        s->Count += RadianCount;
+    }
+    RadianCount = 0;
+}
+
+static void Add(ErrorStats* stats, const float x) {
+    Radians[RadianCount++] = x;
+    Radians[RadianCount++] = -x;
+    if (RadianCount == BATCH) {
+        Flush(stats);
+    }
+}
+
+// Adds every float within 'range' floats of 'center'.
+static void AddNeighbors(ErrorStats* stats, const float center, const int range) {
+    uint32_t bits;
+    memcpy(&bits, &center, sizeof(bits));
+    for (uint32_t b = bits - range; b <= bits + range; b++) {
+        float x;
+        memcpy(&x, &b, sizeof(x));
+        Add(stats, x);
+    }
+}
+
+static void TestSweep(void) {
+    ErrorStats stats[2];
+    memset(stats, 0, sizeof(stats));
+    const float limit = XRAPI_SINCOS_MAX_ARGUMENT;
+    uint32_t limitBits;
+    memcpy(&limitBits, &limit, sizeof(limitBits));
+    for (uint32_t b = 0; b <= limitBits; b += SWEEP_STRIDE) {
+        float x;
+        memcpy(&x, &b, sizeof(x));
+        Add(stats, x);
+    }
+    Add(stats, limit);
+    // Where the reduction cancels the most.
+    for (int k = 1; k <= 8; k++) {
+        AddNeighbors(stats, (float)(k * 1.57079632679489662), 1000);
+    }
+    AddNeighbors(stats, (float)(5215 * 1.57079632679489662), 1000);
+    Flush(stats);
+
+    const char* names[2] = {"FULL", "FAST"};
+    const int64_t maxUlp[2] = {FULL_MAX_ULP, FAST_MAX_ULP};
+    for (int accuracy = 0; accuracy < 2; accuracy++) {
+        const ErrorStats* s = &stats[accuracy];
+        printf(
+            "%s: %lld arguments, at most %lld ulp at %.9g, absolute error %.3g\n",
+            names[accuracy],
+            (long long)s->Count,
+            (long long)s->MaxUlp,
+            s->MaxUlpArgument,
+            s->MaxError);
+        Check(s->MaxUlp <= maxUlp[accuracy], "more ulp than documented", s->MaxUlpArgument);
+    }
+    Check(stats[1].MaxError < FAST_MAX_ERROR, "FAST absolute error larger than documented", 0.0f);
+}
+
+static void TestOutsideRange(void) {
+    const float special[] = {
+        XRAPI_SINCOS_MAX_ARGUMENT * 1.0000001f,
+        -XRAPI_SINCOS_MAX_ARGUMENT * 1.0000001f,
+        12345.678f,
+        1e10f,
+        -3e38f,
+        INFINITY,
+        -INFINITY,
+        NAN,
+    };
+    const int count = (int)(sizeof(special) / sizeof(special[0]));
+    for (int accuracy = 0; accuracy < 2; accuracy++) {
+        float sines[sizeof(special) / sizeof(special[0])];
+        float cosines[sizeof(special) / sizeof(special[0])];
+        xrSinCos_Array(sines, cosines, special, count, (xrSinCosAccuracy)accuracy);
+        for (int i = 0; i < count; i++) {
+            const float sine = sinf(special[i]);
+            const float cosine = cosf(special[i]);
+            const bool sinMatch = (sines[i] == sine) || (isnan(sines[i]) && isnan(sine));
+            const bool cosMatch = (cosines[i] == cosine) || (isnan(cosines[i]) && isnan(cosine));
+            Check(sinMatch && cosMatch, "differs from sinf() and cosf()", special[i]);
+        }
+    }
+}
+
+static void TestRotations(void) {
+    // Not a multiple of the batch size of xrMatrix4f_CreateRotations().
+    enum { COUNT = 77 };
+    xrVector3f radians[COUNT];
+    xrMatrix4f rotations[COUNT];
+    for (int i = 0; i < COUNT; i++) {
+        radians[i].x = 0.1f * i - 3.0f;
+        radians[i].y = 0.37f * i;
+        radians[i].z = -0.05f * i * i;
+    }
+    // Each element multiplies up to three sines and cosines.
+    const float tolerance[2] = {1e-6f, 3.0f * (float)FAST_MAX_ERROR + 1e-6f};
+    for (int accuracy = 0; accuracy < 2; accuracy++) {
+        xrMatrix4f_CreateRotations(rotations, radians, COUNT, (xrSinCosAccuracy)accuracy);
+        for (int i = 0; i < COUNT; i++) {
+            const xrMatrix4f want =
+                xrMatrix4f_CreateRotation(radians[i].x, radians[i].y, radians[i].z);
+            bool match = true;
+            for (int row = 0; row < 4; row++) {
+                for (int column = 0; column < 4; column++) {
+                    const float d = rotations[i].M[row][column] - want.M[row][column];
+                    match &= fabsf(d) <= tolerance[accuracy];
+                }
+            }
+            Check(match, "xrMatrix4f_CreateRotations differs", (float)i);
+        }
+    }
+}
+
+int main(void) {
+    TestSweep();
+    TestOutsideRange();
+    TestRotations();
+    if (Failures > 0) {
+        printf("%d failures\n", Failures);
+        return 1;
+    }
+    printf("All sines and cosines are within the documented bounds\n");
+    return 0;
+}
@@ -0,0 +1,223 @@
+/*
+Reference test of XrApiTimewarp.h.
+
+With the same render and display orientation every output pixel maps to the center of the
+source texel with the same coordinates, so the output must reproduce the source bit-exactly.
+After a small yaw the output must match a projection layer with CLIP_TO_TEXTURE_RECT
+composited by xrReferenceCompositor within the documented 3/255, and cover the same pixels.
+Warps are repeated with one and with several threads, which must give identical output.
+
+Returns 0 if all images match.
+*/
+
+// First, so it can request the POSIX declarations it needs under -std=c99.
+#include "XrApiTimewarp.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SIZE 256
+// The documented difference to xrReferenceCompositor.
+#define COMPOSITOR_TOLERANCE 3
+
+#define TEXTURE_SWAPCHAIN ((xrTextureSwapChain*)(uintptr_t)0x100)
+
+static uint8_t Noise[SIZE * SIZE * 4];
+static uint8_t Pattern[SIZE * SIZE * 4];
+static xrCompositorImage NoiseImage = {SIZE, SIZE, 1, Noise};
+static xrCompositorImage PatternImage = {SIZE, SIZE, 1, Pattern};
+
+static int Failures = 0;
+
+static void Check(const bool condition, const char* what) {
+    if (!condition) {
+        if (Failures < 16) {
+            printf("%s\n", what);
+        }
+        Failures++;
+    }
+}
+
+static void CreateImages(void) {
+    // Every texel differs from its neighbors, so any filtering shows up.
+    uint32_t seed = 1;
+    for (int i = 0; i < SIZE * SIZE * 4; i++) {
+        seed = seed * 1103515245u + 12345u;
+        Noise[i] = (uint8_t)(seed >> 16);
+    }
+    // Red and green ramps with a blue checkerboard, like the compositor test.
+    for (int y = 0; y < SIZE; y++) {
+        for (int x = 0; x < SIZE; x++) {
+            uint8_t* texel = &Pattern[(y * SIZE + x) * 4];
+            texel[0] = (uint8_t)x;
+            texel[1] = (uint8_t)y;
+            texel[2] = (((x / 16) + (y / 16)) & 1) ? 255 : 0;
+            texel[3] = 255;
+        }
+    }
+}
+
+static const xrCompositorImage*
+GetImage(void* userData, const xrTextureSwapChain* swapChain, int index) {
+    (void)userData;
+    (void)index;
+    return (swapChain == TEXTURE_SWAPCHAIN) ? &PatternImage : NULL;
+}
+
+static xrTimewarpParms CreateParms(const xrCompositorImage* source, uint8_t* output) {
+    xrTimewarpParms parms;
+    memset(&parms, 0, sizeof(parms));
+    parms.Source = source;
+    parms.SourceLayer = 0;
+    parms.Output = output;
+    parms.Width = SIZE;
+    parms.Height = SIZE;
+    parms.DisplayProjection =
+        xrMatrix4f_CreateProjectionFov(90.0f, 90.0f, 0.0f, 0.0f, 0.1f, 0.0f);
+    parms.TexCoordsFromTanAngles =
+        xrMatrix4f_TanAngleMatrixFromProjection(&parms.DisplayProjection);
+    parms.RenderOrientation.w = 1.0f;
+    parms.DisplayOrientation.w = 1.0f;
+    return parms;
+}
+
+static xrQuatf CreateYaw(const float degrees) {
+    const float radians = degrees * 3.14159265f / 180.0f;
+    xrQuatf q = {0.0f, sinf(radians * 0.5f), 0.0f, cosf(radians * 0.5f)};
+    return q;
+}
+
+static void TestIdentity(xrTimewarp* timewarp, const char* name) {
+    static uint8_t output[SIZE * SIZE * 4];
+    const xrTimewarpParms parms = CreateParms(&NoiseImage, output);
+    for (int i = 0; i < 3; i++) {
+        memset(output, 0xCD, sizeof(output));
+        const xrTimewarpStats stats = xrTimewarp_Warp(timewarp, &parms);
+        size_t differences = 0;
+        const int maxDifference =
+            xrCompositorImage_Compare(output, Noise, SIZE, SIZE, &differences);
+        if (maxDifference != 0) {
+            printf(
+                "identity %s: %zu channels differ, by up to %d\n",
+                name,
+                differences,
+                maxDifference);
+            Failures++;
+        }
+        Check(stats.OutsidePixels == 0, "identity warp has pixels outside the source");
+    }
+}
+
+static void TestYaw(
+    xrTimewarp* timewarp,
+    const char* name,
+    const float renderDegrees,
+    const float displayDegrees) {
+    xrReferenceCompositorParms compositorParms = xrReferenceCompositor_DefaultParms();
+    compositorParms.Width = SIZE;
+    compositorParms.Height = SIZE;
+    compositorParms.ThreadCount = 1;
+    compositorParms.GetImage = GetImage;
+    xrReferenceCompositor compositor;
+    if (!xrReferenceCompositor_Init(&compositor, &compositorParms)) {
+        printf("xrReferenceCompositor_Init failed\n");
+        Failures++;
+        xrReferenceCompositor_Destroy(&compositor);
+        return;
+    }
+
+    static uint8_t output[SIZE * SIZE * 4];
+    static uint8_t reference[SIZE * SIZE * 4];
+    xrTimewarpParms parms = CreateParms(&PatternImage, output);
+    parms.RenderOrientation = CreateYaw(renderDegrees);
+    parms.DisplayOrientation = CreateYaw(displayDegrees);
+    const xrTimewarpStats stats = xrTimewarp_Warp(timewarp, &parms);
+
+    // The layer is rendered with one orientation and displayed with the other.
+    xrLayerProjection2 layer = xrapiDefaultLayerProjection2();
+    layer.Header.Flags |= XRAPI_FRAME_LAYER_FLAG_CLIP_TO_TEXTURE_RECT;
+    layer.HeadPose.Pose.Orientation = parms.RenderOrientation;
+    for (int eye = 0; eye < XRAPI_FRAME_LAYER_EYE_MAX; eye++) {
+        layer.Textures[eye].ColorSwapChain = TEXTURE_SWAPCHAIN;
+        layer.Textures[eye].TexCoordsFromTanAngles = parms.TexCoordsFromTanAngles;
+    }
+    const xrLayerHeader2* layers[1] = {&layer.Header};
+    xrSubmitFrameDescription2 frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.DisplayTime = 1.0;
+    frame.LayerCount = 1;
+    frame.Layers = layers;
+    xrReferenceCompositor_Compose(&compositor, &frame, &parms.DisplayOrientation);
+    xrReferenceCompositor_GetImage(&compositor, 0, reference);
+    xrReferenceCompositor_Destroy(&compositor);
+
+    size_t differences = 0;
+    const int maxDifference =
+        xrCompositorImage_Compare(output, reference, SIZE, SIZE, &differences);
+    if (maxDifference > COMPOSITOR_TOLERANCE) {
+        printf(
+            "%.1f degree yaw %s: %zu channels differ, by up to %d\n",
+            displayDegrees - renderDegrees,
+            name,
+            differences,
+            maxDifference);
+        Failures++;
+    }
+
+    // The same pixels are covered: transparent black where the compositor left the output
+    // untouched, and nowhere else.
+    int uncovered = 0;
+    for (int i = 0; i < SIZE * SIZE; i++) {
+        uncovered += (reference[i * 4 + 3] == 0);
+    }
+    Check(uncovered > 0, "yaw does not uncover any pixels");
+    Check(stats.OutsidePixels == uncovered, "warp covers different pixels than the compositor");
+}
+
+static void TestThreads(void) {
+    static uint8_t single[SIZE * SIZE * 4];
+    static uint8_t multi[SIZE * SIZE * 4];
+    xrTimewarp singleTimewarp;
+    xrTimewarp multiTimewarp;
+    xrTimewarp_Init(&singleTimewarp, 1);
+    xrTimewarp_Init(&multiTimewarp, 4);
+    Check(multiTimewarp.WorkerCount == 3, "worker threads not started");
+
+    // The workers are reused for every warp.
+    for (int i = 0; i < 50; i++) {
+        xrTimewarpParms parms = CreateParms(&NoiseImage, single);
+        parms.DisplayOrientation = CreateYaw(0.2f * i - 5.0f);
+        const xrTimewarpStats singleStats = xrTimewarp_Warp(&singleTimewarp, &parms);
+        parms.Output = multi;
+        const xrTimewarpStats multiStats = xrTimewarp_Warp(&multiTimewarp, &parms);
+        Check(memcmp(single, multi, sizeof(single)) == 0, "threads give a different output");
+        Check(
+            singleStats.OutsidePixels == multiStats.OutsidePixels,
+            "threads count different pixels outside the source");
+    }
+    xrTimewarp_Destroy(&singleTimewarp);
+    xrTimewarp_Destroy(&multiTimewarp);
+}
+
+int main(void) {
+    CreateImages();
+    const int threadCounts[2] = {1, 4};
+    for (int i = 0; i < 2; i++) {
+        const char* name = (threadCounts[i] == 1) ? "with 1 thread" : "with 4 threads";
+        xrTimewarp timewarp;
+        xrTimewarp_Init(&timewarp, threadCounts[i]);
+        TestIdentity(&timewarp, name);
+        TestYaw(&timewarp, name, 0.0f, 1.0f);
+        TestYaw(&timewarp, name, 0.0f, -2.5f);
+        TestYaw(&timewarp, name, 30.0f, 31.5f);
+        xrTimewarp_Destroy(&timewarp);
+    }
+    TestThreads();
+    if (Failures > 0) {
+        printf("%d failures\n", Failures);
+        return 1;
+    }
+    printf("All timewarp images match\n");
+    return 0;
+}
@@ -0,0 +1,444 @@
+/*
+Round-trip test of XrApiTrackingTrace.h.
+
+Records a synthetic session with head, controller and hand tracking into small chunks, replays
+it and checks every field against the recorded frame within its quantization step. Also checks
+that NaN positions replay as NaN and NaN orientations as identity, that out of range values are
+clamped, that a trace cut off in the middle of its last record replays up to the record before
+it, and that replaying the trace through a mock runtime twice gives bit-identical frames.
+
+Returns 0 if all checks pass.
+*/
+
+// First, so it can request the POSIX declarations it needs under -std=c99.
+#include "XrApiTrackingTrace.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define FRAME_COUNT 2000
+#define REFRESH_RATE 72.0
+// The smallest chunk the writer allows, so the trace spans many chunks.
+#define CHUNK_SIZE (4 * XRAPI_TRACKING_TRACE_MAX_RECORD_SIZE)
+// Frame with NaN values in the controller poses.
+#define NAN_FRAME 777
+
+static const char* TracePath = "tracking_trace_test.trace";
+
+static int Failures = 0;
+
+static void Check(const bool condition, const char* what, const int frame) {
+    if (!condition) {
+        if (Failures < 16) {
+            printf("frame %d: %s\n", frame, what);
+        }
+        Failures++;
+    }
+}
+
+// Checks a replayed value against the recorded one, allowing half a quantization step plus the
+// single precision rounding of the dequantized value.
+static void CheckQuantized(
+    const float* got,
+    const float* want,
+    const int count,
+    const float step,
+    const char* what,
+    const int frame) {
+    for (int i = 0; i < count; i++) {
+        const float bound = 0.5f * step + fabsf(want[i]) * 1e-6f;
+        Check(fabsf(got[i] - want[i]) <= bound, what, frame);
+    }
+}
+
+// Quaternions are normalized after dequantization, which adds up to another step of error.
+static void CheckQuat(
+    const xrQuatf* got,
+    const xrQuatf* want,
+    const float step,
+    const char* what,
+    const int frame) {
+    CheckQuantized(&got->x, &want->x, 4, 3.0f * step, what, frame);
+}
+
+static void CheckTime(const double got, const double want, const char* what, const int frame) {
+    Check(fabs(got - want) <= 1e-9, what, frame);
+}
+
+static xrQuatf CreateQuat(const float yaw, const float pitch, const float roll) {
+    const float cy = cosf(yaw * 0.5f);
+    const float sy = sinf(yaw * 0.5f);
+    const float cp = cosf(pitch * 0.5f);
+    const float sp = sinf(pitch * 0.5f);
+    const float cr = cosf(roll * 0.5f);
+    const float sr = sinf(roll * 0.5f);
+    xrQuatf q;
+    q.x = cy * sp * cr + sy * cp * sr;
+    q.y = sy * cp * cr - cy * sp * sr;
+    q.z = cy * cp * sr - sy * sp * cr;
+    q.w = cy * cp * cr + sy * sp * sr;
+    return q;
+}
+
+static void CreateRigidBody(xrRigidBodyPosef* pose, const float t, const float phase) {
+    pose->Pose.Orientation = CreateQuat(sinf(t * 0.7f + phase), 0.3f * sinf(t * 1.3f), 0.1f * t);
+    pose->Pose.Position.x = 0.3f * sinf(t + phase);
+    pose->Pose.Position.y = 1.6f + 0.05f * sinf(t * 3.0f);
+    pose->Pose.Position.z = -0.2f * cosf(t * 0.5f + phase);
+    pose->AngularVelocity.x = 2.0f * cosf(t * 1.1f + phase);
+    pose->AngularVelocity.y = -1.5f * sinf(t * 0.9f);
+    pose->AngularVelocity.z = 0.5f;
+    pose->LinearVelocity.x = 0.3f * cosf(t + phase);
+    pose->LinearVelocity.y = 0.15f * cosf(t * 3.0f);
+    pose->LinearVelocity.z = 0.1f * sinf(t * 0.5f);
+    pose->AngularAcceleration.x = 20.0f * sinf(t * 5.0f);
+    pose->AngularAcceleration.y = 3.0f;
+    pose->AngularAcceleration.z = -7.5f * cosf(t);
+    pose->LinearAcceleration.x = 9.81f * sinf(t * 2.0f + phase);
+    pose->LinearAcceleration.y = -0.45f * sinf(t * 3.0f);
+    pose->LinearAcceleration.z = 0.0f;
+}
+
+static void CreateFrame(xrTrackingTraceFrame* frame, const int index) {
+    memset(frame, 0, sizeof(xrTrackingTraceFrame));
+    const float t = (float)index / (float)REFRESH_RATE;
+    frame->FrameIndex = 100 + index;
+    frame->RecordTime = 1234.5 + index / REFRESH_RATE;
+    frame->DisplayTime = frame->RecordTime + 0.0425;
+
+    xrTracking2* tracking = &frame->Tracking;
+    tracking->Status = XRAPI_TRACKING_STATUS_ORIENTATION_TRACKED |
+        XRAPI_TRACKING_STATUS_POSITION_TRACKED | XRAPI_TRACKING_STATUS_ORIENTATION_VALID |
+        XRAPI_TRACKING_STATUS_POSITION_VALID;
+    CreateRigidBody(&tracking->HeadPose, t, 0.0f);
+    tracking->HeadPose.TimeInSeconds = frame->DisplayTime;
+    tracking->HeadPose.PredictionInSeconds = 0.0425;
+    // The interpupillary distance changes once during the session.
+    const float halfIpd = (index < FRAME_COUNT / 2) ? 0.032f : 0.0315f;
+    const xrMatrix4f headView = xrapiGetViewMatrixFromPose(&tracking->HeadPose.Pose);
+    for (int eye = 0; eye < XRAPI_EYE_COUNT; eye++) {
+        const xrMatrix4f eyeOffset =
+            xrMatrix4f_CreateTranslation((eye == 0) ? halfIpd : -halfIpd, 0.0f, 0.0f);
+        tracking->Eye[eye].ProjectionMatrix =
+            xrMatrix4f_CreateProjectionFov(90.0f, 90.0f, 0.0f, 0.0f, 0.1f, 0.0f);
+        tracking->Eye[eye].ViewMatrix = xrMatrix4f_Multiply(&eyeOffset, &headView);
+    }
+
+    // Two controllers for most of the session.
+    frame->DeviceCount = (index % 500 < 450) ? 2 : 1;
+    for (int i = 0; i < frame->DeviceCount; i++) {
+        frame->DeviceIDs[i] = 0x100 + i;
+        frame->Devices[i].Status = tracking->Status;
+        CreateRigidBody(&frame->Devices[i].HeadPose, t, 1.0f + i);
+        frame->Devices[i].HeadPose.TimeInSeconds = frame->DisplayTime;
+    }
+
+    frame->HandCount = 1;
+    xrHandPose* hand = &frame->Hands[0];
+    frame->HandIDs[0] = 0x200;
+    hand->Header.Version = xrHandVersion_1;
+    hand->Status = xrHandTrackingStatus_Tracked;
+    hand->RootPose.Orientation = CreateQuat(0.2f * sinf(t), 0.1f, 0.4f * cosf(t));
+    hand->RootPose.Position.x = 0.25f;
+    hand->RootPose.Position.y = 1.2f + 0.1f * sinf(t);
+    hand->RootPose.Position.z = -0.4f;
+    for (int i = 0; i < xrHandBone_Max; i++) {
+        hand->BoneRotations[i] = CreateQuat(0.05f * i, 0.3f * sinf(t + 0.1f * i), 0.0f);
+    }
+    hand->RequestedTimeStamp = frame->DisplayTime;
+    hand->SampleTimeStamp = frame->RecordTime - 0.004;
+    hand->HandConfidence = (index % 100 < 90) ? xrConfidence_HIGH : xrConfidence_LOW;
+    hand->HandScale = 1.0f + 0.01f * sinf(t);
+    for (int i = 0; i < xrHandFinger_Max; i++) {
+        hand->FingerConfidences[i] = ((index + i) % 7 != 0) ? xrConfidence_HIGH
+                                                            : xrConfidence_LOW;
+    }
+
+    if (index == NAN_FRAME) {
+        // A position with a NaN coordinate, an orientation that is all NaN, and an acceleration
+        // outside the quantized range.
+        frame->Devices[0].HeadPose.Pose.Position.x = NAN;
+        frame->Devices[1].HeadPose.Pose.Orientation.x = NAN;
+        frame->Devices[1].HeadPose.Pose.Orientation.y = NAN;
+        frame->Devices[1].HeadPose.Pose.Orientation.z = NAN;
+        frame->Devices[1].HeadPose.Pose.Orientation.w = NAN;
+        frame->Devices[1].HeadPose.LinearAcceleration.x = 1e30f;
+    }
+}
+
+static void CheckRigidBody(
+    const xrRigidBodyPosef* got,
+    const xrRigidBodyPosef* want,
+    const int frame) {
+    CheckQuat(&got->Pose.Orientation, &want->Pose.Orientation, 1e-5f, "orientation", frame);
+    CheckQuantized(&got->Pose.Position.x, &want->Pose.Position.x, 3, 1e-4f, "position", frame);
+    CheckQuantized(
+        &got->AngularVelocity.x, &want->AngularVelocity.x, 3, 1e-3f, "angular velocity", frame);
+    CheckQuantized(
+        &got->LinearVelocity.x, &want->LinearVelocity.x, 3, 1e-3f, "linear velocity", frame);
+    CheckQuantized(
+        &got->AngularAcceleration.x,
+        &want->AngularAcceleration.x,
+        3,
+        1e-2f,
+        "angular acceleration",
+        frame);
+    CheckQuantized(
+        &got->LinearAcceleration.x,
+        &want->LinearAcceleration.x,
+        3,
+        1e-2f,
+        "linear acceleration",
+        frame);
+    CheckTime(got->TimeInSeconds, want->TimeInSeconds, "pose time", frame);
+    CheckTime(got->PredictionInSeconds, want->PredictionInSeconds, "prediction time", frame);
+}
+
+static void CheckFrame(const xrTrackingTraceFrame* got, const int index) {
+    xrTrackingTraceFrame want;
+    CreateFrame(&want, index);
+    Check(got->FrameIndex == want.FrameIndex, "frame index", index);
+    CheckTime(got->RecordTime, want.RecordTime, "record time", index);
+    CheckTime(got->DisplayTime, want.DisplayTime, "display time", index);
+
+    Check(got->Tracking.Status == want.Tracking.Status, "head status", index);
+    CheckRigidBody(&got->Tracking.HeadPose, &want.Tracking.HeadPose, index);
+    for (int eye = 0; eye < XRAPI_EYE_COUNT; eye++) {
+        Check(
+            memcmp(
+                &got->Tracking.Eye[eye].ProjectionMatrix,
+                &want.Tracking.Eye[eye].ProjectionMatrix,
+                sizeof(xrMatrix4f)) == 0,
+            "projection matrix",
+            index);
+        // Rebuilt from the quantized head pose.
+        CheckQuantized(
+            &got->Tracking.Eye[eye].ViewMatrix.M[0][0],
+            &want.Tracking.Eye[eye].ViewMatrix.M[0][0],
+            16,
+            2e-4f,
+            "view matrix",
+            index);
+    }
+
+    Check(got->DeviceCount == want.DeviceCount, "device count", index);
+    for (int i = 0; i < got->DeviceCount && i < want.DeviceCount; i++) {
+        Check(got->DeviceIDs[i] == want.DeviceIDs[i], "device ID", index);
+        Check(got->Devices[i].Status == want.Devices[i].Status, "device status", index);
+        if (index != NAN_FRAME) {
+            CheckRigidBody(&got->Devices[i].HeadPose, &want.Devices[i].HeadPose, index);
+        }
+    }
+
+    Check(got->HandCount == want.HandCount, "hand count", index);
+    for (int i = 0; i < got->HandCount && i < want.HandCount; i++) {
+        const xrHandPose* gotHand = &got->Hands[i];
+        const xrHandPose* wantHand = &want.Hands[i];
+        Check(got->HandIDs[i] == want.HandIDs[i], "hand ID", index);
+        Check(gotHand->Status == wantHand->Status, "hand status", index);
+        CheckQuat(
+            &gotHand->RootPose.Orientation,
+            &wantHand->RootPose.Orientation,
+            1e-5f,
+            "hand orientation",
+            index);
+        CheckQuantized(
+            &gotHand->RootPose.Position.x,
+            &wantHand->RootPose.Position.x,
+            3,
+            1e-4f,
+            "hand position",
+            index);
+        for (int bone = 0; bone < xrHandBone_Max; bone++) {
+            CheckQuat(
+                &gotHand->BoneRotations[bone],
+                &wantHand->BoneRotations[bone],
+                1e-4f,
+                "bone rotation",
+                index);
+        }
+        CheckQuantized(&gotHand->HandScale, &wantHand->HandScale, 1, 1e-4f, "hand scale", index);
+        CheckTime(gotHand->RequestedTimeStamp, wantHand->RequestedTimeStamp, "hand time", index);
+        CheckTime(gotHand->SampleTimeStamp, wantHand->SampleTimeStamp, "hand sample", index);
+        Check(gotHand->HandConfidence == wantHand->HandConfidence, "hand confidence", index);
+        Check(
+            memcmp(
+                gotHand->FingerConfidences,
+                wantHand->FingerConfidences,
+                sizeof(gotHand->FingerConfidences)) == 0,
+            "finger confidences",
+            index);
+    }
+
+    if (index == NAN_FRAME) {
+        const xrRigidBodyPosef* pose = &got->Devices[0].HeadPose;
+        Check(isnan(pose->Pose.Position.x), "NaN position not replayed as NaN", index);
+        Check(
+            fabsf(pose->Pose.Position.y - want.Devices[0].HeadPose.Pose.Position.y) <= 1e-4f,
+            "position next to a NaN",
+            index);
+        const xrQuatf* q = &got->Devices[1].HeadPose.Pose.Orientation;
+        Check(
+            q->x == 0.0f && q->y == 0.0f && q->z == 0.0f && q->w == 1.0f,
+            "NaN orientation not replayed as identity",
+            index);
+        Check(
+            got->Devices[1].HeadPose.LinearAcceleration.x == (float)INT32_MAX * 1e-2f,
+            "acceleration not clamped",
+            index);
+    }
+}
+
+static void Record(void) {
+    xrTrackingTraceWriter writer;
+    if (!xrTrackingTraceWriter_Open(&writer, TracePath, CHUNK_SIZE)) {
+        printf("cannot create %s\n", TracePath);
+        Failures++;
+        return;
+    }
+    for (int i = 0; i < FRAME_COUNT; i++) {
+        xrTrackingTraceFrame frame;
+        CreateFrame(&frame, i);
+        Check(xrTrackingTraceWriter_Append(&writer, &frame), "append failed", i);
+    }
+    printf(
+        "recorded %d frames in %u chunks, %.1f bytes per frame\n",
+        FRAME_COUNT,
+        writer.ChunkIndex + 1,
+        (double)writer.Bytes / FRAME_COUNT);
+    Check(writer.ChunkIndex >= 2, "trace does not span several chunks", -1);
+    xrTrackingTraceWriter_Close(&writer);
+}
+
+static void TestReplay(void) {
+    xrTrackingTraceReader reader;
+    if (!xrTrackingTraceReader_Open(&reader, TracePath)) {
+        printf("cannot open %s\n", TracePath);
+        Failures++;
+        return;
+    }
+    static xrTrackingTraceFrame frame;
+    int count = 0;
+    while (xrTrackingTraceReader_Next(&reader, &frame)) {
+        CheckFrame(&frame, count);
+        count++;
+    }
+    Check(count == FRAME_COUNT, "replayed a different number of frames", count);
+    Check(!xrTrackingTraceReader_Next(&reader, &frame), "replay continued after the end", count);
+    xrTrackingTraceReader_Close(&reader);
+}
+
+//-----------------------------------------------------------------
+// Mock runtime that returns the replayed tracking.
+//-----------------------------------------------------------------
+
+static xrTrackingTraceReader MockReader;
+static xrTrackingTraceFrame MockFrame;
+
+double xrapiGetPredictedDisplayTime(xrMobile* xr, long long frameIndex) {
+    (void)xr;
+    Check(frameIndex == MockFrame.FrameIndex, "mock runtime asked for another frame", -1);
+    return MockFrame.DisplayTime;
+}
+
+xrTracking2 xrapiGetPredictedTracking2(xrMobile* xr, double absTimeInSeconds) {
+    (void)xr;
+    Check(absTimeInSeconds == MockFrame.DisplayTime, "mock runtime asked for another time", -1);
+    return MockFrame.Tracking;
+}
+
+// Advances the mock runtime to the next recorded frame.
+static bool MockRuntime_BeginFrame(long long* frameIndex) {
+    memset(&MockFrame, 0, sizeof(MockFrame));
+    if (!xrTrackingTraceReader_Next(&MockReader, &MockFrame)) {
+        return false;
+    }
+    *frameIndex = MockFrame.FrameIndex;
+    return true;
+}
+
+// Runs the frame loop of an application against the mock runtime and returns the tracking it
+// saw for every frame.
+static int ReplayApplication(double* displayTimes, xrTracking2* trackings) {
+    int count = 0;
+    long long frameIndex = 0;
+    while (count < FRAME_COUNT && MockRuntime_BeginFrame(&frameIndex)) {
+        const double displayTime = xrapiGetPredictedDisplayTime(NULL, frameIndex);
+        displayTimes[count] = displayTime;
+        trackings[count] = xrapiGetPredictedTracking2(NULL, displayTime);
+        count++;
+    }
+    return count;
+}
+
+static void TestDeterministicReplay(void) {
+    double* displayTimes[2];
+    xrTracking2* trackings[2];
+    int counts[2];
+    if (!xrTrackingTraceReader_Open(&MockReader, TracePath)) {
+        printf("cannot open %s\n", TracePath);
+        Failures++;
+        return;
+    }
+    for (int run = 0; run < 2; run++) {
+        displayTimes[run] = (double*)calloc(FRAME_COUNT, sizeof(double));
+        trackings[run] = (xrTracking2*)calloc(FRAME_COUNT, sizeof(xrTracking2));
+        xrTrackingTraceReader_Rewind(&MockReader);
+        counts[run] = ReplayApplication(displayTimes[run], trackings[run]);
+    }
+    xrTrackingTraceReader_Close(&MockReader);
+    Check(counts[0] == FRAME_COUNT && counts[1] == FRAME_COUNT, "mock replay ended early", -1);
+    Check(
+        memcmp(displayTimes[0], displayTimes[1], FRAME_COUNT * sizeof(double)) == 0 &&
+            memcmp(trackings[0], trackings[1], FRAME_COUNT * sizeof(xrTracking2)) == 0,
+        "replays through the mock runtime differ",
+        -1);
+    for (int run = 0; run < 2; run++) {
+        free(displayTimes[run]);
+        free(trackings[run]);
+    }
+}
+
+static void TestTruncatedTrace(void) {
+    // Cut the file in the middle of the last record.
+    const int file = open(TracePath, O_RDWR);
+    struct stat st;
+    if (file < 0 || fstat(file, &st) != 0 || ftruncate(file, st.st_size - 3) != 0) {
+        printf("cannot truncate %s\n", TracePath);
+        Failures++;
+        if (file >= 0) {
+            close(file);
+        }
+        return;
+    }
+    close(file);
+
+    xrTrackingTraceReader reader;
+    if (!xrTrackingTraceReader_Open(&reader, TracePath)) {
+        printf("cannot open the truncated %s\n", TracePath);
+        Failures++;
+        return;
+    }
+    static xrTrackingTraceFrame frame;
+    int count = 0;
+    while (xrTrackingTraceReader_Next(&reader, &frame)) {
+        CheckFrame(&frame, count);
+        count++;
+    }
+    Check(count == FRAME_COUNT - 1, "truncated trace replayed a different number of frames", count);
+    Check(!xrTrackingTraceReader_Next(&reader, &frame), "replay continued after the end", count);
+    xrTrackingTraceReader_Close(&reader);
+}
+
+int main(void) {
+    Record();
+    TestReplay();
+    TestDeterministicReplay();
+    TestTruncatedTrace();
+    remove(TracePath);
+    if (Failures > 0) {
+        printf("%d failures\n", Failures);
+        return 1;
+    }
+    printf("All tracking trace frames round-trip\n");
+    return 0;
+}